@@ -0,0 +1,106 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <Arduino.h>
+#include "types.h"
+#include "metrics.h"
+
+// 自适应采样：每个模拟量通道在配置的最短/最长间隔之间调整自己的采样间隔。
+// 中值滤波已经算出的差值（difference）超过限幅值、或者单次采样偏离上一个中值超过限幅值时，
+// 立即回到最短间隔；连续 ADAPTIVE_QUIET_MEDIANS 个中值都在限幅值以内时间隔加倍，直到最长间隔。
+// 中值和限幅滤波随采样进行，所以滤波的频率也随之变化；当前间隔与最短间隔之比（rateScale）
+// 写入采集快照，MQTT 按这个倍数放慢该通道的发布（见 mqtt.h）。
+//
+// 最短与最长间隔相同时就是固定间隔，默认两者都是主循环的采样节拍，行为与原来一样。
+
+#define ADAPTIVE_TICK_MS 200           // 主循环的采样节拍，与 SENSOR_UPDATE_INTERVAL 相同
+#define ADAPTIVE_MAX_INTERVAL 10000    // 最长间隔的上限(ms)
+#define ADAPTIVE_QUIET_MEDIANS 2       // 连续多少个平稳的中值后放慢一档
+
+struct AdaptiveChannelStats {
+    uint32_t skipped;       // 未到间隔而跳过的采样节拍
+    uint32_t speedups;      // 回到最短间隔的次数
+};
+
+extern AnalogSampleState analogState;
+
+AdaptiveChannelStats adaptiveStats[Board::ANALOG_CHANNELS];
+
+bool adaptiveValidRange(int sampleMin, int sampleMax) {
+    return sampleMin >= ADAPTIVE_TICK_MS && sampleMax >= sampleMin && sampleMax <= ADAPTIVE_MAX_INTERVAL;
+}
+
+// 配置修改后从最短间隔重新开始（syncAnalogSampleState 中调用）
+void adaptiveSync(int channel, uint16_t sampleMin, uint16_t sampleMax) {
+    analogState.sampleMin[channel] = sampleMin;
+    analogState.sampleMax[channel] = sampleMax;
+    analogState.sampleInterval[channel] = sampleMin;
+    analogState.quietCount[channel] = 0;
+}
+
+// 本节拍是否采样该通道；读取失败的通道没有更新采样时间，下一节拍重试
+bool adaptiveDue(int channel, uint32_t now) {
+    uint16_t interval = analogState.sampleInterval[channel];
+    if (interval <= ADAPTIVE_TICK_MS) return true;
+    // 主循环节拍有抖动，差半个节拍以内也算到期
+    if (now - analogState.lastSampleTime[channel] + ADAPTIVE_TICK_MS / 2 >= interval) return true;
+    adaptiveStats[channel].skipped++;
+    return false;
+}
+
+void adaptiveSpeedUp(int channel) {
+    analogState.quietCount[channel] = 0;
+    if (analogState.sampleInterval[channel] == analogState.sampleMin[channel]) return;
+    analogState.sampleInterval[channel] = analogState.sampleMin[channel];
+    adaptiveStats[channel].speedups++;
+}
+
+// 每次采样后调用：偏离上一个中值超过限幅值时不等中值凑齐，立即加快
+void adaptiveOnSample(int channel, int raw) {
+    if (!(analogState.validMask & (1u << channel))) return;
+    if (abs(raw - analogState.lastSecondValue[channel]) > analogState.filterLimit[channel]) {
+        adaptiveSpeedUp(channel);
+    }
+}
+
+// 每个中值计算后调用，diff 即 difference
+void adaptiveOnMedian(int channel, int diff) {
+    if (diff > analogState.filterLimit[channel]) {
+        adaptiveSpeedUp(channel);
+        return;
+    }
+    if (++analogState.quietCount[channel] < ADAPTIVE_QUIET_MEDIANS) return;
+    analogState.quietCount[channel] = 0;
+    uint32_t interval = analogState.sampleInterval[channel] * 2u;
+    analogState.sampleInterval[channel] = min(interval, (uint32_t)analogState.sampleMax[channel]);
+}
+
+// 过期/无效的判断时间随采样间隔延长
+uint32_t adaptiveAgeAllowance(int channel) {
+    uint16_t interval = analogState.sampleInterval[channel];
+    return interval > ADAPTIVE_TICK_MS ? interval - ADAPTIVE_TICK_MS : 0;
+}
+
+uint8_t adaptiveRateScale(int channel) {
+    uint16_t sampleMin = analogState.sampleMin[channel];
+    return sampleMin ? analogState.sampleInterval[channel] / sampleMin : 1;
+}
+
+#if METRICS_ENABLED
+void writeAdaptiveMetrics(Print& out) {
+    out.print("# TYPE esp_adc_sample_interval_ms gauge\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_sample_interval_ms{channel=\"%d\"} %u\n", i, analogState.sampleInterval[i]);
+    }
+    out.print("# TYPE esp_adc_skipped_total counter\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_skipped_total{channel=\"%d\"} %u\n", i, adaptiveStats[i].skipped);
+    }
+    out.print("# TYPE esp_adc_speedups_total counter\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_speedups_total{channel=\"%d\"} %u\n", i, adaptiveStats[i].speedups);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef ADCSCHED_H
+#define ADCSCHED_H
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include "types.h"
+#include "log.h"
+
+// 内部ADC读取调度：按板级配置区分每个通道所在的ADC单元。
+//
+// ADC1 的读取总能成功，直接用 analogRead。ADC2 与 WiFi 驱动共用，WiFi 占用时 adc2_get_raw
+// 返回错误（analogRead 此时返回0或旧值，无法区分），所以 ADC2 通道放在每次采样的最后集中读取，
+// 读失败的通道让出CPU一个节拍等 WiFi 释放后再重试，最多 ADC2_READ_ATTEMPTS 轮。
+// 重试后仍失败的通道本次没有采样值，不写入滤波缓冲区；采样值长时间没有更新时
+// 通道被标记为过期或无效（见 sampleADC）。
+
+#define ADC2_READ_ATTEMPTS 3          // 每次采样 ADC2 最多读取的轮数
+#define ANALOG_STALE_MS 1500          // 超过此时间没有新采样值即为过期
+#define ANALOG_INVALID_MS 5000        // 超过此时间没有新采样值即为无效
+
+struct AdcChannelStats {
+    uint32_t reads;             // 成功的读取
+    uint32_t retries;           // 重试次数（只有 ADC2）
+    uint32_t failures;          // 重试后仍失败
+    uint32_t latencyTotalUs;    // 成功读取的总耗时（含重试等待）
+    uint32_t latencyMaxUs;
+};
+
+AdcChannelStats adcChannelStats[Board::ANALOG_CHANNELS];
+int8_t adc2Channel[Board::ANALOG_CHANNELS];   // ADC2 通道号，不是 ADC2 时为 -1
+
+void adcRecordRead(int channel, uint32_t startUs) {
+    uint32_t us = micros() - startUs;
+    AdcChannelStats& s = adcChannelStats[channel];
+    s.reads++;
+    s.latencyTotalUs += us;
+    if (us > s.latencyMaxUs) s.latencyMaxUs = us;
+}
+
+// 配置 ADC2 通道（setup 中调用）
+void initAdcScheduler() {
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        adc2Channel[i] = -1;
+        if (Board::analogAdcUnit(i) != 2) continue;
+        int8_t ch = digitalPinToAnalogChannel(Board::analogGpio(i));
+        if (ch < SOC_ADC_MAX_CHANNEL_NUM) continue;
+        adc2Channel[i] = ch - SOC_ADC_MAX_CHANNEL_NUM;
+        adc2_config_channel_atten((adc2_channel_t)adc2Channel[i], ADC_ATTEN_DB_11);
+    }
+}
+
+// 读取 ADC1 通道
+int adc1Read(int channel, uint8_t gpio) {
+    uint32_t start = micros();
+    int value = analogRead(gpio);
+    adcRecordRead(channel, start);
+    return value;
+}
+
+// 集中读取 mask 中的 ADC2 通道，成功的写入 raw 并在返回的位图中置位
+uint16_t adc2ReadChannels(uint16_t mask, int* raw) {
+    uint16_t done = 0;
+    uint32_t start[Board::ANALOG_CHANNELS];
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) start[i] = micros();
+
+    for (int attempt = 0; attempt < ADC2_READ_ATTEMPTS && (mask & ~done); attempt++) {
+        if (attempt > 0) vTaskDelay(1);   // 让 WiFi 驱动释放 ADC2
+        for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+            if (!((mask & ~done) & (1u << i))) continue;
+            if (attempt > 0) adcChannelStats[i].retries++;
+            int value;
+            if (adc2Channel[i] >= 0 &&
+                adc2_get_raw((adc2_channel_t)adc2Channel[i], ADC_WIDTH_BIT_12, &value) == ESP_OK) {
+                raw[i] = value;
+                done |= 1u << i;
+                adcRecordRead(i, start[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if ((mask & ~done) & (1u << i)) adcChannelStats[i].failures++;
+    }
+    return done;
+}
+
+#if METRICS_ENABLED
+void writeAdcMetrics(Print& out) {
+    out.print("# TYPE esp_adc_reads_total counter\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_reads_total{channel=\"%d\",unit=\"%d\"} %u\n",
+            i, Board::analogAdcUnit(i), adcChannelStats[i].reads);
+    }
+    out.print("# TYPE esp_adc_retries_total counter\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_retries_total{channel=\"%d\",unit=\"%d\"} %u\n",
+            i, Board::analogAdcUnit(i), adcChannelStats[i].retries);
+    }
+    out.print("# TYPE esp_adc_failures_total counter\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_failures_total{channel=\"%d\",unit=\"%d\"} %u\n",
+            i, Board::analogAdcUnit(i), adcChannelStats[i].failures);
+    }
+    out.print("# TYPE esp_adc_read_latency_seconds_sum counter\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_read_latency_seconds_sum{channel=\"%d\"} %.6f\n",
+            i, adcChannelStats[i].latencyTotalUs / 1e6);
+    }
+    out.print("# TYPE esp_adc_read_latency_seconds_max gauge\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        out.printf("esp_adc_read_latency_seconds_max{channel=\"%d\"} %.6f\n",
+            i, adcChannelStats[i].latencyMaxUs / 1e6);
+    }
+}
+#endif
+
+#endif
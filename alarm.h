@@ -0,0 +1,584 @@
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "jsonwriter.h"
+#include "broadcast.h"
+#include "configcache.h"
+#include "control.h"
+#include "mqtt.h"
+#include "stats.h"
+#include "virtual.h"
+
+// 报警：每个模拟量通道、温度传感器和虚拟通道可以设置高高/高/低/低低限和变化率限值，带回差和延时，
+// 可以锁存。主循环每次采样、测温后立即判断（与采样在同一任务中，不经过快照的推送周期），
+// 状态变化马上通过 WebSocket 推送 {"type":"alarm",...}，启用 MQTT 时再交给 MQTT 任务发布。
+// 从采样开始到消息交给发送队列的延迟按 WebSocket 和 MQTT 分别统计。
+//
+// 配置由网络回调写入快照，主循环发现序号变化后复制一份使用；确认命令经队列交给主循环。
+// 通道编号与 /export 相同：模拟量为 "0".."11"，温度传感器为 "t0"、"t1"，虚拟通道为 "v0".."v3"。
+
+#define ALARM_CHANNELS VIRTUAL_INPUTS
+#define ALARM_ACK_QUEUE_SIZE 16
+#define ALARM_MQTT_QUEUE_SIZE 16
+#define ALARM_RATE_RELEASE 0.9f            // 变化率回落到限值的这个比例以下才恢复
+#define ALARM_MAX_DELAY 3600000u           // 延时上限(ms)
+#define ALARM_CONFIG_PATH "/alarm_config.json"
+
+enum AlarmCondition {
+    ALARM_LOLO = 0,
+    ALARM_LO,
+    ALARM_HI,
+    ALARM_HIHI,
+    ALARM_RATE,         // 10秒窗口的变化率（绝对值，每秒）
+    ALARM_CONDITION_COUNT
+};
+
+const char* const alarmConditionNames[ALARM_CONDITION_COUNT] = {"lolo", "lo", "hi", "hihi", "rate"};
+
+enum AlarmEventType {
+    ALARM_EVENT_RAISE = 0,   // 超限并持续了延时
+    ALARM_EVENT_CLEAR,       // 恢复正常
+    ALARM_EVENT_RETURN,      // 已恢复，但锁存等待确认
+    ALARM_EVENT_ACK,         // 确认
+};
+
+const char* const alarmEventNames[] = {"raise", "clear", "return", "ack"};
+
+struct AlarmConfig {
+    bool enabled;
+    bool latch;                           // 恢复后保持报警，直到确认
+    float limit[ALARM_CONDITION_COUNT];   // NAN 表示不检查
+    float deadband;                       // 回差：高限回落到 limit-deadband 以下（低限类似）才恢复
+    uint32_t onDelay;                     // 持续超限多久才报警(ms)
+};
+
+struct AlarmConfigSet {
+    bool mqtt;                            // 同时发布到 MQTT
+    AlarmConfig channel[ALARM_CHANNELS];
+};
+
+// 每个通道的状态，按条件的位图
+struct AlarmChannelStatus {
+    uint8_t active;       // 报警中
+    uint8_t latched;      // 已恢复、锁存等待确认
+    uint8_t unacked;      // 未确认
+    float value;          // 最近一次状态变化时的值
+    uint32_t changed;     // 最近一次状态变化的 millis()
+};
+
+struct AlarmStatusSet {
+    uint32_t timestamp;
+    AlarmChannelStatus channel[ALARM_CHANNELS];
+};
+
+// 交给 MQTT 任务的事件
+struct AlarmEvent {
+    uint8_t channel;
+    uint8_t condition;
+    uint8_t type;
+    AlarmChannelStatus status;
+    float limit;
+    uint32_t sampleMicros;   // 样本的 micros()，用于统计延迟
+    InlineString<32> name;   // 通道名称（MQTT 任务不访问通道配置）
+};
+
+struct AlarmLatency {
+    uint32_t count;
+    uint32_t last;        // us
+    uint32_t max;
+    uint64_t total;
+
+    void record(uint32_t us) {
+        count++;
+        last = us;
+        total += us;
+        if (us > max) max = us;
+    }
+};
+
+struct AlarmStats {
+    uint32_t events;
+    uint32_t mqttDropped;     // MQTT 事件队列满
+    uint32_t ackDropped;      // 确认命令队列满
+    AlarmLatency ws;
+    AlarmLatency mqtt;
+};
+
+extern AsyncWebSocket ws;
+
+// 只在主循环中访问
+struct AlarmRuntime {
+    uint8_t pending;                          // 超限但延时未到
+    uint32_t since[ALARM_CONDITION_COUNT];    // 开始超限的时间
+};
+
+Snapshot<AlarmConfigSet> alarmConfigs;       // 网络回调写入
+Snapshot<AlarmStatusSet> alarmStatus;        // 主循环发布
+SpscQueue<int8_t, ALARM_ACK_QUEUE_SIZE> alarmAckQueue;          // AsyncTCP 任务 -> 主循环，-1 为全部
+SpscQueue<AlarmEvent, ALARM_MQTT_QUEUE_SIZE> alarmMqttQueue;    // 主循环 -> MQTT 任务
+AlarmStats alarmStats;
+
+AlarmConfigSet alarmActive;                  // 主循环使用的配置
+uint32_t alarmConfigSeq = 0;
+AlarmStatusSet alarmState;
+AlarmRuntime alarmRuntime[ALARM_CHANNELS];
+char alarmJson[512];
+
+// 通道编号的文本形式
+void alarmFormatChannel(int channel, char* buf, size_t size) {
+    if (channel < Board::ANALOG_CHANNELS) {
+        snprintf(buf, size, "%d", channel);
+    } else if (channel < VIRTUAL_BASE) {
+        snprintf(buf, size, "t%d", channel - Board::ANALOG_CHANNELS);
+    } else {
+        snprintf(buf, size, "v%d", channel - VIRTUAL_BASE);
+    }
+}
+
+// "3"、"t0" 或 "v0"，无效时返回 -1
+int alarmParseChannel(const char* s) {
+    bool temp = (*s == 't' || *s == 'T');
+    bool virt = (*s == 'v' || *s == 'V');
+    if (temp || virt) s++;
+    char* endp;
+    long n = strtol(s, &endp, 10);
+    if (endp == s || *endp) return -1;
+    if (temp) return n >= 0 && n < Board::TEMP_SENSORS ? Board::ANALOG_CHANNELS + n : -1;
+    if (virt) return n >= 0 && n < VIRTUAL_CHANNELS ? VIRTUAL_BASE + n : -1;
+    return n >= 0 && n < Board::ANALOG_CHANNELS ? n : -1;
+}
+
+// JSON 中的通道编号也可以是整数（模拟量通道）
+int alarmParseChannel(JsonVariant v) {
+    if (v.is<int>()) {
+        int n = v.as<int>();
+        return n >= 0 && n < Board::ANALOG_CHANNELS ? n : -1;
+    }
+    return alarmParseChannel(v | "");
+}
+
+// 通道名称（主循环中使用）
+const char* alarmChannelName(int channel) {
+    if (channel < Board::ANALOG_CHANNELS) return analogChannels[channel].name.c_str();
+    if (channel < VIRTUAL_BASE) return tempSensors[channel - Board::ANALOG_CHANNELS].name.c_str();
+    return virtualChannels[channel - VIRTUAL_BASE].name.c_str();
+}
+
+// 通道名称（AsyncTCP 任务中使用，取自网络侧的暂存区）
+const char* alarmStagedChannelName(int channel) {
+    if (channel < Board::ANALOG_CHANNELS) return analogStaged.channel[channel].name.c_str();
+    if (channel < VIRTUAL_BASE) return tempStaged.sensor[channel - Board::ANALOG_CHANNELS].name.c_str();
+    return virtualChannels[channel - VIRTUAL_BASE].name.c_str();
+}
+
+void writeAlarmConditions(JsonWriter& json, const char* key, uint8_t mask) {
+    json.beginArray(key);
+    for (int k = 0; k < ALARM_CONDITION_COUNT; k++) {
+        if (mask & (1u << k)) json.value(alarmConditionNames[k]);
+    }
+    json.endArray();
+}
+
+void writeAlarmChannelStatus(JsonWriter& json, const AlarmChannelStatus& s) {
+    writeAlarmConditions(json, "active", s.active);
+    writeAlarmConditions(json, "latched", s.latched);
+    writeAlarmConditions(json, "unacked", s.unacked);
+}
+
+// 事件消息，WebSocket 和 MQTT 共用；condition 为 -1 时表示整个通道（确认，或修改配置后清除）
+size_t alarmFormatEvent(char* buf, size_t size, int channel, const char* name, int condition, uint8_t type,
+                        const AlarmChannelStatus& status, float limit) {
+    char id[8];
+    alarmFormatChannel(channel, id, sizeof(id));
+    BufferPrint out(buf, size);
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("type", "alarm");
+    json.field("event", alarmEventNames[type]);
+    json.field("channel", id);
+    json.field("name", name);
+    if (condition >= 0) {
+        json.field("condition", alarmConditionNames[condition]);
+        json.field("limit", (double)limit);
+    }
+    json.field("value", (double)status.value);
+    writeAlarmChannelStatus(json, status);
+    json.endObject();
+    return out.overflowed() ? 0 : out.length();
+}
+
+// 状态变化：立即推送给所有 WebSocket 客户端，需要时交给 MQTT 任务
+void alarmNotify(int channel, int condition, uint8_t type, float limit, uint32_t sampleMicros) {
+    AlarmChannelStatus& status = alarmState.channel[channel];
+    status.changed = millis();
+    alarmStats.events++;
+
+    if (ws.count() > 0) {
+        size_t len = alarmFormatEvent(alarmJson, sizeof(alarmJson), channel, alarmChannelName(channel),
+                                      condition, type, status, limit);
+        if (len) {
+            // 状态变化不能被积压策略丢掉
+            broadcastText(ws, alarmJson, len, false);
+            uint32_t us = micros() - sampleMicros;
+            alarmStats.ws.record(us);
+            METRICS_RECORD(METRIC_ALARM_WS, us * getCpuFrequencyMhz());
+        }
+    }
+
+    if (alarmActive.mqtt && mqttEnabled()) {
+        AlarmEvent event;
+        event.channel = channel;
+        event.condition = condition < 0 ? 0xFF : condition;
+        event.type = type;
+        event.status = status;
+        event.limit = limit;
+        event.sampleMicros = sampleMicros;
+        event.name.set(alarmChannelName(channel));
+        if (!alarmMqttQueue.push(event)) alarmStats.mqttDropped++;
+    }
+}
+
+// 是否超限；held 为该条件已在报警或延时中，用回差判断恢复
+bool alarmExceeded(int condition, float x, float limit, float deadband, bool held) {
+    if (isnan(x)) return held;
+    switch (condition) {
+    case ALARM_HI:
+    case ALARM_HIHI:
+        return held ? x > limit - deadband : x >= limit;
+    case ALARM_LO:
+    case ALARM_LOLO:
+        return held ? x < limit + deadband : x <= limit;
+    default:
+        x = fabsf(x);
+        return held ? x > limit * ALARM_RATE_RELEASE : x >= limit;
+    }
+}
+
+// 判断一个通道的新样本，返回状态是否变化
+bool alarmEvaluate(int channel, float x, uint32_t now, uint32_t sampleMicros) {
+    const AlarmConfig& c = alarmActive.channel[channel];
+    if (!c.enabled || isnan(x)) return false;
+    AlarmChannelStatus& s = alarmState.channel[channel];
+    AlarmRuntime& r = alarmRuntime[channel];
+
+    float rate = NAN;
+    if (!isnan(c.limit[ALARM_RATE])) rate = channelStats[channel].shortWindow.result().rate;
+
+    bool changed = false;
+    for (int k = 0; k < ALARM_CONDITION_COUNT; k++) {
+        float limit = c.limit[k];
+        if (isnan(limit)) continue;
+        uint8_t bit = 1u << k;
+        bool held = (s.active | r.pending) & bit;
+        if (alarmExceeded(k, k == ALARM_RATE ? rate : x, limit, c.deadband, held)) {
+            if (s.active & bit) continue;
+            if (!(r.pending & bit)) {
+                r.pending |= bit;
+                r.since[k] = now;
+            }
+            if (now - r.since[k] < c.onDelay) continue;
+            r.pending &= ~bit;
+            s.active |= bit;
+            s.latched &= ~bit;
+            s.unacked |= bit;
+            s.value = x;
+            alarmNotify(channel, k, ALARM_EVENT_RAISE, limit, sampleMicros);
+            changed = true;
+        } else {
+            r.pending &= ~bit;
+            if (!(s.active & bit)) continue;
+            s.active &= ~bit;
+            s.value = x;
+            if (c.latch && (s.unacked & bit)) {
+                s.latched |= bit;
+                alarmNotify(channel, k, ALARM_EVENT_RETURN, limit, sampleMicros);
+            } else {
+                s.unacked &= ~bit;
+                alarmNotify(channel, k, ALARM_EVENT_CLEAR, limit, sampleMicros);
+            }
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// 逐项比较（结构体有填充字节，限值用 NAN 表示不检查）
+bool alarmSameConfig(const AlarmConfig& a, const AlarmConfig& b) {
+    if (a.enabled != b.enabled || a.latch != b.latch || a.onDelay != b.onDelay) return false;
+    if (a.deadband != b.deadband) return false;
+    for (int k = 0; k < ALARM_CONDITION_COUNT; k++) {
+        if (isnan(a.limit[k]) ? !isnan(b.limit[k]) : a.limit[k] != b.limit[k]) return false;
+    }
+    return true;
+}
+
+// 配置有变化时复制一份，改动了的通道清除状态；清除了报警、锁存或未确认时推送 clear 事件，返回状态是否变化
+bool alarmRefreshConfig(uint32_t sampleMicros) {
+    if (alarmConfigs.sequence() == alarmConfigSeq) return false;
+    AlarmConfigSet previous = alarmActive;
+    alarmConfigSeq = alarmConfigs.read(alarmActive);
+    bool changed = false;
+    for (int i = 0; i < ALARM_CHANNELS; i++) {
+        if (alarmSameConfig(previous.channel[i], alarmActive.channel[i])) continue;
+        memset(&alarmRuntime[i], 0, sizeof(AlarmRuntime));
+        AlarmChannelStatus& s = alarmState.channel[i];
+        bool wasSet = s.active | s.latched | s.unacked;
+        s.active = s.latched = s.unacked = 0;
+        s.changed = millis();
+        if (wasSet) {
+            alarmNotify(i, -1, ALARM_EVENT_CLEAR, NAN, sampleMicros);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// 处理确认命令
+bool alarmProcessAcks(uint32_t sampleMicros) {
+    bool changed = false;
+    int8_t channel;
+    while (alarmAckQueue.pop(channel)) {
+        for (int i = 0; i < ALARM_CHANNELS; i++) {
+            if (channel >= 0 && i != channel) continue;
+            AlarmChannelStatus& s = alarmState.channel[i];
+            if (!s.unacked) continue;
+            s.unacked = 0;
+            s.latched = 0;
+            alarmNotify(i, -1, ALARM_EVENT_ACK, NAN, sampleMicros);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void publishAlarmStatus() {
+    alarmState.timestamp = millis();
+    alarmStatus.publish(alarmState);
+}
+
+// 虚拟通道按与统计相同的划分随模拟量采样或测温判断
+bool alarmSampleVirtual(const SensorSnapshot& snap, uint32_t now, uint32_t sampleMicros, bool analog) {
+    uint8_t fast = virtualAnalogMask();
+    bool changed = false;
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        uint8_t bit = 1u << k;
+        if (!(snap.virtualMask & bit) || ((fast & bit) != 0) != analog) continue;
+        if (alarmEvaluate(VIRTUAL_BASE + k, snap.virtualValue[k], now, sampleMicros)) changed = true;
+    }
+    return changed;
+}
+
+// 模拟量采样并发布快照后调用，sampleMicros 为本轮采样开始的 micros()
+void alarmSampleAnalog(const SensorSnapshot& snap, uint32_t now, uint32_t sampleMicros) {
+    bool changed = alarmRefreshConfig(sampleMicros);
+    if (alarmProcessAcks(sampleMicros)) changed = true;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        uint16_t bit = 1u << i;
+        if (!(snap.enabledMask & bit) || ((snap.staleMask | snap.invalidMask) & bit)) continue;
+        if (alarmEvaluate(i, snap.value[i], now, sampleMicros)) changed = true;
+    }
+    if (alarmSampleVirtual(snap, now, sampleMicros, true)) changed = true;
+    if (changed) publishAlarmStatus();
+}
+
+// 测温并发布快照后调用
+void alarmSampleTemps(const SensorSnapshot& snap, uint32_t now, uint32_t sampleMicros) {
+    bool changed = alarmRefreshConfig(sampleMicros);
+    if (alarmProcessAcks(sampleMicros)) changed = true;
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        if (!tempSensors[i].enabled || snap.tempFault[i]) continue;
+        if (alarmEvaluate(Board::ANALOG_CHANNELS + i, snap.tempValue[i], now, sampleMicros)) changed = true;
+    }
+    if (alarmSampleVirtual(snap, now, sampleMicros, false)) changed = true;
+    if (changed) publishAlarmStatus();
+}
+
+// 确认报警（AsyncTCP 任务），channel 为 -1 时确认全部
+bool requestAlarmAck(int channel) {
+    if (!alarmAckQueue.push((int8_t)channel)) {
+        alarmStats.ackDropped++;
+        return false;
+    }
+    return true;
+}
+
+// MQTT 任务中调用：发布排队的事件到 <base>/alarm/<通道>（保留消息）
+void mqttPublishAlarms() {
+    static char payload[512];
+    AlarmEvent event;
+    while (alarmMqttQueue.pop(event)) {
+        char id[8];
+        alarmFormatChannel(event.channel, id, sizeof(id));
+        char topic[96];
+        snprintf(topic, sizeof(topic), "%s/alarm/%s", mqttBase, id);
+        size_t len = alarmFormatEvent(payload, sizeof(payload), event.channel, event.name.c_str(),
+            event.condition == 0xFF ? -1 : event.condition, event.type, event.status, event.limit);
+        if (!len || !mqttPublish(topic, payload, len, true)) continue;
+        uint32_t us = micros() - event.sampleMicros;
+        alarmStats.mqtt.record(us);
+        METRICS_RECORD(METRIC_ALARM_MQTT, us * getCpuFrequencyMhz());
+    }
+}
+
+// 报警配置（/get_alarm_config，也是配置文件的格式）
+void writeAlarmConfigJson(JsonWriter& json) {
+    AlarmConfigSet set;
+    alarmConfigs.read(set);
+    json.field("mqtt", set.mqtt);
+    json.beginArray("alarms");
+    for (int i = 0; i < ALARM_CHANNELS; i++) {
+        const AlarmConfig& c = set.channel[i];
+        char id[8];
+        alarmFormatChannel(i, id, sizeof(id));
+        json.beginObject();
+        json.field("channel", id);
+        json.field("enabled", c.enabled);
+        json.field("latch", c.latch);
+        for (int k = 0; k < ALARM_CONDITION_COUNT; k++) json.field(alarmConditionNames[k], (double)c.limit[k]);
+        json.field("deadband", (double)c.deadband);
+        json.field("delay", (unsigned long)c.onDelay);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// 应用配置：{"mqtt":bool,"alarms":[{channel,enabled,latch,lolo,lo,hi,hihi,rate,deadband,delay},...]}，
+// 只修改列出的通道；有任何一项无效时不做修改，返回错误信息
+const char* applyAlarmConfig(JsonObject config) {
+    AlarmConfigSet set;
+    alarmConfigs.read(set);
+    if (config.containsKey("mqtt")) set.mqtt = config["mqtt"] | false;
+    for (JsonObject a : config["alarms"].as<JsonArray>()) {
+        int channel = alarmParseChannel(a["channel"]);
+        if (channel < 0) return "invalid channel";
+        AlarmConfig c{};
+        c.enabled = a["enabled"] | false;
+        c.latch = a["latch"] | false;
+        for (int k = 0; k < ALARM_CONDITION_COUNT; k++) c.limit[k] = a[alarmConditionNames[k]] | NAN;
+        c.deadband = a["deadband"] | 0.0f;
+        c.onDelay = a["delay"] | 0u;
+        if (isnan(c.deadband) || c.deadband < 0) return "invalid deadband";
+        if (c.onDelay > ALARM_MAX_DELAY) return "invalid delay";
+        if (!isnan(c.limit[ALARM_RATE]) && c.limit[ALARM_RATE] <= 0) return "invalid rate limit";
+        if (c.limit[ALARM_LOLO] > c.limit[ALARM_LO] || c.limit[ALARM_LO] >= c.limit[ALARM_HI] ||
+            c.limit[ALARM_HI] > c.limit[ALARM_HIHI] || c.limit[ALARM_LOLO] >= c.limit[ALARM_HIHI] ||
+            c.limit[ALARM_LO] >= c.limit[ALARM_HIHI] || c.limit[ALARM_LOLO] >= c.limit[ALARM_HI]) {
+            return "limits out of order";
+        }
+        set.channel[channel] = c;
+    }
+    alarmConfigs.publish(set);
+    configChanged(CONFIG_ALARM);
+    return NULL;
+}
+
+void saveAlarmConfig() {
+    METRICS_SCOPE(METRIC_SAVE_ALARM);
+    File file = SPIFFS.open(ALARM_CONFIG_PATH, "w");
+    if (!file) {
+        LOGE(LOG_MOD_CFG, "Failed to open alarm config file for writing");
+        return;
+    }
+    JsonWriter json(file);
+    json.beginObject();
+    writeAlarmConfigJson(json);
+    json.endObject();
+    file.close();
+    LOGI(LOG_MOD_CFG, "Alarm config saved");
+}
+
+void loadAlarmConfig() {
+    AlarmConfigSet set;
+    memset(&set, 0, sizeof(set));
+    for (int i = 0; i < ALARM_CHANNELS; i++) {
+        for (int k = 0; k < ALARM_CONDITION_COUNT; k++) set.channel[i].limit[k] = NAN;
+    }
+    alarmConfigs.publish(set);
+
+    if (!SPIFFS.exists(ALARM_CONFIG_PATH)) return;
+    File file = SPIFFS.open(ALARM_CONFIG_PATH, "r");
+    if (!file) {
+        LOGE(LOG_MOD_CFG, "Failed to open alarm config file");
+        return;
+    }
+    DynamicJsonDocument doc(8192);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    const char* invalid = error ? "parse error" : applyAlarmConfig(doc.as<JsonObject>());
+    if (invalid) {
+        LOGE(LOG_MOD_CFG, "Failed to load alarm config: %s", invalid);
+        return;
+    }
+    LOGI(LOG_MOD_CFG, "Alarm config loaded");
+}
+
+void writeAlarmLatency(JsonWriter& json, const char* key, const AlarmLatency& l) {
+    json.beginObject(key);
+    json.field("count", (unsigned long)l.count);
+    json.field("last", (unsigned long)l.last);
+    json.field("max", (unsigned long)l.max);
+    json.field("mean", l.count ? (double)l.total / l.count : 0.0);
+    json.endObject();
+}
+
+// /alarms 和 get_alarms：有报警或未确认的通道，以及通知延迟(us)
+void writeAlarmStatusJson(JsonWriter& json) {
+    static AlarmStatusSet set;   // 只在 AsyncTCP 任务中使用
+    alarmStatus.read(set);
+    json.beginArray("alarms");
+    for (int i = 0; i < ALARM_CHANNELS; i++) {
+        const AlarmChannelStatus& s = set.channel[i];
+        if (!(s.active | s.latched | s.unacked)) continue;
+        char id[8];
+        alarmFormatChannel(i, id, sizeof(id));
+        json.beginObject();
+        json.field("channel", id);
+        json.field("name", alarmStagedChannelName(i));
+        json.field("value", (double)s.value);
+        json.field("age", (unsigned long)(millis() - s.changed));
+        writeAlarmChannelStatus(json, s);
+        json.endObject();
+    }
+    json.endArray();
+    json.field("events", (unsigned long)alarmStats.events);
+    json.beginObject("latency");
+    writeAlarmLatency(json, "ws", alarmStats.ws);
+    writeAlarmLatency(json, "mqtt", alarmStats.mqtt);
+    json.endObject();
+}
+
+// 加载配置并发布初始状态（loadTempConfig 之后调用）
+void initAlarms() {
+    loadAlarmConfig();
+    alarmRefreshConfig(micros());
+    publishAlarmStatus();
+}
+
+#if METRICS_ENABLED
+void writeAlarmMetrics(Print& out) {
+    out.print("# TYPE esp_alarm_events_total counter\n");
+    out.printf("esp_alarm_events_total %u\n", alarmStats.events);
+    out.print("# TYPE esp_alarm_mqtt_dropped_total counter\n");
+    out.printf("esp_alarm_mqtt_dropped_total %u\n", alarmStats.mqttDropped);
+    out.print("# TYPE esp_alarm_ack_dropped_total counter\n");
+    out.printf("esp_alarm_ack_dropped_total %u\n", alarmStats.ackDropped);
+    out.print("# TYPE esp_alarm_notify_latency_max_us gauge\n");
+    out.printf("esp_alarm_notify_latency_max_us{transport=\"ws\"} %u\n", alarmStats.ws.max);
+    out.printf("esp_alarm_notify_latency_max_us{transport=\"mqtt\"} %u\n", alarmStats.mqtt.max);
+    AlarmStatusSet set;
+    alarmStatus.read(set);
+    int active = 0;
+    for (int i = 0; i < ALARM_CHANNELS; i++) active += __builtin_popcount(set.channel[i].active);
+    out.print("# TYPE esp_alarm_active gauge\n");
+    out.printf("esp_alarm_active %d\n", active);
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdint.h>
+
+// 板级配置：通道数量、引脚分配和 ADC 单元只在这里定义，
+// 其余代码的数组大小、循环次数和接口的通道范围都由 Board 在编译时决定。
+// 增加新板子时照 BoardEsp32S3 写一个同样成员的结构体，编译时用 -DBOARD_PROFILE=结构体名 选择。
+
+// 继电器输出方式（Board::RELAY_OUTPUT），驱动见 relayio.h
+enum RelayOutputKind {
+    RELAY_OUTPUT_GPIO = 0,      // 直接用 GPIO，引脚见 relayGpio
+    RELAY_OUTPUT_MCP23017 = 1,  // I2C 扩展芯片，每片16路
+    RELAY_OUTPUT_74HC595 = 2    // 级联移位寄存器，每片8路
+};
+
+// ESP32-S3 默认板：12路模拟量、4路继电器、2路 MAX31865 温度传感器
+namespace board_esp32s3 {
+    constexpr uint8_t analogGpio[] = {1, 2, 3, 4, 5, 6, 7, 8, 15, 16, 17, 18};
+    constexpr uint8_t relayGpio[] = {21, 45, 47, 48};      // 高电平触发
+    constexpr uint8_t tempCsGpio[] = {10, 39};
+}
+
+struct BoardEsp32S3 {
+    enum {
+        ANALOG_CHANNELS = 12,
+        RELAY_CHANNELS = 4,
+        TEMP_SENSORS = 2,
+        RELAY_OUTPUT = RELAY_OUTPUT_GPIO,
+        // MAX31865 使用的硬件 SPI 引脚
+        SPI_SCK_GPIO = 12,
+        SPI_MISO_GPIO = 13,
+        SPI_MOSI_GPIO = 11,
+        // 外部ADC：ADS1115 在 I2C 上，ADS1256 与 MAX31865 共用上面的SPI
+        EXT_I2C_SDA_GPIO = 41,
+        EXT_I2C_SCL_GPIO = 42,
+        ADS1115_RDY_GPIO = 40,
+        ADS1256_CS_GPIO = 9,
+        ADS1256_DRDY_GPIO = 14
+    };
+
+    static constexpr uint8_t analogGpio(int channel) { return board_esp32s3::analogGpio[channel]; }
+    // GPIO1-10 属于 ADC1，GPIO11-20 属于 ADC2（WiFi 工作时 ADC2 可能读取失败）
+    static constexpr uint8_t analogAdcUnit(int channel) { return analogGpio(channel) <= 10 ? 1 : 2; }
+    static constexpr uint8_t relayGpio(int channel) { return board_esp32s3::relayGpio[channel]; }
+    static constexpr uint8_t tempCsGpio(int sensor) { return board_esp32s3::tempCsGpio[sensor]; }
+};
+
+// 16路继电器接在一片 MCP23017（地址 0x20）上，与 ADS1115 共用 I2C
+struct BoardEsp32S3Mcp23017 : BoardEsp32S3 {
+    enum {
+        RELAY_CHANNELS = 16,
+        RELAY_OUTPUT = RELAY_OUTPUT_MCP23017,
+        MCP23017_ADDRESS = 0x20
+    };
+    static constexpr int relayGpio(int channel) { return -1; }   // 不占用 GPIO
+};
+
+// 32路继电器接在4片级联的 74HC595 上，DS/SHCP 接 SPI 的 MOSI/SCK，STCP 接 GPIO38
+struct BoardEsp32S3Hc595 : BoardEsp32S3 {
+    enum {
+        RELAY_CHANNELS = 32,
+        RELAY_OUTPUT = RELAY_OUTPUT_74HC595,
+        HC595_LATCH_GPIO = 38
+    };
+    static constexpr int relayGpio(int channel) { return -1; }
+};
+
+static_assert(sizeof(board_esp32s3::analogGpio) == BoardEsp32S3::ANALOG_CHANNELS, "analog pin map size");
+static_assert(sizeof(board_esp32s3::relayGpio) == BoardEsp32S3::RELAY_CHANNELS, "relay pin map size");
+static_assert(sizeof(board_esp32s3::tempCsGpio) == BoardEsp32S3::TEMP_SENSORS, "temp CS pin map size");
+
+#ifndef BOARD_PROFILE
+#define BOARD_PROFILE BoardEsp32S3
+#endif
+
+typedef BOARD_PROFILE Board;
+
+// 位图字段的宽度限制了通道数
+static_assert(Board::ANALOG_CHANNELS <= 16, "analog enabledMask is 16 bits");
+static_assert(Board::ANALOG_CHANNELS + Board::TEMP_SENSORS <= 32, "history channel mask is 32 bits");
+static_assert(Board::RELAY_CHANNELS <= 32, "relay state bitmaps are 32 bits");
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// WebSocket 广播：每帧只序列化一次，所有客户端共享同一个引用计数缓冲区。
+// 发送慢的客户端排队超过上限时跳过该帧，等它腾出空间后直接收到最新一帧。
+
+#define WS_CLIENT_QUEUE_LIMIT 2         // 单个客户端最多排队的消息数
+#define WS_BUFFER_POOL_SIZE 8           // 同时在途的共享缓冲区数
+#define WS_CLEANUP_INTERVAL 1000        // 清理断开客户端的间隔(ms)
+
+struct BroadcastStats {
+    uint32_t broadcasts;   // 广播（序列化）次数
+    uint32_t queued;       // 入队到客户端的消息数
+    uint32_t dropped;      // 因客户端积压跳过的消息数
+    uint32_t noBuffer;     // 缓冲区全部在途导致整帧丢弃的次数
+};
+
+BroadcastStats wsBroadcastStats;
+
+// 共享缓冲区池：客户端消息持有引用（lock/unlock），引用归零后缓冲区可复用。
+// 缓冲区长度按 WS_BUFFER_GRANULE 取整，多出部分用空格填充（JSON允许尾部空白），
+// 这样帧长度小幅变化时仍能复用同一块内存，稳定运行时不再申请堆内存。
+#define WS_BUFFER_GRANULE 64
+
+AsyncWebSocketMessageBuffer* wsBufferPool[WS_BUFFER_POOL_SIZE];
+
+// 取一个长度至少为 len 的空闲缓冲区，全部在途时返回 NULL
+AsyncWebSocketMessageBuffer* acquireBroadcastBuffer(size_t len) {
+    size_t size = (len + WS_BUFFER_GRANULE - 1) / WS_BUFFER_GRANULE * WS_BUFFER_GRANULE;
+    int freeSlot = -1;
+    int idleSlot = -1;
+
+    for (int i = 0; i < WS_BUFFER_POOL_SIZE; i++) {
+        AsyncWebSocketMessageBuffer* buf = wsBufferPool[i];
+        if (!buf) {
+            if (freeSlot < 0) freeSlot = i;
+        } else if (buf->canDelete()) {
+            if (buf->length() == size) return buf;   // 同尺寸空闲缓冲区直接复用
+            if (idleSlot < 0) idleSlot = i;
+        }
+    }
+
+    // 没有同尺寸的空闲缓冲区：优先占用空槽，否则替换一个尺寸不同的空闲缓冲区
+    int slot = freeSlot >= 0 ? freeSlot : idleSlot;
+    if (slot < 0) {
+        wsBroadcastStats.noBuffer++;
+        return NULL;
+    }
+    delete wsBufferPool[slot];
+    wsBufferPool[slot] = new AsyncWebSocketMessageBuffer(size);
+    return wsBufferPool[slot];
+}
+
+// 把缓冲区发给每个已连接的客户端；droppable 为 true 时跳过积压的客户端
+void broadcastBuffer(AsyncWebSocket& server, AsyncWebSocketMessageBuffer* buffer, bool droppable = true) {
+    wsBroadcastStats.broadcasts++;
+
+    buffer->lock();  // 发送期间自己持有一个引用
+    for (AsyncWebSocketClient* client : server.getClients()) {
+        if (client->status() != WS_CONNECTED) continue;
+        if (client->queueIsFull() || (droppable && client->queueLen() >= WS_CLIENT_QUEUE_LIMIT)) {
+            wsBroadcastStats.dropped++;
+            continue;
+        }
+        client->text(buffer);
+        wsBroadcastStats.queued++;
+    }
+    buffer->unlock();
+}
+
+// 把一段文本复制到共享缓冲区并广播
+void broadcastText(AsyncWebSocket& server, const char* data, size_t len, bool droppable = true) {
+    AsyncWebSocketMessageBuffer* buffer = acquireBroadcastBuffer(len);
+    if (!buffer) return;
+
+    uint8_t* dst = buffer->get();
+    memcpy(dst, data, len);
+    memset(dst + len, ' ', buffer->length() - len);
+    broadcastBuffer(server, buffer, droppable);
+}
+
+// 按客户端速率推送：每个客户端可以请求自己的更新间隔（最快与采样同步），
+// 主循环每个采样周期只序列化一次，再发给本周期到期的客户端。
+// 全局令牌桶限制实时数据的总出站字节率，超出预算的客户端顺延到下个周期，
+// 轮询起点每次后移，预算紧张时各客户端轮流得到发送机会。
+
+#define WS_STREAM_MAX_CLIENTS 8          // 同时登记速率的客户端数
+#define WS_STREAM_MAX_INTERVAL 60000     // 最慢更新间隔(ms)
+#define WS_STREAM_BUDGET 32768           // 实时数据总带宽预算(字节/秒)，也是最大突发量
+
+struct WsStreamClient {
+    uint32_t id;               // 客户端ID，0 表示空槽
+    uint32_t interval;         // 更新间隔(ms)
+    unsigned long lastSent;    // 上次发送时间
+};
+
+struct WsStreamStats {
+    uint32_t throttled;        // 因带宽预算顺延的次数
+    uint32_t bytes;            // 已发送的实时数据字节数
+};
+
+WsStreamClient wsStreamClients[WS_STREAM_MAX_CLIENTS];
+WsStreamStats wsStreamStats;
+uint32_t wsStreamTokens = WS_STREAM_BUDGET;
+unsigned long wsStreamRefillTime = 0;
+uint8_t wsStreamCursor = 0;
+
+// 登记新客户端，使用默认间隔；连接后立即收到第一帧
+void wsStreamAdd(uint32_t id, uint32_t interval) {
+    for (int i = 0; i < WS_STREAM_MAX_CLIENTS; i++) {
+        if (wsStreamClients[i].id == 0) {
+            wsStreamClients[i].interval = interval;
+            wsStreamClients[i].lastSent = millis() - interval;
+            wsStreamClients[i].id = id;   // 最后写入ID，主循环看到时其余字段已就绪
+            return;
+        }
+    }
+}
+
+void wsStreamRemove(uint32_t id) {
+    for (int i = 0; i < WS_STREAM_MAX_CLIENTS; i++) {
+        if (wsStreamClients[i].id == id) wsStreamClients[i].id = 0;
+    }
+}
+
+// 设置客户端的更新间隔，限制在 [minInterval, WS_STREAM_MAX_INTERVAL]，返回实际生效的间隔，
+// 客户端未登记时返回 0
+uint32_t wsStreamSetInterval(uint32_t id, uint32_t interval, uint32_t minInterval) {
+    if (interval < minInterval) interval = minInterval;
+    if (interval > WS_STREAM_MAX_INTERVAL) interval = WS_STREAM_MAX_INTERVAL;
+    for (int i = 0; i < WS_STREAM_MAX_CLIENTS; i++) {
+        if (wsStreamClients[i].id == id) {
+            wsStreamClients[i].interval = interval;
+            return interval;
+        }
+    }
+    return 0;
+}
+
+bool wsStreamDue(const WsStreamClient& c, unsigned long now) {
+    return c.id != 0 && now - c.lastSent >= c.interval;
+}
+
+// 是否有客户端在本周期到期（没有就不必序列化）
+bool wsStreamAnyDue(unsigned long now) {
+    for (int i = 0; i < WS_STREAM_MAX_CLIENTS; i++) {
+        if (wsStreamDue(wsStreamClients[i], now)) return true;
+    }
+    return false;
+}
+
+// 把一帧实时数据发给本周期到期的客户端
+void broadcastStream(AsyncWebSocket& server, const char* data, size_t len, unsigned long now) {
+    // 按经过的时间补充令牌
+    uint32_t refill = (uint32_t)((uint64_t)(now - wsStreamRefillTime) * WS_STREAM_BUDGET / 1000);
+    if (refill > 0) {
+        wsStreamTokens = refill >= WS_STREAM_BUDGET - wsStreamTokens ? WS_STREAM_BUDGET : wsStreamTokens + refill;
+        wsStreamRefillTime = now;
+    }
+
+    AsyncWebSocketMessageBuffer* buffer = NULL;
+    for (int n = 0; n < WS_STREAM_MAX_CLIENTS; n++) {
+        WsStreamClient& c = wsStreamClients[(wsStreamCursor + n) % WS_STREAM_MAX_CLIENTS];
+        if (!wsStreamDue(c, now)) continue;
+
+        AsyncWebSocketClient* client = server.client(c.id);
+        if (!client || client->status() != WS_CONNECTED) continue;
+        if (wsStreamTokens < len) {
+            wsStreamStats.throttled++;   // 仍然到期，下个周期再试
+            continue;
+        }
+        if (client->queueIsFull() || client->queueLen() >= WS_CLIENT_QUEUE_LIMIT) {
+            wsBroadcastStats.dropped++;
+            continue;
+        }
+
+        // 第一个需要发送的客户端才取缓冲区并复制数据
+        if (!buffer) {
+            buffer = acquireBroadcastBuffer(len);
+            if (!buffer) return;
+            uint8_t* dst = buffer->get();
+            memcpy(dst, data, len);
+            memset(dst + len, ' ', buffer->length() - len);
+            buffer->lock();
+            wsBroadcastStats.broadcasts++;
+        }
+        client->text(buffer);
+        wsBroadcastStats.queued++;
+        wsStreamTokens -= len;
+        wsStreamStats.bytes += len;
+        c.lastSent = now;
+    }
+    wsStreamCursor = (wsStreamCursor + 1) % WS_STREAM_MAX_CLIENTS;
+    if (buffer) buffer->unlock();
+}
+
+#endif
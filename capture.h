@@ -0,0 +1,574 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <atomic>
+#include <memory>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "jsonwriter.h"
+#include "relayio.h"
+#include "mains.h"
+
+// 触发式波形捕获（示波器模式）：内部 ADC1 切换到 DMA 连续转换，按设定的转换速率
+// 把选中通道的原始码值写入开机时预分配的环形缓冲区，满足触发条件后再记录设定的触发后深度，
+// 得到 [触发前 pre 帧, 触发后 post 帧] 的波形，通过 /capture/data 或 WebSocket 以二进制下载。
+//
+// 工频抑制的连续采样（mains.h）在捕获期间暂停。
+//
+// 一帧 = DMA 按转换表把所有参与转换的通道各转换一次。转换表包含要捕获的通道、触发通道
+// 和所有已启用的内部 ADC1 通道，转换速率由这些通道平分。捕获期间 ADC1 只能由 DMA 使用，
+// sampleADC 改取每个通道最近一次的转换结果，常规监测、滤波和发布照常进行；ADC2 和外部ADC不受影响。
+//
+// 状态机：IDLE -> ARMING（网络回调提交配置）-> ARMED（主循环启动DMA，填充触发前数据并检测触发）
+//   -> TRIGGERED（记录触发后数据）-> DONE（主循环停止DMA，数据可下载，直到下次布防）。
+// 取消时捕获任务转入 STOPPING，主循环停止DMA后回到 IDLE。DMA 的启停只在主循环中进行，
+// 与 sampleADC 对 ADC1 的读取不会交错。
+
+#define CAPTURE_BUFFER_SAMPLES 16384      // 环形缓冲区容量（int16 样本，所有通道合计）
+#define CAPTURE_DMA_READ_BYTES 1024       // 每次从DMA驱动读取的字节数
+#define CAPTURE_READ_TIMEOUT_MS 20        // 读DMA超时，超时后检查取消请求
+#define CAPTURE_BINARY_VERSION 1
+#define CAPTURE_HEADER_SIZE 32
+#define CAPTURE_DEFAULT_RATE 20000        // 未指定参数时的默认值
+#define CAPTURE_DEFAULT_PRE 1000
+#define CAPTURE_DEFAULT_POST 3000
+#define CAPTURE_RESULT_HOLD_MS 300000     // 网页发起的捕获完成后至少保留5分钟，之后可被频谱分析占用
+
+enum CaptureTrigger {
+    CAPTURE_TRIG_IMMEDIATE = 0,   // 触发前数据填满即触发
+    CAPTURE_TRIG_ABOVE,           // 触发通道码值 >= level
+    CAPTURE_TRIG_BELOW,           // 触发通道码值 <= level
+    CAPTURE_TRIG_RISING,          // 上升穿越 level
+    CAPTURE_TRIG_FALLING,         // 下降穿越 level
+    CAPTURE_TRIG_RELAY,           // 继电器切换（relay 为 -1 时任意一路）
+    CAPTURE_TRIG_COUNT
+};
+
+const char* const captureTriggerNames[CAPTURE_TRIG_COUNT] = {
+    "immediate", "above", "below", "rising", "falling", "relay"
+};
+
+enum CaptureState {
+    CAPTURE_IDLE = 0,
+    CAPTURE_ARMING,
+    CAPTURE_ARMED,
+    CAPTURE_TRIGGERED,
+    CAPTURE_DONE,
+    CAPTURE_STOPPING,
+    CAPTURE_CONFIGURING       // 网络回调正在写入配置
+};
+
+const char* const captureStateNames[] = {"idle", "arming", "armed", "triggered", "done", "stopping", "configuring"};
+
+// 捕获的发起方：网页/WebSocket，或频谱分析的周期性采样窗口（spectrum.h）
+enum CaptureOwner {
+    CAPTURE_OWNER_USER = 0,
+    CAPTURE_OWNER_SPECTRUM
+};
+
+struct CaptureConfig {
+    uint16_t channelMask;     // 记录的通道（内部 ADC1 通道）
+    uint32_t rate;            // DMA 总转换速率(Hz)
+    uint32_t preFrames;       // 触发前帧数
+    uint32_t postFrames;      // 触发后帧数（含触发帧）
+    uint8_t trigger;
+    int8_t trigChannel;       // 电平/边沿触发的通道
+    int16_t level;            // 触发电平（原始码值 0-4095）
+    int8_t relay;             // 继电器触发的通道，-1 为任意
+    uint8_t owner;
+};
+
+// 一次捕获的结果（捕获任务写，DONE 后只读）
+struct CaptureResult {
+    uint8_t channels[Board::ANALOG_CHANNELS];   // 记录的通道，按通道号升序
+    uint8_t channelCount;
+    uint32_t capacityFrames;   // 本次环形缓冲区的帧容量
+    uint32_t writeFrame;       // 已写入的帧数
+    uint32_t triggerFrame;     // 触发帧的序号
+    uint32_t triggerMillis;
+    uint32_t doneMillis;
+    float frameRate;           // 每通道的采样率(Hz)
+    bool overrun;              // DMA 驱动缓冲区溢出过，波形中有间断
+};
+
+struct CaptureStats {
+    uint32_t armed;            // 布防次数
+    uint32_t completed;        // 完成的捕获
+    uint32_t cancelled;
+    uint32_t frames;           // DMA 产生的总帧数
+    uint32_t overruns;         // DMA 驱动缓冲区溢出次数
+    uint32_t downloads;
+};
+
+extern AnalogChannel analogChannels[Board::ANALOG_CHANNELS];
+extern AnalogSampleState analogState;
+
+int16_t captureBuffer[CAPTURE_BUFFER_SAMPLES];
+CaptureConfig captureConfig;                  // 仅在 ARMING 状态由网络回调写入
+CaptureResult captureResult;
+CaptureStats captureStats;
+std::atomic<uint8_t> captureState(CAPTURE_IDLE);
+std::atomic<bool> captureCancelRequested(false);
+std::atomic<int> captureReaders(0);           // 正在进行的下载，期间不能重新布防
+int8_t captureAdc1Channel[Board::ANALOG_CHANNELS];   // ADC1 通道号，不能捕获的通道为 -1
+TaskHandle_t captureTaskHandle = NULL;
+
+// 捕获期间每个通道最近一次的转换结果（捕获任务写，sampleADC 读）
+volatile int16_t captureLatest[Board::ANALOG_CHANNELS];
+std::atomic<bool> captureLatestReady(false);
+bool captureDmaRunning = false;               // 只在主循环中访问
+
+// 捕获任务的工作状态
+int8_t captureAdcMap[SOC_ADC_MAX_CHANNEL_NUM];   // ADC1 通道号 -> 模拟量通道
+uint8_t captureLastAdcChannel;                   // 转换表最后一个通道，收到它的结果即为一帧结束
+bool captureSynced;                              // 已丢弃第一个可能不完整的帧
+int16_t captureTrigPrev;
+uint32_t captureRelayMask;
+
+// 通道能否捕获：内部ADC、属于 ADC1
+bool captureChannelUsable(int channel) {
+    return channel >= 0 && channel < Board::ANALOG_CHANNELS &&
+        captureAdc1Channel[channel] >= 0 && analogChannels[channel].backend == ADC_BACKEND_INTERNAL;
+}
+
+int captureParseTrigger(const char* name) {
+    for (int i = 0; i < CAPTURE_TRIG_COUNT; i++) {
+        if (strcmp(name, captureTriggerNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// 通道列表 "0,1,3" 转为位图
+uint16_t captureParseChannels(const char* list) {
+    uint16_t mask = 0;
+    while (*list) {
+        char* end;
+        long ch = strtol(list, &end, 10);
+        if (end == list) break;
+        if (ch >= 0 && ch < Board::ANALOG_CHANNELS) mask |= 1u << ch;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return mask;
+}
+
+// 由接口参数组成配置，出错时返回原因（通道能否捕获等在 captureArm 中检查）
+const char* captureParseConfig(uint16_t mask, const char* trigger, long rate, long pre, long post,
+                               long trigChannel, long level, long relay, CaptureConfig& config) {
+    int type = captureParseTrigger(trigger);
+    if (type < 0) return "invalid trigger";
+    if (rate <= 0 || pre < 0 || post <= 0 || pre > CAPTURE_BUFFER_SAMPLES || post > CAPTURE_BUFFER_SAMPLES) {
+        return "invalid parameters";
+    }
+    bool levelTrigger = type >= CAPTURE_TRIG_ABOVE && type <= CAPTURE_TRIG_FALLING;
+    config.channelMask = mask;
+    config.rate = rate;
+    config.preFrames = pre;
+    config.postFrames = post;
+    config.trigger = type;
+    config.trigChannel = levelTrigger && trigChannel >= 0 && trigChannel < Board::ANALOG_CHANNELS ? trigChannel : -1;
+    config.level = level < 0 || level > 4095 ? -1 : level;
+    config.relay = relay < -1 || relay >= Board::RELAY_CHANNELS ? -2 : relay;
+    config.owner = CAPTURE_OWNER_USER;
+    return NULL;
+}
+
+// 提交捕获配置（网络回调中调用），出错时返回原因
+const char* captureArm(const CaptureConfig& config) {
+    if (config.channelMask == 0) return "no channels";
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if ((config.channelMask & (1u << i)) && !captureChannelUsable(i)) return "channel is not on ADC1";
+    }
+    if (config.rate < SOC_ADC_SAMPLE_FREQ_THRES_LOW || config.rate > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) {
+        return "rate out of range";
+    }
+    if (config.trigger >= CAPTURE_TRIG_COUNT) return "invalid trigger";
+    if (config.trigger >= CAPTURE_TRIG_ABOVE && config.trigger <= CAPTURE_TRIG_FALLING) {
+        if (!captureChannelUsable(config.trigChannel)) return "trigger channel is not on ADC1";
+        if (config.level < 0 || config.level > 4095) return "level out of range";
+    }
+    if (config.trigger == CAPTURE_TRIG_RELAY && (config.relay < -1 || config.relay >= Board::RELAY_CHANNELS)) {
+        return "invalid relay";
+    }
+    uint32_t capacity = CAPTURE_BUFFER_SAMPLES / __builtin_popcount(config.channelMask);
+    if (config.postFrames == 0 || config.preFrames + config.postFrames > capacity) return "depth exceeds buffer";
+
+    // 先占住状态再检查下载，与 captureOpenReader 的顺序相反，两边不会同时成功
+    uint8_t state = captureState.load();
+    // 频谱分析不覆盖网页发起、还在保留期内的结果
+    bool keep = state == CAPTURE_DONE && config.owner == CAPTURE_OWNER_SPECTRUM &&
+        captureConfig.owner == CAPTURE_OWNER_USER && millis() - captureResult.doneMillis < CAPTURE_RESULT_HOLD_MS;
+    if ((state != CAPTURE_IDLE && state != CAPTURE_DONE) || keep ||
+        !captureState.compare_exchange_strong(state, CAPTURE_CONFIGURING)) {
+        return "capture busy";
+    }
+    if (captureReaders.load() > 0) {
+        captureState.store(state);
+        return "download in progress";
+    }
+    captureConfig = config;
+    captureCancelRequested = false;
+    captureState.store(CAPTURE_ARMING);
+    return NULL;
+}
+
+// 取消布防或进行中的捕获
+void captureCancel() {
+    uint8_t state = CAPTURE_ARMING;
+    if (captureState.compare_exchange_strong(state, CAPTURE_IDLE)) return;
+    if (state == CAPTURE_ARMED || state == CAPTURE_TRIGGERED) captureCancelRequested = true;
+}
+
+// ---- 捕获任务 ----
+
+bool captureTriggered(int16_t value) {
+    const CaptureConfig& c = captureConfig;
+    switch (c.trigger) {
+        case CAPTURE_TRIG_IMMEDIATE: return true;
+        case CAPTURE_TRIG_ABOVE: return value >= c.level;
+        case CAPTURE_TRIG_BELOW: return value <= c.level;
+        case CAPTURE_TRIG_RISING: return captureTrigPrev < c.level && value >= c.level;
+        case CAPTURE_TRIG_FALLING: return captureTrigPrev > c.level && value <= c.level;
+        case CAPTURE_TRIG_RELAY: return relayOutputToggled.load(std::memory_order_relaxed) & captureRelayMask;
+    }
+    return false;
+}
+
+// 一帧结束：写入环形缓冲区并推进状态
+void captureFrame() {
+    // 第一帧可能从转换表中间开始，丢弃，之后每帧每个通道都有值
+    if (!captureSynced) {
+        captureSynced = true;
+        return;
+    }
+    CaptureResult& r = captureResult;
+    int16_t* dst = &captureBuffer[(r.writeFrame % r.capacityFrames) * r.channelCount];
+    for (int k = 0; k < r.channelCount; k++) dst[k] = captureLatest[r.channels[k]];
+    uint32_t frame = r.writeFrame++;
+    captureStats.frames++;
+    if (frame == 0) captureLatestReady = true;
+
+    uint8_t state = captureState.load(std::memory_order_relaxed);
+    if (state == CAPTURE_ARMED) {
+        int16_t value = captureConfig.trigChannel >= 0 ? captureLatest[captureConfig.trigChannel] : 0;
+        if (frame == 0) captureTrigPrev = value;
+        // 触发前数据填满后才开始检测，之前的继电器切换不算
+        if (frame == captureConfig.preFrames) relayOutputToggled.store(0, std::memory_order_relaxed);
+        if (frame >= captureConfig.preFrames && captureTriggered(value)) {
+            r.triggerFrame = frame;
+            r.triggerMillis = millis();
+            captureState.store(CAPTURE_TRIGGERED);
+        }
+        captureTrigPrev = value;
+    } else if (state == CAPTURE_TRIGGERED && r.writeFrame - r.triggerFrame >= captureConfig.postFrames) {
+        captureStats.completed++;
+        r.doneMillis = millis();
+        captureState.store(CAPTURE_DONE);
+    }
+}
+
+// 处理一批 DMA 结果（ESP32-S3 为 TYPE2 格式，每个结果4字节）
+void captureProcess(const uint8_t* data, uint32_t len) {
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* d = (const adc_digi_output_data_t*)(data + i);
+        if (d->type2.unit != 0 || d->type2.channel >= SOC_ADC_MAX_CHANNEL_NUM) continue;
+        int channel = captureAdcMap[d->type2.channel];
+        if (channel < 0) continue;
+        captureLatest[channel] = d->type2.data;
+        if (d->type2.channel == captureLastAdcChannel) {
+            captureFrame();
+            uint8_t state = captureState.load(std::memory_order_relaxed);
+            if (state != CAPTURE_ARMED && state != CAPTURE_TRIGGERED) return;
+        }
+    }
+}
+
+void captureTask(void* param) {
+    static uint8_t dmaData[CAPTURE_DMA_READ_BYTES];
+    for (;;) {
+        uint8_t state = captureState.load();
+        if (state != CAPTURE_ARMED && state != CAPTURE_TRIGGERED) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (captureCancelRequested) {
+            captureStats.cancelled++;
+            captureState.store(CAPTURE_STOPPING);
+            continue;
+        }
+        uint32_t len = 0;
+        esp_err_t err = adc_digi_read_bytes(dmaData, sizeof(dmaData), &len, CAPTURE_READ_TIMEOUT_MS);
+        if (err == ESP_ERR_INVALID_STATE) {
+            // 驱动缓冲区溢出，丢失了部分转换结果，本次读到的数据仍然有效
+            captureStats.overruns++;
+            captureResult.overrun = true;
+        } else if (err != ESP_OK) {
+            continue;
+        }
+        captureProcess(dmaData, len);
+    }
+}
+
+// ---- 主循环 ----
+
+// 按配置启动 DMA 连续转换
+bool captureStartDma() {
+    const CaptureConfig& c = captureConfig;
+    uint16_t patternMask = c.channelMask;
+    if (c.trigger >= CAPTURE_TRIG_ABOVE && c.trigger <= CAPTURE_TRIG_FALLING) patternMask |= 1u << c.trigChannel;
+    // 已启用的 ADC1 通道也放进转换表，常规监测从中取值
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if ((analogState.enabledMask & (1u << i)) && captureChannelUsable(i)) patternMask |= 1u << i;
+    }
+
+    adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX];
+    uint32_t adcMask = 0;
+    int n = 0;
+    for (int i = 0; i < SOC_ADC_MAX_CHANNEL_NUM; i++) captureAdcMap[i] = -1;
+    for (int i = 0; i < Board::ANALOG_CHANNELS && n < SOC_ADC_PATT_LEN_MAX; i++) {
+        if (!(patternMask & (1u << i))) continue;
+        int adcChannel = captureAdc1Channel[i];
+        pattern[n].atten = ADC_ATTEN_DB_11;
+        pattern[n].channel = adcChannel;
+        pattern[n].unit = 0;   // ADC1
+        pattern[n].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        captureAdcMap[adcChannel] = i;
+        captureLastAdcChannel = adcChannel;
+        adcMask |= 1u << adcChannel;
+        n++;
+    }
+
+    CaptureResult& r = captureResult;
+    r.channelCount = 0;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (c.channelMask & (1u << i)) r.channels[r.channelCount++] = i;
+    }
+    r.capacityFrames = CAPTURE_BUFFER_SAMPLES / r.channelCount;
+    r.writeFrame = 0;
+    r.triggerFrame = 0;
+    r.triggerMillis = 0;
+    r.frameRate = (float)c.rate / n;
+    r.overrun = false;
+    captureSynced = false;
+    captureRelayMask = c.relay < 0 ? RELAY_ALL_MASK : 1u << c.relay;
+    captureLatestReady = false;
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = CAPTURE_DMA_READ_BYTES * 4;
+    init.conv_num_each_intr = CAPTURE_DMA_READ_BYTES;
+    init.adc1_chan_mask = adcMask;
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = false;
+    config.conv_limit_num = 250;
+    config.pattern_num = n;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = c.rate;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+    if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+        adc_digi_deinitialize();
+        return false;
+    }
+    return true;
+}
+
+void captureStopDma() {
+    adc_digi_stop();
+    adc_digi_deinitialize();
+    captureDmaRunning = false;
+    captureLatestReady = false;
+    mainsResume();
+}
+
+// 主循环每次采样前调用：按状态启停 DMA
+void captureService() {
+    uint8_t state = captureState.load();
+    bool user = captureConfig.owner == CAPTURE_OWNER_USER;
+    if (state == CAPTURE_ARMING) {
+        // 上一次的结果已被释放、DMA 还没来得及停止时先停止
+        if (captureDmaRunning) captureStopDma();
+        mainsPause();
+        if (!captureStartDma()) {
+            LOGE(LOG_MOD_ADC, "Failed to start ADC DMA for waveform capture");
+            mainsResume();
+            captureState.store(CAPTURE_IDLE);
+            return;
+        }
+        captureDmaRunning = true;
+        captureStats.armed++;
+        captureState.store(CAPTURE_ARMED);
+        xTaskNotifyGive(captureTaskHandle);
+        if (user) {
+            LOGI(LOG_MOD_ADC, "Waveform capture armed: %d channels, %.1f Hz per channel, trigger %s",
+                captureResult.channelCount, captureResult.frameRate, captureTriggerNames[captureConfig.trigger]);
+        }
+    } else if (captureDmaRunning && state != CAPTURE_ARMED && state != CAPTURE_TRIGGERED) {
+        captureStopDma();
+        if (state == CAPTURE_STOPPING) captureState.store(CAPTURE_IDLE);
+        else if (state == CAPTURE_DONE && user) LOGI(LOG_MOD_ADC, "Waveform capture complete");
+    }
+}
+
+// sampleADC 中 ADC1 是否由 DMA 占用
+bool captureAdc1Busy() {
+    return captureDmaRunning;
+}
+
+// 取 DMA 最近一次的转换结果，通道不在转换表中或还没有结果时返回 false
+bool captureLatestValue(int channel, int& value) {
+    int8_t adcChannel = captureAdc1Channel[channel];
+    if (!captureLatestReady || adcChannel < 0 || captureAdcMap[adcChannel] != channel) return false;
+    value = captureLatest[channel];
+    return true;
+}
+
+// 映射 ADC1 通道并启动捕获任务（setup 中 initAdcScheduler 之后调用）
+void initCapture() {
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        captureAdc1Channel[i] = -1;
+        if (Board::analogAdcUnit(i) != 1) continue;
+        int8_t ch = digitalPinToAnalogChannel(Board::analogGpio(i));
+        if (ch >= 0 && ch < SOC_ADC_MAX_CHANNEL_NUM) captureAdc1Channel[i] = ch;
+    }
+    for (int i = 0; i < SOC_ADC_MAX_CHANNEL_NUM; i++) captureAdcMap[i] = -1;
+    xTaskCreatePinnedToCore(captureTask, "capture", 3072, NULL, 3, &captureTaskHandle, 0);
+}
+
+// ---- 状态与下载 ----
+
+// 结果中的帧数
+uint32_t captureFrames() {
+    return captureConfig.preFrames + captureConfig.postFrames;
+}
+
+void writeCaptureStatusJson(JsonWriter& json) {
+    uint8_t state = captureState.load();
+    const CaptureConfig& c = captureConfig;
+    const CaptureResult& r = captureResult;
+    json.field("state", captureStateNames[state]);
+    json.field("owner", captureConfig.owner == CAPTURE_OWNER_USER ? "user" : "spectrum");
+    json.field("bufferSamples", (unsigned long)CAPTURE_BUFFER_SAMPLES);
+    if (state == CAPTURE_IDLE) return;
+    json.beginArray("channels");
+    for (int k = 0; k < r.channelCount; k++) json.value((int)r.channels[k]);
+    json.endArray();
+    json.field("trigger", captureTriggerNames[c.trigger]);
+    json.field("rate", (unsigned long)c.rate);
+    json.field("frameRate", (double)r.frameRate);
+    json.field("pre", (unsigned long)c.preFrames);
+    json.field("post", (unsigned long)c.postFrames);
+    json.field("written", (unsigned long)r.writeFrame);
+    if (state == CAPTURE_DONE) {
+        json.field("frames", (unsigned long)captureFrames());
+        json.field("triggerMillis", (unsigned long)r.triggerMillis);
+        json.field("overrun", r.overrun);
+    }
+}
+
+// 二进制格式（小端）：32字节头 "WJKW", u16 版本, u8 通道数, u8 触发类型, f32 每通道采样率,
+// u32 帧数, u32 触发帧在结果中的位置, u32 触发时的开机毫秒数, u16 通道掩码, u8 标志(bit0 溢出),
+// u8 保留, u32 DMA 转换速率；之后按帧依次排列，每帧按通道号升序各一个 int16 原始码值
+size_t captureDataSize() {
+    return CAPTURE_HEADER_SIZE + (size_t)captureFrames() * captureResult.channelCount * sizeof(int16_t);
+}
+
+void captureRenderHeader(uint8_t* out) {
+    const CaptureConfig& c = captureConfig;
+    const CaptureResult& r = captureResult;
+    uint16_t version = CAPTURE_BINARY_VERSION;
+    uint32_t frames = captureFrames();
+    uint32_t flags = r.overrun ? 1 : 0;
+    memcpy(out, "WJKW", 4);
+    memcpy(out + 4, &version, 2);
+    out[6] = r.channelCount;
+    out[7] = c.trigger;
+    memcpy(out + 8, &r.frameRate, 4);
+    memcpy(out + 12, &frames, 4);
+    memcpy(out + 16, &c.preFrames, 4);
+    memcpy(out + 20, &r.triggerMillis, 4);
+    memcpy(out + 24, &c.channelMask, 2);
+    out[26] = flags;
+    out[27] = 0;
+    memcpy(out + 28, &c.rate, 4);
+}
+
+// 从第 index 字节起按下载格式填充，返回写入的字节数
+size_t captureRender(uint8_t* out, size_t index, size_t maxLen) {
+    size_t total = captureDataSize();
+    if (index >= total) return 0;
+    size_t n = 0;
+    if (index < CAPTURE_HEADER_SIZE) {
+        uint8_t header[CAPTURE_HEADER_SIZE];
+        captureRenderHeader(header);
+        n = min(maxLen, (size_t)CAPTURE_HEADER_SIZE - index);
+        memcpy(out, header + index, n);
+        index += n;
+    }
+    // 结果在环形缓冲区中从 (触发帧 - pre) 开始，可能绕回开头
+    const CaptureResult& r = captureResult;
+    size_t ringBytes = (size_t)r.capacityFrames * r.channelCount * sizeof(int16_t);
+    size_t startFrame = (r.triggerFrame - captureConfig.preFrames) % r.capacityFrames;
+    size_t startByte = startFrame * r.channelCount * sizeof(int16_t);
+    const uint8_t* ring = (const uint8_t*)captureBuffer;
+    while (n < maxLen && index < total) {
+        size_t pos = (startByte + index - CAPTURE_HEADER_SIZE) % ringBytes;
+        size_t len = min(min(maxLen - n, total - index), ringBytes - pos);
+        memcpy(out + n, ring + pos, len);
+        n += len;
+        index += len;
+    }
+    return n;
+}
+
+// 下载期间持有，阻止重新布防覆盖缓冲区（随响应对象释放）
+struct CaptureReader {
+    CaptureReader() { captureReaders++; }
+    ~CaptureReader() { captureReaders--; }
+};
+
+// 结果中第 frame 帧（0 为最早的触发前帧）第 k 个记录通道的码值，只在持有 CaptureReader 时调用
+int16_t captureSample(uint32_t frame, int k) {
+    const CaptureResult& r = captureResult;
+    uint32_t ringFrame = (r.triggerFrame - captureConfig.preFrames + frame) % r.capacityFrames;
+    return captureBuffer[ringFrame * r.channelCount + k];
+}
+
+// 释放 owner 发起的已完成捕获，回到空闲
+void captureRelease(uint8_t owner) {
+    uint8_t state = CAPTURE_DONE;
+    if (captureConfig.owner == owner) captureState.compare_exchange_strong(state, CAPTURE_IDLE);
+}
+
+// 开始一次下载，没有完成的捕获时返回空
+std::shared_ptr<CaptureReader> captureOpenReader() {
+    std::shared_ptr<CaptureReader> reader = std::make_shared<CaptureReader>();
+    if (captureState.load() != CAPTURE_DONE) return std::shared_ptr<CaptureReader>();
+    captureStats.downloads++;
+    return reader;
+}
+
+#if METRICS_ENABLED
+void writeCaptureMetrics(Print& out) {
+    out.print("# TYPE esp_capture_state gauge\n");
+    out.printf("esp_capture_state %d\n", captureState.load());
+    out.print("# TYPE esp_capture_armed_total counter\n");
+    out.printf("esp_capture_armed_total %u\n", captureStats.armed);
+    out.print("# TYPE esp_capture_completed_total counter\n");
+    out.printf("esp_capture_completed_total %u\n", captureStats.completed);
+    out.print("# TYPE esp_capture_cancelled_total counter\n");
+    out.printf("esp_capture_cancelled_total %u\n", captureStats.cancelled);
+    out.print("# TYPE esp_capture_frames_total counter\n");
+    out.printf("esp_capture_frames_total %u\n", captureStats.frames);
+    out.print("# TYPE esp_capture_dma_overruns_total counter\n");
+    out.printf("esp_capture_dma_overruns_total %u\n", captureStats.overruns);
+    out.print("# TYPE esp_capture_downloads_total counter\n");
+    out.printf("esp_capture_downloads_total %u\n", captureStats.downloads);
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef CONFIGCACHE_H
+#define CONFIGCACHE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+#include <memory>
+#include "jsonwriter.h"
+#include "metrics.h"
+
+// 配置 GET 接口的缓存：每个配置分区有一个代数，配置修改后加一（configChanged）。
+// 请求时代数没变就直接发送上次生成的 JSON，并带 ETag；浏览器带 If-None-Match 重新验证时
+// 代数没变返回 304，不生成也不发送内容。
+// 缓存只在 AsyncTCP 任务中读写；代数可以在任意任务中修改，要在修改配置之后再加一，
+// 这样即使生成时读到了修改了一半的配置，随后的请求也会重新生成。
+
+enum ConfigSection {
+    CONFIG_ANALOG = 0,
+    CONFIG_RELAY,
+    CONFIG_TEMP,
+    CONFIG_MQTT,
+    CONFIG_ALARM,
+    CONFIG_VIRTUAL,
+    CONFIG_SECTION_COUNT
+};
+
+struct ConfigCacheEntry {
+    uint32_t generation;            // 生成 body 时的代数
+    std::shared_ptr<char> body;     // 正在发送的响应也持有，重新生成时旧内容发完才释放
+    size_t length;
+};
+
+struct ConfigCacheStats {
+    uint32_t hits;          // 直接使用缓存
+    uint32_t rebuilds;      // 重新生成
+    uint32_t notModified;   // 返回 304
+};
+
+// 只计算长度的 Print，用于先确定缓冲区大小
+class CountingPrint : public Print {
+public:
+    CountingPrint() : count_(0) {}
+    size_t write(uint8_t c) override { count_++; return 1; }
+    size_t write(const uint8_t* data, size_t len) override { count_ += len; return len; }
+    size_t count() const { return count_; }
+private:
+    size_t count_;
+};
+
+std::atomic<uint32_t> configGeneration[CONFIG_SECTION_COUNT];
+ConfigCacheEntry configCache[CONFIG_SECTION_COUNT];
+ConfigCacheStats configCacheStats;
+uint32_t configBootId = 0;   // 重启后旧的 ETag 不再匹配
+
+// 配置修改后调用
+void configChanged(ConfigSection section) {
+    configGeneration[section].fetch_add(1, std::memory_order_release);
+}
+
+// 代数变化时重新生成；writeFn 向已打开的对象写入成员
+ConfigCacheEntry& refreshConfigCache(ConfigSection section, void (*writeFn)(JsonWriter&)) {
+    ConfigCacheEntry& entry = configCache[section];
+    uint32_t generation = configGeneration[section].load(std::memory_order_acquire);
+    if (entry.body && entry.generation == generation) {
+        configCacheStats.hits++;
+        return entry;
+    }
+
+    // 先数出长度再按实际大小申请，不需要预留最大长度；
+    // 两次之间配置被其他任务改长了就重来
+    std::shared_ptr<char> body;
+    size_t length;
+    for (;;) {
+        CountingPrint counter;
+        JsonWriter countJson(counter);
+        countJson.beginObject();
+        writeFn(countJson);
+        countJson.endObject();
+
+        size_t size = counter.count() + 1;
+        body.reset(new char[size], std::default_delete<char[]>());
+        BufferPrint out(body.get(), size);
+        JsonWriter json(out);
+        json.beginObject();
+        writeFn(json);
+        json.endObject();
+        length = out.length();
+        if (!out.overflowed()) break;
+    }
+
+    entry.generation = generation;
+    entry.body = body;
+    entry.length = length;
+    configCacheStats.rebuilds++;
+    return entry;
+}
+
+// 发送配置 JSON，客户端缓存仍有效时返回 304
+void sendConfigJson(AsyncWebServerRequest *request, ConfigSection section, void (*writeFn)(JsonWriter&)) {
+    if (!configBootId) configBootId = esp_random() | 1;
+    ConfigCacheEntry& entry = refreshConfigCache(section, writeFn);
+
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%08x-%d-%u\"", configBootId, (int)section, entry.generation);
+
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag) {
+        configCacheStats.notModified++;
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        request->send(response);
+        return;
+    }
+
+    std::shared_ptr<char> body = entry.body;
+    size_t length = entry.length;
+    AsyncWebServerResponse *response = request->beginResponse("application/json", length,
+        [body, length](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t n = min(maxLen, length - index);
+            memcpy(buffer, body.get() + index, n);
+            return n;
+        });
+    response->addHeader("ETag", etag);
+    // 每次都向设备验证，未修改时只返回 304
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+#if METRICS_ENABLED
+void writeConfigCacheMetrics(Print& out) {
+    out.print("# TYPE esp_config_cache_hits_total counter\n");
+    out.printf("esp_config_cache_hits_total %u\n", configCacheStats.hits);
+    out.print("# TYPE esp_config_cache_rebuilds_total counter\n");
+    out.printf("esp_config_cache_rebuilds_total %u\n", configCacheStats.rebuilds);
+    out.print("# TYPE esp_config_not_modified_total counter\n");
+    out.printf("esp_config_not_modified_total %u\n", configCacheStats.notModified);
+}
+#endif
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "configcache.h"
+#include "relayio.h"
+
+// 继电器控制任务：继电器状态和继电器配置只在这里修改。
+// 每个生产者任务各用一个无锁单生产者单消费者队列：HTTP、WebSocket、Modbus 回调都运行在
+// AsyncTCP 任务中，共用 relayCommandQueue；MQTT 任务使用 relayMqttCommandQueue。
+// 生产者把命令入队、唤醒控制任务后立即返回；控制任务按顺序执行命令、运行自动循环并保存配置，
+// 带请求号的命令执行完后把确认放入应答队列，由主循环回复给对应的 WebSocket 客户端。
+// 继电器配置和运行状态有变化时发布到 relayConfigs 快照，其他任务从快照读取。
+
+#define RELAY_CMD_QUEUE_SIZE 32      // 命令队列长度（2的幂），一次 Modbus 写全部继电器也能放下
+#define RELAY_ACK_QUEUE_SIZE 16      // 应答队列长度（2的幂）
+#define RELAY_CONTROL_TICK_MS 10     // 没有命令时检查自动循环的间隔(ms)
+
+// 有界单生产者单消费者队列
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    SpscQueue() : head_(0), tail_(0) {}
+
+    // 生产者调用，队列满时返回 false
+    bool push(const T& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= N) return false;
+        items_[tail & (N - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 生产者调用：n 个元素一起入队，消费者要么一个都看不到、要么全部看到；放不下时一个也不入队
+    bool pushAll(const T* items, size_t n) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (N - (tail - head_.load(std::memory_order_acquire)) < n) return false;
+        for (size_t i = 0; i < n; i++) items_[(tail + i) & (N - 1)] = items[i];
+        tail_.store(tail + n, std::memory_order_release);
+        return true;
+    }
+
+    // 消费者调用，队列空时返回 false
+    bool pop(T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        item = items_[head & (N - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+    }
+
+    // 生产者调用：之后至少还能连续 push 这么多次（消费者只会让空间变多）
+    size_t space() const {
+        return N - (tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire));
+    }
+
+private:
+    T items_[N];
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+};
+
+enum RelayCommandType {
+    RELAY_CMD_SET = 0,     // 手动模式开关继电器
+    RELAY_CMD_AUTO,        // 启动/停止自动运行
+    RELAY_CMD_CONFIG       // 修改单个继电器配置
+};
+
+struct RelayCommand {
+    uint32_t seq;              // 命令序号
+    int64_t enqueuedMicros;    // 入队时的 esp_timer_get_time()（周期计数器每个核各一个，不能跨核相减）
+    uint32_t clientId;         // 需要确认的 WebSocket 客户端，0 表示不需要
+    int32_t requestId;         // 客户端请求号
+    uint8_t type;              // RelayCommandType
+    uint8_t channel;
+    bool value;                // SET: 目标状态；AUTO: 是否运行
+    RelayMode mode;            // 以下仅 CONFIG 使用
+    unsigned long onTime;
+    unsigned long offTime;
+    unsigned int maxCycles;
+    InlineString<32> name;
+};
+
+struct RelayAck {
+    uint32_t seq;
+    uint32_t clientId;
+    int32_t requestId;
+    bool ok;                   // 命令在当前模式下是否有效
+};
+
+struct RelayControlStats {
+    uint32_t enqueued;         // 入队的命令数
+    uint32_t queueFull;        // 队列满被拒绝的命令数
+    uint32_t completed;        // 执行完的命令数
+    uint32_t rejected;         // 执行时因模式不符被拒绝的命令数
+    uint32_t ackDropped;       // 应答队列满丢弃的确认数
+};
+
+extern RelayChannel relayChannels[Board::RELAY_CHANNELS];
+extern volatile bool relayStatusDirty;
+void setRelayState(int channel, bool state);
+void saveRelayConfig();
+
+typedef SpscQueue<RelayCommand, RELAY_CMD_QUEUE_SIZE> RelayCommandQueue;
+static_assert(Board::RELAY_CHANNELS <= RELAY_CMD_QUEUE_SIZE, "relay command queue must hold a write of every relay");
+
+RelayCommandQueue relayCommandQueue;           // AsyncTCP 任务
+RelayCommandQueue relayMqttCommandQueue;       // MQTT 任务
+SpscQueue<RelayAck, RELAY_ACK_QUEUE_SIZE> relayAckQueue;
+RelayControlStats relayControlStats;
+Snapshot<RelayConfigSet> relayConfigs;         // 控制任务发布
+std::atomic<uint32_t> relayCommandSeq(0);
+std::atomic<uint32_t> relayCompletedSeq(0);    // 最近执行完的命令序号
+TaskHandle_t relayControlTaskHandle = NULL;
+
+// 入队并唤醒控制任务，返回命令序号，队列满时返回 0。
+// queue 必须是调用任务自己的队列，默认为 AsyncTCP 任务的队列
+uint32_t enqueueRelayCommand(RelayCommand& cmd, RelayCommandQueue& queue) {
+    cmd.seq = relayCommandSeq.fetch_add(1, std::memory_order_relaxed) + 1;
+    cmd.enqueuedMicros = esp_timer_get_time();
+    if (!queue.push(cmd)) {
+        relayControlStats.queueFull++;
+        return 0;
+    }
+    relayControlStats.enqueued++;
+    if (relayControlTaskHandle) xTaskNotifyGive(relayControlTaskHandle);
+    return cmd.seq;
+}
+
+// 多条命令一起入队：控制任务在同一轮中全部执行（需要时只保存一次），
+// 队列放不下时一条也不入队，返回 false
+bool enqueueRelayCommands(RelayCommand* cmds, size_t n, RelayCommandQueue& queue) {
+    uint32_t seq = relayCommandSeq.fetch_add(n, std::memory_order_relaxed) + 1;
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < n; i++) {
+        cmds[i].seq = seq + i;
+        cmds[i].enqueuedMicros = now;
+    }
+    if (!queue.pushAll(cmds, n)) {
+        relayControlStats.queueFull += n;
+        return false;
+    }
+    relayControlStats.enqueued += n;
+    if (relayControlTaskHandle) xTaskNotifyGive(relayControlTaskHandle);
+    return true;
+}
+
+uint32_t requestRelaySet(int channel, bool state, uint32_t clientId = 0, int32_t requestId = 0,
+                         RelayCommandQueue& queue = relayCommandQueue) {
+    RelayCommand cmd = {};
+    cmd.type = RELAY_CMD_SET;
+    cmd.channel = channel;
+    cmd.value = state;
+    cmd.clientId = clientId;
+    cmd.requestId = requestId;
+    return enqueueRelayCommand(cmd, queue);
+}
+
+uint32_t requestRelayAuto(int channel, bool running, uint32_t clientId = 0, int32_t requestId = 0,
+                          RelayCommandQueue& queue = relayCommandQueue) {
+    RelayCommand cmd = {};
+    cmd.type = RELAY_CMD_AUTO;
+    cmd.channel = channel;
+    cmd.value = running;
+    cmd.clientId = clientId;
+    cmd.requestId = requestId;
+    return enqueueRelayCommand(cmd, queue);
+}
+
+uint32_t requestRelayConfig(int channel, const char* name, RelayMode mode,
+                            unsigned long onTime, unsigned long offTime, unsigned int maxCycles) {
+    RelayCommand cmd = {};
+    cmd.type = RELAY_CMD_CONFIG;
+    cmd.channel = channel;
+    cmd.name.set(name);
+    cmd.mode = mode;
+    cmd.onTime = onTime;
+    cmd.offTime = offTime;
+    cmd.maxCycles = maxCycles;
+    return enqueueRelayCommand(cmd, relayCommandQueue);
+}
+
+// 一次修改 mask 中各通道的配置（取自 staged 的同号元素），全部生效或全部不生效
+bool requestRelayConfigBatch(const RelayChannel* staged, uint32_t mask) {
+    static RelayCommand cmds[Board::RELAY_CHANNELS];   // 只在 AsyncTCP 任务中使用
+    size_t n = 0;
+    for (int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        if (!(mask & (1u << i))) continue;
+        RelayCommand& cmd = cmds[n++];
+        cmd = {};
+        cmd.type = RELAY_CMD_CONFIG;
+        cmd.channel = i;
+        cmd.name.set(staged[i].name.c_str());
+        cmd.mode = staged[i].mode;
+        cmd.onTime = staged[i].onTime;
+        cmd.offTime = staged[i].offTime;
+        cmd.maxCycles = staged[i].maxCycles;
+    }
+    return enqueueRelayCommands(cmds, n, relayCommandQueue);
+}
+
+// 执行一条命令，返回是否有效；需要保存配置时置 save
+bool executeRelayCommand(const RelayCommand& cmd, bool& save) {
+    RelayChannel& relay = relayChannels[cmd.channel];
+    switch (cmd.type) {
+        case RELAY_CMD_SET:
+            if (relay.mode != MANUAL) return false;
+            setRelayState(cmd.channel, cmd.value);
+            return true;
+
+        case RELAY_CMD_AUTO:
+            if (relay.mode != AUTOMATIC) return false;
+            relay.autoRunning = cmd.value;
+            if (cmd.value) {
+                // 只在开始新的自动运行时才重置循环次数
+                if (relay.currentCycles >= relay.maxCycles) {
+                    relay.currentCycles = 0;
+                }
+                relay.lastToggleTime = millis();
+                // 从关闭状态开始
+                setRelayState(cmd.channel, false);
+            }
+            relayStatusDirty = true;
+            save = true;
+            return true;
+
+        case RELAY_CMD_CONFIG:
+            relay.name = cmd.name;
+            relay.mode = cmd.mode;
+            if (relay.mode == AUTOMATIC) {
+                relay.onTime = cmd.onTime;
+                relay.offTime = cmd.offTime;
+                relay.maxCycles = cmd.maxCycles;
+                relay.currentCycles = 0;
+                relay.autoRunning = false;
+            }
+            relayStatusDirty = true;
+            save = true;
+            return true;
+    }
+    return false;
+}
+
+// 自动运行：按开/关时间切换，达到最大循环次数后停止；返回是否有继电器切换或停止
+bool runRelayAutoCycles(bool& save) {
+    bool changed = false;
+    for (int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        if (relayChannels[i].mode == AUTOMATIC && relayChannels[i].autoRunning) {
+            unsigned long currentTime = millis();
+            unsigned long timeInState = currentTime - relayChannels[i].lastToggleTime;
+
+            // 根据当前状态决定使用哪个时间间隔
+            unsigned long waitTime = relayChannels[i].state ?
+                                   relayChannels[i].onTime :
+                                   relayChannels[i].offTime;
+
+            if (timeInState >= waitTime) {
+                // 检查是否达到最大循环次数
+                if (relayChannels[i].currentCycles >= relayChannels[i].maxCycles) {
+                    relayChannels[i].autoRunning = false;
+                    relayStatusDirty = true;
+                    save = true;  // 保存当前状态
+                    changed = true;
+                    continue;
+                }
+
+                // 切换状态
+                bool newState = !relayChannels[i].state;
+                setRelayState(i, newState);
+                relayChannels[i].lastToggleTime = currentTime;
+                changed = true;
+
+                // 从开到关时增加循环计数
+                if (!newState) {
+                    relayChannels[i].currentCycles++;
+                    save = true;  // 保存循环次数
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+// 执行一个队列中的全部命令，返回是否执行了命令
+bool processRelayCommands(RelayCommandQueue& queue, bool& save) {
+    RelayCommand cmd;
+    bool any = false;
+    while (queue.pop(cmd)) {
+        any = true;
+        bool ok = executeRelayCommand(cmd, save);
+        uint32_t us = (uint32_t)(esp_timer_get_time() - cmd.enqueuedMicros);
+        METRICS_RECORD(METRIC_RELAY_COMMAND, us * getCpuFrequencyMhz());
+        relayControlStats.completed++;
+        if (!ok) {
+            relayControlStats.rejected++;
+            LOGW(LOG_MOD_RELAY, "Relay command %u (type %d) rejected on channel %d",
+                cmd.seq, cmd.type, cmd.channel);
+        }
+        relayCompletedSeq.store(cmd.seq, std::memory_order_release);
+
+        if (cmd.clientId) {
+            RelayAck ack = {cmd.seq, cmd.clientId, cmd.requestId, ok};
+            if (!relayAckQueue.push(ack)) relayControlStats.ackDropped++;
+        }
+    }
+    return any;
+}
+
+// 发布继电器配置和运行状态（只在控制任务中调用，启动时在创建任务前调用一次）
+void publishRelayConfig() {
+    RelayConfigSet set;
+    for (int i = 0; i < Board::RELAY_CHANNELS; i++) set.channel[i] = relayChannels[i];
+    relayConfigs.publish(set);
+}
+
+void relayControlTask(void* param) {
+    for (;;) {
+        // 有命令时立即被唤醒，否则按固定间隔检查自动循环
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RELAY_CONTROL_TICK_MS));
+
+        bool save = false;
+        bool changed = processRelayCommands(relayCommandQueue, save);
+        changed |= processRelayCommands(relayMqttCommandQueue, save);
+
+        {
+            METRICS_SCOPE(METRIC_RELAY_LOOP);
+            changed |= runRelayAutoCycles(save);
+        }
+
+        // 本轮命令和自动循环的全部切换一次写到输出
+        relayOutputFlush();
+        // 先发布再让缓存失效，/get_relay_config 按新代数生成时读到的已是本轮结果
+        if (changed) {
+            publishRelayConfig();
+            configChanged(CONFIG_RELAY);
+        }
+
+        // 一轮命令和自动循环只写一次配置文件（需要保存时本轮一定有修改）
+        if (save) saveRelayConfig();
+    }
+}
+
+// 启动控制任务（继电器配置加载完成后调用）
+void initRelayControl() {
+    publishRelayConfig();
+    xTaskCreatePinnedToCore(relayControlTask, "relay_ctrl", 6144, NULL, 2, &relayControlTaskHandle, 1);
+}
+
+#if METRICS_ENABLED
+void writeRelayControlMetrics(Print& out) {
+    out.print("# TYPE esp_relay_commands_enqueued_total counter\n");
+    out.printf("esp_relay_commands_enqueued_total %u\n", relayControlStats.enqueued);
+    out.print("# TYPE esp_relay_commands_queue_full_total counter\n");
+    out.printf("esp_relay_commands_queue_full_total %u\n", relayControlStats.queueFull);
+    out.print("# TYPE esp_relay_commands_completed_total counter\n");
+    out.printf("esp_relay_commands_completed_total %u\n", relayControlStats.completed);
+    out.print("# TYPE esp_relay_commands_rejected_total counter\n");
+    out.printf("esp_relay_commands_rejected_total %u\n", relayControlStats.rejected);
+    out.print("# TYPE esp_relay_acks_dropped_total counter\n");
+    out.printf("esp_relay_acks_dropped_total %u\n", relayControlStats.ackDropped);
+    out.print("# TYPE esp_relay_command_queue_length gauge\n");
+    out.printf("esp_relay_command_queue_length{source=\"web\"} %u\n", (unsigned)relayCommandQueue.size());
+    out.printf("esp_relay_command_queue_length{source=\"mqtt\"} %u\n", (unsigned)relayMqttCommandQueue.size());
+    out.print("# TYPE esp_relay_output_flushes_total counter\n");
+    out.printf("esp_relay_output_flushes_total %u\n", relayOutputStats.flushes);
+    out.print("# TYPE esp_relay_output_switched_total counter\n");
+    out.printf("esp_relay_output_switched_total %u\n", relayOutputStats.switched);
+    out.print("# TYPE esp_relay_output_failed_total counter\n");
+    out.printf("esp_relay_output_failed_total %u\n", relayOutputStats.failed);
+}
+#endif
+
+#endif
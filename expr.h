@@ -0,0 +1,327 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+// 表达式编译为逆波兰字节码，只依赖标准库，可以直接在主机上编译验证。
+//
+// 语法：数字、变量、+ - * / ^（乘方，右结合）、一元负号、括号，以及函数
+// sqrt(x)、abs(x)、min(x,...)、max(x,...)、avg(x,...)。变量名由调用方解析为输入下标。
+// 编译时用递归下降直接按后序输出字节码，同时计算栈深度和用到的输入；运行时只有一个定长栈，
+// 不分配内存。任一输入为 NAN 时结果为 NAN，结果不是有限值（如除以0）时也为 NAN。
+
+#define EXPR_MAX_CODE 48        // 字节码长度
+#define EXPR_MAX_CONSTS 8       // 常数个数
+#define EXPR_MAX_STACK 12       // 运算栈深度
+#define EXPR_MAX_ARGS 8         // min/max/avg 的参数个数
+#define EXPR_MAX_NEST 8         // 括号和函数调用的嵌套层数（限制编译时的递归深度）
+
+enum ExprOp {
+    EXPR_CONST = 1,   // 后跟常数下标
+    EXPR_LOAD,        // 后跟输入下标
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_POW,
+    EXPR_NEG,
+    EXPR_SQRT,
+    EXPR_ABS,
+    EXPR_MIN,         // 后跟参数个数
+    EXPR_MAX,
+    EXPR_AVG,
+};
+
+// 编译结果，可以直接按字节复制
+struct ExprProgram {
+    uint8_t code[EXPR_MAX_CODE];
+    float consts[EXPR_MAX_CONSTS];
+    uint8_t length;
+    uint8_t constCount;
+    uint32_t inputs;      // 用到的输入位图
+
+    float eval(const float* in) const {
+        float stack[EXPR_MAX_STACK];
+        int sp = 0;
+        for (int pc = 0; pc < length; pc++) {
+            switch (code[pc]) {
+            case EXPR_CONST: stack[sp++] = consts[code[++pc]]; break;
+            case EXPR_LOAD: stack[sp++] = in[code[++pc]]; break;
+            case EXPR_ADD: sp--; stack[sp - 1] += stack[sp]; break;
+            case EXPR_SUB: sp--; stack[sp - 1] -= stack[sp]; break;
+            case EXPR_MUL: sp--; stack[sp - 1] *= stack[sp]; break;
+            case EXPR_DIV: sp--; stack[sp - 1] /= stack[sp]; break;
+            case EXPR_POW: sp--; stack[sp - 1] = powf(stack[sp - 1], stack[sp]); break;
+            case EXPR_NEG: stack[sp - 1] = -stack[sp - 1]; break;
+            case EXPR_SQRT: stack[sp - 1] = sqrtf(stack[sp - 1]); break;
+            case EXPR_ABS: stack[sp - 1] = fabsf(stack[sp - 1]); break;
+            case EXPR_MIN:
+            case EXPR_MAX:
+            case EXPR_AVG: {
+                uint8_t op = code[pc];
+                int n = code[++pc];
+                sp -= n;
+                float r = stack[sp];
+                for (int i = 1; i < n; i++) {
+                    float v = stack[sp + i];
+                    if (isnan(v)) r = v;
+                    else if (op == EXPR_MIN) r = v < r ? v : r;
+                    else if (op == EXPR_MAX) r = v > r ? v : r;
+                    else r += v;
+                }
+                stack[sp++] = op == EXPR_AVG ? r / n : r;
+                break;
+            }
+            }
+        }
+        float r = sp == 1 ? stack[0] : NAN;
+        return isfinite(r) ? r : NAN;
+    }
+};
+
+// 变量名解析：返回输入下标（0-31），不认识时返回 -1
+typedef int (*ExprResolver)(const char* name, size_t len, void* context);
+
+class ExprCompiler {
+public:
+    ExprCompiler(ExprResolver resolve, void* context) : resolve_(resolve), context_(context) {}
+
+    // 编译成功返回 NULL，否则返回错误信息，errorPos 为出错的字符位置
+    const char* compile(const char* text, ExprProgram& out) {
+        src_ = text;
+        p_ = text;
+        prog_ = &out;
+        memset(&out, 0, sizeof(out));
+        depth_ = 0;
+        maxDepth_ = 0;
+        nest_ = 0;
+        error_ = NULL;
+        skip();
+        if (!*p_) return fail("empty expression");
+        parseExpr();
+        if (!error_ && *p_) fail("unexpected character");
+        return error_;
+    }
+
+    int errorPos() const { return (int)(p_ - src_); }
+
+private:
+    const char* fail(const char* message) {
+        if (!error_) error_ = message;
+        return error_;
+    }
+
+    void skip() {
+        while (*p_ == ' ' || *p_ == '\t') p_++;
+    }
+
+    void emit(uint8_t byte) {
+        if (prog_->length >= EXPR_MAX_CODE) {
+            fail("expression too long");
+            return;
+        }
+        prog_->code[prog_->length++] = byte;
+    }
+
+    // 栈深度变化
+    void push(int n) {
+        depth_ += n;
+        if (depth_ > maxDepth_) maxDepth_ = depth_;
+        if (maxDepth_ > EXPR_MAX_STACK) fail("expression too deep");
+    }
+
+    void parseExpr() {
+        parseTerm();
+        while (!error_ && (*p_ == '+' || *p_ == '-')) {
+            char op = *p_++;
+            skip();
+            parseTerm();
+            emit(op == '+' ? EXPR_ADD : EXPR_SUB);
+            push(-1);
+        }
+    }
+
+    void parseTerm() {
+        parseUnary();
+        while (!error_ && (*p_ == '*' || *p_ == '/')) {
+            char op = *p_++;
+            skip();
+            parseUnary();
+            emit(op == '*' ? EXPR_MUL : EXPR_DIV);
+            push(-1);
+        }
+    }
+
+    void parseUnary() {
+        if (*p_ == '-') {
+            p_++;
+            skip();
+            parseUnary();
+            emit(EXPR_NEG);
+            return;
+        }
+        if (*p_ == '+') {
+            p_++;
+            skip();
+            parseUnary();
+            return;
+        }
+        parsePower();
+    }
+
+    // 乘方比一元负号优先：-a^2 = -(a^2)
+    void parsePower() {
+        parsePrimary();
+        if (!error_ && *p_ == '^') {
+            p_++;
+            skip();
+            parseUnary();
+            emit(EXPR_POW);
+            push(-1);
+        }
+    }
+
+    void parsePrimary() {
+        if (error_) return;
+        if (*p_ == '(') {
+            if (++nest_ > EXPR_MAX_NEST) {
+                fail("expression too deep");
+                return;
+            }
+            p_++;
+            skip();
+            parseExpr();
+            if (error_) return;
+            if (*p_ != ')') {
+                fail("expected ')'");
+                return;
+            }
+            nest_--;
+            p_++;
+            skip();
+            return;
+        }
+        if (isdigit((unsigned char)*p_) || *p_ == '.') {
+            char* end;
+            float v = strtof(p_, &end);
+            if (end == p_) {
+                fail("invalid number");
+                return;
+            }
+            p_ = end;
+            skip();
+            int index = -1;
+            for (int i = 0; i < prog_->constCount; i++) {
+                if (prog_->consts[i] == v) index = i;
+            }
+            if (index < 0) {
+                if (prog_->constCount >= EXPR_MAX_CONSTS) {
+                    fail("too many constants");
+                    return;
+                }
+                index = prog_->constCount++;
+                prog_->consts[index] = v;
+            }
+            emit(EXPR_CONST);
+            emit(index);
+            push(1);
+            return;
+        }
+        if (isalpha((unsigned char)*p_) || *p_ == '_') {
+            const char* name = p_;
+            while (isalnum((unsigned char)*p_) || *p_ == '_') p_++;
+            size_t len = p_ - name;
+            skip();
+            if (*p_ == '(') {
+                parseCall(name, len);
+                return;
+            }
+            int index = resolve_(name, len, context_);
+            if (index < 0 || index > 31) {
+                p_ = name;
+                fail("unknown variable");
+                return;
+            }
+            prog_->inputs |= 1u << index;
+            emit(EXPR_LOAD);
+            emit(index);
+            push(1);
+            return;
+        }
+        fail(*p_ ? "unexpected character" : "unexpected end");
+    }
+
+    void parseCall(const char* name, size_t len) {
+        uint8_t op;
+        bool variadic = true;
+        if (len == 4 && strncmp(name, "sqrt", 4) == 0) {
+            op = EXPR_SQRT;
+            variadic = false;
+        } else if (len == 3 && strncmp(name, "abs", 3) == 0) {
+            op = EXPR_ABS;
+            variadic = false;
+        } else if (len == 3 && strncmp(name, "min", 3) == 0) {
+            op = EXPR_MIN;
+        } else if (len == 3 && strncmp(name, "max", 3) == 0) {
+            op = EXPR_MAX;
+        } else if (len == 3 && strncmp(name, "avg", 3) == 0) {
+            op = EXPR_AVG;
+        } else {
+            p_ = name;
+            fail("unknown function");
+            return;
+        }
+        if (++nest_ > EXPR_MAX_NEST) {
+            fail("expression too deep");
+            return;
+        }
+        p_++;   // '('
+        skip();
+        int args = 0;
+        for (;;) {
+            parseExpr();
+            if (error_) return;
+            args++;
+            if (*p_ == ',') {
+                p_++;
+                skip();
+                continue;
+            }
+            if (*p_ == ')') {
+                nest_--;
+                p_++;
+                skip();
+                break;
+            }
+            fail("expected ')'");
+            return;
+        }
+        if (!variadic && args != 1) {
+            fail("function takes one argument");
+            return;
+        }
+        if (args > EXPR_MAX_ARGS) {
+            fail("too many arguments");
+            return;
+        }
+        emit(op);
+        if (variadic) emit(args);
+        push(1 - args);
+    }
+
+    ExprResolver resolve_;
+    void* context_;
+    const char* src_;
+    const char* p_;
+    ExprProgram* prog_;
+    const char* error_;
+    int depth_;
+    int maxDepth_;
+    int nest_;
+};
+
+#endif
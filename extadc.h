@@ -0,0 +1,370 @@
+#ifndef EXTADC_H
+#define EXTADC_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <atomic>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+
+// 外部精密ADC（ADS1115 / ADS1256），作为模拟量通道的另一种采样后端，在模拟量配置页按通道选择。
+//
+// 两个芯片都工作在连续转换模式，由采集任务按多路开关顺序轮流扫描通道用到的输入：
+// 每次转换完成（ADS1115 的 ALERT/RDY 或 ADS1256 的 DRDY 下降沿中断唤醒任务）后，
+// 先切换多路开关启动下一个输入的转换，再读出刚完成的结果，总线读取与下一次转换重叠。
+// 一轮扫完后整批发布到快照，主循环的 sampleADC 从快照取值，与内部ADC走同样的中值和限幅滤波。
+//
+// 通道值仍为 int16 码值：ADS1115 为原始16位码值（±4.096V 量程），
+// ADS1256 取24位结果的高16位（VREF=2.5V、PGA=1 时 ±5V 量程）。
+// ADS1256 与 MAX31865 共用硬件SPI，每次访问都在 SPI 事务内，由 SPI 库的总线锁互斥。
+
+#define EXT_ADC_DEVICES 2                  // 设备序号 = 后端 - 1
+#define EXT_ADC_MAX_INPUTS 8
+#define EXT_ADC_SCAN_INTERVAL_MS 20        // 扫描周期(ms)
+#define EXT_ADC_READY_TIMEOUT_MS 10        // 等待单次转换完成的超时
+
+#define ADS1115_ADDRESS 0x48
+#define ADS1115_REG_CONVERSION 0x00
+#define ADS1115_REG_CONFIG 0x01
+#define ADS1115_REG_LO_THRESH 0x02
+#define ADS1115_REG_HI_THRESH 0x03
+// 连续转换、PGA ±4.096V、860SPS，比较器每次转换后输出 RDY 脉冲（低有效）
+#define ADS1115_CONFIG_BASE ((0x1 << 9) | (0x0 << 8) | (0x7 << 5) | 0x0)
+#define ADS1115_VOLTS_PER_CODE (4.096f / 32768.0f)
+
+#define ADS1256_CMD_WAKEUP 0x00
+#define ADS1256_CMD_RDATA 0x01
+#define ADS1256_CMD_RREG 0x10
+#define ADS1256_CMD_WREG 0x50
+#define ADS1256_CMD_SELFCAL 0xF0
+#define ADS1256_CMD_SYNC 0xFC
+#define ADS1256_CMD_RESET 0xFE
+#define ADS1256_REG_STATUS 0x00
+#define ADS1256_REG_MUX 0x01
+#define ADS1256_REG_ADCON 0x02
+#define ADS1256_REG_DRATE 0x03
+#define ADS1256_ID 0x3                     // STATUS 高4位
+#define ADS1256_DRATE_1000SPS 0xA1
+#define ADS1256_AINCOM 0x8
+#define ADS1256_VOLTS_PER_CODE (5.0f / 32768.0f)
+
+// 一轮扫描的结果（采集任务发布，主循环读取）
+struct ExtAdcBatch {
+    uint32_t timestamp;                                    // 发布时的 millis()
+    int16_t code[EXT_ADC_DEVICES][EXT_ADC_MAX_INPUTS];     // 每个输入最近一次的码值
+    uint8_t validMask[EXT_ADC_DEVICES];                    // 本轮读到的输入
+};
+
+struct ExtAdcStats {
+    uint32_t batches;                    // 发布的批次
+    uint32_t conversions[EXT_ADC_DEVICES];
+    uint32_t timeouts[EXT_ADC_DEVICES];  // 等待转换完成超时
+    uint32_t busErrors[EXT_ADC_DEVICES]; // I2C 无应答等总线错误
+};
+
+extern AnalogChannel analogChannels[Board::ANALOG_CHANNELS];
+
+Snapshot<ExtAdcBatch> extAdcBatch;
+ExtAdcStats extAdcStats;
+bool extAdcPresent[EXT_ADC_DEVICES];
+std::atomic<uint8_t> extAdcScanMask[EXT_ADC_DEVICES];   // 需要扫描的输入，由通道配置同步
+volatile bool extAdcReady[EXT_ADC_DEVICES];             // 中断置位，采集任务清除
+TaskHandle_t extAdcTaskHandle = NULL;
+
+const SPISettings ads1256SpiSettings(1800000, MSBFIRST, SPI_MODE1);   // SCLK 不超过 fCLKIN/4
+
+void IRAM_ATTR extAdcReadyIsr(int device) {
+    extAdcReady[device] = true;
+    if (extAdcTaskHandle) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(extAdcTaskHandle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+void IRAM_ATTR ads1115ReadyIsr() { extAdcReadyIsr(ADC_BACKEND_ADS1115 - 1); }
+void IRAM_ATTR ads1256ReadyIsr() { extAdcReadyIsr(ADC_BACKEND_ADS1256 - 1); }
+
+// 按通道配置重新计算每个设备要扫描的输入
+void extAdcUpdateScanMask() {
+    uint8_t mask[EXT_ADC_DEVICES] = {0};
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        const AnalogChannel& ch = analogChannels[i];
+        if (!ch.enabled || ch.backend == ADC_BACKEND_INTERNAL) continue;
+        mask[ch.backend - 1] |= 1u << ch.extInput;
+    }
+    for (int d = 0; d < EXT_ADC_DEVICES; d++) {
+        extAdcScanMask[d].store(mask[d], std::memory_order_relaxed);
+    }
+}
+
+// 等待设备完成一次转换，超时返回 false
+bool extAdcWaitReady(int device) {
+    TickType_t start = xTaskGetTickCount();
+    while (!extAdcReady[device]) {
+        // 另一个设备的中断也会唤醒任务，所以按标志判断
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(EXT_ADC_READY_TIMEOUT_MS)) {
+            extAdcStats.timeouts[device]++;
+            return false;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(EXT_ADC_READY_TIMEOUT_MS));
+    }
+    extAdcReady[device] = false;
+    return true;
+}
+
+// ---- ADS1115 (I2C) ----
+
+bool ads1115WriteReg(uint8_t reg, uint16_t value) {
+    Wire.beginTransmission(ADS1115_ADDRESS);
+    Wire.write(reg);
+    Wire.write(value >> 8);
+    Wire.write(value & 0xFF);
+    return Wire.endTransmission() == 0;
+}
+
+bool ads1115ReadReg(uint8_t reg, int16_t& value) {
+    Wire.beginTransmission(ADS1115_ADDRESS);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0) return false;
+    if (Wire.requestFrom((uint8_t)ADS1115_ADDRESS, (uint8_t)2) != 2) return false;
+    uint8_t hi = Wire.read();
+    uint8_t lo = Wire.read();
+    value = (int16_t)((hi << 8) | lo);
+    return true;
+}
+
+// 选择单端输入 AINn 并重新开始转换
+bool ads1115Select(uint8_t input) {
+    return ads1115WriteReg(ADS1115_REG_CONFIG, ADS1115_CONFIG_BASE | ((0x4 + input) << 12));
+}
+
+bool initAds1115() {
+    Wire.begin(Board::EXT_I2C_SDA_GPIO, Board::EXT_I2C_SCL_GPIO, 400000);
+    Wire.beginTransmission(ADS1115_ADDRESS);
+    if (Wire.endTransmission() != 0) return false;
+
+    // 阈值寄存器设为 Hi=0x8000、Lo=0x0000 时 ALERT 引脚作为转换完成信号
+    if (!ads1115WriteReg(ADS1115_REG_LO_THRESH, 0x0000) ||
+        !ads1115WriteReg(ADS1115_REG_HI_THRESH, 0x8000) ||
+        !ads1115Select(0)) {
+        return false;
+    }
+    pinMode(Board::ADS1115_RDY_GPIO, INPUT_PULLUP);   // 开漏输出
+    attachInterrupt(digitalPinToInterrupt(Board::ADS1115_RDY_GPIO), ads1115ReadyIsr, FALLING);
+    return true;
+}
+
+// 扫描 mask 中的输入，返回读到的输入位图
+uint8_t ads1115Scan(uint8_t mask, int16_t* code) {
+    const int device = ADC_BACKEND_ADS1115 - 1;
+    uint8_t inputs[ADS1115_INPUTS];
+    int n = 0;
+    for (int i = 0; i < ADS1115_INPUTS; i++) {
+        if (mask & (1u << i)) inputs[n++] = i;
+    }
+    if (n == 0) return 0;
+
+    uint8_t valid = 0;
+    if (!ads1115Select(inputs[0])) {
+        extAdcStats.busErrors[device]++;
+        return 0;
+    }
+    extAdcReady[device] = false;
+    for (int k = 0; k < n; k++) {
+        if (!extAdcWaitReady(device)) break;
+        // 写配置寄存器会以新的输入重新开始转换，转换寄存器在新结果出来前保持本次结果
+        if (k + 1 < n) {
+            if (!ads1115Select(inputs[k + 1])) {
+                extAdcStats.busErrors[device]++;
+                break;
+            }
+            extAdcReady[device] = false;
+        }
+        int16_t value;
+        if (!ads1115ReadReg(ADS1115_REG_CONVERSION, value)) {
+            extAdcStats.busErrors[device]++;
+            break;
+        }
+        code[inputs[k]] = value;
+        valid |= 1u << inputs[k];
+        extAdcStats.conversions[device]++;
+    }
+    return valid;
+}
+
+// ---- ADS1256 (SPI) ----
+
+void ads1256Begin() {
+    SPI.beginTransaction(ads1256SpiSettings);
+    digitalWrite(Board::ADS1256_CS_GPIO, LOW);
+}
+
+void ads1256End() {
+    digitalWrite(Board::ADS1256_CS_GPIO, HIGH);
+    SPI.endTransaction();
+}
+
+// 以下在事务内调用；命令间的等待按 fCLKIN=7.68MHz 的时序要求取整
+void ads1256WriteRegRaw(uint8_t reg, uint8_t value) {
+    SPI.transfer(ADS1256_CMD_WREG | reg);
+    SPI.transfer(0);                  // 写1个寄存器
+    SPI.transfer(value);
+    delayMicroseconds(1);
+}
+
+// 切换到单端输入 AINn（相对 AINCOM）并重新开始转换
+void ads1256SelectRaw(uint8_t input) {
+    ads1256WriteRegRaw(ADS1256_REG_MUX, (input << 4) | ADS1256_AINCOM);
+    SPI.transfer(ADS1256_CMD_SYNC);
+    delayMicroseconds(4);
+    SPI.transfer(ADS1256_CMD_WAKEUP);
+    delayMicroseconds(1);
+}
+
+// 读出最近完成的一次转换，取高16位
+int16_t ads1256ReadDataRaw() {
+    SPI.transfer(ADS1256_CMD_RDATA);
+    delayMicroseconds(7);
+    uint8_t b0 = SPI.transfer(0);
+    uint8_t b1 = SPI.transfer(0);
+    SPI.transfer(0);                  // 低8位
+    return (int16_t)((b0 << 8) | b1);
+}
+
+// 轮询 DRDY（中断挂接前使用）
+bool ads1256PollReady(uint32_t timeoutMs) {
+    uint32_t start = millis();
+    while (digitalRead(Board::ADS1256_DRDY_GPIO) == HIGH) {
+        if (millis() - start >= timeoutMs) return false;
+        delay(1);
+    }
+    return true;
+}
+
+bool initAds1256() {
+    pinMode(Board::ADS1256_CS_GPIO, OUTPUT);
+    digitalWrite(Board::ADS1256_CS_GPIO, HIGH);
+    pinMode(Board::ADS1256_DRDY_GPIO, INPUT_PULLUP);
+    SPI.begin(Board::SPI_SCK_GPIO, Board::SPI_MISO_GPIO, Board::SPI_MOSI_GPIO);
+
+    ads1256Begin();
+    SPI.transfer(ADS1256_CMD_RESET);
+    ads1256End();
+    if (!ads1256PollReady(50)) return false;
+
+    ads1256Begin();
+    SPI.transfer(ADS1256_CMD_RREG | ADS1256_REG_STATUS);
+    SPI.transfer(0);
+    delayMicroseconds(7);
+    uint8_t status = SPI.transfer(0);
+    ads1256End();
+    if ((status >> 4) != ADS1256_ID) return false;
+
+    // 自动校准、不用输入缓冲（输入范围 0-AVDD）、关闭时钟输出、PGA=1
+    ads1256Begin();
+    ads1256WriteRegRaw(ADS1256_REG_STATUS, 0x04);
+    ads1256WriteRegRaw(ADS1256_REG_ADCON, 0x00);
+    ads1256WriteRegRaw(ADS1256_REG_DRATE, ADS1256_DRATE_1000SPS);
+    SPI.transfer(ADS1256_CMD_SELFCAL);
+    ads1256End();
+    if (!ads1256PollReady(100)) return false;
+
+    attachInterrupt(digitalPinToInterrupt(Board::ADS1256_DRDY_GPIO), ads1256ReadyIsr, FALLING);
+    return true;
+}
+
+// 按数据手册的多路开关轮换流程：DRDY 后切换输入、SYNC、WAKEUP，再 RDATA 读出上一个输入的结果
+uint8_t ads1256Scan(uint8_t mask, int16_t* code) {
+    const int device = ADC_BACKEND_ADS1256 - 1;
+    uint8_t inputs[ADS1256_INPUTS];
+    int n = 0;
+    for (int i = 0; i < ADS1256_INPUTS; i++) {
+        if (mask & (1u << i)) inputs[n++] = i;
+    }
+    if (n == 0) return 0;
+
+    uint8_t valid = 0;
+    ads1256Begin();
+    ads1256SelectRaw(inputs[0]);
+    ads1256End();
+    extAdcReady[device] = false;
+    for (int k = 0; k < n; k++) {
+        if (!extAdcWaitReady(device)) break;
+        ads1256Begin();
+        if (k + 1 < n) ads1256SelectRaw(inputs[k + 1]);
+        int16_t value = ads1256ReadDataRaw();
+        ads1256End();
+        if (k + 1 < n) extAdcReady[device] = false;
+        code[inputs[k]] = value;
+        valid |= 1u << inputs[k];
+        extAdcStats.conversions[device]++;
+    }
+    return valid;
+}
+
+// ---- 采集任务 ----
+
+void extAdcTask(void* param) {
+    ExtAdcBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(EXT_ADC_SCAN_INTERVAL_MS));
+        {
+            METRICS_SCOPE(METRIC_EXT_ADC_SCAN);
+            int d = ADC_BACKEND_ADS1115 - 1;
+            batch.validMask[d] = extAdcPresent[d] ?
+                ads1115Scan(extAdcScanMask[d].load(std::memory_order_relaxed), batch.code[d]) : 0;
+            d = ADC_BACKEND_ADS1256 - 1;
+            batch.validMask[d] = extAdcPresent[d] ?
+                ads1256Scan(extAdcScanMask[d].load(std::memory_order_relaxed), batch.code[d]) : 0;
+        }
+        batch.timestamp = millis();
+        extAdcBatch.publish(batch);
+        extAdcStats.batches++;
+    }
+}
+
+// 探测外部ADC并启动采集任务（温度传感器初始化之后调用，与其共用SPI总线）
+void initExtAdc() {
+    extAdcPresent[ADC_BACKEND_ADS1115 - 1] = initAds1115();
+    extAdcPresent[ADC_BACKEND_ADS1256 - 1] = initAds1256();
+    LOGI(LOG_MOD_ADC, "External ADC: ADS1115 %s, ADS1256 %s",
+        extAdcPresent[ADC_BACKEND_ADS1115 - 1] ? "found" : "absent",
+        extAdcPresent[ADC_BACKEND_ADS1256 - 1] ? "found" : "absent");
+    extAdcUpdateScanMask();
+
+    if (!extAdcPresent[0] && !extAdcPresent[1]) return;
+    // 等待转换完成的时间很短，优先级高于继电器控制任务
+    xTaskCreatePinnedToCore(extAdcTask, "ext_adc", 3072, NULL, 3, &extAdcTaskHandle, 1);
+}
+
+#if METRICS_ENABLED
+void writeExtAdcMetrics(Print& out) {
+    static const char* const names[EXT_ADC_DEVICES] = {"ads1115", "ads1256"};
+    out.print("# TYPE esp_ext_adc_present gauge\n");
+    for (int d = 0; d < EXT_ADC_DEVICES; d++) {
+        out.printf("esp_ext_adc_present{device=\"%s\"} %d\n", names[d], extAdcPresent[d] ? 1 : 0);
+    }
+    out.print("# TYPE esp_ext_adc_batches_total counter\n");
+    out.printf("esp_ext_adc_batches_total %u\n", extAdcStats.batches);
+    out.print("# TYPE esp_ext_adc_conversions_total counter\n");
+    for (int d = 0; d < EXT_ADC_DEVICES; d++) {
+        out.printf("esp_ext_adc_conversions_total{device=\"%s\"} %u\n", names[d], extAdcStats.conversions[d]);
+    }
+    out.print("# TYPE esp_ext_adc_timeouts_total counter\n");
+    for (int d = 0; d < EXT_ADC_DEVICES; d++) {
+        out.printf("esp_ext_adc_timeouts_total{device=\"%s\"} %u\n", names[d], extAdcStats.timeouts[d]);
+    }
+    out.print("# TYPE esp_ext_adc_bus_errors_total counter\n");
+    for (int d = 0; d < EXT_ADC_DEVICES; d++) {
+        out.printf("esp_ext_adc_bus_errors_total{device=\"%s\"} %u\n", names[d], extAdcStats.busErrors[d]);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <math.h>
+#include <stdint.h>
+
+// 定长实数FFT和 Goertzel 单频检测，只依赖标准库，可以直接在主机上编译验证。
+//
+// N 点实数序列按偶/奇下标组成 N/2 点复数序列，做一次基2迭代复数FFT，再用一轮蝶形拆分出
+// 实数序列的频谱，运算量约为同长度复数FFT的一半。旋转因子、位反转表和 Hann 窗在构造时算好。
+
+template <int N>
+class RealFft {
+    static_assert(N >= 8 && (N & (N - 1)) == 0, "FFT size must be a power of two");
+
+public:
+    enum { SIZE = N, BINS = N / 2 + 1 };
+
+    RealFft() {
+        const double pi = 3.14159265358979323846;
+        for (int k = 0; k < N / 2; k++) {
+            cos_[k] = (float)cos(2 * pi * k / N);
+            sin_[k] = (float)sin(2 * pi * k / N);
+        }
+        int bits = 0;
+        while ((1 << bits) < N / 2) bits++;
+        for (int i = 0; i < N / 2; i++) {
+            int r = 0;
+            for (int b = 0; b < bits; b++) {
+                if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+            }
+            bitrev_[i] = r;
+        }
+        windowSum_ = 0;
+        windowPower_ = 0;
+        for (int i = 0; i < N; i++) {
+            window_[i] = (float)(0.5 - 0.5 * cos(2 * pi * i / N));
+            windowSum_ += window_[i];
+            windowPower_ += window_[i] * window_[i];
+        }
+    }
+
+    // 原地变换。输入 N 个实数；输出为打包格式：data[0] = 直流，data[1] = N/2 处（奈奎斯特），
+    // data[2k]、data[2k+1] 为第 k 个频点（1 <= k < N/2）的实部和虚部
+    void forward(float* data) const {
+        const int M = N / 2;
+        complexFft(data);
+
+        // 拆分：Z[k] 为复数FFT结果，X[k] = Xe[k] + W^k Xo[k]，X[M-k] = conj(Xe[k] - W^k Xo[k])
+        float z0r = data[0], z0i = data[1];
+        data[0] = z0r + z0i;
+        data[1] = z0r - z0i;
+        for (int k = 1; k <= M / 2; k++) {
+            int m = M - k;
+            float zkr = data[2 * k], zki = data[2 * k + 1];
+            float zmr = data[2 * m], zmi = data[2 * m + 1];
+            float er = 0.5f * (zkr + zmr), ei = 0.5f * (zki - zmi);
+            float orr = 0.5f * (zki + zmi), oi = -0.5f * (zkr - zmr);
+            // W^k = cos - i·sin
+            float tr = cos_[k] * orr + sin_[k] * oi;
+            float ti = cos_[k] * oi - sin_[k] * orr;
+            data[2 * k] = er + tr;
+            data[2 * k + 1] = ei + ti;
+            if (m != k) {
+                data[2 * m] = er - tr;
+                data[2 * m + 1] = -(ei - ti);
+            }
+        }
+    }
+
+    // 打包结果中第 k 个频点（0 <= k <= N/2）的功率 |X[k]|²
+    static float power(const float* data, int k) {
+        if (k == 0) return data[0] * data[0];
+        if (k == N / 2) return data[1] * data[1];
+        return data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1];
+    }
+
+    // 乘以 Hann 窗
+    void applyWindow(float* data) const {
+        for (int i = 0; i < N; i++) data[i] *= window_[i];
+    }
+
+    float windowSum() const { return windowSum_; }      // 正弦幅值 = 2|X[k]| / windowSum
+    float windowPower() const { return windowPower_; }  // 均方值 = 2Σ|X[k]|² / (N · windowPower)
+
+private:
+    // N/2 点复数FFT（实部、虚部交错存放），位反转后逐级蝶形
+    void complexFft(float* data) const {
+        const int M = N / 2;
+        for (int i = 0; i < M; i++) {
+            int j = bitrev_[i];
+            if (j > i) {
+                float tr = data[2 * i], ti = data[2 * i + 1];
+                data[2 * i] = data[2 * j];
+                data[2 * i + 1] = data[2 * j + 1];
+                data[2 * j] = tr;
+                data[2 * j + 1] = ti;
+            }
+        }
+        for (int len = 2; len <= M; len <<= 1) {
+            int half = len / 2;
+            int step = N / len;   // W_len^j = W_N^(j·N/len)
+            for (int i = 0; i < M; i += len) {
+                for (int j = 0; j < half; j++) {
+                    float wr = cos_[j * step], wi = -sin_[j * step];
+                    float* a = data + 2 * (i + j);
+                    float* b = data + 2 * (i + j + half);
+                    float tr = wr * b[0] - wi * b[1];
+                    float ti = wr * b[1] + wi * b[0];
+                    b[0] = a[0] - tr;
+                    b[1] = a[1] - ti;
+                    a[0] += tr;
+                    a[1] += ti;
+                }
+            }
+        }
+    }
+
+    float cos_[N / 2];
+    float sin_[N / 2];
+    uint16_t bitrev_[N / 2];
+    float window_[N];
+    float windowSum_;
+    float windowPower_;
+};
+
+// Goertzel：求 n 个样本在频率 freq（可以不在FFT频点上）处的 |X|²
+inline float goertzelPower(const float* x, int n, float freq, float sampleRate) {
+    float coeff = 2.0f * cosf(2.0f * 3.14159265f * freq / sampleRate);
+    float s1 = 0, s2 = 0;
+    for (int i = 0; i < n; i++) {
+        float s0 = x[i] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+#endif
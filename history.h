@@ -0,0 +1,419 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <atomic>
+#include <memory>
+#include <time.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "virtual.h"
+
+// 历史数据：记录任务（core 0）按固定间隔从采集快照取一条记录追加到 SPIFFS，
+// 存储分为 HISTORY_SEGMENTS 个段文件循环使用，写满后删除最旧的一段。
+// 每条记录带递增序号 seq，序号决定所在的段和段内偏移，可以直接定位，
+// 导出时用序号作为续传位置（见 HistoryExport）。
+
+#define HISTORY_INTERVAL_MS 60000         // 记录间隔(ms)
+#define HISTORY_SEGMENTS 8                // 段文件数
+#define HISTORY_SEGMENT_RECORDS 1024      // 每段记录数
+#define HISTORY_READ_BATCH 8              // 导出时每次从文件读取的记录数
+#define HISTORY_BINARY_VERSION 2
+#define HISTORY_CHANNELS VIRTUAL_INPUTS   // 模拟量、温度、虚拟通道，编号同虚拟通道的输入
+#define HISTORY_ALL_CHANNELS ((uint32_t)((1ull << HISTORY_CHANNELS) - 1))
+
+struct HistoryRecord {
+    uint32_t seq;                          // 序号，从0开始递增
+    uint32_t epoch;                        // UTC 秒，未校时为 0
+    uint32_t uptime;                       // millis()
+    float value[Board::ANALOG_CHANNELS];   // 未启用的通道为 NAN
+    float temp[Board::TEMP_SENSORS];       // 未启用的传感器为 NAN
+    float virt[VIRTUAL_CHANNELS];          // 未启用的虚拟通道为 NAN
+};
+
+struct HistoryStats {
+    uint32_t appended;      // 写入的记录数
+    uint32_t failed;        // 写入失败的记录数
+    uint32_t exports;       // 导出请求数
+    uint32_t exported;      // 导出的记录数
+};
+
+extern Snapshot<SensorSnapshot> sensorSnapshot;
+
+// 只由记录任务写入，导出时读取
+std::atomic<uint32_t> historyFirstSeq(0);   // 最旧的可用记录
+std::atomic<uint32_t> historyNextSeq(0);    // 下一条记录的序号
+HistoryStats historyStats;
+
+// 记录中加入虚拟通道后段文件改名，旧格式的文件在启动时删除
+void historySegmentPath(int slot, char* path, size_t size) {
+    snprintf(path, size, "/hist_%d.bin", slot);
+}
+
+int historySlot(uint32_t seq) {
+    return (seq / HISTORY_SEGMENT_RECORDS) % HISTORY_SEGMENTS;
+}
+
+// 写满一轮后最旧的可用记录
+uint32_t historyOldestFor(uint32_t next) {
+    uint32_t segment = next / HISTORY_SEGMENT_RECORDS;
+    if (segment < HISTORY_SEGMENTS) return 0;
+    return (segment - (HISTORY_SEGMENTS - 1)) * HISTORY_SEGMENT_RECORDS;
+}
+
+// 在记录任务中调用
+void historyAppend(HistoryRecord& rec) {
+    METRICS_SCOPE(METRIC_SAVE_HISTORY);
+    uint32_t seq = historyNextSeq.load(std::memory_order_relaxed);
+    char path[24];
+    historySegmentPath(historySlot(seq), path, sizeof(path));
+
+    if (seq % HISTORY_SEGMENT_RECORDS == 0) {
+        // 开始新的一段：先推进最旧序号再删除旧文件，读取方按记录中的序号校验
+        historyFirstSeq.store(historyOldestFor(seq + 1), std::memory_order_release);
+        SPIFFS.remove(path);
+    }
+
+    rec.seq = seq;
+    File file = SPIFFS.open(path, "a");
+    if (file && file.write((const uint8_t*)&rec, sizeof(rec)) == sizeof(rec)) {
+        historyStats.appended++;
+        historyNextSeq.store(seq + 1, std::memory_order_release);
+    } else {
+        // 段内偏移必须与序号对应，写入失败时从下一段重新开始
+        historyStats.failed++;
+        historyNextSeq.store((seq / HISTORY_SEGMENT_RECORDS + 1) * HISTORY_SEGMENT_RECORDS,
+            std::memory_order_release);
+        LOGW(LOG_MOD_CFG, "Failed to append history record %u", seq);
+    }
+    if (file) file.close();
+}
+
+HistoryRecord historyMakeRecord() {
+    SensorSnapshot snap;
+    sensorSnapshot.read(snap);
+
+    HistoryRecord rec;
+    rec.seq = 0;
+    time_t now = time(NULL);
+    rec.epoch = now > 1600000000 ? (uint32_t)now : 0;
+    rec.uptime = snap.timestamp;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        rec.value[i] = (snap.enabledMask & (1u << i)) ? snap.value[i] : NAN;
+    }
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        rec.temp[i] = (snap.tempEnabledMask & (1u << i)) ? snap.tempValue[i] : NAN;
+    }
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        rec.virt[k] = (snap.virtualMask & (1u << k)) ? snap.virtualValue[k] : NAN;
+    }
+    return rec;
+}
+
+void historyTask(void* param) {
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(HISTORY_INTERVAL_MS));
+        HistoryRecord rec = historyMakeRecord();
+        historyAppend(rec);
+    }
+}
+
+// 按序号顺序读取，打开的段文件在连续读取之间保持打开
+class HistoryReader {
+public:
+    HistoryReader() : slot_(-1) {}
+    ~HistoryReader() { if (slot_ >= 0) file_.close(); }
+
+    // 从 seq 开始读取同一段内最多 max 条连续记录，返回条数；
+    // 该位置的记录已被覆盖或尚未写入时返回 0
+    size_t read(uint32_t seq, HistoryRecord* out, size_t max) {
+        int slot = historySlot(seq);
+        if (slot != slot_) {
+            if (slot_ >= 0) file_.close();
+            slot_ = -1;
+            char path[24];
+            historySegmentPath(slot, path, sizeof(path));
+            if (!SPIFFS.exists(path)) return 0;
+            file_ = SPIFFS.open(path, "r");
+            if (!file_) return 0;
+            slot_ = slot;
+        }
+        size_t left = HISTORY_SEGMENT_RECORDS - seq % HISTORY_SEGMENT_RECORDS;
+        if (max > left) max = left;
+        if (!file_.seek((seq % HISTORY_SEGMENT_RECORDS) * sizeof(HistoryRecord))) return 0;
+        size_t count = file_.read((uint8_t*)out, max * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+        for (size_t i = 0; i < count; i++) {
+            if (out[i].seq != seq + i) return i;
+        }
+        return count;
+    }
+
+    // 读取单条记录
+    bool readOne(uint32_t seq, HistoryRecord& rec) {
+        return read(seq, &rec, 1) == 1;
+    }
+
+private:
+    File file_;
+    int slot_;
+};
+
+// 启动时扫描段文件，恢复序号范围
+void initHistory() {
+    uint32_t first = UINT32_MAX;
+    uint32_t next = 0;
+    for (int slot = 0; slot < HISTORY_SEGMENTS; slot++) {
+        char path[24];
+        snprintf(path, sizeof(path), "/history_%d.bin", slot);
+        if (SPIFFS.exists(path)) SPIFFS.remove(path);
+        historySegmentPath(slot, path, sizeof(path));
+        if (!SPIFFS.exists(path)) continue;
+        File file = SPIFFS.open(path, "r");
+        if (!file) continue;
+        size_t size = file.size();
+        size_t count = size / sizeof(HistoryRecord);
+        HistoryRecord head, tail;
+        if (count > 0 &&
+            file.read((uint8_t*)&head, sizeof(head)) == sizeof(head) &&
+            file.seek((count - 1) * sizeof(HistoryRecord)) &&
+            file.read((uint8_t*)&tail, sizeof(tail)) == sizeof(tail)) {
+            if (head.seq < first) first = head.seq;
+            uint32_t end = tail.seq + 1;
+            // 末尾有不完整的记录（写入时掉电）时从下一段开始，保证段内偏移与序号对应
+            if (size % sizeof(HistoryRecord) != 0) {
+                end = (tail.seq / HISTORY_SEGMENT_RECORDS + 1) * HISTORY_SEGMENT_RECORDS;
+            }
+            if (end > next) next = end;
+        }
+        file.close();
+    }
+    if (first == UINT32_MAX) first = 0;
+    if (first < historyOldestFor(next)) first = historyOldestFor(next);
+    historyFirstSeq.store(first, std::memory_order_relaxed);
+    historyNextSeq.store(next, std::memory_order_relaxed);
+    LOGI(LOG_MOD_CFG, "History records %u..%u", first, next);
+
+    xTaskCreatePinnedToCore(historyTask, "history", 4096, NULL, 1, NULL, 0);
+}
+
+// 解析通道列表，如 "0,1,5,t0,v0"：数字为模拟通道，t0/t1 为温度，v0..v3 为虚拟通道；为空时选择全部
+uint32_t historyParseChannels(const char* list) {
+    uint32_t mask = 0;
+    const char* p = list;
+    while (*p) {
+        bool temp = (*p == 't' || *p == 'T');
+        bool virt = (*p == 'v' || *p == 'V');
+        if (temp || virt) p++;
+        char* endp;
+        long n = strtol(p, &endp, 10);
+        if (endp != p) {
+            if (temp && n >= 0 && n < Board::TEMP_SENSORS) mask |= 1u << (Board::ANALOG_CHANNELS + n);
+            if (virt && n >= 0 && n < VIRTUAL_CHANNELS) mask |= 1u << (VIRTUAL_BASE + n);
+            if (!temp && !virt && n >= 0 && n < Board::ANALOG_CHANNELS) mask |= 1u << n;
+        }
+        p = endp;
+        while (*p && *p != ',') p++;
+        if (*p == ',') p++;
+    }
+    return mask ? mask : HISTORY_ALL_CHANNELS;
+}
+
+// 流式导出（/export）：每次填充回调只读取少量记录并格式化到发送缓冲区，
+// 内存占用与导出的记录数无关，也不会长时间占用 AsyncTCP 任务。
+// 导出范围在请求开始时确定；每条记录带序号，中断后用 offset=最后序号+1 续传。
+class HistoryExport {
+public:
+    enum Format { CSV = 0, BINARY };
+
+    // channelMask：低 Board::ANALOG_CHANNELS 位为模拟通道，其后为温度和虚拟通道；from/to 为 UTC 秒，0 表示不限
+    HistoryExport(Format format, uint32_t channelMask, uint32_t from, uint32_t to,
+                  uint32_t offset, uint32_t limit)
+        : format_(format), mask_(channelMask), from_(from), to_(to), limit_(limit),
+          batchCount_(0), batchPos_(0), lineLen_(0), linePos_(0), headerDone_(false) {
+        end_ = historyNextSeq.load(std::memory_order_acquire);
+        uint32_t first = historyFirstSeq.load(std::memory_order_acquire);
+        next_ = offset > first ? offset : first;
+        if (from_ && next_ == first) next_ = seekEpoch(first, end_, from_);
+        start_ = next_;
+        historyStats.exports++;
+    }
+
+    uint32_t start() const { return start_; }
+    uint32_t end() const { return end_; }
+
+    // 填充回调，返回 0 表示结束
+    size_t fill(uint8_t* buffer, size_t maxLen) {
+        METRICS_SCOPE(METRIC_HTTP_EXPORT);
+        size_t out = 0;
+        while (out < maxLen) {
+            if (linePos_ < lineLen_) {
+                size_t n = min(lineLen_ - linePos_, maxLen - out);
+                memcpy(buffer + out, line_ + linePos_, n);
+                linePos_ += n;
+                out += n;
+                continue;
+            }
+            if (!headerDone_) {
+                headerDone_ = true;
+                render(format_ == CSV ? renderCsvHeader() : renderBinaryHeader());
+                continue;
+            }
+            const HistoryRecord* rec = nextRecord();
+            if (!rec) break;
+            if (rec->epoch == 0 ? (from_ || to_) : (rec->epoch < from_)) continue;
+            if (to_ && rec->epoch > to_) {
+                end_ = next_;
+                break;
+            }
+            render(format_ == CSV ? renderCsv(*rec) : renderBinary(*rec));
+            historyStats.exported++;
+            if (limit_ && --limit_ == 0) end_ = next_;
+        }
+        return out;
+    }
+
+private:
+    // 二分查找第一条时间不早于 epoch 的记录（未校时的记录视为更早）
+    uint32_t seekEpoch(uint32_t lo, uint32_t hi, uint32_t epoch) {
+        HistoryRecord rec;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (reader_.readOne(mid, rec) && rec.epoch < epoch) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    const HistoryRecord* nextRecord() {
+        while (batchPos_ >= batchCount_) {
+            if (next_ >= end_) return NULL;
+            batchPos_ = 0;
+            batchCount_ = reader_.read(next_, batch_, min((uint32_t)HISTORY_READ_BATCH, end_ - next_));
+            if (batchCount_ == 0) {
+                // 读取期间该段已被覆盖，跳到当前最旧的记录；否则记录缺失，结束
+                uint32_t first = historyFirstSeq.load(std::memory_order_acquire);
+                if (next_ >= first) return NULL;
+                next_ = first;
+            }
+        }
+        const HistoryRecord* rec = &batch_[batchPos_++];
+        next_ = rec->seq + 1;
+        return rec;
+    }
+
+    void render(size_t len) {
+        lineLen_ = len;
+        linePos_ = 0;
+    }
+
+    static float channelValue(const HistoryRecord& rec, int i) {
+        if (i < Board::ANALOG_CHANNELS) return rec.value[i];
+        if (i < VIRTUAL_BASE) return rec.temp[i - Board::ANALOG_CHANNELS];
+        return rec.virt[i - VIRTUAL_BASE];
+    }
+
+    size_t renderCsvHeader() {
+        size_t n = snprintf(line_, sizeof(line_), "seq,time,uptime_ms");
+        for (int i = 0; i < HISTORY_CHANNELS; i++) {
+            if (!(mask_ & (1u << i))) continue;
+            if (i < Board::ANALOG_CHANNELS) {
+                n += snprintf(line_ + n, sizeof(line_) - n, ",a%d", i);
+            } else if (i < VIRTUAL_BASE) {
+                n += snprintf(line_ + n, sizeof(line_) - n, ",t%d", i - Board::ANALOG_CHANNELS);
+            } else {
+                n += snprintf(line_ + n, sizeof(line_) - n, ",v%d", i - VIRTUAL_BASE);
+            }
+        }
+        n += snprintf(line_ + n, sizeof(line_) - n, "\r\n");
+        return n;
+    }
+
+    size_t renderCsv(const HistoryRecord& rec) {
+        size_t n = snprintf(line_, sizeof(line_), "%u,", rec.seq);
+        if (rec.epoch) {
+            time_t t = rec.epoch;
+            struct tm tm;
+            gmtime_r(&t, &tm);
+            n += strftime(line_ + n, sizeof(line_) - n, "%Y-%m-%dT%H:%M:%SZ", &tm);
+        }
+        n += snprintf(line_ + n, sizeof(line_) - n, ",%u", rec.uptime);
+        for (int i = 0; i < HISTORY_CHANNELS; i++) {
+            if (!(mask_ & (1u << i))) continue;
+            float v = channelValue(rec, i);
+            n += isnan(v) ? snprintf(line_ + n, sizeof(line_) - n, ",")
+                          : snprintf(line_ + n, sizeof(line_) - n, ",%.6g", v);
+        }
+        n += snprintf(line_ + n, sizeof(line_) - n, "\r\n");
+        return n;
+    }
+
+    // 二进制格式（小端）：20字节头 "WJKH", u16 版本, u16 保留, u32 通道掩码, u32 起始序号, u32 结束序号；
+    // 每条记录 u32 序号, u32 UTC秒, u32 开机毫秒数, 之后按掩码位顺序每个通道一个 float32
+    size_t renderBinaryHeader() {
+        uint16_t version = HISTORY_BINARY_VERSION;
+        uint16_t reserved = 0;
+        memcpy(line_, "WJKH", 4);
+        memcpy(line_ + 4, &version, 2);
+        memcpy(line_ + 6, &reserved, 2);
+        memcpy(line_ + 8, &mask_, 4);
+        memcpy(line_ + 12, &start_, 4);
+        memcpy(line_ + 16, &end_, 4);
+        return 20;
+    }
+
+    size_t renderBinary(const HistoryRecord& rec) {
+        memcpy(line_, &rec.seq, 4);
+        memcpy(line_ + 4, &rec.epoch, 4);
+        memcpy(line_ + 8, &rec.uptime, 4);
+        size_t n = 12;
+        for (int i = 0; i < HISTORY_CHANNELS; i++) {
+            if (!(mask_ & (1u << i))) continue;
+            float v = channelValue(rec, i);
+            memcpy(line_ + n, &v, 4);
+            n += 4;
+        }
+        return n;
+    }
+
+    Format format_;
+    uint32_t mask_;
+    uint32_t from_;
+    uint32_t to_;
+    uint32_t limit_;
+    uint32_t start_;
+    uint32_t next_;
+    uint32_t end_;
+    HistoryReader reader_;
+    HistoryRecord batch_[HISTORY_READ_BATCH];
+    size_t batchCount_;
+    size_t batchPos_;
+    char line_[320];
+    size_t lineLen_;
+    size_t linePos_;
+    bool headerDone_;
+};
+
+#if METRICS_ENABLED
+void writeHistoryMetrics(Print& out) {
+    out.print("# TYPE esp_history_records gauge\n");
+    out.printf("esp_history_records %u\n",
+        historyNextSeq.load(std::memory_order_relaxed) - historyFirstSeq.load(std::memory_order_relaxed));
+    out.print("# TYPE esp_history_appended_total counter\n");
+    out.printf("esp_history_appended_total %u\n", historyStats.appended);
+    out.print("# TYPE esp_history_append_failed_total counter\n");
+    out.printf("esp_history_append_failed_total %u\n", historyStats.failed);
+    out.print("# TYPE esp_history_exports_total counter\n");
+    out.printf("esp_history_exports_total %u\n", historyStats.exports);
+    out.print("# TYPE esp_history_exported_records_total counter\n");
+    out.printf("esp_history_exported_records_total %u\n", historyStats.exported);
+}
+#endif
+
+#endif
@@ -4,11 +4,13 @@
 #include <Arduino.h>
 #include "types.h"  // 包含共享类型定义
 #include "ws.h"     // 添加这行，包含 AnalogChannel 定义
+#include "mainsfilter.h"
+#include "adaptive.h"
 
 // 声明外部变量
 extern String systemTitle;
-extern RelayChannel relayChannels[4];
-extern AnalogChannel analogChannels[12];  // 现在可以识别 AnalogChannel 类型了
+extern RelayChannel relayChannels[Board::RELAY_CHANNELS];
+extern AnalogChannel analogChannels[Board::ANALOG_CHANNELS];  // 现在可以识别 AnalogChannel 类型了
 
 // Generate the HTML header section
 String generateHeader() {
@@ -379,8 +381,24 @@ String generateHomePage() {
                 background-color: #ccc;
                 cursor: not-allowed;
             }
+            .alarm-item {
+                padding: 8px 12px;
+                margin-bottom: 6px;
+                border-radius: 4px;
+                background-color: #f44336;
+                color: white;
+            }
+            .alarm-item.latched {
+                background-color: #FFA000;
+            }
+            .alarm-item button {
+                float: right;
+            }
         </style>
 
+        <!-- 报警（服务器在状态变化时推送） -->
+        <div id='alarmBar'></div>
+
         <!-- 传感器数据显示区 -->
         <div id='sensorData' class='sensor-container'></div>
 
@@ -390,15 +408,93 @@ String generateHomePage() {
             <!-- 温度数据将通过WebSocket动态更新 -->
         </div>
 
+        <!-- 虚拟通道（没有启用时隐藏） -->
+        <div id='virtualSection' style='display:none'>
+            <h3>虚拟通道</h3>
+            <div id='virtualData' class='sensor-container'></div>
+        </div>
+
         <!-- 继电器控制区域 -->
         <h3>继电器控制</h3>
         <div id='relayControl' class='relay-container'></div>
 
         <script>
-            var ws = new WebSocket('ws://' + window.location.hostname + '/ws');
-            ws.onmessage = function(event) {
+            var ws;
+            var wsNextId = 1;
+            var wsPending = {};   // 等待应答的命令：id -> {resolve, reject, timer}
+
+            // 通过WebSocket发送命令，返回在收到应答后完成的Promise
+            function wsRequest(cmd, params) {
+                return new Promise(function(resolve, reject) {
+                    if (!ws || ws.readyState !== WebSocket.OPEN) {
+                        reject(new Error('WebSocket未连接'));
+                        return;
+                    }
+                    var msg = Object.assign({id: wsNextId++, cmd: cmd}, params || {});
+                    var timer = setTimeout(function() {
+                        delete wsPending[msg.id];
+                        reject(new Error('命令超时'));
+                    }, 5000);
+                    wsPending[msg.id] = {resolve: resolve, reject: reject, timer: timer};
+                    ws.send(JSON.stringify(msg));
+                });
+            }
+
+            function initWebSocket() {
+                ws = new WebSocket('ws://' + window.location.hostname + '/ws');
+                ws.onmessage = onWsMessage;
+                ws.onopen = loadAlarms;
+
+                // 处理WebSocket连错误
+                ws.onerror = function(error) {
+                    console.error('WebSocket错误:', error);
+                };
+
+                // 处理WebSocket连接关闭
+                ws.onclose = function() {
+                    console.log('WebSocket连接已关闭');
+                    // 未完成的命令全部失败
+                    Object.keys(wsPending).forEach(function(id) {
+                        clearTimeout(wsPending[id].timer);
+                        wsPending[id].reject(new Error('WebSocket连接已关闭'));
+                        delete wsPending[id];
+                    });
+                    // 尝试重新连接
+                    setTimeout(function() {
+                        console.log('尝试重新连接...');
+                        initWebSocket();
+                    }, 5000);
+                };
+            }
+
+            function onWsMessage(event) {
                 try {
                     var data = JSON.parse(event.data);
+
+                    // 命令应答
+                    if(data.type === 'resp') {
+                        var pending = wsPending[data.id];
+                        if(pending) {
+                            clearTimeout(pending.timer);
+                            delete wsPending[data.id];
+                            if(data.ok) pending.resolve(data.data);
+                            else pending.reject(new Error(data.error));
+                        }
+                        return;
+                    }
+
+                    // 继电器状态推送（连接时和每次状态变化时）
+                    if(data.type === 'relays') {
+                        renderRelays(data.relays);
+                        return;
+                    }
+
+                    // 报警状态变化
+                    if(data.type === 'alarm') {
+                        alarms[data.channel] = data;
+                        renderAlarms();
+                        return;
+                    }
                     
                     // 处理模拟量数据
                     if(data.values) {
@@ -409,12 +505,16 @@ String generateHomePage() {
                             var sensorDiv = document.createElement('div');
                             sensorDiv.className = 'sensor-card';
                             
-                            // 计算实际的GPIO编号
-                            var gpioNum = sensor.channel < 8 ? sensor.channel + 1 : sensor.channel + 7;
+                            // 实际的GPIO编号由设备按板级配置给出
+                            var gpioNum = sensor.gpio;
+
+                            // 读取失败时值无效（null），长时间没有新采样时标记过期
+                            var valueText = sensor.valid ? sensor.value.toFixed(2) + ' ' + sensor.unit : '--';
+                            if (sensor.stale) valueText += ' (过期)';
                             
                             var html = `
                                 <div class="sensor-name">${sensor.name}</div>
-                                <div class="sensor-value">${sensor.value.toFixed(2)} ${sensor.unit}</div>
+                                <div class="sensor-value">${valueText}</div>
                                 <div class="sensor-details">
                                     GPIO${gpioNum}<br>
                                     原始电压: ${sensor.rawVoltage.toFixed(3)}V<br>
@@ -462,80 +562,105 @@ String generateHomePage() {
                             }
                         }
                     }
+
+                    // 虚拟通道
+                    if(data.virtual) {
+                        document.getElementById('virtualSection').style.display = data.virtual.length ? '' : 'none';
+                        var virtualContainer = document.getElementById('virtualData');
+                        virtualContainer.innerHTML = '';
+                        data.virtual.forEach(function(v) {
+                            var virtualDiv = document.createElement('div');
+                            virtualDiv.className = 'sensor-card';
+                            virtualDiv.innerHTML = `
+                                <div class="sensor-name">${v.name}</div>
+                                <div class="sensor-value">${v.valid ? v.value.toFixed(2) + ' ' + v.unit : '--'}</div>
+                                <div class="sensor-details">v${v.index}</div>
+                            `;
+                            virtualContainer.appendChild(virtualDiv);
+                        });
+                    }
                 } catch(e) {
                     console.error('Error parsing WebSocket message:', e);
                 }
-            };
-
-            // 处理WebSocket连错误
-            ws.onerror = function(error) {
-                console.error('WebSocket错误:', error);
-            };
-
-            // 处理WebSocket连接关闭
-            ws.onclose = function() {
-                console.log('WebSocket连接已关闭');
-                // 尝试重新连接
-                setTimeout(function() {
-                    console.log('尝试重新连接...');
-                    ws = new WebSocket('ws://' + window.location.hostname + '/ws');
-                }, 5000);
-            };
+            }
 
-            // 更新继电器UI的函数
-            function updateRelayUI() {
-                fetch('/get_relay_status')
-                    .then(function(response) { return response.json(); })
-                    .then(function(data) {
-                        var container = document.getElementById('relayControl');
-                        container.innerHTML = '';
-                        
-                        data.relays.forEach(function(relay, index) {
-                            var div = document.createElement('div');
-                            div.className = 'relay-card';
-                            
-                            // 获取对应的GPIO编号
-                            var gpioNum;
-                            switch(index) {
-                                case 0: gpioNum = 21; break;  // 继电器1 - GPIO21
-                                case 1: gpioNum = 45; break;  // 继电器2 - GPIO45
-                                case 2: gpioNum = 47; break;  // 继电器3 - GPIO47
-                                case 3: gpioNum = 48; break;  // 继电器4 - GPIO48
-                                default: gpioNum = relay.gpio; break;
-                            }
-                            
-                            var buttonClass = relay.mode === 0 ? 
-                                (relay.state ? 'relay-on' : 'relay-off') : 
-                                'relay-disabled';
-                            
-                            var buttonDisabled = relay.mode === 1 ? ' disabled' : '';
-                            var buttonText = relay.state ? '关���' : '启动';
-                            
-                            div.innerHTML = 
-                                "<div class=\"relay-name\">" + relay.name + "</div>" +
-                                "<div class=\"gpio-info\">GPIO" + gpioNum + "</div>" +
-                                (relay.mode === 1 ? 
-                                    "<div class=\"auto-info\">" +
-                                    "循环次数: " + (relay.currentCycles || 0) + "/" + (relay.maxCycles || 0) + "<br>" +
-                                    "开时间: " + ((relay.onTime || 0)/1000).toFixed(1) + "秒<br>" +
-                                    "关位时间: " + ((relay.offTime || 0)/1000).toFixed(1) + "秒" +
-                                    "</div>" : "") +
-                                "<div class=\"button-group\">" +
-                                "<button class=\"relay-button " + buttonClass + "\"" +
-                                " onclick=\"toggleRelay(" + index + ")\"" +
-                                (relay.mode === 1 ? ' disabled' : '') + ">" +
-                                buttonText +
-                                "</button>" +
-                                (relay.mode === 1 ? 
-                                    "<button class=\"auto-control-btn" + (relay.autoRunning ? ' running' : '') + "\"" +
-                                    " onclick=\"toggleAutoRun(" + index + ")\">" +
-                                    (relay.autoRunning ? '止' : '运行') +
-                                    "</button>" : "") +
-                                "</div>";
-                            
-                            container.appendChild(div);
-                        });
-                    });
+            var alarms = {};   // 通道 -> 最近的报警状态
+
+            function loadAlarms() {
+                wsRequest('get_alarms').then(function(data) {
+                    alarms = {};
+                    data.alarms.forEach(function(a) { alarms[a.channel] = a; });
+                    renderAlarms();
+                }).catch(function(e) { console.error('读取报警失败:', e); });
+            }
+
+            function ackAlarm(channel) {
+                wsRequest('alarm_ack', {channel: channel}).catch(function(e) { alert('确认失败: ' + e.message); });
+            }
+
+            function renderAlarms() {
+                var bar = document.getElementById('alarmBar');
+                bar.innerHTML = '';
+                Object.keys(alarms).forEach(function(channel) {
+                    var a = alarms[channel];
+                    if (!a.active.length && !a.latched.length && !a.unacked.length) return;
+                    var div = document.createElement('div');
+                    div.className = 'alarm-item' + (a.active.length ? '' : ' latched');
+                    var value = a.value === null ? '--' : a.value.toFixed(2);
+                    div.textContent = a.name + ' ' + a.active.concat(a.latched).join('/') + ' ' + value;
+                    if (a.unacked.length) {
+                        var button = document.createElement('button');
+                        button.textContent = '确认';
+                        button.onclick = function() { ackAlarm(channel); };
+                        div.appendChild(button);
+                    }
+                    bar.appendChild(div);
+                });
+            }
+
+            // 根据服务器推送的状态更新继电器UI
+            function renderRelays(relays) {
+                var container = document.getElementById('relayControl');
+                container.innerHTML = '';
+                
+                relays.forEach(function(relay, index) {
+                    var div = document.createElement('div');
+                    div.className = 'relay-card';
+                    
+                    // 输出位置（GPIO 或扩展芯片的引脚）
+                    var pin = relay.pin;
+                    
+                    var buttonClass = relay.mode === 0 ? 
+                        (relay.state ? 'relay-on' : 'relay-off') : 
+                        'relay-disabled';
+                    
+                    var buttonDisabled = relay.mode === 1 ? ' disabled' : '';
+                    var buttonText = relay.state ? '关���' : '启动';
+                    
+                    div.innerHTML = 
+                        "<div class=\"relay-name\">" + relay.name + "</div>" +
+                        "<div class=\"gpio-info\">" + pin + "</div>" +
+                        (relay.mode === 1 ? 
+                            "<div class=\"auto-info\">" +
+                            "循环次数: " + (relay.currentCycles || 0) + "/" + (relay.maxCycles || 0) + "<br>" +
+                            "开时间: " + ((relay.onTime || 0)/1000).toFixed(1) + "秒<br>" +
+                            "关位时间: " + ((relay.offTime || 0)/1000).toFixed(1) + "秒" +
+                            "</div>" : "") +
+                        "<div class=\"button-group\">" +
+                        "<button class=\"relay-button " + buttonClass + "\"" +
+                        " onclick=\"toggleRelay(" + index + ")\"" +
+                        (relay.mode === 1 ? ' disabled' : '') + ">" +
+                        buttonText +
+                        "</button>" +
+                        (relay.mode === 1 ? 
+                            "<button class=\"auto-control-btn" + (relay.autoRunning ? ' running' : '') + "\"" +
+                            " onclick=\"toggleAutoRun(" + index + ")\">" +
+                            (relay.autoRunning ? '止' : '运行') +
+                            "</button>" : "") +
+                        "</div>";
+                    
+                    container.appendChild(div);
+                });
             }
             
             // 切换继电器态
@@ -544,24 +669,15 @@ String generateHomePage() {
                 var button = buttons[channel];
                 var newState = button.classList.contains('relay-off') ? 1 : 0;
                 
-                fetch('/relay/set', {
-                    method: 'POST',
-                    headers: {
-                        'Content-Type': 'application/x-www-form-urlencoded',
-                    },
-                    body: 'channel=' + channel + '&state=' + newState
-                })
-                .then(function(response) { return response.text(); })
-                .then(function(result) {
-                    if(result === 'OK') {
-                        updateRelayUI();
-                    }
+                // 新状态由服务器推送，不需要再查询
+                wsRequest('relay_set', {channel: channel, state: newState})
+                .catch(function(error) {
+                    console.error('继电器控制失败:', error);
                 });
             }
             
-            // 页面加载完成后开定时更新
-            setInterval(updateRelayUI, 1000);
-            updateRelayUI();
+            // 继电器状态在连接建立时由服务器推送
+            initWebSocket();
 
             // 在 generateHomePage 添加 toggleAutoRun 函数
             function toggleAutoRun(channel) {
@@ -569,21 +685,7 @@ String generateHomePage() {
                 var button = buttons[channel];
                 var running = !button.classList.contains('running');
                 
-                fetch('/relay/auto_control', {
-                    method: 'POST',
-                    headers: {
-                        'Content-Type': 'application/x-www-form-urlencoded',
-                    },
-                    body: 'channel=' + channel + '&running=' + (running ? '1' : '0')
-                })
-                .then(function(response) { return response.text(); })
-                .then(function(result) {
-                    if(result === 'OK') {
-                        updateRelayUI();
-                    } else {
-                        alert('操作失败');
-                    }
-                })
+                wsRequest('relay_auto', {channel: channel, running: running ? 1 : 0})
                 .catch(function(error) {
                     console.error('自动控制失败:', error);
                     alert('操作失败');
@@ -612,6 +714,30 @@ String generateWiFiPage(bool connected, String ssid, String ip) {
     html += "<button onclick='saveTitle()' class='save-btn'>存标题</button>";
     html += "</div>";
     html += "</div>";
+
+    // MQTT 设置
+    html += R"(
+        <div class='settings-section'>
+            <h3>MQTT</h3>
+            <p><label><input type='checkbox' id='mqttEnabled'> 启用</label></p>
+            <p><label>代理地址:</label><br><input type='text' id='mqttHost'></p>
+            <p><label>端口:</label><br><input type='number' id='mqttPort' value='1883'></p>
+            <p><label>用户名:</label><br><input type='text' id='mqttUser'></p>
+            <p><label>密码（留空不修改）:</label><br><input type='password' id='mqttPass'></p>
+            <p><label>主题前缀（留空自动生成）:</label><br><input type='text' id='mqttBase'></p>
+            <p><label>发布间隔(ms):</label><br><input type='number' id='mqttInterval' value='5000' min='200'></p>
+            <p><label><input type='checkbox' id='mqttBatch' checked> 批量发布（所有通道合并为一条消息）</label></p>
+            <button onclick='saveMqtt()' class='save-btn'>保存MQTT设置</button>
+        </div>
+        <div class='settings-section'>
+            <h3>历史数据导出</h3>
+            <p><label>格式:</label><br><select id='exportFormat'><option value='csv'>CSV</option><option value='bin'>二进制</option></select></p>
+            <p><label>通道（如 0,1,t0，留空为全部）:</label><br><input type='text' id='exportChannels'></p>
+            <p><label>开始时间:</label><br><input type='datetime-local' id='exportFrom'></p>
+            <p><label>结束时间:</label><br><input type='datetime-local' id='exportTo'></p>
+            <button onclick='exportHistory()' class='save-btn'>下载</button>
+        </div>
+    )";
     html += "</div>";
 
     // 右列：WiFi 设置
@@ -692,7 +818,7 @@ String generateWiFiPage(bool connected, String ssid, String ip) {
             .save-btn:hover, .connect-btn:hover {
                 background-color: #45a049;
             }
-            input[type="text"], input[type="password"] {
+            input[type="text"], input[type="password"], input[type="number"] {
                 width: 100%;
                 padding: 8px;
                 margin: 5px 0;
@@ -732,6 +858,59 @@ String generateWiFiPage(bool connected, String ssid, String ip) {
                     });
             }
 
+            function loadMqtt() {
+                fetch('/get_mqtt_config')
+                    .then(function(response) { return response.json(); })
+                    .then(function(cfg) {
+                        document.getElementById('mqttEnabled').checked = cfg.enabled;
+                        document.getElementById('mqttHost').value = cfg.host;
+                        document.getElementById('mqttPort').value = cfg.port;
+                        document.getElementById('mqttUser').value = cfg.user;
+                        document.getElementById('mqttBase').value = cfg.baseTopic;
+                        document.getElementById('mqttInterval').value = cfg.interval;
+                        document.getElementById('mqttBatch').checked = cfg.batch;
+                    });
+            }
+
+            function saveMqtt() {
+                var cfg = {
+                    enabled: document.getElementById('mqttEnabled').checked,
+                    host: document.getElementById('mqttHost').value.trim(),
+                    port: parseInt(document.getElementById('mqttPort').value) || 1883,
+                    user: document.getElementById('mqttUser').value,
+                    pass: document.getElementById('mqttPass').value,
+                    baseTopic: document.getElementById('mqttBase').value.trim(),
+                    interval: parseInt(document.getElementById('mqttInterval').value) || 5000,
+                    batch: document.getElementById('mqttBatch').checked
+                };
+                fetch('/save_mqtt_config', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify(cfg)
+                })
+                .then(function(response) { return response.text(); })
+                .then(function(result) {
+                    alert(result === 'OK' ? 'MQTT设置已保存' : '保存失败');
+                })
+                .catch(function(error) {
+                    alert('保存失败: ' + error);
+                });
+            }
+
+            // 由浏览器直接下载，设备分块发送，页面不需要等待
+            function exportHistory() {
+                var params = ['format=' + document.getElementById('exportFormat').value];
+                var channels = document.getElementById('exportChannels').value.replace(/\s/g, '');
+                if (channels) params.push('channels=' + encodeURIComponent(channels));
+                var from = document.getElementById('exportFrom').value;
+                var to = document.getElementById('exportTo').value;
+                if (from) params.push('from=' + Math.floor(new Date(from).getTime() / 1000));
+                if (to) params.push('to=' + Math.floor(new Date(to).getTime() / 1000));
+                window.location = '/export?' + params.join('&');
+            }
+
+            loadMqtt();
+
             function saveTitle() {
                 var newTitle = document.getElementById('titleInput').value;
                 if(newTitle.trim() === '') {
@@ -837,7 +1016,7 @@ String generateAnalogConfigPage() {
                 margin-bottom: 3px;
                 font-size: 0.9em;
             }
-            .input-row input {
+            .input-row input, .input-row select {
                 width: 100%;
                 padding: 4px;
                 border: 1px solid #ddd;
@@ -925,10 +1104,10 @@ String generateAnalogConfigPage() {
         <div class="config-container">
     )";
 
-    // 生成12个通道的配置卡片
-    for (int i = 0; i < 12; i++) {  // 从8改为12
-        // 计算实际的GPIO编号
-        int gpioNum = i < 8 ? i + 1 : i + 7;  // GPIO1-8, GPIO15-18
+    // 生成每个通道的配置卡片
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        // 实际的GPIO编号
+        int gpioNum = Board::analogGpio(i);
         
         html += "<div class='channel-card'>";
         html += "<div class='channel-header'>";
@@ -941,6 +1120,46 @@ String generateAnalogConfigPage() {
         html += "<label>名称:</label>";
         html += "<input type='text' id='name" + String(i) + "' placeholder='传感器 " + String(i + 1) + "'>";
         html += "</div>";
+
+        // 采样后端和外部ADC输入号在同一行
+        html += "<div class='input-row'>";
+        html += "<div>";
+        html += "<label>采样:</label>";
+        html += "<select id='backend" + String(i) + "' onchange='updateBackendInputs(" + String(i) + ")'>";
+        html += "<option value='0'>内部ADC (GPIO" + String(gpioNum) + ")</option>";
+        html += "<option value='1'>ADS1115</option>";
+        html += "<option value='2'>ADS1256</option>";
+        html += "</select>";
+        html += "</div>";
+        html += "<div>";
+        html += "<label>输入:</label>";
+        html += "<select id='input" + String(i) + "' disabled>";
+        for (int j = 0; j < ADS1256_INPUTS; j++) {
+            html += "<option value='" + String(j) + "'>AIN" + String(j) + "</option>";
+        }
+        html += "</select>";
+        html += "</div>";
+        html += "</div>";
+
+        // 工频抑制（只有内部 ADC1 通道可用）
+        html += "<div class='input-row'>";
+        html += "<div>";
+        html += "<label>工频抑制:</label>";
+        html += "<select id='mains" + String(i) + "' data-adc2='" + String(Board::analogAdcUnit(i) == 2 ? 1 : 0) + "'>";
+        html += "<option value='0'>关闭</option>";
+        html += "<option value='1'>周期积分</option>";
+        html += "<option value='2'>陷波</option>";
+        html += "</select>";
+        html += "</div>";
+        html += "<div>";
+        html += "<label>频率:</label>";
+        html += "<select id='mainsHz" + String(i) + "'><option value='50'>50Hz</option><option value='60'>60Hz</option></select>";
+        html += "</div>";
+        html += "<div>";
+        html += "<label>积分周期:</label>";
+        html += "<input type='number' id='mainsCycles" + String(i) + "' min='1' max='" + String(MAINS_MAX_CYCLES) + "' value='1'>";
+        html += "</div>";
+        html += "</div>";
         
         // 单位限幅值和补偿值在同一行
         html += "<div class='input-row'>";
@@ -952,7 +1171,7 @@ String generateAnalogConfigPage() {
         // 限幅值
         html += "<div>";
         html += "<label>限幅滤波值:</label>";
-        html += "<input type='number' id='filter" + String(i) + "' min='0' max='200' value='20' class='filter-input' onchange='updateFilterLimit(" + String(i) + ")'>";
+        html += "<input type='number' id='filter" + String(i) + "' min='1' max='200' value='20' class='filter-input' onchange='updateFilterLimit(" + String(i) + ")'>";
         html += "</div>";
         // 补偿值
         html += "<div>";
@@ -962,13 +1181,26 @@ String generateAnalogConfigPage() {
         html += "</div>";
 
         // 限幅值范围说明单独一行
-        html += "<div class='help-text'>限幅滤波范围：0-200，默认：20。当前值与上次值之差大于此值时才更新，建议根据实波动情况调整</div>";
+        html += "<div class='help-text'>限幅滤波范围：1-200，默认：20。当前值与上次值之差大于此值时才更新，建议根据实波动情况调整</div>";
+
+        // 自适应采样间隔
+        html += "<div class='input-row'>";
+        html += "<div>";
+        html += "<label>最短采样间隔(ms):</label>";
+        html += "<input type='number' id='sampleMin" + String(i) + "' min='" + String(ADAPTIVE_TICK_MS) + "' max='" + String(ADAPTIVE_MAX_INTERVAL) + "' step='" + String(ADAPTIVE_TICK_MS) + "' value='" + String(ADAPTIVE_TICK_MS) + "'>";
+        html += "</div>";
+        html += "<div>";
+        html += "<label>最长采样间隔(ms):</label>";
+        html += "<input type='number' id='sampleMax" + String(i) + "' min='" + String(ADAPTIVE_TICK_MS) + "' max='" + String(ADAPTIVE_MAX_INTERVAL) + "' step='" + String(ADAPTIVE_TICK_MS) + "' value='" + String(ADAPTIVE_TICK_MS) + "'>";
+        html += "</div>";
+        html += "</div>";
+        html += "<div class='help-text'>差值超过限幅值时按最短间隔采样，平稳时逐步放慢到最长间隔，MQTT 发布随之放慢；两者相同时为固定间隔</div>";
 
         // 差值显示独一行
         html += "<div class='diff-value' id='diff" + String(i) + "'>当前差值: 0</div>";
 
         // 压值范围提示
-        html += "<div class='voltage-note'>⚠️ 电压值范围：0-3.0V (注意：3.0V以上为ADC死区)</div>";
+        html += "<div class='voltage-note'>⚠️ 电压值范围：内部ADC 0-3.0V (注意：3.0V以上为ADC死区)；ADS1115 0-3.3V，ADS1256 0-5V</div>";
         
         // 校准点表格
         html += "<table class='calibration-table'>";
@@ -1009,7 +1241,9 @@ String generateAnalogConfigPage() {
 
     html += "</div>";  // 结束 config-container
 
-    // 添加接线指导说明
+    html += "<div class='button-group'><button type='button' class='save-btn' onclick='saveAllChannels()'>保存全部通道</button></div>";
+
+    // 添加接线指导说明，GPIO分配表按板级配置生成
     html += R"(
         <div class="wiring-guide">
             <h3>接线指导说明</h3>
@@ -1019,13 +1253,14 @@ String generateAnalogConfigPage() {
                 <h4>GPIO通道分配:</h4>
                 <table class="gpio-table">
                     <tr><th>通道号</th><th>GPIO</th></tr>
-                    <tr><td>通道1-8</td><td>GPIO1-8</td></tr>
-                    <tr><td>通道9</td><td>GPIO15</td></tr>
-                    <tr><td>通道10</td><td>GPIO16</td></tr>
-                    <tr><td>通道11</td><td>GPIO17</td></tr>
-                    <tr><td>通道12</td><td>GPIO18</td></tr>
+    )";
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        html += "<tr><td>通道" + String(i + 1) + "</td><td>GPIO" + String(Board::analogGpio(i)) +
+                (Board::analogAdcUnit(i) == 2 ? " (ADC2)" : "") + "</td></tr>";
+    }
+    html += R"(
                 </table>
-                <p class="note">注意：GPIO9-14未使用请勿接线到这些引脚。</p>
+                <p class="note">注意：只接线到上表列出的引脚；ADC2 的引脚在 WiFi 工作时可能读取失败。</p>
             </div>
 
             <style>
@@ -1156,6 +1391,21 @@ String generateAnalogConfigPage() {
         <script>
             // 全局 WebSocket 变量
             var ws;
+            var wsNextId = 1;
+            var wsPending = {};   // 等待应答的命令：id -> {resolve, reject}
+
+            // 通过WebSocket发送命令，返回在收到应答后完成的Promise
+            function wsRequest(cmd, params) {
+                return new Promise(function(resolve, reject) {
+                    if (!ws || ws.readyState !== WebSocket.OPEN) {
+                        reject(new Error('WebSocket未连接'));
+                        return;
+                    }
+                    var msg = Object.assign({id: wsNextId++, cmd: cmd}, params || {});
+                    wsPending[msg.id] = {resolve: resolve, reject: reject};
+                    ws.send(JSON.stringify(msg));
+                });
+            }
             
             // WebSocket 连函数
             function initWebSocket() {
@@ -1164,12 +1414,21 @@ String generateAnalogConfigPage() {
                     ws.onmessage = function(event) {
                         try {
                             var data = JSON.parse(event.data);
+                            if(data.type === 'resp') {
+                                var pending = wsPending[data.id];
+                                if(pending) {
+                                    delete wsPending[data.id];
+                                    if(data.ok) pending.resolve(data.data);
+                                    else pending.reject(new Error(data.error));
+                                }
+                                return;
+                            }
                             if(data.values) {
                                 data.values.forEach(function(channel) {
                                     // 更新差值显示
                                     var diffSpan = document.getElementById('diff' + channel.channel);
                                     if(diffSpan) {
-                                        diffSpan.textContent = '当前差值: ' + channel.difference;
+                                        diffSpan.textContent = '当前差值: ' + channel.difference + '  实时采样: ' + channel.sample + '  采样间隔: ' + channel.interval + 'ms';
                                         console.log('Channel ' + channel.channel + ' difference: ' + channel.difference);
                                     }
                                 });
@@ -1179,8 +1438,19 @@ String generateAnalogConfigPage() {
                         }
                     };
                     
+                    // 调试限幅和补偿时需要更快的更新，服务器会限制在采样速率以内
+                    ws.onopen = function() {
+                        wsRequest('set_rate', {hz: 20}).catch(function(error) {
+                            console.error('Failed to set update rate:', error);
+                        });
+                    };
+
                     ws.onclose = function() {
                         console.log('WebSocket disconnected');
+                        Object.keys(wsPending).forEach(function(id) {
+                            wsPending[id].reject(new Error('WebSocket disconnected'));
+                            delete wsPending[id];
+                        });
                         setTimeout(initWebSocket, 2000);
                     };
                 }
@@ -1197,6 +1467,14 @@ String generateAnalogConfigPage() {
                             document.getElementById('unit' + i).value = channel.unit;
                             document.getElementById('filter' + i).value = channel.filterLimit;
                             document.getElementById('comp' + i).value = channel.compensation || 0;
+                            document.getElementById('backend' + i).value = channel.backend || 0;
+                            document.getElementById('input' + i).value = channel.input || 0;
+                            document.getElementById('mains' + i).value = channel.mains || 0;
+                            document.getElementById('mainsHz' + i).value = channel.mainsHz || 50;
+                            document.getElementById('mainsCycles' + i).value = channel.mainsCycles || 1;
+                            document.getElementById('sampleMin' + i).value = channel.sampleMin || 200;
+                            document.getElementById('sampleMax' + i).value = channel.sampleMax || 200;
+                            updateBackendInputs(i);
                             
                             // 填充校准点数据
                             channel.calibPoints.forEach((point, j) => {
@@ -1212,9 +1490,22 @@ String generateAnalogConfigPage() {
                     });
             }
 
-            // 修改保存通道配置函数
-            function saveChannelConfig(channelIndex) {
-                var config = [];
+            // 按采样后端限制可选的输入：ADS1115 为 AIN0-3，ADS1256 为 AIN0-7，内部ADC不需要选择
+            function updateBackendInputs(channelIndex) {
+                var backend = parseInt(document.getElementById('backend' + channelIndex).value);
+                var input = document.getElementById('input' + channelIndex);
+                var count = backend === 1 ? )" + String(ADS1115_INPUTS) + R"( : backend === 2 ? )" + String(ADS1256_INPUTS) + R"( : 0;
+                input.disabled = count === 0;
+                for (var j = 0; j < input.options.length; j++) input.options[j].disabled = j >= count;
+                if (count && input.selectedIndex >= count) input.selectedIndex = 0;
+                // 工频抑制只用于内部 ADC1 通道
+                var mains = document.getElementById('mains' + channelIndex);
+                mains.disabled = backend !== 0 || mains.dataset.adc2 === '1';
+                if (mains.disabled) mains.value = 0;
+            }
+
+            // 读取页面上一个通道的配置
+            function collectChannelConfig(channelIndex) {
                 var channelConfig = {
                     channel: channelIndex,
                     enabled: document.getElementById('enable' + channelIndex).checked,
@@ -1222,6 +1513,13 @@ String generateAnalogConfigPage() {
                     unit: document.getElementById('unit' + channelIndex).value || '单位',
                     filterLimit: parseInt(document.getElementById('filter' + channelIndex).value) || 20,
                     compensation: parseFloat(document.getElementById('comp' + channelIndex).value) || 0,
+                    backend: parseInt(document.getElementById('backend' + channelIndex).value) || 0,
+                    input: parseInt(document.getElementById('input' + channelIndex).value) || 0,
+                    mains: parseInt(document.getElementById('mains' + channelIndex).value) || 0,
+                    mainsHz: parseInt(document.getElementById('mainsHz' + channelIndex).value) || 50,
+                    mainsCycles: parseInt(document.getElementById('mainsCycles' + channelIndex).value) || 1,
+                    sampleMin: parseInt(document.getElementById('sampleMin' + channelIndex).value) || 200,
+                    sampleMax: parseInt(document.getElementById('sampleMax' + channelIndex).value) || 200,
                     calibPoints: []
                 };
 
@@ -1237,7 +1535,12 @@ String generateAnalogConfigPage() {
                     }
                 }
 
-                config.push(channelConfig);
+                return channelConfig;
+            }
+
+            // 修改保存通道配置函数
+            function saveChannelConfig(channelIndex) {
+                var config = [collectChannelConfig(channelIndex)];
 
                 fetch('/save_analog_config', {
                     method: 'POST',
@@ -1255,6 +1558,26 @@ String generateAnalogConfigPage() {
                 });
             }
 
+            // 所有通道一次提交，设备全部校验通过后才应用并只写一次配置文件
+            function saveAllChannels() {
+                var config = [];
+                for (var i = 0; i < )" + String(Board::ANALOG_CHANNELS) + R"(; i++) config.push(collectChannelConfig(i));
+
+                fetch('/save_analog_config', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({config: config})
+                })
+                .then(response => {
+                    alert(response.ok ? '全部通道配置已保存' : '保存失败，配置未修改');
+                    loadConfig();
+                })
+                .catch(error => {
+                    console.error('Save error:', error);
+                    loadConfig();
+                });
+            }
+
             // 切换显示额外的校准点
             function toggleExtraPoints(channelIndex) {
                 const extraPoints = document.querySelectorAll('#extra' + channelIndex);
@@ -1277,21 +1600,9 @@ String generateAnalogConfigPage() {
                 if (limit > 200) limit = 200;
                 document.getElementById('filter' + channelIndex).value = limit;
                 
-                fetch('/save_filter_limit', {
-                    method: 'POST',
-                    headers: {
-                        'Content-Type': 'application/x-www-form-urlencoded',
-                    },
-                    body: 'channel=' + channelIndex + '&limit=' + limit
-                })
-                .then(response => response.text())
-                .then(result => {
-                    if(result !== 'OK') {
-                        console.error('Failed to update filter limit');
-                    }
-                })
+                wsRequest('save_filter_limit', {channel: channelIndex, limit: limit})
                 .catch(error => {
-                    console.error('Error:', error);
+                    console.error('Failed to update filter limit:', error);
                 });
             }
 
@@ -1392,15 +1703,10 @@ String generateRelayConfigPage() {
         <div class="config-container">
     )";
 
-    for(int i = 0; i < 4; i++) {
-        // 获取对应的GPIO编号
-        int gpioNum;
-        switch(i) {
-            case 0: gpioNum = 21; break;  // 继电器1 - GPIO21
-            case 1: gpioNum = 45; break;  // 继电器2 - GPIO45
-            case 2: gpioNum = 47; break;  // 继电器3 - GPIO47
-            case 3: gpioNum = 48; break;  // 继电器4 - GPIO48
-        }
+    for(int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        // 输出位置（GPIO 或扩展芯片的引脚）
+        char pin[32];
+        relayOutputLabel(i, pin, sizeof(pin));
 
         html += "<div class='relay-card'>";
         html += "<div class='relay-header'>";
@@ -1410,7 +1716,7 @@ String generateRelayConfigPage() {
         html += "<div class='form-group'>";
         html += "<label>名称:</label>";
         html += "<input type='text' id='name" + String(i) + "' placeholder='继电器 " + String(i + 1) + "'>";
-        html += "<div class='gpio-note'>GPIO" + String(gpioNum) + "</div>";
+        html += "<div class='gpio-note'>" + String(pin) + "</div>";
         html += "</div>";
         
         html += "<div class='form-group'>";
@@ -1565,10 +1871,10 @@ String generateTempConfigPage() {
         <div class="temp-container">
     )";
 
-    // 生成两个温度传感器的配置卡片
-    for(int i = 0; i < 2; i++) {
+    // 生成每个温度传感器的配置卡片
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
         // 获取对应的 CS 引脚
-        int csPin = (i == 0) ? 10 : 39;  // 传感器1用GPIO10，传感器2用GPIO39
+        int csPin = Board::tempCsGpio(i);
         
         html += "<div class='temp-card'>";
         html += "<h3>温度传感器 " + String(i + 1) + " (CS" + String(i + 1) + ": GPIO" + String(csPin) + ")</h3>";
@@ -1599,9 +1905,9 @@ String generateTempConfigPage() {
         html += "<tr><th>信号</th><th>GPIO</th><th>说明</th></tr>";
         html += "<tr><td>VIN</td><td>3.3V</td><td>供电电压</td></tr>";
         html += "<tr><td>GND</td><td>GND</td><td>接地</td></tr>";
-        html += "<tr><td>SCK</td><td>GPIO12</td><td>SPI时钟信号</td></tr>";
-        html += "<tr><td>SDO</td><td>GPIO13</td><td>SPI数据输出(MISO)</td></tr>";
-        html += "<tr><td>SDI</td><td>GPIO11</td><td>SPI数据输入(MOSI)</td></tr>";
+        html += "<tr><td>SCK</td><td>GPIO" + String(Board::SPI_SCK_GPIO) + "</td><td>SPI时钟信号</td></tr>";
+        html += "<tr><td>SDO</td><td>GPIO" + String(Board::SPI_MISO_GPIO) + "</td><td>SPI数据输出(MISO)</td></tr>";
+        html += "<tr><td>SDI</td><td>GPIO" + String(Board::SPI_MOSI_GPIO) + "</td><td>SPI数据输入(MOSI)</td></tr>";
         html += "<tr><td>CS" + String(i + 1) + "</td><td>GPIO" + String(csPin) + "</td><td>传感器" + String(i + 1) + "片选</td></tr>";
         html += "</table>";
         
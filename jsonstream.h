@@ -0,0 +1,136 @@
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#include <Arduino.h>
+
+// 流式拆分JSON数组：请求体分几次到达时逐段喂入，每凑齐数组中的一个对象元素就回调一次，
+// 由回调用小文档解析该元素。只缓存当前元素，内存占用与请求体大小和元素个数无关。
+//
+// 处理请求体中出现的第一个数组，可以是顶层数组 [{...},{...}]，
+// 也可以是顶层对象的成员 {"config":[{...},{...}]}。
+//
+// 结构体不含构造和析构，可以直接用 calloc 分配后放在 request->_tempObject 中
+// （请求结束时由 AsyncWebServer 用 free 释放）。
+
+#define JSON_STREAM_ELEMENT_MAX 1024   // 单个元素的最大长度
+
+// 返回 false 时停止解析并报错；json 以 '\0' 结尾，回调可以原地修改
+typedef bool (*JsonElementHandler)(char* json, size_t len, void* context);
+
+struct JsonArrayStream {
+    char element[JSON_STREAM_ELEMENT_MAX];
+    size_t length;            // 当前元素已缓存的长度
+    uint8_t depth;            // 当前嵌套层数
+    uint8_t arrayDepth;       // 元素所在的层数，0 表示还没遇到数组
+    bool capturing;           // 正在缓存元素
+    bool inString;
+    bool escape;
+    bool error;
+    uint16_t count;           // 已回调的元素数
+
+    // 喂入一段数据，出错后忽略后续数据
+    void feed(const uint8_t* data, size_t len, JsonElementHandler handler, void* context) {
+        for (size_t i = 0; i < len && !error; i++) {
+            char c = (char)data[i];
+
+            if (inString) {
+                append(c);
+                if (escape) {
+                    escape = false;
+                } else if (c == '\\') {
+                    escape = true;
+                } else if (c == '"') {
+                    inString = false;
+                }
+                continue;
+            }
+
+            switch (c) {
+                case '"':
+                    inString = true;
+                    append(c);
+                    break;
+
+                case '[':
+                case '{':
+                    if (depth == 255) {
+                        error = true;
+                        break;
+                    }
+                    if (arrayDepth == 0 && c == '[' && depth <= 1) {
+                        arrayDepth = ++depth;
+                        break;
+                    }
+                    if (arrayDepth && depth == arrayDepth && !capturing) {
+                        if (c != '{') {
+                            error = true;  // 元素只能是对象
+                            break;
+                        }
+                        capturing = true;
+                        length = 0;
+                    }
+                    append(c);
+                    depth++;
+                    break;
+
+                case ']':
+                case '}':
+                    if (depth == 0) {
+                        error = true;
+                        break;
+                    }
+                    depth--;
+                    if (capturing) {
+                        append(c);
+                        if (depth == arrayDepth && !error) {
+                            capturing = false;
+                            element[length] = '\0';
+                            count++;
+                            if (!handler(element, length, context)) error = true;
+                        }
+                    }
+                    break;
+
+                default:
+                    append(c);
+                    break;
+            }
+        }
+    }
+
+    // 请求体全部到达后调用：遇到过数组且括号完整
+    bool finished() const {
+        return !error && arrayDepth && depth == 0 && !inString;
+    }
+
+private:
+    void append(char c) {
+        if (!capturing) return;
+        if (length + 1 >= JSON_STREAM_ELEMENT_MAX) {
+            error = true;
+            return;
+        }
+        element[length++] = c;
+    }
+};
+
+// 整体缓存请求体：请求体是一个对象、需要整体解析时使用，分段到达时依次拼接。
+// 同样不含构造和析构，可以用 calloc 分配后放在 request->_tempObject 中。
+template <size_t N>
+struct JsonBodyBuffer {
+    char body[N];
+    size_t length;
+    bool overflow;            // 超过 N 字节，之后的数据不再保存
+
+    void append(const uint8_t* data, size_t len) {
+        if (overflow) return;
+        if (length + len > N) {
+            overflow = true;
+            return;
+        }
+        memcpy(body + length, data, len);
+        length += len;
+    }
+};
+
+#endif
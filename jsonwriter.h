@@ -0,0 +1,158 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <Arduino.h>
+
+// 流式JSON输出：边生成边写入 Print（AsyncResponseStream 或固定缓冲区），
+// 不建立文档树，不申请堆内存。
+//
+//   JsonWriter json(out);
+//   json.beginObject();
+//   json.beginArray("relays");
+//   json.beginObject().field("name", name).field("state", state).endObject();
+//   json.endArray();
+//   json.endObject();
+
+// 写入固定缓冲区的 Print，超出容量时截断并置溢出标志
+class BufferPrint : public Print {
+public:
+    BufferPrint(char* buf, size_t size) : buf_(buf), size_(size), len_(0), overflow_(false) {}
+
+    size_t write(uint8_t c) override {
+        if (len_ + 1 >= size_) {
+            overflow_ = true;
+            return 0;
+        }
+        buf_[len_++] = c;
+        buf_[len_] = '\0';
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t len) override {
+        if (len_ + len >= size_) {
+            overflow_ = true;
+            len = size_ - 1 - len_;
+        }
+        memcpy(buf_ + len_, data, len);
+        len_ += len;
+        buf_[len_] = '\0';
+        return len;
+    }
+
+    const char* c_str() const { return buf_; }
+    size_t length() const { return len_; }
+    bool overflowed() const { return overflow_; }
+    void clear() { len_ = 0; overflow_ = false; buf_[0] = '\0'; }
+
+private:
+    char* buf_;
+    size_t size_;
+    size_t len_;
+    bool overflow_;
+};
+
+class JsonWriter {
+public:
+    explicit JsonWriter(Print& out) : out_(out), depth_(0), first_(1) {}
+
+    JsonWriter& beginObject(const char* key = NULL) { open(key, '{'); return *this; }
+    JsonWriter& endObject() { close('}'); return *this; }
+    JsonWriter& beginArray(const char* key = NULL) { open(key, '['); return *this; }
+    JsonWriter& endArray() { close(']'); return *this; }
+
+    JsonWriter& field(const char* key, const char* v) { separator(key); string(v); return *this; }
+    JsonWriter& field(const char* key, bool v) { separator(key); out_.print(v ? "true" : "false"); return *this; }
+    JsonWriter& field(const char* key, int v) { separator(key); integer(v); return *this; }
+    JsonWriter& field(const char* key, long v) { separator(key); integer(v); return *this; }
+    JsonWriter& field(const char* key, unsigned int v) { separator(key); uinteger(v); return *this; }
+    JsonWriter& field(const char* key, unsigned long v) { separator(key); uinteger(v); return *this; }
+    JsonWriter& field(const char* key, double v) { separator(key); number(v); return *this; }
+
+    // 数组元素
+    template <typename T>
+    JsonWriter& value(T v) { return field(NULL, v); }
+
+    // 直接写入已经是合法JSON的片段
+    JsonWriter& raw(const char* key, const char* json) { separator(key); out_.print(json); return *this; }
+
+private:
+    void separator(const char* key) {
+        if (first_ & (1u << depth_)) {
+            first_ &= ~(1u << depth_);
+        } else {
+            out_.write(',');
+        }
+        if (key) {
+            string(key);
+            out_.write(':');
+        }
+    }
+
+    void open(const char* key, char c) {
+        if (depth_ > 0) separator(key);
+        out_.write(c);
+        depth_++;
+        first_ |= (1u << depth_);
+    }
+
+    void close(char c) {
+        out_.write(c);
+        if (depth_ > 0) depth_--;
+    }
+
+    void string(const char* s) {
+        static const char hex[] = "0123456789abcdef";
+        out_.write('"');
+        if (s) {
+            const char* run = s;
+            for (; *s; s++) {
+                uint8_t c = (uint8_t)*s;
+                if (c >= 0x20 && c != '"' && c != '\\') continue;
+                // 先写出前面无需转义的一段
+                out_.write((const uint8_t*)run, s - run);
+                run = s + 1;
+                switch (c) {
+                    case '"':  out_.print("\\\""); break;
+                    case '\\': out_.print("\\\\"); break;
+                    case '\n': out_.print("\\n"); break;
+                    case '\r': out_.print("\\r"); break;
+                    case '\t': out_.print("\\t"); break;
+                    default: {
+                        char esc[7] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F], '\0'};
+                        out_.print(esc);
+                    }
+                }
+            }
+            out_.write((const uint8_t*)run, s - run);
+        }
+        out_.write('"');
+    }
+
+    void integer(long v) {
+        char buf[12];
+        int n = snprintf(buf, sizeof(buf), "%ld", v);
+        out_.write((const uint8_t*)buf, n);
+    }
+
+    void uinteger(unsigned long v) {
+        char buf[12];
+        int n = snprintf(buf, sizeof(buf), "%lu", v);
+        out_.write((const uint8_t*)buf, n);
+    }
+
+    void number(double v) {
+        if (isnan(v) || isinf(v)) {
+            out_.print("null");
+            return;
+        }
+        char buf[24];
+        int n = snprintf(buf, sizeof(buf), "%.7g", v);
+        out_.write((const uint8_t*)buf, n);
+    }
+
+    Print& out_;
+    uint8_t depth_;
+    uint32_t first_;   // 每层是否还没有写过元素
+};
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// 异步日志：调用方只把格式串指针和参数写入无锁环形缓冲区，
+// 由低优先级的日志任务在后台格式化并输出到串口和日志WebSocket。
+//
+// 用法：LOGI(LOG_MOD_ADC, "channel %d value %d", ch, value);
+// 注意：格式串必须是字符串常量（只保存指针），%s 参数会被复制进记录。
+
+// 日志级别
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// 日志模块（位掩码）
+#define LOG_MOD_SYS   0x01
+#define LOG_MOD_WIFI  0x02
+#define LOG_MOD_ADC   0x04
+#define LOG_MOD_TEMP  0x08
+#define LOG_MOD_RELAY 0x10
+#define LOG_MOD_CFG   0x20
+#define LOG_MOD_WEB   0x40
+#define LOG_MOD_ALL   0xFF
+
+// 编译期过滤：在包含本文件之前定义即可覆盖
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef LOG_MODULES
+#define LOG_MODULES LOG_MOD_ALL
+#endif
+
+#define LOG_RING_SIZE 32      // 环形缓冲区记录数（必须是2的幂）
+#define LOG_MAX_ARGS 8        // 每条记录最多参数个数
+#define LOG_TEXT_SIZE 48      // 每条记录内 %s 参数的复制空间
+#define LOG_LINE_SIZE 256     // 格式化后单行最大长度
+
+// 条件在编译期为常量，被过滤掉的日志连参数求值都不会产生
+#define LOG_AT(level, module, fmt, ...) do { \
+    if ((level) <= LOG_LEVEL && ((module) & LOG_MODULES)) { \
+        logWrite((level), (module), fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define LOGE(module, fmt, ...) LOG_AT(LOG_LEVEL_ERROR, module, fmt, ##__VA_ARGS__)
+#define LOGW(module, fmt, ...) LOG_AT(LOG_LEVEL_WARN, module, fmt, ##__VA_ARGS__)
+#define LOGI(module, fmt, ...) LOG_AT(LOG_LEVEL_INFO, module, fmt, ##__VA_ARGS__)
+#define LOGD(module, fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, module, fmt, ##__VA_ARGS__)
+
+// 参数类型标记
+enum LogArgType : uint8_t {
+    LOG_ARG_INT = 0,
+    LOG_ARG_UINT = 1,
+    LOG_ARG_DOUBLE = 2,
+    LOG_ARG_STR = 3
+};
+
+union LogArgValue {
+    int64_t i;
+    uint64_t u;
+    double d;
+    uint16_t str;   // 字符串在 text 中的偏移
+};
+
+// 二进制日志记录
+struct LogRecord {
+    uint32_t timestamp;
+    const char* fmt;
+    uint8_t level;
+    uint8_t module;
+    uint8_t argc;
+    uint8_t textLen;
+    uint8_t types[LOG_MAX_ARGS];
+    LogArgValue args[LOG_MAX_ARGS];
+    char text[LOG_TEXT_SIZE];
+};
+
+struct LogSlot {
+    std::atomic<uint32_t> seq;
+    LogRecord rec;
+};
+
+// 日志WebSocket（定义在 webjk.ino）
+extern AsyncWebSocket logWs;
+
+LogSlot logSlots[LOG_RING_SIZE];
+std::atomic<uint32_t> logEnqueuePos(0);
+uint32_t logDequeuePos = 0;               // 只有日志任务访问
+std::atomic<uint32_t> logDropped(0);      // 缓冲区满时丢弃的记录数
+
+// 参数打包
+void logPack(LogRecord& r, int v)                { r.types[r.argc] = LOG_ARG_INT;  r.args[r.argc++].i = v; }
+void logPack(LogRecord& r, long v)               { r.types[r.argc] = LOG_ARG_INT;  r.args[r.argc++].i = v; }
+void logPack(LogRecord& r, long long v)          { r.types[r.argc] = LOG_ARG_INT;  r.args[r.argc++].i = v; }
+void logPack(LogRecord& r, unsigned int v)       { r.types[r.argc] = LOG_ARG_UINT; r.args[r.argc++].u = v; }
+void logPack(LogRecord& r, unsigned long v)      { r.types[r.argc] = LOG_ARG_UINT; r.args[r.argc++].u = v; }
+void logPack(LogRecord& r, unsigned long long v) { r.types[r.argc] = LOG_ARG_UINT; r.args[r.argc++].u = v; }
+void logPack(LogRecord& r, double v)             { r.types[r.argc] = LOG_ARG_DOUBLE; r.args[r.argc++].d = v; }
+void logPack(LogRecord& r, const char* s) {
+    if (!s) s = "(null)";
+    size_t room = LOG_TEXT_SIZE - r.textLen;
+    size_t len = strlen(s);
+    if (room == 0) {
+        r.types[r.argc] = LOG_ARG_STR;
+        r.args[r.argc++].str = LOG_TEXT_SIZE - 1;   // 指向最后的结束符
+        return;
+    }
+    if (len >= room) len = room - 1;
+    memcpy(r.text + r.textLen, s, len);
+    r.text[r.textLen + len] = '\0';
+    r.types[r.argc] = LOG_ARG_STR;
+    r.args[r.argc++].str = r.textLen;
+    r.textLen += len + 1;
+}
+
+void logPackAll(LogRecord& r) {}
+
+template <typename T, typename... Rest>
+void logPackAll(LogRecord& r, T first, Rest... rest) {
+    logPack(r, first);
+    logPackAll(r, rest...);
+}
+
+// 写入一条日志（无锁，多生产者）；缓冲区满时丢弃并计数
+template <typename... Args>
+void logWrite(uint8_t level, uint8_t module, const char* fmt, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+
+    uint32_t pos = logEnqueuePos.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &logSlots[pos & (LOG_RING_SIZE - 1)];
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        int32_t dif = (int32_t)(seq - pos);
+        if (dif == 0) {
+            if (logEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            logDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = logEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    LogRecord& r = slot->rec;
+    r.timestamp = millis();
+    r.fmt = fmt;
+    r.level = level;
+    r.module = module;
+    r.argc = 0;
+    r.textLen = 0;
+    r.text[0] = '\0';
+    logPackAll(r, args...);
+
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+const char* logLevelName(uint8_t level) {
+    switch (level) {
+        case LOG_LEVEL_ERROR: return "E";
+        case LOG_LEVEL_WARN:  return "W";
+        case LOG_LEVEL_INFO:  return "I";
+        default:              return "D";
+    }
+}
+
+const char* logModuleName(uint8_t module) {
+    switch (module) {
+        case LOG_MOD_SYS:   return "SYS";
+        case LOG_MOD_WIFI:  return "WIFI";
+        case LOG_MOD_ADC:   return "ADC";
+        case LOG_MOD_TEMP:  return "TEMP";
+        case LOG_MOD_RELAY: return "RELAY";
+        case LOG_MOD_CFG:   return "CFG";
+        case LOG_MOD_WEB:   return "WEB";
+        default:            return "?";
+    }
+}
+
+// 按记录中的格式串和参数格式化成一行文本，返回长度
+size_t logFormat(const LogRecord& r, char* out, size_t size) {
+    int n = snprintf(out, size, "[%lu][%s][%s] ",
+        (unsigned long)r.timestamp, logLevelName(r.level), logModuleName(r.module));
+    size_t len = (n > 0 && (size_t)n < size) ? n : 0;
+
+    const char* p = r.fmt;
+    uint8_t argi = 0;
+    while (*p && len < size - 1) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // 复制标志、宽度和精度，丢弃长度修饰符（由记录中的类型决定）
+        char spec[16];
+        size_t sl = 0;
+        spec[sl++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && sl < sizeof(spec) - 4) spec[sl++] = *p++;
+        while (*p && strchr("hlzjtL", *p)) p++;
+        char conv = *p ? *p++ : 's';
+
+        if (argi >= r.argc) break;
+        uint8_t type = r.types[argi];
+        const LogArgValue& v = r.args[argi++];
+        size_t room = size - len;
+
+        if (conv == 's') {
+            spec[sl++] = 's';
+            spec[sl] = '\0';
+            n = snprintf(out + len, room, spec, type == LOG_ARG_STR ? r.text + v.str : "?");
+        } else if (strchr("feEgGaA", conv)) {
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            double d = type == LOG_ARG_DOUBLE ? v.d : (type == LOG_ARG_UINT ? (double)v.u : (double)v.i);
+            n = snprintf(out + len, room, spec, d);
+        } else if (conv == 'c') {
+            spec[sl++] = 'c';
+            spec[sl] = '\0';
+            n = snprintf(out + len, room, spec, (int)v.i);
+        } else {
+            bool isSigned = (conv == 'd' || conv == 'i');
+            spec[sl++] = 'l';
+            spec[sl++] = 'l';
+            spec[sl++] = (conv == 'p') ? 'x' : conv;
+            spec[sl] = '\0';
+            if (type == LOG_ARG_DOUBLE) {
+                n = isSigned ? snprintf(out + len, room, spec, (long long)v.d)
+                             : snprintf(out + len, room, spec, (unsigned long long)v.d);
+            } else {
+                n = isSigned ? snprintf(out + len, room, spec, (long long)v.i)
+                             : snprintf(out + len, room, spec, (unsigned long long)v.u);
+            }
+        }
+        if (n < 0) break;
+        len += ((size_t)n < room) ? n : room - 1;
+    }
+
+    // 去掉格式串自带的换行，统一在末尾追加
+    while (len > 0 && (out[len - 1] == '\n' || out[len - 1] == '\r')) len--;
+    out[len] = '\0';
+    return len;
+}
+
+// 取出一条记录并格式化，没有记录时返回0（只在日志任务中调用）
+size_t logDrainOne(char* line, size_t size) {
+    LogSlot& slot = logSlots[logDequeuePos & (LOG_RING_SIZE - 1)];
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if ((int32_t)(seq - (logDequeuePos + 1)) < 0) return 0;
+
+    size_t len = logFormat(slot.rec, line, size);
+    slot.seq.store(logDequeuePos + LOG_RING_SIZE, std::memory_order_release);
+    logDequeuePos++;
+    return len;
+}
+
+// 日志输出任务：低优先级，串口和WebSocket的阻塞只发生在这里
+void logDrainTask(void* param) {
+    static char line[LOG_LINE_SIZE];
+    uint32_t reportedDrops = 0;
+
+    for (;;) {
+        size_t len = logDrainOne(line, sizeof(line));
+        if (len == 0) {
+            uint32_t dropped = logDropped.load(std::memory_order_relaxed);
+            if (dropped != reportedDrops) {
+                Serial.printf("[log] %u records dropped\n", dropped - reportedDrops);
+                reportedDrops = dropped;
+            }
+            vTaskDelay(pdMS_TO_TICKS(20));
+            continue;
+        }
+
+        Serial.write((const uint8_t*)line, len);
+        Serial.write('\n');
+        if (logWs.count() > 0) {
+            logWs.textAll(line, len);
+        }
+    }
+}
+
+// 初始化环形缓冲区并启动日志任务，需在第一条日志之前调用
+void initLog() {
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        logSlots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    logEnqueuePos.store(0, std::memory_order_relaxed);
+    logDequeuePos = 0;
+
+    xTaskCreatePinnedToCore(logDrainTask, "log", 4096, NULL, 1, NULL, 0);
+}
+
+#endif
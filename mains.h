@@ -0,0 +1,172 @@
+#ifndef MAINS_H
+#define MAINS_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "mainsfilter.h"
+
+// 工频干扰抑制：在模拟量配置页为内部 ADC1 通道选择“周期积分”或“陷波”后，该通道不再由
+// sampleADC 每200ms单次读取，而是由独立任务以 MAINS_SAMPLE_RATE 连续采样并滤波（mainsfilter.h），
+// sampleADC 取滤波器的最新输出，之后照常做中值和限幅滤波。
+//
+// 采样节拍由 esp_timer 产生，回调只通知采样任务，ADC 读取在任务中进行。
+// 波形捕获（包括频谱分析每10秒一次的后台捕获）占用 ADC1 期间采样任务暂停，恢复后滤波器重新积累；
+// 暂停前已有输出的通道在此期间保持最后的滤波值，超过 MAINS_HOLD_MS 后 sampleADC 改为单次读取。
+
+#define MAINS_TICK_US (1000000 / MAINS_SAMPLE_RATE)
+#define MAINS_HOLD_MS 2000       // 暂停和重新积累期间保持滤波输出的最长时间
+
+struct MainsStats {
+    uint32_t ticks;            // 采样节拍
+    uint32_t samples;          // 滤波的样本数
+    uint32_t missed;           // 任务没赶上的节拍
+    uint32_t restarts;         // 捕获结束后滤波器重新积累的次数
+};
+
+// 采样任务使用的配置：启用<<24 | 模式<<16 | 频率<<8 | 周期数，由 syncAnalogSampleState 写入
+std::atomic<uint32_t> mainsRequest[Board::ANALOG_CHANNELS];
+std::atomic<uint16_t> mainsReadyMask(0);          // 滤波器输出可用的通道
+std::atomic<uint16_t> mainsHeldMask(0);           // 重新积累中、输出保持暂停前的值的通道
+std::atomic<uint32_t> mainsPausedAt(0);           // 最近一次暂停的 millis()
+volatile int16_t mainsOutput[Board::ANALOG_CHANNELS];
+std::atomic<bool> mainsPaused(false);
+std::atomic<bool> mainsBusy(false);
+std::atomic<bool> mainsResetRequested(false);
+MainsStats mainsStats;
+MainsFilter mainsFilters[Board::ANALOG_CHANNELS];  // 只在采样任务中访问
+esp_timer_handle_t mainsTimer = NULL;
+TaskHandle_t mainsTaskHandle = NULL;
+bool mainsTimerRunning = false;
+
+// 通道能否使用工频抑制：内部ADC、属于 ADC1
+bool mainsChannelSupported(int channel) {
+    return Board::analogAdcUnit(channel) == 1;
+}
+
+void mainsTimerCallback(void* arg) {
+    mainsStats.ticks++;
+    xTaskNotifyGive(mainsTaskHandle);
+}
+
+void mainsTask(void* param) {
+    uint32_t applied[Board::ANALOG_CHANNELS] = {0};
+    for (;;) {
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (pending > 1) mainsStats.missed += pending - 1;
+
+        mainsBusy = true;
+        if (mainsPaused) {
+            mainsBusy = false;
+            continue;
+        }
+        bool restart = mainsResetRequested.exchange(false);
+        if (restart) mainsStats.restarts++;
+        uint16_t ready = mainsReadyMask.load(std::memory_order_relaxed);
+        // 暂停后重新积累：已有输出的通道保持原值，直到滤波器再次积累完成
+        uint16_t held = restart ? ready : mainsHeldMask.load(std::memory_order_relaxed);
+        for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+            uint16_t bit = 1u << i;
+            uint32_t request = mainsRequest[i].load(std::memory_order_relaxed);
+            if (request != applied[i]) {
+                ready &= ~bit;
+                held &= ~bit;
+            }
+            if (request != applied[i] || restart) {
+                applied[i] = request;
+                mainsFilters[i].configure((request >> 16) & 0xFF, (request >> 8) & 0xFF, request & 0xFF, MAINS_SAMPLE_RATE);
+            }
+            if (!(request >> 24) || ((request >> 16) & 0xFF) == MAINS_OFF) continue;
+            float value = mainsFilters[i].update(analogRead(Board::analogGpio(i)));
+            if (mainsFilters[i].ready()) {
+                ready |= bit;
+                held &= ~bit;
+            }
+            if (!(held & bit)) mainsOutput[i] = (int16_t)lroundf(value);
+            mainsStats.samples++;
+        }
+        mainsHeldMask.store(held, std::memory_order_relaxed);
+        mainsReadyMask.store(ready, std::memory_order_release);
+        mainsBusy = false;
+    }
+}
+
+// 按通道配置更新采样任务的配置，有通道需要时才启动节拍
+void mainsUpdateConfig(int channel, bool enabled, uint8_t backend, uint8_t mode, uint8_t hz, uint8_t cycles) {
+    bool active = enabled && backend == ADC_BACKEND_INTERNAL && mode != MAINS_OFF && mainsChannelSupported(channel);
+    mainsRequest[channel].store(active ? (1u << 24) | (mode << 16) | (hz << 8) | cycles : 0);
+    if (!active) {
+        mainsReadyMask.fetch_and(~(1u << channel));
+        mainsHeldMask.fetch_and(~(1u << channel));
+    }
+
+    if (!mainsTimer) return;
+    bool any = false;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (mainsRequest[i].load()) any = true;
+    }
+    if (any && !mainsTimerRunning) {
+        esp_timer_start_periodic(mainsTimer, MAINS_TICK_US);
+        mainsTimerRunning = true;
+    } else if (!any && mainsTimerRunning) {
+        esp_timer_stop(mainsTimer);
+        mainsTimerRunning = false;
+    }
+}
+
+// 波形捕获启动 DMA 前暂停采样，返回时采样任务不在读取 ADC；已有的滤波输出保持
+void mainsPause() {
+    mainsPausedAt = millis();
+    mainsPaused = true;
+    while (mainsBusy) vTaskDelay(1);
+}
+
+// 捕获结束后恢复，滤波器从头积累
+void mainsResume() {
+    mainsResetRequested = true;
+    mainsPaused = false;
+}
+
+// sampleADC 中取滤波后的值，滤波器还没有输出、或保持的值太旧时返回 false
+bool mainsFilteredValue(int channel, int& value) {
+    uint16_t bit = 1u << channel;
+    if (!(mainsReadyMask.load(std::memory_order_acquire) & bit)) return false;
+    if ((mainsPaused || (mainsHeldMask.load(std::memory_order_relaxed) & bit)) &&
+        millis() - mainsPausedAt.load() > MAINS_HOLD_MS) {
+        return false;
+    }
+    value = mainsOutput[channel];
+    return true;
+}
+
+// 创建节拍定时器和采样任务（在 initAnalogChannels 之前调用）
+void initMains() {
+    xTaskCreatePinnedToCore(mainsTask, "mains", 3072, NULL, 4, &mainsTaskHandle, 1);
+    esp_timer_create_args_t args = {};
+    args.callback = mainsTimerCallback;
+    args.name = "mains";
+    esp_timer_create(&args, &mainsTimer);
+}
+
+#if METRICS_ENABLED
+void writeMainsMetrics(Print& out) {
+    out.print("# TYPE esp_mains_ticks_total counter\n");
+    out.printf("esp_mains_ticks_total %u\n", mainsStats.ticks);
+    out.print("# TYPE esp_mains_samples_total counter\n");
+    out.printf("esp_mains_samples_total %u\n", mainsStats.samples);
+    out.print("# TYPE esp_mains_missed_ticks_total counter\n");
+    out.printf("esp_mains_missed_ticks_total %u\n", mainsStats.missed);
+    out.print("# TYPE esp_mains_restarts_total counter\n");
+    out.printf("esp_mains_restarts_total %u\n", mainsStats.restarts);
+    out.print("# TYPE esp_mains_ready gauge\n");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (!mainsRequest[i].load()) continue;
+        out.printf("esp_mains_ready{channel=\"%d\"} %d\n", i, (mainsReadyMask.load() >> i) & 1);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef MAINSFILTER_H
+#define MAINSFILTER_H
+
+#include <math.h>
+#include <stdint.h>
+
+// 工频干扰抑制滤波器，只依赖标准库，可以直接在主机上编译验证。
+//
+// 积分：对最近整数个工频周期的样本求平均（滑动和，每个样本 O(1)），频率响应在工频及其
+// 所有谐波处为零，阶跃变化在一个积分窗口内完全反映出来。
+// 陷波：二阶IIR陷波器，只抑制基波，零点在工频处，极点半径 MAINS_NOTCH_RADIUS 决定带宽，
+// 直流增益归一化为1；对阶跃的响应比积分快，但不抑制谐波。
+
+#define MAINS_SAMPLE_RATE 600             // 采样率(Hz)，50Hz 每周期12点、60Hz 每周期10点
+#define MAINS_MAX_CYCLES 10               // 积分最多的周期数
+#define MAINS_WINDOW_MAX (MAINS_SAMPLE_RATE / 50 * MAINS_MAX_CYCLES)
+#define MAINS_NOTCH_RADIUS 0.95f          // 600Hz 采样时 -3dB 带宽约 10Hz
+#define MAINS_NOTCH_SETTLE 100            // 陷波器启动后等待的样本数（约5个时间常数）
+
+enum MainsMode {
+    MAINS_OFF = 0,
+    MAINS_INTEGRATE = 1,
+    MAINS_NOTCH = 2,
+    MAINS_MODE_COUNT
+};
+
+class MainsFilter {
+public:
+    MainsFilter() : mode_(MAINS_OFF), window_(1) { reset(); }
+
+    // hz 为工频频率（50/60），cycles 为积分的周期数
+    void configure(uint8_t mode, uint8_t hz, uint8_t cycles, float sampleRate) {
+        mode_ = mode;
+        if (cycles < 1) cycles = 1;
+        if (cycles > MAINS_MAX_CYCLES) cycles = MAINS_MAX_CYCLES;
+        window_ = (int)lroundf(sampleRate / hz) * cycles;
+        if (window_ > MAINS_WINDOW_MAX) window_ = MAINS_WINDOW_MAX;
+
+        float c = cosf(2.0f * 3.14159265f * hz / sampleRate);
+        float r = MAINS_NOTCH_RADIUS;
+        float gain = (1 - 2 * r * c + r * r) / (2 - 2 * c);
+        b0_ = gain;
+        b1_ = -2 * c * gain;
+        b2_ = gain;
+        a1_ = -2 * r * c;
+        a2_ = r * r;
+        reset();
+    }
+
+    void reset() {
+        pos_ = 0;
+        count_ = 0;
+        sum_ = 0;
+        x1_ = x2_ = y1_ = y2_ = 0;
+    }
+
+    // 输入一个样本，返回滤波后的值
+    float update(int16_t x) {
+        if (mode_ == MAINS_INTEGRATE) {
+            if (count_ >= window_) sum_ -= ring_[pos_];
+            else count_++;
+            ring_[pos_] = x;
+            sum_ += x;
+            if (++pos_ >= window_) pos_ = 0;
+            return (float)sum_ / count_;
+        }
+        if (mode_ == MAINS_NOTCH) {
+            // 第一个样本按已稳定在该值初始化状态，避免从0开始的大幅过渡
+            if (count_ == 0) x1_ = x2_ = y1_ = y2_ = x;
+            if (count_ < MAINS_NOTCH_SETTLE) count_++;
+            float y = b0_ * x + b1_ * x1_ + b2_ * x2_ - a1_ * y1_ - a2_ * y2_;
+            x2_ = x1_;
+            x1_ = x;
+            y2_ = y1_;
+            y1_ = y;
+            return y;
+        }
+        return x;
+    }
+
+    // 积分窗口已填满或陷波器已稳定
+    bool ready() const {
+        if (mode_ == MAINS_INTEGRATE) return count_ >= window_;
+        if (mode_ == MAINS_NOTCH) return count_ >= MAINS_NOTCH_SETTLE;
+        return true;
+    }
+
+private:
+    uint8_t mode_;
+    int window_;
+    int16_t ring_[MAINS_WINDOW_MAX];
+    int pos_;
+    int count_;
+    int32_t sum_;
+    float b0_, b1_, b2_, a1_, a2_;
+    float x1_, x2_, y1_, y2_;
+};
+
+#endif
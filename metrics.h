@@ -0,0 +1,315 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include "log.h"
+#include "broadcast.h"
+
+// 性能统计：按阶段记录调用次数、总/最大CPU周期和对数-线性延迟直方图，
+// 通过 /metrics 以 Prometheus 文本格式输出。
+// 编译时定义 METRICS_ENABLED 为 0 可完全去掉统计代码和 /metrics 路由。
+
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+// 统计阶段
+enum MetricStage {
+    // 主循环
+    METRIC_SAMPLE_ADC = 0,
+    METRIC_READ_TEMPS,
+    METRIC_SEND_SENSOR_DATA,
+    METRIC_RELAY_LOOP,
+    // HTTP 处理函数
+    METRIC_HTTP_HOME,
+    METRIC_HTTP_WIFI_PAGE,
+    METRIC_HTTP_CONNECT,
+    METRIC_HTTP_ANALOG_PAGE,
+    METRIC_HTTP_RELAY_PAGE,
+    METRIC_HTTP_TEMP_PAGE,
+    METRIC_HTTP_SAVE_ANALOG_CONFIG,
+    METRIC_HTTP_GET_ANALOG_CONFIG,
+    METRIC_HTTP_GET_RELAY_STATUS,
+    METRIC_HTTP_RELAY_SET,
+    METRIC_HTTP_GET_RELAY_CONFIG,
+    METRIC_HTTP_SAVE_RELAY_CONFIG,
+    METRIC_HTTP_RELAY_AUTO_CONTROL,
+    METRIC_HTTP_SAVE_TITLE,
+    METRIC_HTTP_SAVE_FILTER_LIMIT,
+    METRIC_HTTP_GET_TEMP_CONFIG,
+    METRIC_HTTP_SAVE_TEMP_CONFIG,
+    METRIC_HTTP_GET_MQTT_CONFIG,
+    METRIC_HTTP_SAVE_MQTT_CONFIG,
+    METRIC_HTTP_EXPORT,
+    METRIC_HTTP_METRICS,
+    METRIC_HTTP_CAPTURE_ARM,
+    METRIC_HTTP_CAPTURE_CANCEL,
+    METRIC_HTTP_CAPTURE_STATUS,
+    METRIC_HTTP_CAPTURE_DATA,
+    METRIC_HTTP_SPECTRUM,
+    METRIC_HTTP_STATS,
+    METRIC_HTTP_GET_ALARM_CONFIG,
+    METRIC_HTTP_SAVE_ALARM_CONFIG,
+    METRIC_HTTP_ALARMS,
+    METRIC_HTTP_ALARM_ACK,
+    METRIC_HTTP_GET_VIRTUAL_CONFIG,
+    METRIC_HTTP_SAVE_VIRTUAL_CONFIG,
+    // WebSocket 命令
+    METRIC_WS_COMMAND,
+    // 继电器命令从入队到执行完的延迟
+    METRIC_RELAY_COMMAND,
+    // Modbus TCP 请求
+    METRIC_MODBUS_REQUEST,
+    // 外部ADC一轮扫描（含等待转换）
+    METRIC_EXT_ADC_SCAN,
+    // 一轮频谱分析（不含采样窗口）
+    METRIC_SPECTRUM_ANALYZE,
+    // 报警从采样到通知交给发送队列的延迟
+    METRIC_ALARM_WS,
+    METRIC_ALARM_MQTT,
+    // SPIFFS 保存
+    METRIC_SAVE_ANALOG,
+    METRIC_SAVE_RELAY,
+    METRIC_SAVE_TEMP,
+    METRIC_SAVE_WIFI,
+    METRIC_SAVE_TITLE,
+    METRIC_SAVE_MQTT,
+    METRIC_SAVE_HISTORY,
+    METRIC_SAVE_ALARM,
+    METRIC_SAVE_VIRTUAL,
+    METRIC_COUNT
+};
+
+#if METRICS_ENABLED
+
+// 直方图：每个2的幂区间再等分为 2^METRICS_SUB_BITS 个子区间，
+// 低于 2^METRICS_MIN_EXP 个周期的都计入第一个桶
+#define METRICS_SUB_BITS 1
+#define METRICS_MIN_EXP 10
+#define METRICS_BUCKETS (1 + (32 - METRICS_MIN_EXP) * (1 << METRICS_SUB_BITS))
+
+struct StageMetric {
+    uint32_t calls;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t buckets[METRICS_BUCKETS];
+};
+
+// 阶段名和类别（与 MetricStage 顺序一致）
+struct StageInfo {
+    const char* kind;
+    const char* name;
+};
+
+const StageInfo stageInfo[METRIC_COUNT] = {
+    {"loop", "sample_adc"},
+    {"loop", "read_temperatures"},
+    {"loop", "send_sensor_data"},
+    {"loop", "relay_control"},
+    {"http", "/"},
+    {"http", "/wifi"},
+    {"http", "/connect"},
+    {"http", "/analog"},
+    {"http", "/relay"},
+    {"http", "/temp"},
+    {"http", "/save_analog_config"},
+    {"http", "/get_analog_config"},
+    {"http", "/get_relay_status"},
+    {"http", "/relay/set"},
+    {"http", "/get_relay_config"},
+    {"http", "/save_relay_config"},
+    {"http", "/relay/auto_control"},
+    {"http", "/save_title"},
+    {"http", "/save_filter_limit"},
+    {"http", "/get_temp_config"},
+    {"http", "/save_temp_config"},
+    {"http", "/get_mqtt_config"},
+    {"http", "/save_mqtt_config"},
+    {"http", "/export"},
+    {"http", "/metrics"},
+    {"http", "/capture/arm"},
+    {"http", "/capture/cancel"},
+    {"http", "/capture/status"},
+    {"http", "/capture/data"},
+    {"http", "/spectrum"},
+    {"http", "/stats"},
+    {"http", "/get_alarm_config"},
+    {"http", "/save_alarm_config"},
+    {"http", "/alarms"},
+    {"http", "/alarm/ack"},
+    {"http", "/get_virtual_config"},
+    {"http", "/save_virtual_config"},
+    {"ws", "command"},
+    {"control", "relay_command"},
+    {"modbus", "request"},
+    {"extadc", "scan"},
+    {"spectrum", "analyze"},
+    {"alarm", "notify_ws"},
+    {"alarm", "notify_mqtt"},
+    {"save", "analog_config"},
+    {"save", "relay_config"},
+    {"save", "temp_config"},
+    {"save", "wifi_config"},
+    {"save", "title"},
+    {"save", "mqtt_config"},
+    {"save", "history"},
+    {"save", "alarm_config"},
+    {"save", "virtual_config"},
+};
+
+StageMetric stageMetrics[METRIC_COUNT];
+
+// 周期数对应的直方图桶
+uint32_t metricBucket(uint32_t cycles) {
+    if (cycles < (1u << METRICS_MIN_EXP)) return 0;
+    uint32_t e = 31 - __builtin_clz(cycles);
+    uint32_t sub = (cycles >> (e - METRICS_SUB_BITS)) & ((1u << METRICS_SUB_BITS) - 1);
+    return 1 + ((e - METRICS_MIN_EXP) << METRICS_SUB_BITS) + sub;
+}
+
+// 桶的上界（周期数），即下一个桶的下界
+uint64_t metricBucketUpper(uint32_t bucket) {
+    if (bucket == 0) return 1ull << METRICS_MIN_EXP;
+    uint32_t i = bucket - 1;
+    uint32_t e = METRICS_MIN_EXP + (i >> METRICS_SUB_BITS);
+    uint64_t sub = (i & ((1u << METRICS_SUB_BITS) - 1)) + 1;
+    return (1ull << e) + (sub << (e - METRICS_SUB_BITS));
+}
+
+// 记录一次耗时；不同任务同时写同一阶段时计数可能少记，可接受
+void recordMetric(uint8_t stage, uint32_t cycles) {
+    StageMetric& m = stageMetrics[stage];
+    m.calls++;
+    m.totalCycles += cycles;
+    if (cycles > m.maxCycles) m.maxCycles = cycles;
+    m.buckets[metricBucket(cycles)]++;
+}
+
+// 作用域计时：构造时取周期计数，析构时记录
+class MetricScope {
+public:
+    explicit MetricScope(uint8_t stage) : stage_(stage), start_(ESP.getCycleCount()) {}
+    ~MetricScope() { recordMetric(stage_, ESP.getCycleCount() - start_); }
+private:
+    uint8_t stage_;
+    uint32_t start_;
+};
+
+#define METRICS_SCOPE(stage) MetricScope _metricScope(stage)
+#define METRICS_RECORD(stage, cycles) recordMetric(stage, cycles)
+
+extern AsyncWebSocket ws;
+void writeRelayControlMetrics(Print& out);
+void writeModbusMetrics(Print& out);
+void writeMqttMetrics(Print& out);
+void writeHistoryMetrics(Print& out);
+void writeConfigCacheMetrics(Print& out);
+void writeExtAdcMetrics(Print& out);
+void writeAdcMetrics(Print& out);
+void writeAdaptiveMetrics(Print& out);
+void writeCaptureMetrics(Print& out);
+void writeSpectrumMetrics(Print& out);
+void writeMainsMetrics(Print& out);
+void writeAlarmMetrics(Print& out);
+void writeVirtualMetrics(Print& out);
+
+// 以 Prometheus 文本格式输出所有统计
+void writeMetrics(Print& out) {
+    double hz = getCpuFrequencyMhz() * 1e6;
+
+    out.print("# TYPE esp_stage_calls_total counter\n");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        out.printf("esp_stage_calls_total{kind=\"%s\",stage=\"%s\"} %u\n",
+            stageInfo[i].kind, stageInfo[i].name, stageMetrics[i].calls);
+    }
+
+    out.print("# TYPE esp_stage_cycles_total counter\n");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        out.printf("esp_stage_cycles_total{kind=\"%s\",stage=\"%s\"} %llu\n",
+            stageInfo[i].kind, stageInfo[i].name, (unsigned long long)stageMetrics[i].totalCycles);
+    }
+
+    out.print("# TYPE esp_stage_cycles_max gauge\n");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        out.printf("esp_stage_cycles_max{kind=\"%s\",stage=\"%s\"} %u\n",
+            stageInfo[i].kind, stageInfo[i].name, stageMetrics[i].maxCycles);
+    }
+
+    // 只输出到最后一个非空桶为止，其余由 +Inf 覆盖
+    out.print("# TYPE esp_stage_latency_seconds histogram\n");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        const StageMetric& m = stageMetrics[i];
+        int last = -1;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            if (m.buckets[b]) last = b;
+        }
+        uint32_t cumulative = 0;
+        for (int b = 0; b <= last; b++) {
+            cumulative += m.buckets[b];
+            out.printf("esp_stage_latency_seconds_bucket{kind=\"%s\",stage=\"%s\",le=\"%.6g\"} %u\n",
+                stageInfo[i].kind, stageInfo[i].name, metricBucketUpper(b) / hz, cumulative);
+        }
+        out.printf("esp_stage_latency_seconds_bucket{kind=\"%s\",stage=\"%s\",le=\"+Inf\"} %u\n",
+            stageInfo[i].kind, stageInfo[i].name, m.calls);
+        out.printf("esp_stage_latency_seconds_sum{kind=\"%s\",stage=\"%s\"} %.6f\n",
+            stageInfo[i].kind, stageInfo[i].name, m.totalCycles / hz);
+        out.printf("esp_stage_latency_seconds_count{kind=\"%s\",stage=\"%s\"} %u\n",
+            stageInfo[i].kind, stageInfo[i].name, m.calls);
+    }
+
+    out.print("# TYPE esp_heap_free_bytes gauge\n");
+    out.printf("esp_heap_free_bytes %u\n", ESP.getFreeHeap());
+    out.print("# TYPE esp_heap_min_free_bytes gauge\n");
+    out.printf("esp_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+    out.print("# TYPE esp_heap_largest_free_block_bytes gauge\n");
+    out.printf("esp_heap_largest_free_block_bytes %u\n", ESP.getMaxAllocHeap());
+    out.print("# TYPE esp_ws_clients gauge\n");
+    out.printf("esp_ws_clients %u\n", (unsigned)ws.count());
+    out.print("# TYPE esp_ws_broadcasts_total counter\n");
+    out.printf("esp_ws_broadcasts_total %u\n", wsBroadcastStats.broadcasts);
+    out.print("# TYPE esp_ws_messages_queued_total counter\n");
+    out.printf("esp_ws_messages_queued_total %u\n", wsBroadcastStats.queued);
+    out.print("# TYPE esp_ws_messages_dropped_total counter\n");
+    out.printf("esp_ws_messages_dropped_total %u\n", wsBroadcastStats.dropped);
+    out.print("# TYPE esp_ws_frames_no_buffer_total counter\n");
+    out.printf("esp_ws_frames_no_buffer_total %u\n", wsBroadcastStats.noBuffer);
+    out.print("# TYPE esp_ws_client_queue_length gauge\n");
+    for (AsyncWebSocketClient* client : ws.getClients()) {
+        out.printf("esp_ws_client_queue_length{client=\"%u\"} %u\n",
+            client->id(), (unsigned)client->queueLen());
+    }
+    out.print("# TYPE esp_ws_stream_interval_seconds gauge\n");
+    for (int i = 0; i < WS_STREAM_MAX_CLIENTS; i++) {
+        if (wsStreamClients[i].id == 0) continue;
+        out.printf("esp_ws_stream_interval_seconds{client=\"%u\"} %.3f\n",
+            wsStreamClients[i].id, wsStreamClients[i].interval / 1000.0);
+    }
+    out.print("# TYPE esp_ws_stream_bytes_total counter\n");
+    out.printf("esp_ws_stream_bytes_total %u\n", wsStreamStats.bytes);
+    out.print("# TYPE esp_ws_stream_throttled_total counter\n");
+    out.printf("esp_ws_stream_throttled_total %u\n", wsStreamStats.throttled);
+    writeRelayControlMetrics(out);
+    writeModbusMetrics(out);
+    writeMqttMetrics(out);
+    writeHistoryMetrics(out);
+    writeConfigCacheMetrics(out);
+    writeAdcMetrics(out);
+    writeAdaptiveMetrics(out);
+    writeExtAdcMetrics(out);
+    writeCaptureMetrics(out);
+    writeSpectrumMetrics(out);
+    writeMainsMetrics(out);
+    writeAlarmMetrics(out);
+    writeVirtualMetrics(out);
+    out.print("# TYPE esp_log_dropped_total counter\n");
+    out.printf("esp_log_dropped_total %u\n", logDropped.load(std::memory_order_relaxed));
+}
+
+#else
+
+#define METRICS_SCOPE(stage) ((void)0)
+#define METRICS_RECORD(stage, cycles) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "control.h"
+#include "modbuspdu.h"
+
+// Modbus TCP 从站（端口502），供 SCADA 轮询。
+// 读请求全部由采集快照和继电器配置快照应答，不访问硬件；写线圈/寄存器转换为继电器控制命令入队。
+// 报文处理和寄存器映射见 modbuspdu.h，这里只负责 TCP 连接和 MBAP 报文头。
+
+#define MODBUS_PORT 502
+#define MODBUS_MAX_CONNECTIONS 4
+
+// 每个连接的接收缓冲区：TCP 可能把一个请求拆开或把多个请求合并到一起
+struct ModbusConnection {
+    uint8_t rx[MODBUS_MAX_ADU];
+    size_t rxLen;
+    bool closing;    // 收到无效报文，等轮询回调中断开（数据回调中不能关闭连接）
+};
+
+extern Snapshot<SensorSnapshot> sensorSnapshot;
+
+AsyncServer modbusServer(MODBUS_PORT);
+
+void mbReadSensors(SensorSnapshot& snap) {
+    sensorSnapshot.read(snap);
+}
+
+void mbReadRelays(RelayConfigSet& relays) {
+    relayConfigs.read(relays);
+}
+
+// Modbus 回调运行在 AsyncTCP 任务中，使用该任务的命令队列
+size_t mbCommandSpace() {
+    return relayCommandQueue.space();
+}
+
+bool mbRequestRelaySet(int channel, bool on) {
+    return requestRelaySet(channel, on) != 0;
+}
+
+// 修改继电器模式：保留名称和定时参数，通过控制任务执行
+bool mbRequestRelayMode(const RelayChannel& relay, int channel, uint16_t mode) {
+    return requestRelayConfig(channel, relay.name.c_str(), (RelayMode)mode,
+        relay.onTime, relay.offTime, relay.maxCycles) != 0;
+}
+
+// 处理接收缓冲区中所有完整的请求，应答直接写回连接；报文无效、需要断开时返回 false
+bool modbusHandleFrames(AsyncClient* client, ModbusConnection* conn) {
+    uint8_t out[MODBUS_MAX_ADU];
+    size_t pos = 0;
+
+    while (conn->rxLen - pos >= 7) {
+        const uint8_t* adu = conn->rx + pos;
+        uint16_t protocol = mbGet16(adu + 2);
+        uint16_t length = mbGet16(adu + 4);   // 单元号 + PDU
+        if (protocol != 0 || length < 2 || length > MODBUS_MAX_ADU - 6) {
+            // 不是 Modbus 报文，断开
+            LOGW(LOG_MOD_WEB, "Modbus: invalid MBAP header, closing connection");
+            conn->closing = true;
+            conn->rxLen = 0;
+            return false;
+        }
+        if (conn->rxLen - pos < 6u + length) break;  // 请求还没收完
+
+        METRICS_SCOPE(METRIC_MODBUS_REQUEST);
+        memcpy(out, adu, 7);  // 事务号、协议号、单元号原样返回
+        size_t pduLen = modbusProcess(adu + 7, length - 1, out + 7);
+        mbPut16(out + 4, pduLen + 1);
+        // 发送窗口已满时丢弃应答，由主站超时重试
+        if (client->space() >= 7 + pduLen) {
+            client->add((const char*)out, 7 + pduLen);
+        }
+        pos += 6 + length;
+    }
+    client->send();
+
+    // 未处理完的部分移到缓冲区开头
+    memmove(conn->rx, conn->rx + pos, conn->rxLen - pos);
+    conn->rxLen -= pos;
+    return true;
+}
+
+void onModbusClient(void* arg, AsyncClient* client) {
+    if (modbusStats.connections >= MODBUS_MAX_CONNECTIONS) {
+        modbusStats.rejected++;
+        client->close(true);
+        delete client;
+        return;
+    }
+    ModbusConnection* conn = new ModbusConnection();
+    conn->rxLen = 0;
+    conn->closing = false;
+    modbusStats.connections++;
+    client->setNoDelay(true);
+
+    client->onData([conn](void* arg, AsyncClient* c, void* data, size_t len) {
+        if (conn->closing) return;
+        const uint8_t* bytes = (const uint8_t*)data;
+        while (len > 0) {
+            size_t n = min(len, sizeof(conn->rx) - conn->rxLen);
+            memcpy(conn->rx + conn->rxLen, bytes, n);
+            conn->rxLen += n;
+            bytes += n;
+            len -= n;
+            if (!modbusHandleFrames(c, conn)) return;
+        }
+    }, NULL);
+
+    // 断开回调会释放 conn 和 client，所以只在轮询回调中关闭，不在数据回调中关闭
+    client->onPoll([conn](void* arg, AsyncClient* c) {
+        if (conn->closing) c->close();
+    }, NULL);
+
+    client->onDisconnect([conn](void* arg, AsyncClient* c) {
+        modbusStats.connections--;
+        delete conn;
+        delete c;
+    }, NULL);
+}
+
+#if METRICS_ENABLED
+void writeModbusMetrics(Print& out) {
+    out.print("# TYPE esp_modbus_requests_total counter\n");
+    out.printf("esp_modbus_requests_total %u\n", modbusStats.requests);
+    out.print("# TYPE esp_modbus_exceptions_total counter\n");
+    out.printf("esp_modbus_exceptions_total %u\n", modbusStats.exceptions);
+    out.print("# TYPE esp_modbus_connections gauge\n");
+    out.printf("esp_modbus_connections %u\n", modbusStats.connections);
+    out.print("# TYPE esp_modbus_connections_rejected_total counter\n");
+    out.printf("esp_modbus_connections_rejected_total %u\n", modbusStats.rejected);
+}
+#endif
+
+void initModbus() {
+    modbusServer.onClient(onModbusClient, NULL);
+    modbusServer.setNoDelay(true);
+    modbusServer.begin();
+    LOGI(LOG_MOD_WEB, "Modbus TCP server started on port %d", MODBUS_PORT);
+}
+
+#endif
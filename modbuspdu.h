@@ -0,0 +1,223 @@
+#ifndef MODBUSPDU_H
+#define MODBUSPDU_H
+
+#include <Arduino.h>
+#include "types.h"
+
+// Modbus 报文处理（modbusProcess），与传输和硬件无关：只依赖请求和应答缓冲区，
+// 读取采集值、继电器配置和提交继电器命令都通过下面声明的几个函数（由 modbus.h 实现）。
+//
+// 寄存器映射（地址从0开始，以默认板 12路模拟量/4路继电器/2路温度 为例，数量由 Board 决定）：
+//   线圈        0-3     继电器输出状态（读写，写入=手动模式开关，自动模式下返回异常）
+//   离散输入    0-3     继电器是否在自动运行
+//   保持寄存器  0-3     继电器模式 0=手动 1=自动（读写）
+//   输入寄存器  0-23    通道0-11 物理值，float32，每通道2个寄存器（高字在前）
+//               100-111 通道0-11 滤波后的ADC原始值
+//               200-203 温度传感器0-1 温度(°C)，float32
+//               204-205 温度传感器0-1 故障码（紧跟在温度之后）
+
+#define MODBUS_MAX_ADU 260            // MBAP头7字节 + PDU最多253字节
+
+#define MB_FC_READ_COILS 0x01
+#define MB_FC_READ_DISCRETE_INPUTS 0x02
+#define MB_FC_READ_HOLDING_REGISTERS 0x03
+#define MB_FC_READ_INPUT_REGISTERS 0x04
+#define MB_FC_WRITE_SINGLE_COIL 0x05
+#define MB_FC_WRITE_SINGLE_REGISTER 0x06
+#define MB_FC_WRITE_MULTIPLE_COILS 0x0F
+#define MB_FC_WRITE_MULTIPLE_REGISTERS 0x10
+
+#define MB_EX_ILLEGAL_FUNCTION 0x01
+#define MB_EX_ILLEGAL_ADDRESS 0x02
+#define MB_EX_ILLEGAL_VALUE 0x03
+#define MB_EX_DEVICE_BUSY 0x06
+
+#define MB_INPUT_ANALOG_VALUE 0
+#define MB_INPUT_ANALOG_RAW 100
+#define MB_INPUT_TEMP_VALUE 200
+#define MB_INPUT_TEMP_FAULT (MB_INPUT_TEMP_VALUE + 2 * Board::TEMP_SENSORS)
+
+static_assert(2 * Board::ANALOG_CHANNELS <= MB_INPUT_ANALOG_RAW, "analog value registers overlap raw registers");
+static_assert(MB_INPUT_ANALOG_RAW + Board::ANALOG_CHANNELS <= MB_INPUT_TEMP_VALUE, "analog raw registers overlap temperature registers");
+
+struct ModbusStats {
+    uint32_t requests;       // 处理的请求数
+    uint32_t exceptions;     // 返回异常应答的请求数
+    uint32_t connections;    // 当前连接数
+    uint32_t rejected;       // 因连接数已满拒绝的连接
+};
+
+ModbusStats modbusStats;
+
+// 设备访问（modbus.h 中实现）
+void mbReadSensors(SensorSnapshot& snap);
+void mbReadRelays(RelayConfigSet& relays);
+size_t mbCommandSpace();                      // 命令队列还能放入的命令数
+bool mbRequestRelaySet(int channel, bool on);
+bool mbRequestRelayMode(const RelayChannel& relay, int channel, uint16_t mode);
+
+void mbPut16(uint8_t* p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+uint16_t mbGet16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+// 输入寄存器的值，地址无效时返回 false
+bool mbInputRegister(const SensorSnapshot& snap, uint16_t addr, uint16_t& out) {
+    if (addr < MB_INPUT_ANALOG_VALUE + 2 * Board::ANALOG_CHANNELS) {
+        int ch = (addr - MB_INPUT_ANALOG_VALUE) / 2;
+        uint32_t bits;
+        memcpy(&bits, &snap.value[ch], 4);
+        out = (addr & 1) ? (bits & 0xFFFF) : (bits >> 16);
+        return true;
+    }
+    if (addr >= MB_INPUT_ANALOG_RAW && addr < MB_INPUT_ANALOG_RAW + Board::ANALOG_CHANNELS) {
+        out = (uint16_t)snap.currentValue[addr - MB_INPUT_ANALOG_RAW];
+        return true;
+    }
+    if (addr >= MB_INPUT_TEMP_VALUE && addr < MB_INPUT_TEMP_VALUE + 2 * Board::TEMP_SENSORS) {
+        int i = (addr - MB_INPUT_TEMP_VALUE) / 2;
+        uint32_t bits;
+        memcpy(&bits, &snap.tempValue[i], 4);
+        out = (addr & 1) ? (bits & 0xFFFF) : (bits >> 16);
+        return true;
+    }
+    if (addr >= MB_INPUT_TEMP_FAULT && addr < MB_INPUT_TEMP_FAULT + Board::TEMP_SENSORS) {
+        out = snap.tempFault[addr - MB_INPUT_TEMP_FAULT];
+        return true;
+    }
+    return false;
+}
+
+// 异常应答，返回PDU长度
+size_t mbException(uint8_t* pdu, uint8_t fc, uint8_t code) {
+    modbusStats.exceptions++;
+    pdu[0] = fc | 0x80;
+    pdu[1] = code;
+    return 2;
+}
+
+// 处理一个PDU（功能码+数据），应答写入 resp，返回应答PDU长度。
+// 写多个线圈/寄存器时先检查全部的值和继电器模式，并确认命令队列放得下，然后才入队，不会只执行一部分。
+size_t modbusProcess(const uint8_t* req, size_t len, uint8_t* resp) {
+    modbusStats.requests++;
+    uint8_t fc = req[0];
+    if (len < 5) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+
+    uint16_t addr = mbGet16(req + 1);
+    uint16_t count = mbGet16(req + 3);
+    resp[0] = fc;
+
+    switch (fc) {
+        case MB_FC_READ_COILS:
+        case MB_FC_READ_DISCRETE_INPUTS: {
+            if (count < 1 || count > 2000) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            if (addr + count > Board::RELAY_CHANNELS) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+            SensorSnapshot snap;
+            mbReadSensors(snap);
+            uint32_t bits = fc == MB_FC_READ_COILS ? snap.relayState : snap.relayAutoRunning;
+            uint8_t bytes = (count + 7) / 8;
+            resp[1] = bytes;
+            memset(resp + 2, 0, bytes);
+            for (int i = 0; i < count; i++) {
+                if (bits & (1u << (addr + i))) resp[2 + i / 8] |= 1u << (i % 8);
+            }
+            return 2 + bytes;
+        }
+
+        case MB_FC_READ_HOLDING_REGISTERS: {
+            if (count < 1 || count > 125) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            if (addr + count > Board::RELAY_CHANNELS) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+            RelayConfigSet relays;
+            mbReadRelays(relays);
+            resp[1] = count * 2;
+            for (int i = 0; i < count; i++) {
+                mbPut16(resp + 2 + i * 2, relays.channel[addr + i].mode);
+            }
+            return 2 + count * 2;
+        }
+
+        case MB_FC_READ_INPUT_REGISTERS: {
+            if (count < 1 || count > 125) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            SensorSnapshot snap;
+            mbReadSensors(snap);
+            resp[1] = count * 2;
+            for (int i = 0; i < count; i++) {
+                uint16_t v;
+                if (!mbInputRegister(snap, addr + i, v)) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+                mbPut16(resp + 2 + i * 2, v);
+            }
+            return 2 + count * 2;
+        }
+
+        case MB_FC_WRITE_SINGLE_COIL: {
+            uint16_t value = count;
+            if (value != 0xFF00 && value != 0x0000) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            if (addr >= Board::RELAY_CHANNELS) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+            RelayConfigSet relays;
+            mbReadRelays(relays);
+            // 自动模式下输出由自动循环控制，控制任务会拒绝手动开关
+            if (relays.channel[addr].mode != MANUAL) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            if (!mbRequestRelaySet(addr, value == 0xFF00)) return mbException(resp, fc, MB_EX_DEVICE_BUSY);
+            memcpy(resp, req, 5);  // 原样回显
+            return 5;
+        }
+
+        case MB_FC_WRITE_SINGLE_REGISTER: {
+            uint16_t value = count;
+            if (addr >= Board::RELAY_CHANNELS) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+            if (value > AUTOMATIC) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            RelayConfigSet relays;
+            mbReadRelays(relays);
+            if (!mbRequestRelayMode(relays.channel[addr], addr, value)) return mbException(resp, fc, MB_EX_DEVICE_BUSY);
+            memcpy(resp, req, 5);
+            return 5;
+        }
+
+        case MB_FC_WRITE_MULTIPLE_COILS: {
+            if (len < 6 || count < 1 || count > 1968 || req[5] != (count + 7) / 8 || len < 6u + req[5]) {
+                return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            }
+            if (addr + count > Board::RELAY_CHANNELS) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+            RelayConfigSet relays;
+            mbReadRelays(relays);
+            for (int i = 0; i < count; i++) {
+                if (relays.channel[addr + i].mode != MANUAL) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            }
+            if (mbCommandSpace() < count) return mbException(resp, fc, MB_EX_DEVICE_BUSY);
+            for (int i = 0; i < count; i++) {
+                bool on = (req[6 + i / 8] >> (i % 8)) & 1;
+                if (!mbRequestRelaySet(addr + i, on)) return mbException(resp, fc, MB_EX_DEVICE_BUSY);
+            }
+            memcpy(resp, req, 5);
+            return 5;
+        }
+
+        case MB_FC_WRITE_MULTIPLE_REGISTERS: {
+            if (len < 6 || count < 1 || count > 123 || req[5] != count * 2 || len < 6u + req[5]) {
+                return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            }
+            if (addr + count > Board::RELAY_CHANNELS) return mbException(resp, fc, MB_EX_ILLEGAL_ADDRESS);
+            for (int i = 0; i < count; i++) {
+                if (mbGet16(req + 6 + i * 2) > AUTOMATIC) return mbException(resp, fc, MB_EX_ILLEGAL_VALUE);
+            }
+            if (mbCommandSpace() < count) return mbException(resp, fc, MB_EX_DEVICE_BUSY);
+            RelayConfigSet relays;
+            mbReadRelays(relays);
+            for (int i = 0; i < count; i++) {
+                int channel = addr + i;
+                if (!mbRequestRelayMode(relays.channel[channel], channel, mbGet16(req + 6 + i * 2))) {
+                    return mbException(resp, fc, MB_EX_DEVICE_BUSY);
+                }
+            }
+            memcpy(resp, req, 5);
+            return 5;
+        }
+    }
+    return mbException(resp, fc, MB_EX_ILLEGAL_FUNCTION);
+}
+
+#endif
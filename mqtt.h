@@ -0,0 +1,499 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "control.h"
+#include "jsonwriter.h"
+#include "configcache.h"
+
+// MQTT 发布任务（core 0）：按设定间隔从采集快照生成记录放入发件队列，连接代理时依次发布；
+// 继电器状态以保留消息发布，并订阅继电器命令主题。
+// 使用自适应采样的通道按快照中的 rateScale 放慢发布：每个基本间隔只放入到期的通道，
+// 其余记为 NAN（批量模式为 null，单通道模式不发布）；没有任何通道到期时不生成记录。
+// 与代理断开期间记录先存在内存环形队列，满了以后把最旧的记录转存到 SPIFFS 文件，
+// 重连后先回放文件再回放内存，保证顺序。所有网络和文件操作都在这个任务中，不影响采样。
+//
+// 主题（<base> 默认为 webjk/<MAC后6位>，时间戳为开机后的毫秒数）：
+//   <base>/status              online/offline（保留，遗嘱消息）
+//   <base>/analog/<ch>         单通道模式：{"ts":ms,"v":物理值}
+//   <base>/temp/<i>            单通道模式：{"ts":ms,"v":温度}
+//   <base>/telemetry           批量模式：[[ts,[a0..a11],[t0,t1]],...]，未启用或本次未到期的通道为 null
+//   <base>/relay/<n>/state     ON/OFF（保留）
+//   <base>/relay/<n>/auto      ON/OFF 是否在自动运行（保留）
+//   <base>/relay/<n>/set       命令：ON/OFF
+//   <base>/relay/<n>/auto/set  命令：ON/OFF 启动/停止自动运行
+//   <base>/alarm/<ch>          报警状态变化（保留，格式同 WebSocket 报警消息，见 alarm.h）
+
+#define MQTT_RAM_QUEUE_SIZE 64                 // 内存队列记录数
+#define MQTT_FLASH_QUEUE_PATH "/mqtt_queue.bin"
+#define MQTT_FLASH_QUEUE_MAX 65536             // 文件队列上限(字节)
+#define MQTT_BATCH_MAX 8                       // 批量模式每条消息最多的记录数
+#define MQTT_DRAIN_MAX 4                       // 每轮最多发布的消息数，避免回放时长时间不处理命令
+#define MQTT_PAYLOAD_SIZE 1024
+#define MQTT_RECORD_JSON_SIZE 320              // 批量模式一条记录的JSON（12路模拟量约230字节）
+#define MQTT_TASK_TICK_MS 20
+#define MQTT_RECONNECT_MIN 1000                // 重连退避(ms)
+#define MQTT_RECONNECT_MAX 60000
+
+struct MqttConfig {
+    bool enabled;
+    InlineString<64> host;
+    uint16_t port;
+    InlineString<32> user;
+    InlineString<64> pass;
+    InlineString<48> baseTopic;
+    uint32_t interval;      // 记录/发布间隔(ms)
+    bool batch;             // true: 批量主题；false: 每通道一个主题
+};
+
+// 一条遥测记录（内存和文件队列中的格式）
+struct MqttRecord {
+    uint32_t timestamp;                    // millis()
+    float value[Board::ANALOG_CHANNELS];   // 未启用的通道为 NAN
+    float temp[Board::TEMP_SENSORS];       // 未启用的传感器为 NAN
+};
+
+struct MqttStats {
+    uint32_t published;     // 发布成功的消息数
+    uint32_t failed;        // 发布失败的消息数
+    uint32_t spilled;       // 转存到文件的记录数
+    uint32_t dropped;       // 队列全满丢弃的记录数
+    uint32_t connects;      // 成功连接次数
+    uint32_t commands;      // 收到的继电器命令数
+};
+
+extern Snapshot<SensorSnapshot> sensorSnapshot;
+
+// 网络回调只修改暂存的配置（只在 AsyncTCP 任务中访问）并发布，MQTT 任务取到新配置后重新连接
+MqttConfig mqttStaged = {false, {}, 1883, {}, {}, {}, 5000, true};
+Snapshot<MqttConfig> mqttConfigs;
+MqttConfig mqttConfig = mqttStaged;      // MQTT 任务使用的配置
+MqttStats mqttStats;
+
+WiFiClient mqttNet;
+PubSubClient mqttClient(mqttNet);
+char mqttBase[48];
+char mqttPayload[MQTT_PAYLOAD_SIZE];
+
+// 发件队列：只在 MQTT 任务中访问
+MqttRecord mqttRam[MQTT_RAM_QUEUE_SIZE];
+uint32_t mqttRamHead = 0;
+uint32_t mqttRamTail = 0;
+uint32_t mqttFlashSize = 0;       // 文件中的记录总字节数
+uint32_t mqttFlashReadPos = 0;    // 已发布到的位置
+
+uint8_t mqttChannelWait[Board::ANALOG_CHANNELS];   // 各通道距上次发布经过的基本间隔数
+
+uint32_t mqttRelayState = 0;      // 已发布的继电器状态
+uint32_t mqttRelayAuto = 0;
+
+// 内存队列满时把最旧的记录转存到文件，文件也满时丢弃
+void mqttEnqueue(const MqttRecord& rec) {
+    if (mqttRamTail - mqttRamHead >= MQTT_RAM_QUEUE_SIZE) {
+        const MqttRecord& oldest = mqttRam[mqttRamHead % MQTT_RAM_QUEUE_SIZE];
+        if (mqttFlashSize + sizeof(MqttRecord) <= MQTT_FLASH_QUEUE_MAX) {
+            File file = SPIFFS.open(MQTT_FLASH_QUEUE_PATH, "a");
+            if (file && file.write((const uint8_t*)&oldest, sizeof(MqttRecord)) == sizeof(MqttRecord)) {
+                mqttFlashSize += sizeof(MqttRecord);
+                mqttStats.spilled++;
+            } else {
+                mqttStats.dropped++;
+            }
+            if (file) file.close();
+        } else {
+            mqttStats.dropped++;
+        }
+        mqttRamHead++;
+    }
+    mqttRam[mqttRamTail % MQTT_RAM_QUEUE_SIZE] = rec;
+    mqttRamTail++;
+}
+
+// 每个基本间隔调用一次，没有要发布的值时返回 false
+bool mqttMakeRecord(MqttRecord& rec) {
+    SensorSnapshot snap;
+    sensorSnapshot.read(snap);
+
+    bool any = false;
+    rec.timestamp = snap.timestamp;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        rec.value[i] = NAN;
+        if (!(snap.enabledMask & (1u << i))) continue;
+        // 通道加快时 rateScale 变小，下一个基本间隔就到期
+        if (++mqttChannelWait[i] < snap.rateScale[i]) continue;
+        mqttChannelWait[i] = 0;
+        rec.value[i] = snap.value[i];
+        any = true;
+    }
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        bool enabled = snap.tempEnabledMask & (1u << i);
+        rec.temp[i] = enabled ? snap.tempValue[i] : NAN;
+        if (enabled) any = true;
+    }
+    return any;
+}
+
+bool mqttPublish(const char* topic, const char* payload, size_t len, bool retained) {
+    if (mqttClient.publish(topic, (const uint8_t*)payload, len, retained)) {
+        mqttStats.published++;
+        return true;
+    }
+    mqttStats.failed++;
+    return false;
+}
+
+// 发布一组记录，返回从头开始已发布的记录数（失败时之后的记录稍后重发）。
+// 批量模式下放不进这条消息的记录留给下一条消息。
+int mqttPublishRecords(const MqttRecord* recs, int count) {
+    char topic[96];
+
+    if (mqttConfig.batch) {
+        static char recordJson[MQTT_RECORD_JSON_SIZE];
+        BufferPrint out(mqttPayload, MQTT_PAYLOAD_SIZE);
+        JsonWriter json(out);
+        json.beginArray();
+        int n = 0;
+        for (; n < count; n++) {
+            BufferPrint record(recordJson, sizeof(recordJson));
+            JsonWriter item(record);
+            item.beginArray();
+            item.value((unsigned long)recs[n].timestamp);
+            item.beginArray();
+            for (int i = 0; i < Board::ANALOG_CHANNELS; i++) item.value((double)recs[n].value[i]);
+            item.endArray();
+            item.beginArray();
+            for (int i = 0; i < Board::TEMP_SENSORS; i++) item.value((double)recs[n].temp[i]);
+            item.endArray();
+            item.endArray();
+            if (record.overflowed()) break;
+            // 分隔的逗号和结尾的 ] 也要放得下
+            if (out.length() + (n ? 1 : 0) + record.length() + 1 >= MQTT_PAYLOAD_SIZE) break;
+            json.raw(NULL, recordJson);
+        }
+        json.endArray();
+        if (n == 0 || out.overflowed()) {
+            LOGW(LOG_MOD_WEB, "MQTT record does not fit in %u byte payload", (unsigned)MQTT_PAYLOAD_SIZE);
+            mqttStats.failed++;
+            return 0;
+        }
+        snprintf(topic, sizeof(topic), "%s/telemetry", mqttBase);
+        return mqttPublish(topic, mqttPayload, out.length(), false) ? n : 0;
+    }
+
+    for (int r = 0; r < count; r++) {
+        for (int i = 0; i < Board::ANALOG_CHANNELS + Board::TEMP_SENSORS; i++) {
+            float v = i < Board::ANALOG_CHANNELS ? recs[r].value[i] : recs[r].temp[i - Board::ANALOG_CHANNELS];
+            if (isnan(v)) continue;
+            if (i < Board::ANALOG_CHANNELS) {
+                snprintf(topic, sizeof(topic), "%s/analog/%d", mqttBase, i);
+            } else {
+                snprintf(topic, sizeof(topic), "%s/temp/%d", mqttBase, i - Board::ANALOG_CHANNELS);
+            }
+            int n = snprintf(mqttPayload, MQTT_PAYLOAD_SIZE, "{\"ts\":%u,\"v\":%.7g}",
+                recs[r].timestamp, v);
+            if (!mqttPublish(topic, mqttPayload, n, false)) return r;
+        }
+    }
+    return count;
+}
+
+// 先回放文件中的记录，再发布内存中的记录
+void mqttDrain() {
+    MqttRecord recs[MQTT_BATCH_MAX];
+    int perMessage = mqttConfig.batch ? MQTT_BATCH_MAX : 1;
+
+    for (int m = 0; m < MQTT_DRAIN_MAX; m++) {
+        if (mqttFlashReadPos < mqttFlashSize) {
+            File file = SPIFFS.open(MQTT_FLASH_QUEUE_PATH, "r");
+            if (!file) {
+                mqttFlashSize = mqttFlashReadPos = 0;
+                continue;
+            }
+            file.seek(mqttFlashReadPos);
+            size_t bytes = file.read((uint8_t*)recs, perMessage * sizeof(MqttRecord));
+            file.close();
+            int count = bytes / sizeof(MqttRecord);
+            if (count == 0) {
+                // 文件比记录的短（例如写入时掉电），放弃剩余部分
+                mqttFlashReadPos = mqttFlashSize;
+            } else {
+                int sent = mqttPublishRecords(recs, count);
+                mqttFlashReadPos += sent * sizeof(MqttRecord);
+                if (sent == 0) return;
+            }
+            if (mqttFlashReadPos >= mqttFlashSize) {
+                SPIFFS.remove(MQTT_FLASH_QUEUE_PATH);
+                mqttFlashSize = mqttFlashReadPos = 0;
+            }
+            continue;
+        }
+
+        int count = 0;
+        while (count < perMessage && mqttRamHead + count < mqttRamTail) {
+            recs[count] = mqttRam[(mqttRamHead + count) % MQTT_RAM_QUEUE_SIZE];
+            count++;
+        }
+        if (count == 0) return;
+        int sent = mqttPublishRecords(recs, count);
+        mqttRamHead += sent;
+        if (sent == 0) return;
+    }
+}
+
+// 继电器状态有变化时发布保留消息；force 用于刚连接时全部重发
+void mqttPublishRelayStates(bool force) {
+    SensorSnapshot snap;
+    sensorSnapshot.read(snap);
+    char topic[96];
+
+    for (int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        uint32_t bit = 1u << i;
+        bool state = snap.relayState & bit;
+        bool autoRunning = snap.relayAutoRunning & bit;
+        if (force || state != (bool)(mqttRelayState & bit)) {
+            snprintf(topic, sizeof(topic), "%s/relay/%d/state", mqttBase, i);
+            if (!mqttPublish(topic, state ? "ON" : "OFF", state ? 2 : 3, true)) return;
+        }
+        if (force || autoRunning != (bool)(mqttRelayAuto & bit)) {
+            snprintf(topic, sizeof(topic), "%s/relay/%d/auto", mqttBase, i);
+            if (!mqttPublish(topic, autoRunning ? "ON" : "OFF", autoRunning ? 2 : 3, true)) return;
+        }
+    }
+    mqttRelayState = snap.relayState;
+    mqttRelayAuto = snap.relayAutoRunning;
+}
+
+// 继电器命令：<base>/relay/<n>/set 或 <base>/relay/<n>/auto/set，载荷 ON/OFF/1/0
+void onMqttMessage(char* topic, uint8_t* payload, unsigned int len) {
+    size_t baseLen = strlen(mqttBase);
+    if (strncmp(topic, mqttBase, baseLen) != 0 || strncmp(topic + baseLen, "/relay/", 7) != 0) return;
+
+    const char* p = topic + baseLen + 7;
+    char* endp;
+    long channel = strtol(p, &endp, 10);
+    if (endp == p || *endp != '/' || channel < 0 || channel >= Board::RELAY_CHANNELS) return;
+    const char* action = endp + 1;
+    bool on = (len == 2 && strncasecmp((const char*)payload, "ON", 2) == 0) ||
+              (len == 1 && payload[0] == '1');
+
+    mqttStats.commands++;
+    bool queued;
+    if (strcmp(action, "set") == 0) {
+        queued = requestRelaySet(channel, on, 0, 0, relayMqttCommandQueue) != 0;
+    } else if (strcmp(action, "auto/set") == 0) {
+        queued = requestRelayAuto(channel, on, 0, 0, relayMqttCommandQueue) != 0;
+    } else {
+        return;
+    }
+    if (!queued) {
+        LOGW(LOG_MOD_RELAY, "MQTT relay command dropped, queue full");
+    }
+}
+
+bool mqttConnect() {
+    if (mqttConfig.baseTopic.isEmpty()) {
+        String mac = WiFi.macAddress();
+        mac.replace(":", "");
+        snprintf(mqttBase, sizeof(mqttBase), "webjk/%s", mac.c_str() + (mac.length() > 6 ? mac.length() - 6 : 0));
+    } else {
+        snprintf(mqttBase, sizeof(mqttBase), "%s", mqttConfig.baseTopic.c_str());
+    }
+
+    char willTopic[64];
+    snprintf(willTopic, sizeof(willTopic), "%s/status", mqttBase);
+
+    mqttClient.setServer(mqttConfig.host.c_str(), mqttConfig.port);
+    const char* user = mqttConfig.user.isEmpty() ? NULL : mqttConfig.user.c_str();
+    const char* pass = mqttConfig.pass.isEmpty() ? NULL : mqttConfig.pass.c_str();
+    if (!mqttClient.connect(mqttBase, user, pass, willTopic, 1, true, "offline")) {
+        LOGW(LOG_MOD_WEB, "MQTT connect to %s:%d failed, state %d",
+            mqttConfig.host.c_str(), mqttConfig.port, mqttClient.state());
+        return false;
+    }
+
+    mqttStats.connects++;
+    mqttPublish(willTopic, "online", 6, true);
+
+    char topic[96];
+    snprintf(topic, sizeof(topic), "%s/relay/+/set", mqttBase);
+    mqttClient.subscribe(topic);
+    snprintf(topic, sizeof(topic), "%s/relay/+/auto/set", mqttBase);
+    mqttClient.subscribe(topic);
+
+    mqttPublishRelayStates(true);
+    LOGI(LOG_MOD_WEB, "MQTT connected to %s:%d as %s", mqttConfig.host.c_str(), mqttConfig.port, mqttBase);
+    return true;
+}
+
+void mqttPublishAlarms();   // alarm.h
+
+void mqttTask(void* param) {
+    unsigned long lastRecord = 0;
+    unsigned long lastAttempt = 0;
+    unsigned long backoff = 0;
+    uint32_t configSeq = 0;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(MQTT_TASK_TICK_MS));
+        unsigned long now = millis();
+
+        // 配置修改后用新配置重新连接
+        if (mqttConfigs.sequence() != configSeq) {
+            configSeq = mqttConfigs.read(mqttConfig);
+            if (mqttClient.connected()) mqttClient.disconnect();
+            backoff = 0;
+        }
+        if (!mqttConfig.enabled || mqttConfig.host.isEmpty()) continue;
+
+        // 断线时也照常记录，重连后回放
+        if (now - lastRecord >= mqttConfig.interval) {
+            lastRecord = now;
+            MqttRecord rec;
+            if (mqttMakeRecord(rec)) mqttEnqueue(rec);
+        }
+
+        if (!mqttClient.connected()) {
+            if (WiFi.status() != WL_CONNECTED || now - lastAttempt < backoff) continue;
+            lastAttempt = now;
+            if (mqttConnect()) {
+                backoff = 0;
+            } else {
+                backoff = backoff ? min(backoff * 2, (unsigned long)MQTT_RECONNECT_MAX) : MQTT_RECONNECT_MIN;
+            }
+            continue;
+        }
+
+        mqttClient.loop();
+        mqttPublishRelayStates(false);
+        mqttPublishAlarms();
+        mqttDrain();
+    }
+}
+
+// 保存 MQTT 配置
+void saveMqttConfig() {
+    METRICS_SCOPE(METRIC_SAVE_MQTT);
+    File file = SPIFFS.open("/mqtt_config.json", "w");
+    if (!file) {
+        LOGE(LOG_MOD_CFG, "Failed to open MQTT config file for writing");
+        return;
+    }
+
+    DynamicJsonDocument doc(512);
+    doc["enabled"] = mqttStaged.enabled;
+    doc["host"] = mqttStaged.host.c_str();
+    doc["port"] = mqttStaged.port;
+    doc["user"] = mqttStaged.user.c_str();
+    doc["pass"] = mqttStaged.pass.c_str();
+    doc["baseTopic"] = mqttStaged.baseTopic.c_str();
+    doc["interval"] = mqttStaged.interval;
+    doc["batch"] = mqttStaged.batch;
+
+    if (serializeJson(doc, file)) {
+        LOGI(LOG_MOD_CFG, "MQTT config saved");
+    } else {
+        LOGE(LOG_MOD_CFG, "Failed to write MQTT config");
+    }
+    file.close();
+}
+
+// 应用配置（password 为空时保留原密码），发布给 MQTT 任务重新连接
+void applyMqttConfig(JsonObject config) {
+    mqttStaged.enabled = config["enabled"] | false;
+    mqttStaged.host.set(config["host"] | "");
+    mqttStaged.port = config["port"] | 1883;
+    mqttStaged.user.set(config["user"] | "");
+    const char* pass = config["pass"] | "";
+    if (*pass) mqttStaged.pass.set(pass);
+    mqttStaged.baseTopic.set(config["baseTopic"] | "");
+    mqttStaged.interval = max(config["interval"] | 5000u, 200u);
+    mqttStaged.batch = config["batch"] | true;
+    mqttConfigs.publish(mqttStaged);
+    configChanged(CONFIG_MQTT);
+}
+
+void loadMqttConfig() {
+    if (!SPIFFS.exists("/mqtt_config.json")) {
+        LOGI(LOG_MOD_CFG, "No MQTT config file found, MQTT disabled");
+        return;
+    }
+    File file = SPIFFS.open("/mqtt_config.json", "r");
+    if (!file) {
+        LOGE(LOG_MOD_CFG, "Failed to open MQTT config file");
+        return;
+    }
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+        LOGE(LOG_MOD_CFG, "Failed to parse MQTT config file");
+        return;
+    }
+    applyMqttConfig(doc.as<JsonObject>());
+    LOGI(LOG_MOD_CFG, "MQTT config loaded, broker %s:%d", mqttStaged.host.c_str(), mqttStaged.port);
+}
+
+// 是否启用了 MQTT（任意任务中调用）
+bool mqttEnabled() {
+    MqttConfig config;
+    mqttConfigs.read(config);
+    return config.enabled;
+}
+
+// MQTT 配置（/get_mqtt_config），不返回密码
+void writeMqttConfigJson(JsonWriter& json) {
+    json.field("enabled", mqttStaged.enabled);
+    json.field("host", mqttStaged.host.c_str());
+    json.field("port", (unsigned int)mqttStaged.port);
+    json.field("user", mqttStaged.user.c_str());
+    json.field("hasPassword", !mqttStaged.pass.isEmpty());
+    json.field("baseTopic", mqttStaged.baseTopic.c_str());
+    json.field("interval", (unsigned long)mqttStaged.interval);
+    json.field("batch", mqttStaged.batch);
+}
+
+void initMqtt() {
+    // 上次断电前未发完的记录继续回放
+    if (SPIFFS.exists(MQTT_FLASH_QUEUE_PATH)) {
+        File file = SPIFFS.open(MQTT_FLASH_QUEUE_PATH, "r");
+        if (file) {
+            mqttFlashSize = file.size() / sizeof(MqttRecord) * sizeof(MqttRecord);
+            file.close();
+        }
+    }
+    mqttClient.setBufferSize(MQTT_PAYLOAD_SIZE + 128);
+    mqttClient.setCallback(onMqttMessage);
+    xTaskCreatePinnedToCore(mqttTask, "mqtt", 6144, NULL, 1, NULL, 0);
+}
+
+#if METRICS_ENABLED
+void writeMqttMetrics(Print& out) {
+    out.print("# TYPE esp_mqtt_connected gauge\n");
+    out.printf("esp_mqtt_connected %d\n", mqttClient.connected() ? 1 : 0);
+    out.print("# TYPE esp_mqtt_published_total counter\n");
+    out.printf("esp_mqtt_published_total %u\n", mqttStats.published);
+    out.print("# TYPE esp_mqtt_publish_failed_total counter\n");
+    out.printf("esp_mqtt_publish_failed_total %u\n", mqttStats.failed);
+    out.print("# TYPE esp_mqtt_connects_total counter\n");
+    out.printf("esp_mqtt_connects_total %u\n", mqttStats.connects);
+    out.print("# TYPE esp_mqtt_commands_total counter\n");
+    out.printf("esp_mqtt_commands_total %u\n", mqttStats.commands);
+    out.print("# TYPE esp_mqtt_records_spilled_total counter\n");
+    out.printf("esp_mqtt_records_spilled_total %u\n", mqttStats.spilled);
+    out.print("# TYPE esp_mqtt_records_dropped_total counter\n");
+    out.printf("esp_mqtt_records_dropped_total %u\n", mqttStats.dropped);
+    out.print("# TYPE esp_mqtt_queue_records gauge\n");
+    out.printf("esp_mqtt_queue_records %u\n",
+        (unsigned)(mqttRamTail - mqttRamHead + (mqttFlashSize - mqttFlashReadPos) / sizeof(MqttRecord)));
+}
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef RELAYIO_H
+#define RELAYIO_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <soc/gpio_struct.h>
+#include <atomic>
+#include "types.h"
+#include "log.h"
+
+// 继电器输出：板级配置 Board::RELAY_OUTPUT 选择直接用 GPIO、MCP23017 或级联的 74HC595。
+//
+// 控制任务执行命令和自动循环时只修改目标状态（relayOutputSet），一轮结束后 relayOutputFlush
+// 把所有变化一次写出：GPIO 每个寄存器组各写一次 w1ts/w1tc，MCP23017 每片一次 I2C 传输，
+// 74HC595 整条链移位一次后锁存。同一轮切换的继电器同时动作，总线访问也最少。
+// 状态位图第i位对应继电器i，高电平（置1）为吸合。
+
+// GPIO：GPIO0-31 在 out 寄存器组，GPIO32-48 在 out1 寄存器组
+template <typename B>
+struct RelayOutputGpio {
+    static void begin() {
+        for (int i = 0; i < B::RELAY_CHANNELS; i++) {
+            digitalWrite(B::relayGpio(i), LOW);
+            pinMode(B::relayGpio(i), OUTPUT);
+        }
+    }
+
+    static bool write(uint32_t state, uint32_t changed) {
+        uint32_t set0 = 0, clear0 = 0, set1 = 0, clear1 = 0;
+        for (int i = 0; i < B::RELAY_CHANNELS; i++) {
+            if (!(changed & (1u << i))) continue;
+            int pin = B::relayGpio(i);
+            bool on = state & (1u << i);
+            if (pin < 32) {
+                if (on) set0 |= 1u << pin; else clear0 |= 1u << pin;
+            } else {
+                if (on) set1 |= 1u << (pin - 32); else clear1 |= 1u << (pin - 32);
+            }
+        }
+        if (set0) GPIO.out_w1ts = set0;
+        if (clear0) GPIO.out_w1tc = clear0;
+        if (set1) GPIO.out1_w1ts.val = set1;
+        if (clear1) GPIO.out1_w1tc.val = clear1;
+        return true;
+    }
+
+    static void label(int channel, char* buf, size_t len) {
+        snprintf(buf, len, "GPIO%d", B::relayGpio(channel));
+    }
+};
+
+// MCP23017：每片16路，地址从 B::MCP23017_ADDRESS 起连续；与外部ADC共用 I2C
+#define MCP23017_REG_IODIRA 0x00
+#define MCP23017_REG_OLATA 0x14
+
+template <typename B>
+struct RelayOutputMcp23017 {
+    enum { CHIPS = (B::RELAY_CHANNELS + 15) / 16 };
+
+    // 写 A、B 两个端口（寄存器地址自动递增）
+    static bool writeReg16(int chip, uint8_t reg, uint16_t value) {
+        Wire.beginTransmission(B::MCP23017_ADDRESS + chip);
+        Wire.write(reg);
+        Wire.write(value & 0xFF);
+        Wire.write(value >> 8);
+        return Wire.endTransmission() == 0;
+    }
+
+    static void begin() {
+        Wire.begin(B::EXT_I2C_SDA_GPIO, B::EXT_I2C_SCL_GPIO, 400000);
+        for (int chip = 0; chip < CHIPS; chip++) {
+            // 先把输出锁存清零再设为输出，上电时不会误吸合
+            if (!writeReg16(chip, MCP23017_REG_OLATA, 0) || !writeReg16(chip, MCP23017_REG_IODIRA, 0)) {
+                LOGE(LOG_MOD_RELAY, "MCP23017 at 0x%02x not responding", B::MCP23017_ADDRESS + chip);
+            }
+        }
+    }
+
+    static bool write(uint32_t state, uint32_t changed) {
+        bool ok = true;
+        for (int chip = 0; chip < CHIPS; chip++) {
+            if (!((changed >> (chip * 16)) & 0xFFFF)) continue;
+            if (!writeReg16(chip, MCP23017_REG_OLATA, (state >> (chip * 16)) & 0xFFFF)) ok = false;
+        }
+        return ok;
+    }
+
+    static void label(int channel, char* buf, size_t len) {
+        int pin = channel % 16;
+        snprintf(buf, len, "MCP23017@0x%02x GP%c%d", B::MCP23017_ADDRESS + channel / 16,
+            pin < 8 ? 'A' : 'B', pin % 8);
+    }
+};
+
+// 74HC595：DS/SHCP 接硬件SPI的 MOSI/SCK，STCP 接 B::HC595_LATCH_GPIO。
+// 其他SPI设备通信时移位寄存器会移入无关数据，但锁存前总是整条链重新移位，输出不受影响
+template <typename B>
+struct RelayOutput74hc595 {
+    enum { CHIPS = (B::RELAY_CHANNELS + 7) / 8 };
+
+    static void begin() {
+        digitalWrite(B::HC595_LATCH_GPIO, LOW);
+        pinMode(B::HC595_LATCH_GPIO, OUTPUT);
+        SPI.begin(B::SPI_SCK_GPIO, B::SPI_MISO_GPIO, B::SPI_MOSI_GPIO);
+    }
+
+    static bool write(uint32_t state, uint32_t changed) {
+        SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+        // 先移入链上最后一片的数据
+        for (int chip = CHIPS - 1; chip >= 0; chip--) {
+            SPI.transfer((state >> (chip * 8)) & 0xFF);
+        }
+        // 上升沿同时更新全部输出
+        digitalWrite(B::HC595_LATCH_GPIO, HIGH);
+        digitalWrite(B::HC595_LATCH_GPIO, LOW);
+        SPI.endTransaction();
+        return true;
+    }
+
+    static void label(int channel, char* buf, size_t len) {
+        snprintf(buf, len, "74HC595 #%d Q%d", channel / 8 + 1, channel % 8);
+    }
+};
+
+template <typename B, int Kind = B::RELAY_OUTPUT> struct RelayOutputSelect;
+template <typename B> struct RelayOutputSelect<B, RELAY_OUTPUT_GPIO> { typedef RelayOutputGpio<B> type; };
+template <typename B> struct RelayOutputSelect<B, RELAY_OUTPUT_MCP23017> { typedef RelayOutputMcp23017<B> type; };
+template <typename B> struct RelayOutputSelect<B, RELAY_OUTPUT_74HC595> { typedef RelayOutput74hc595<B> type; };
+
+typedef RelayOutputSelect<Board>::type RelayOutput;
+
+#define RELAY_ALL_MASK (0xFFFFFFFFu >> (32 - Board::RELAY_CHANNELS))
+
+struct RelayOutputStats {
+    uint32_t flushes;          // 有变化并写出的次数
+    uint32_t switched;         // 切换的继电器路数
+    uint32_t failed;           // 写出失败的次数（下一轮重试）
+};
+
+// 只在控制任务中访问（初始化在控制任务启动前）
+uint32_t relayOutputTarget = 0;    // 目标状态
+uint32_t relayOutputApplied = 0;   // 已写到硬件的状态
+RelayOutputStats relayOutputStats;
+// 写出后切换过的继电器位图，由读取方清零（波形捕获的继电器触发）
+std::atomic<uint32_t> relayOutputToggled(0);
+
+// 初始化输出，全部断开
+void initRelayOutputs() {
+    relayOutputTarget = 0;
+    relayOutputApplied = 0;
+    RelayOutput::begin();
+    RelayOutput::write(0, RELAY_ALL_MASK);
+}
+
+void relayOutputSet(int channel, bool on) {
+    if (on) relayOutputTarget |= 1u << channel;
+    else relayOutputTarget &= ~(1u << channel);
+}
+
+// 把本轮的全部变化一次写出
+void relayOutputFlush() {
+    uint32_t changed = relayOutputTarget ^ relayOutputApplied;
+    if (!changed) return;
+    if (!RelayOutput::write(relayOutputTarget, changed)) {
+        relayOutputStats.failed++;
+        return;
+    }
+    relayOutputApplied = relayOutputTarget;
+    relayOutputToggled.fetch_or(changed, std::memory_order_relaxed);
+    relayOutputStats.flushes++;
+    relayOutputStats.switched += __builtin_popcount(changed);
+}
+
+// 继电器的输出位置，如 "GPIO21"、"MCP23017@0x20 GPA3"
+void relayOutputLabel(int channel, char* buf, size_t len) {
+    RelayOutput::label(channel, buf, len);
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef ROLLINGSTATS_H
+#define ROLLINGSTATS_H
+
+#include <math.h>
+#include <stdint.h>
+
+// 滑动窗口统计，只依赖标准库，可以直接在主机上编译验证。
+//
+// 窗口按时间切成 BUCKETS 个桶，每桶 BUCKET_MS：当前桶用 Welford 累计样本数、均值和二阶矩，
+// 桶满后并入窗口汇总（Chan 合并），最老的桶按同样的公式从汇总中减去，每个样本 O(1)。
+// 最小/最大值用单调队列维护各桶的极值，变化率取最新和最老的非空桶均值之差除以其时间差。
+// 窗口覆盖当前桶和之前 BUCKETS-1 个完整的桶。汇总每轮换一圈从桶重新累计一次，消除减法的舍入累积。
+
+struct RollingResult {
+    uint32_t count;     // 窗口内的样本数
+    float min;
+    float max;
+    float mean;
+    float std;          // 样本标准差
+    float rate;         // 变化率（每秒），数据不足时为 NAN
+};
+
+template <uint32_t BUCKET_MS, int BUCKETS>
+class RollingWindow {
+    static_assert(BUCKETS >= 2 && BUCKETS <= 255, "bucket count out of range");
+
+public:
+    static const uint32_t SPAN_MS = BUCKET_MS * BUCKETS;
+
+    RollingWindow() { reset(); }
+
+    void reset() {
+        started_ = false;
+        seq_ = 0;
+        for (int k = 0; k < BUCKETS; k++) clear(ring_[k]);
+        clear(cur_);
+        curSum_ = 0;
+        count_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+        minHead_ = minSize_ = 0;
+        maxHead_ = maxSize_ = 0;
+        oldest_ = newest_ = 0;
+        hasData_ = false;
+    }
+
+    // 加入一个样本，now 为 millis()
+    void add(uint32_t now, float x) {
+        advance(now);
+        Bucket& b = cur_;
+        b.n++;
+        float d = x - b.mean;
+        b.mean += d / b.n;
+        b.m2 += d * (x - b.mean);
+        if (b.n == 1 || x < b.min) b.min = x;
+        if (b.n == 1 || x > b.max) b.max = x;
+        curSum_ += now - start_;
+    }
+
+    // 把时间推进到 now，期间结束的桶依次并入窗口（没有样本时也要调用，使旧数据按时移出）
+    void advance(uint32_t now) {
+        if (!started_) {
+            started_ = true;
+            start_ = now - now % BUCKET_MS;
+            return;
+        }
+        uint32_t elapsed = now - start_;
+        if (elapsed < BUCKET_MS) return;
+        if (elapsed >= SPAN_MS) {
+            // 整个窗口都已过去
+            reset();
+            started_ = true;
+            start_ = now - now % BUCKET_MS;
+            return;
+        }
+        while (now - start_ >= BUCKET_MS) {
+            cur_.t = cur_.n ? start_ + curSum_ / cur_.n : start_;
+            close(cur_);
+            clear(cur_);
+            curSum_ = 0;
+            start_ += BUCKET_MS;
+        }
+    }
+
+    RollingResult result() const {
+        RollingResult r;
+        r.count = count_ + cur_.n;
+        if (r.count == 0) {
+            r.min = r.max = r.mean = r.std = r.rate = NAN;
+            return r;
+        }
+        // 汇总与当前桶合并
+        double n = r.count;
+        double mean = (count_ * mean_ + cur_.n * (double)cur_.mean) / n;
+        double d = cur_.mean - mean_;
+        double m2 = m2_ + cur_.m2 + d * d * count_ * cur_.n / n;
+        r.mean = (float)mean;
+        r.std = r.count > 1 && m2 > 0 ? (float)sqrt(m2 / (n - 1)) : 0.0f;
+
+        r.min = cur_.n ? cur_.min : INFINITY;
+        r.max = cur_.n ? cur_.max : -INFINITY;
+        if (minSize_ && ring_[minQueue_[minHead_]].min < r.min) r.min = ring_[minQueue_[minHead_]].min;
+        if (maxSize_ && ring_[maxQueue_[maxHead_]].max > r.max) r.max = ring_[maxQueue_[maxHead_]].max;
+
+        // 变化率：最新的非空桶（可能是当前桶）与最老的非空桶
+        r.rate = NAN;
+        if (hasData_) {
+            const Bucket& first = ring_[oldest_ % BUCKETS];
+            float lastMean = cur_.n ? cur_.mean : ring_[newest_ % BUCKETS].mean;
+            uint32_t lastTime = cur_.n ? start_ + curSum_ / cur_.n : ring_[newest_ % BUCKETS].t;
+            int32_t dt = (int32_t)(lastTime - first.t);
+            if (dt > 0) r.rate = (lastMean - first.mean) * 1000.0f / dt;
+        }
+        return r;
+    }
+
+private:
+    struct Bucket {
+        float mean;
+        float m2;
+        float min;
+        float max;
+        uint32_t t;     // 样本的平均时间
+        uint16_t n;
+    };
+
+    static void clear(Bucket& b) {
+        b.n = 0;
+        b.mean = 0;
+        b.m2 = 0;
+        b.min = 0;
+        b.max = 0;
+        b.t = 0;
+    }
+
+    // 窗口保留的完整桶为序号 (seq_ - BUCKETS + 1, seq_]，seq_ 为最新完整桶的序号
+    bool retained(uint32_t seq) const { return seq_ - seq < (uint32_t)(BUCKETS - 1); }
+
+    void close(const Bucket& b) {
+        seq_++;
+        uint8_t slot = seq_ % BUCKETS;
+
+        // 移出离开窗口的桶；新桶的槽位中是上一轮已经移出的桶
+        if (seq_ >= (uint32_t)BUCKETS) unmerge(ring_[(seq_ - (BUCKETS - 1)) % BUCKETS]);
+        ring_[slot] = b;
+        merge(b);
+        if (seq_ % BUCKETS == 0) rebuild();
+
+        while (minSize_ && !retained(seqOf(minQueue_[minHead_]))) pop(minHead_, minSize_);
+        while (maxSize_ && !retained(seqOf(maxQueue_[maxHead_]))) pop(maxHead_, maxSize_);
+        if (hasData_ && !retained(oldest_)) {
+            // 向后找最老的非空桶，每个桶最多被跳过一次
+            while (oldest_ != newest_ && (!retained(oldest_) || ring_[oldest_ % BUCKETS].n == 0)) oldest_++;
+            if (!retained(oldest_)) hasData_ = false;
+        }
+
+        if (b.n == 0) return;
+        while (minSize_ && ring_[minQueue_[(minHead_ + minSize_ - 1) % BUCKETS]].min >= b.min) minSize_--;
+        minQueue_[(minHead_ + minSize_++) % BUCKETS] = slot;
+        while (maxSize_ && ring_[maxQueue_[(maxHead_ + maxSize_ - 1) % BUCKETS]].max <= b.max) maxSize_--;
+        maxQueue_[(maxHead_ + maxSize_++) % BUCKETS] = slot;
+        if (!hasData_) {
+            hasData_ = true;
+            oldest_ = seq_;
+        }
+        newest_ = seq_;
+    }
+
+    // 槽位中的桶对应的序号（只对保留范围内的槽位有意义）
+    uint32_t seqOf(uint8_t slot) const {
+        return seq_ - (seq_ % BUCKETS + BUCKETS - slot) % BUCKETS;
+    }
+
+    static void pop(uint8_t& head, uint8_t& size) {
+        head = (head + 1) % BUCKETS;
+        size--;
+    }
+
+    void merge(const Bucket& b) {
+        if (b.n == 0) return;
+        uint32_t n = count_ + b.n;
+        double d = b.mean - mean_;
+        mean_ += d * b.n / n;
+        m2_ += b.m2 + d * d * count_ * b.n / n;
+        count_ = n;
+    }
+
+    void unmerge(const Bucket& b) {
+        if (b.n == 0) return;
+        if (count_ <= b.n) {
+            count_ = 0;
+            mean_ = 0;
+            m2_ = 0;
+            return;
+        }
+        uint32_t n = count_ - b.n;
+        double mean = (count_ * mean_ - b.n * (double)b.mean) / n;
+        double d = b.mean - mean;
+        m2_ -= b.m2 + d * d * n * b.n / count_;
+        if (m2_ < 0) m2_ = 0;
+        mean_ = mean;
+        count_ = n;
+    }
+
+    void rebuild() {
+        count_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+        for (int k = 0; k < BUCKETS - 1; k++) merge(ring_[(seq_ - k) % BUCKETS]);
+    }
+
+    Bucket ring_[BUCKETS];        // 完整的桶，按序号取模存放
+    Bucket cur_;                  // 当前桶
+    uint32_t start_;              // 当前桶的起始时间
+    uint32_t curSum_;             // 当前桶样本相对起始时间之和
+    uint32_t seq_;
+    bool started_;
+    bool hasData_;                // 保留范围内有非空的完整桶
+    uint32_t oldest_;             // 其中最老和最新的序号
+    uint32_t newest_;
+    uint32_t count_;              // 完整桶的汇总
+    double mean_;
+    double m2_;
+    uint8_t minQueue_[BUCKETS];   // 单调队列，存槽位
+    uint8_t maxQueue_[BUCKETS];
+    uint8_t minHead_, minSize_;
+    uint8_t maxHead_, maxSize_;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+// 双缓冲快照：只有一个写入方（主循环），任意多个读取方（AsyncTCP回调等）无锁复制。
+//
+// 写入方总是写“另一块”缓冲区，写完后序号加一发布；读取方按序号选中已发布的那块复制，
+// 复制后序号未变说明期间没有覆盖，否则重试。已发布的那块在写入方下一次发布前不会被改写，
+// 所以即使高优先级的读取方在同一核上打断写入方，也能一次读完，不需要等待。
+// 数据按32位字用原子变量存取（ESP32上就是普通的读写指令），没有未定义的数据竞争。
+
+template <typename T>
+class Snapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshot requires a trivially copyable type");
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+public:
+    Snapshot() : seq_(0) {}
+
+    // 发布新值（只能由同一个任务调用）
+    void publish(const T& value) {
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        // 读者若复制到了本次写入的数据，随后读到的序号一定已经变化，从而重试
+        std::atomic_thread_fence(std::memory_order_release);
+        store(words_[(seq + 1) & 1], value);
+        seq_.store(seq + 1, std::memory_order_release);
+    }
+
+    // 复制最近发布的值，返回其序号
+    uint32_t read(T& out) const {
+        uint32_t before, after;
+        do {
+            before = seq_.load(std::memory_order_acquire);
+            load(words_[before & 1], out);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq_.load(std::memory_order_relaxed);
+        } while (before != after);
+        return before;
+    }
+
+    // 已发布的次数
+    uint32_t sequence() const { return seq_.load(std::memory_order_acquire); }
+
+private:
+    static void store(std::atomic<uint32_t>* dst, const T& value) {
+        uint32_t tmp[WORDS] = {0};
+        memcpy(tmp, &value, sizeof(T));
+        for (size_t i = 0; i < WORDS; i++) dst[i].store(tmp[i], std::memory_order_relaxed);
+    }
+
+    static void load(const std::atomic<uint32_t>* src, T& out) {
+        uint32_t tmp[WORDS];
+        for (size_t i = 0; i < WORDS; i++) tmp[i] = src[i].load(std::memory_order_relaxed);
+        memcpy(&out, tmp, sizeof(T));
+    }
+
+    std::atomic<uint32_t> seq_;
+    std::atomic<uint32_t> words_[2][WORDS];
+};
+
+#endif
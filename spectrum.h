@@ -0,0 +1,241 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <Arduino.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "jsonwriter.h"
+#include "capture.h"
+#include "fft.h"
+
+// 模拟量通道的频谱分析：后台任务定期借用波形捕获的 DMA 通道，对所有已启用的内部 ADC1 通道
+// 以 SPECTRUM_SAMPLE_RATE 过采样 SPECTRUM_SIZE 点，去掉直流、加 Hann 窗后做实数FFT，
+// 求出主频、各频带的有效值和信噪比，工频（50/60Hz）幅值用 Goertzel 在准确频率处计算。
+// 结果按通道发布到快照，由 /spectrum 和 WebSocket 命令 get_spectrum 读取。
+//
+// 网页发起的波形捕获优先：捕获进行中或结果在保留期内时本轮跳过。
+
+#define SPECTRUM_SIZE 512                 // FFT 点数（每通道的窗长）
+#define SPECTRUM_SAMPLE_RATE 1000         // 每通道采样率(Hz)，频率分辨率约 2Hz
+#define SPECTRUM_INTERVAL_MS 10000        // 分析周期
+#define SPECTRUM_MIN_HZ 1.0f              // 主频搜索的下限，低于此视为缓变的过程量
+#define SPECTRUM_BANDS 5
+
+// 频带边界(Hz)：过程量、低频振动、工频、工频谐波和泵振动、高频
+const float spectrumBandEdges[SPECTRUM_BANDS + 1] = {1, 20, 45, 65, 200, 500};
+
+struct SpectrumChannel {
+    float mean;               // 直流分量（码值）
+    float rms;                // 去直流后的有效值（码值）
+    float peakHz;             // 主频
+    float peakAmplitude;      // 主频的正弦幅值（码值）
+    float snrDb;              // 主频功率与其余交流功率之比
+    float mains50;            // 50Hz、60Hz 的正弦幅值（码值）
+    float mains60;
+    float band[SPECTRUM_BANDS];   // 各频带的有效值（码值）
+};
+
+struct SpectrumSet {
+    uint32_t timestamp;       // 发布时的 millis()
+    uint16_t validMask;       // 本轮分析了的通道
+    float sampleRate;         // 实际的每通道采样率
+    SpectrumChannel channel[Board::ANALOG_CHANNELS];
+};
+
+struct SpectrumStats {
+    uint32_t windows;          // 完成的分析
+    uint32_t skipped;          // 捕获占用，本轮跳过
+    uint32_t timeouts;         // 采样窗口没有按时完成
+};
+
+Snapshot<SpectrumSet> spectrumSet;
+SpectrumStats spectrumStats;
+RealFft<SPECTRUM_SIZE> spectrumFft;
+
+// 分析一个通道：data 为 SPECTRUM_SIZE 个码值，变换后内容被覆盖
+void spectrumAnalyze(float* data, float sampleRate, SpectrumChannel& out) {
+    float mean = 0;
+    for (int i = 0; i < SPECTRUM_SIZE; i++) mean += data[i];
+    mean /= SPECTRUM_SIZE;
+    for (int i = 0; i < SPECTRUM_SIZE; i++) data[i] -= mean;
+    out.mean = mean;
+
+    // 工频幅值在加窗前按矩形窗计算
+    out.mains50 = 2.0f * sqrtf(goertzelPower(data, SPECTRUM_SIZE, 50.0f, sampleRate)) / SPECTRUM_SIZE;
+    out.mains60 = 2.0f * sqrtf(goertzelPower(data, SPECTRUM_SIZE, 60.0f, sampleRate)) / SPECTRUM_SIZE;
+
+    spectrumFft.applyWindow(data);
+    spectrumFft.forward(data);
+
+    float binHz = sampleRate / SPECTRUM_SIZE;
+    // 均方值 = 2Σ|X[k]|² / (N · Σw²)，奈奎斯特频点不乘2
+    float scale = 2.0f / (SPECTRUM_SIZE * spectrumFft.windowPower());
+    int first = (int)ceilf(SPECTRUM_MIN_HZ / binHz);
+    if (first < 2) first = 2;   // Hann 窗的直流主瓣占 0、1 两个频点
+    int peak = first;
+    float peakPower = 0;
+    float total = 0;
+    for (int b = 0; b < SPECTRUM_BANDS; b++) out.band[b] = 0;
+    for (int k = first; k <= SPECTRUM_SIZE / 2; k++) {
+        float p = RealFft<SPECTRUM_SIZE>::power(data, k) * (k == SPECTRUM_SIZE / 2 ? scale / 2 : scale);
+        total += p;
+        if (p > peakPower) {
+            peakPower = p;
+            peak = k;
+        }
+        float hz = k * binHz;
+        for (int b = 0; b < SPECTRUM_BANDS; b++) {
+            if (hz >= spectrumBandEdges[b] && hz < spectrumBandEdges[b + 1]) out.band[b] += p;
+        }
+    }
+    for (int b = 0; b < SPECTRUM_BANDS; b++) out.band[b] = sqrtf(out.band[b]);
+    out.rms = sqrtf(total);
+
+    // 抛物线插值修正主频
+    float delta = 0;
+    if (peak > first && peak < SPECTRUM_SIZE / 2) {
+        float a = sqrtf(RealFft<SPECTRUM_SIZE>::power(data, peak - 1));
+        float b = sqrtf(RealFft<SPECTRUM_SIZE>::power(data, peak));
+        float c = sqrtf(RealFft<SPECTRUM_SIZE>::power(data, peak + 1));
+        float d = a - 2 * b + c;
+        if (d != 0) delta = 0.5f * (a - c) / d;
+    }
+    out.peakHz = (peak + delta) * binHz;
+    out.peakAmplitude = 2.0f * sqrtf(RealFft<SPECTRUM_SIZE>::power(data, peak)) / spectrumFft.windowSum();
+
+    // 信号取主频两侧各2个频点（Hann 窗主瓣），其余为噪声
+    float signal = 0;
+    for (int k = peak - 2; k <= peak + 2; k++) {
+        if (k >= first && k <= SPECTRUM_SIZE / 2) signal += RealFft<SPECTRUM_SIZE>::power(data, k) * scale;
+    }
+    float noise = total - signal;
+    out.snrDb = signal > 0 && noise > 0 ? 10.0f * log10f(signal / noise) : NAN;
+}
+
+// 参与分析的通道：已启用的内部 ADC1 通道
+uint16_t spectrumChannelMask() {
+    uint16_t mask = 0;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (analogChannels[i].enabled && captureChannelUsable(i)) mask |= 1u << i;
+    }
+    return mask;
+}
+
+// 采集一个窗口，成功时持有结果直到分析完
+bool spectrumAcquire(uint16_t mask) {
+    int n = __builtin_popcount(mask);
+    CaptureConfig config;
+    config.channelMask = mask;
+    config.rate = constrain(SPECTRUM_SAMPLE_RATE * n, SOC_ADC_SAMPLE_FREQ_THRES_LOW, SOC_ADC_SAMPLE_FREQ_THRES_HIGH);
+    config.preFrames = 0;
+    config.postFrames = SPECTRUM_SIZE;
+    config.trigger = CAPTURE_TRIG_IMMEDIATE;
+    config.trigChannel = -1;
+    config.level = 0;
+    config.relay = -1;
+    config.owner = CAPTURE_OWNER_SPECTRUM;
+    if (captureArm(config)) {
+        spectrumStats.skipped++;
+        return false;
+    }
+
+    // 窗口时长加上主循环启动DMA的时间
+    uint32_t timeout = SPECTRUM_SIZE * 1000u / SPECTRUM_SAMPLE_RATE * 2 + 1000;
+    uint32_t start = millis();
+    while (millis() - start < timeout) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        uint8_t state = captureState.load();
+        if (state == CAPTURE_DONE) return true;
+        if (state == CAPTURE_IDLE) break;   // 被取消
+    }
+    captureCancel();
+    spectrumStats.timeouts++;
+    return false;
+}
+
+void spectrumTask(void* param) {
+    static float data[SPECTRUM_SIZE];
+    static SpectrumSet result;
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SPECTRUM_INTERVAL_MS));
+        uint16_t mask = spectrumChannelMask();
+        if (!mask || !spectrumAcquire(mask)) continue;
+
+        {
+            // 持有读者期间结果不会被新的捕获覆盖
+            CaptureReader reader;
+            if (captureState.load() != CAPTURE_DONE || captureConfig.owner != CAPTURE_OWNER_SPECTRUM) continue;
+            METRICS_SCOPE(METRIC_SPECTRUM_ANALYZE);
+            const CaptureResult& r = captureResult;
+            result.sampleRate = r.frameRate;
+            result.validMask = 0;
+            for (int k = 0; k < r.channelCount; k++) {
+                for (int i = 0; i < SPECTRUM_SIZE; i++) data[i] = captureSample(i, k);
+                spectrumAnalyze(data, r.frameRate, result.channel[r.channels[k]]);
+                result.validMask |= 1u << r.channels[k];
+            }
+        }
+        captureRelease(CAPTURE_OWNER_SPECTRUM);
+        result.timestamp = millis();
+        spectrumSet.publish(result);
+        spectrumStats.windows++;
+    }
+}
+
+// 启动分析任务（initCapture 之后调用）
+void initSpectrum() {
+    SpectrumSet empty;
+    memset(&empty, 0, sizeof(empty));
+    spectrumSet.publish(empty);
+    xTaskCreatePinnedToCore(spectrumTask, "spectrum", 4096, NULL, 1, NULL, 0);
+}
+
+void writeSpectrumJson(JsonWriter& json) {
+    SpectrumSet set;
+    spectrumSet.read(set);
+    json.field("size", SPECTRUM_SIZE);
+    json.field("sampleRate", (double)set.sampleRate);
+    json.field("age", (unsigned long)(set.timestamp ? millis() - set.timestamp : 0));
+    json.beginArray("bands");
+    for (int b = 0; b < SPECTRUM_BANDS; b++) {
+        json.beginArray();
+        json.value((double)spectrumBandEdges[b]).value((double)spectrumBandEdges[b + 1]);
+        json.endArray();
+    }
+    json.endArray();
+    json.beginArray("channels");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (!(set.validMask & (1u << i))) continue;
+        const SpectrumChannel& c = set.channel[i];
+        json.beginObject();
+        json.field("index", i);
+        json.field("mean", (double)c.mean);
+        json.field("rms", (double)c.rms);
+        json.field("peakHz", (double)c.peakHz);
+        json.field("peakAmplitude", (double)c.peakAmplitude);
+        json.field("snr", (double)c.snrDb);
+        json.field("mains50", (double)c.mains50);
+        json.field("mains60", (double)c.mains60);
+        json.beginArray("band");
+        for (int b = 0; b < SPECTRUM_BANDS; b++) json.value((double)c.band[b]);
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+}
+
+#if METRICS_ENABLED
+void writeSpectrumMetrics(Print& out) {
+    out.print("# TYPE esp_spectrum_windows_total counter\n");
+    out.printf("esp_spectrum_windows_total %u\n", spectrumStats.windows);
+    out.print("# TYPE esp_spectrum_skipped_total counter\n");
+    out.printf("esp_spectrum_skipped_total %u\n", spectrumStats.skipped);
+    out.print("# TYPE esp_spectrum_timeouts_total counter\n");
+    out.printf("esp_spectrum_timeouts_total %u\n", spectrumStats.timeouts);
+}
+#endif
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <Arduino.h>
+#include "types.h"
+#include "snapshot.h"
+#include "jsonwriter.h"
+#include "rollingstats.h"
+#include "virtual.h"
+
+// 各模拟量通道、温度传感器和虚拟通道的滑动窗口统计（最小、最大、均值、标准差、变化率）。
+//
+// 主循环每次采样后把有效的物理值加入各窗口（rollingstats.h，每个样本 O(1)），然后发布结果快照；
+// 实时数据推送、/stats 和 WebSocket 命令 get_stats 都从快照读取。
+// 无效、过期或有故障的样本不计入；通道停用时清空其统计。
+// 窗口的桶长和桶数在下面修改，窗口长度为两者之积。
+
+#define STATS_WINDOWS 3
+#define STATS_CHANNELS VIRTUAL_INPUTS   // 编号同虚拟通道的输入
+
+typedef RollingWindow<1000, 10> StatsWindowShort;     // 10秒，每桶1秒
+typedef RollingWindow<5000, 12> StatsWindowMedium;    // 1分钟，每桶5秒
+typedef RollingWindow<120000, 30> StatsWindowLong;    // 1小时，每桶2分钟
+
+const char* const statsWindowNames[STATS_WINDOWS] = {"10s", "1m", "1h"};
+const uint32_t statsWindowSpans[STATS_WINDOWS] = {
+    StatsWindowShort::SPAN_MS, StatsWindowMedium::SPAN_MS, StatsWindowLong::SPAN_MS
+};
+
+struct ChannelStats {
+    StatsWindowShort shortWindow;
+    StatsWindowMedium mediumWindow;
+    StatsWindowLong longWindow;
+
+    void add(uint32_t now, float x) {
+        shortWindow.add(now, x);
+        mediumWindow.add(now, x);
+        longWindow.add(now, x);
+    }
+
+    void advance(uint32_t now) {
+        shortWindow.advance(now);
+        mediumWindow.advance(now);
+        longWindow.advance(now);
+    }
+
+    void reset() {
+        shortWindow.reset();
+        mediumWindow.reset();
+        longWindow.reset();
+    }
+
+    void result(RollingResult* out) const {
+        out[0] = shortWindow.result();
+        out[1] = mediumWindow.result();
+        out[2] = longWindow.result();
+    }
+};
+
+// 统计结果：下标 0..ANALOG_CHANNELS-1 为模拟量通道，之后为温度传感器和虚拟通道
+struct StatsSet {
+    uint32_t timestamp;
+    RollingResult result[STATS_CHANNELS][STATS_WINDOWS];
+};
+
+extern TempSensorConfig tempSensors[Board::TEMP_SENSORS];
+extern AnalogConfigSet analogStaged;
+extern TempConfigSet tempStaged;
+
+ChannelStats channelStats[STATS_CHANNELS];   // 只在主循环中访问
+Snapshot<StatsSet> statsSet;
+
+void publishStats(uint32_t now) {
+    static StatsSet set;
+    set.timestamp = now;
+    for (int i = 0; i < STATS_CHANNELS; i++) channelStats[i].result(set.result[i]);
+    statsSet.publish(set);
+}
+
+// 虚拟通道：analog 为 true 时处理随模拟量采样更新的通道，否则处理随测温更新的
+void statsSampleVirtual(uint32_t now, const SensorSnapshot& snap, bool analog) {
+    uint8_t fast = virtualAnalogMask();
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        uint8_t bit = 1u << k;
+        ChannelStats& stats = channelStats[VIRTUAL_BASE + k];
+        if (!(snap.virtualMask & bit)) {
+            stats.reset();
+        } else if (((fast & bit) != 0) != analog) {
+            continue;
+        } else if (!isnan(snap.virtualValue[k])) {
+            stats.add(now, snap.virtualValue[k]);
+        } else {
+            stats.advance(now);
+        }
+    }
+}
+
+// 模拟量采样并发布快照后调用，snap 为刚发布的快照
+void statsSampleAnalog(uint32_t now, const SensorSnapshot& snap) {
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        uint16_t bit = 1u << i;
+        if (!(snap.enabledMask & bit)) {
+            channelStats[i].reset();
+        } else if (!((snap.staleMask | snap.invalidMask) & bit) && !isnan(snap.value[i])) {
+            channelStats[i].add(now, snap.value[i]);
+        } else {
+            channelStats[i].advance(now);
+        }
+    }
+    statsSampleVirtual(now, snap, true);
+    publishStats(now);
+}
+
+// 测温并发布快照后调用
+void statsSampleTemps(uint32_t now, const SensorSnapshot& snap) {
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        ChannelStats& stats = channelStats[Board::ANALOG_CHANNELS + i];
+        if (!tempSensors[i].enabled) {
+            stats.reset();
+        } else if (!snap.tempFault[i] && !isnan(snap.tempValue[i])) {
+            stats.add(now, snap.tempValue[i]);
+        } else {
+            stats.advance(now);
+        }
+    }
+    statsSampleVirtual(now, snap, false);
+    publishStats(now);
+}
+
+// 实时数据中的紧凑格式："stats":{"10s":[min,max,mean,std,rate],...}
+void writeStatsCompact(JsonWriter& json, const RollingResult* result) {
+    json.beginObject("stats");
+    for (int w = 0; w < STATS_WINDOWS; w++) {
+        const RollingResult& r = result[w];
+        json.beginArray(statsWindowNames[w]);
+        json.value((double)r.min).value((double)r.max).value((double)r.mean).value((double)r.std).value((double)r.rate);
+        json.endArray();
+    }
+    json.endObject();
+}
+
+void writeStatsWindows(JsonWriter& json, const RollingResult* result) {
+    json.beginObject("windows");
+    for (int w = 0; w < STATS_WINDOWS; w++) {
+        const RollingResult& r = result[w];
+        json.beginObject(statsWindowNames[w]);
+        json.field("count", (unsigned long)r.count);
+        json.field("min", (double)r.min);
+        json.field("max", (double)r.max);
+        json.field("mean", (double)r.mean);
+        json.field("std", (double)r.std);
+        json.field("rate", (double)r.rate);
+        json.endObject();
+    }
+    json.endObject();
+}
+
+// /stats 和 get_stats：各窗口的长度和每个启用通道的统计
+void writeStatsJson(JsonWriter& json) {
+    static StatsSet set;   // 只在 AsyncTCP 任务中使用
+    statsSet.read(set);
+    json.field("age", (unsigned long)(set.timestamp ? millis() - set.timestamp : 0));
+    json.beginObject("spans");
+    for (int w = 0; w < STATS_WINDOWS; w++) json.field(statsWindowNames[w], (unsigned long)statsWindowSpans[w]);
+    json.endObject();
+    json.beginArray("analog");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (!analogStaged.channel[i].enabled) continue;
+        json.beginObject();
+        json.field("channel", i);
+        json.field("name", analogStaged.channel[i].name.c_str());
+        json.field("unit", analogStaged.channel[i].unit.c_str());
+        writeStatsWindows(json, set.result[i]);
+        json.endObject();
+    }
+    json.endArray();
+    json.beginArray("temperatures");
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        if (!tempStaged.sensor[i].enabled) continue;
+        json.beginObject();
+        json.field("index", i);
+        json.field("name", tempStaged.sensor[i].name.c_str());
+        writeStatsWindows(json, set.result[Board::ANALOG_CHANNELS + i]);
+        json.endObject();
+    }
+    json.endArray();
+    json.beginArray("virtual");
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        if (!virtualChannels[k].enabled) continue;
+        json.beginObject();
+        json.field("index", k);
+        json.field("name", virtualChannels[k].name.c_str());
+        json.field("unit", virtualChannels[k].unit.c_str());
+        writeStatsWindows(json, set.result[VIRTUAL_BASE + k]);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+#endif
@@ -2,6 +2,9 @@
 #define TEMP_H
 
 #include <Adafruit_MAX31865.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
 
 // 定义温度传感器类型
 enum TempSensorType {
@@ -12,53 +15,54 @@ enum TempSensorType {
 // 温度传感器配置结构
 struct TempSensorConfig {
     bool enabled;
-    String name;
+    InlineString<32> name;
     TempSensorType type;
     float lastTemp;
     uint8_t cs_pin;
+    float lastResistance;   // 最近一次测得的电阻
+    uint8_t lastFault;      // 最近一次读到的故障码
 };
 
-// 定义三个温度传感器
-extern Adafruit_MAX31865 thermo1;
-extern Adafruit_MAX31865 thermo2;
+// 网络回调暂存的温度传感器配置，主循环按 revision 找出改动的传感器后应用
+struct TempSensorSettings {
+    bool enabled;
+    InlineString<32> name;
+    TempSensorType type;
+};
+
+struct TempConfigSet {
+    TempSensorSettings sensor[Board::TEMP_SENSORS];
+    uint16_t revision[Board::TEMP_SENSORS];   // 每次修改加一
+};
+
+// 温度传感器对象
+extern Adafruit_MAX31865* thermoSensors[Board::TEMP_SENSORS];
 
 // 传感器配置数组
-extern TempSensorConfig tempSensors[2];
+extern TempSensorConfig tempSensors[Board::TEMP_SENSORS];
 
 // 初始化温度传感器
 void initTempSensors() {
-    // 设置SPI引脚
-    const int sck_pin = 12;   // GPIO12 - SCK
-    const int sdo_pin = 13;   // GPIO13 - SDO (MISO)
-    const int sdi_pin = 11;   // GPIO11 - SDI (MOSI)
-    
     // 设置引脚模式
-    pinMode(sck_pin, OUTPUT);
-    pinMode(sdo_pin, INPUT);
-    pinMode(sdi_pin, OUTPUT);
-    
-    // 设置CS引脚
-    pinMode(10, OUTPUT);   // CS1 - GPIO10
-    pinMode(39, OUTPUT);   // CS2 - GPIO39
-    
-    // 初始化每个传感器为2线制模式
-    thermo1.begin(MAX31865_2WIRE);  // 2线制PT100/PT1000
-    thermo2.begin(MAX31865_2WIRE);  // 2线制PT100/PT1000
+    pinMode(Board::SPI_SCK_GPIO, OUTPUT);
+    pinMode(Board::SPI_MISO_GPIO, INPUT);
+    pinMode(Board::SPI_MOSI_GPIO, OUTPUT);
     
-    // 初始CS引脚为高电平
-    digitalWrite(10, HIGH);
-    digitalWrite(39, HIGH);
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
+        if(!thermoSensors[i]) thermoSensors[i] = new Adafruit_MAX31865(Board::tempCsGpio(i));
+
+        // 设置CS引脚，初始化为2线制模式（PT100/PT1000），CS初始为高电平
+        pinMode(Board::tempCsGpio(i), OUTPUT);
+        thermoSensors[i]->begin(MAX31865_2WIRE);
+        digitalWrite(Board::tempCsGpio(i), HIGH);
+    }
 }
 
 // 读取温度数据
 void readTemperatures() {
-    for(int i = 0; i < 2; i++) {
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
         if(tempSensors[i].enabled) {
-            Adafruit_MAX31865* sensor;
-            switch(i) {
-                case 0: sensor = &thermo1; break;
-                case 1: sensor = &thermo2; break;
-            }
+            Adafruit_MAX31865* sensor = thermoSensors[i];
             
             // 使用标准参数
             float r0 = 100.0;        // 0℃时的标准电阻值
@@ -67,8 +71,9 @@ void readTemperatures() {
             
             // 读取温度前检查故障
             uint8_t fault = sensor->readFault();
+            tempSensors[i].lastFault = fault;
             if(fault) {
-                Serial.printf("Sensor %d fault: %d\n", i, fault);
+                LOGW(LOG_MOD_TEMP, "Sensor %d fault: %d", i, fault);
                 sensor->clearFault();
                 continue;
             }
@@ -83,103 +88,92 @@ void readTemperatures() {
             
             // 保存温度值
             tempSensors[i].lastTemp = temp;
+            tempSensors[i].lastResistance = measured_r;
             
-            // 输出详细调试信息
-            Serial.printf("\nSensor %d Detailed Info:\n", i);
-            Serial.printf("RTD Raw Value: %.2f\n", rtd);
-            Serial.printf("Ratio: %.6f\n", ratio);
-            Serial.printf("Measured Resistance: %.2f ohms\n", measured_r);
-            Serial.printf("Target R at 18°C: 107.02 ohms\n");  // 添加目标值显示
-            Serial.printf("R0 (0°C standard): %.2f ohms\n", r0);
-            Serial.printf("Reference R: %.2f ohms\n", rref);
-            Serial.printf("Temperature Coefficient: %.6f\n", alpha);
-            Serial.printf("Final Temperature: %.2f°C\n", temp);
-            
-            // 添加电阻误差显示
-            float r_error = measured_r - 107.02;
-            Serial.printf("Resistance Error: %.3f ohms\n", r_error);
+            // 调试信息（默认编译期关闭）
+            LOGD(LOG_MOD_TEMP, "Sensor %d: rtd=%.0f ratio=%.6f R=%.2f ohms T=%.2f C",
+                i, rtd, ratio, measured_r, temp);
         }
     }
 }
 
 // 保存温度传感器配置
 void saveTempConfig() {
-    Serial.println("Saving temperature config to file...");
-    
+    METRICS_SCOPE(METRIC_SAVE_TEMP);
     File file = SPIFFS.open("/temp_config.json", "w");
     if(!file) {
-        Serial.println("Failed to open temp config file for writing");
+        LOGE(LOG_MOD_CFG, "Failed to open temp config file for writing");
         return;
     }
 
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(512 * Board::TEMP_SENSORS);
     JsonArray array = doc.createNestedArray("sensors");
 
-    for(int i = 0; i < 2; i++) {
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
         JsonObject sensor = array.createNestedObject();
         sensor["enabled"] = tempSensors[i].enabled;
-        sensor["name"] = tempSensors[i].name;
+        sensor["name"] = tempSensors[i].name.c_str();
         sensor["type"] = (int)tempSensors[i].type;
         sensor["cs_pin"] = tempSensors[i].cs_pin;
-        
-        Serial.printf("Saving sensor %d: enabled=%d, name=%s, type=%d, cs_pin=%d\n",
-            i, tempSensors[i].enabled, tempSensors[i].name.c_str(), 
-            (int)tempSensors[i].type, tempSensors[i].cs_pin);
     }
 
     bool success = serializeJson(doc, file);
     file.close();
 
     if(success) {
-        Serial.println("Temperature config saved successfully");
+        LOGI(LOG_MOD_CFG, "Temperature config saved");
     } else {
-        Serial.println("Failed to write temperature config");
+        LOGE(LOG_MOD_CFG, "Failed to write temperature config");
     }
 }
 
 // 加载温度传感器配��
 void loadTempConfig() {
-    Serial.println("Loading temperature config...");
-    
+    // 先设置默认值（默认关闭），再用配置文件覆盖
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
+        tempSensors[i].enabled = false;
+        tempSensors[i].name.set(("温度传感器 " + String(i + 1)).c_str());
+        tempSensors[i].type = PT100;
+        tempSensors[i].lastTemp = 0.0;
+        tempSensors[i].cs_pin = Board::tempCsGpio(i);
+    }
+
     if(!SPIFFS.exists("/temp_config.json")) {
-        Serial.println("No temperature config file found, using defaults");
+        LOGI(LOG_MOD_CFG, "No temperature config file found, using defaults");
         return;
     }
 
     File file = SPIFFS.open("/temp_config.json", "r");
     if(!file) {
-        Serial.println("Failed to open temperature config file");
+        LOGE(LOG_MOD_CFG, "Failed to open temperature config file");
         return;
     }
 
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(512 * Board::TEMP_SENSORS);
     DeserializationError error = deserializeJson(doc, file);
     file.close();
     
     if(error) {
-        Serial.println("Failed to parse temperature config file");
+        LOGE(LOG_MOD_CFG, "Failed to parse temperature config file");
         return;
     }
     
     JsonArray array = doc["sensors"].as<JsonArray>();
     int i = 0;
     for(JsonVariant v : array) {
-        if(i < 2) {
+        if(i < Board::TEMP_SENSORS) {
             tempSensors[i].enabled = v["enabled"].as<bool>();
-            tempSensors[i].name = v["name"].as<String>();
+            tempSensors[i].name.set(v["name"] | "");
             tempSensors[i].type = (TempSensorType)v["type"].as<int>();
-            if(v.containsKey("cs_pin")) {
-                tempSensors[i].cs_pin = v["cs_pin"].as<uint8_t>();
-            }
             
-            Serial.printf("Loaded sensor %d: enabled=%d, name=%s, type=%d, cs_pin=%d\n",
+            LOGD(LOG_MOD_CFG, "Loaded sensor %d: enabled=%d, name=%s, type=%d, cs_pin=%d",
                 i, tempSensors[i].enabled, tempSensors[i].name.c_str(), 
                 (int)tempSensors[i].type, tempSensors[i].cs_pin);
             
             i++;
         }
     }
-    Serial.println("Temperature config loaded successfully");
+    LOGI(LOG_MOD_CFG, "Temperature config loaded");
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE1 1
+
+// 主机测试用的 SPI 接口，由测试实现（模拟总线上的设备）
+class SPISettings {
+public:
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+class SPIClass {
+public:
+    void begin(int8_t sck, int8_t miso, int8_t mosi);
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+    uint8_t transfer(uint8_t value);
+};
+
+extern SPIClass SPI;
+
+#endif
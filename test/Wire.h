@@ -0,0 +1,19 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include <Arduino.h>
+
+// 主机测试用的 I2C 接口，由测试实现（模拟总线上的设备）
+class TwoWire {
+public:
+    bool begin(int sda, int scl, uint32_t frequency);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t value);
+    uint8_t endTransmission(bool stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t count);
+    int read();
+};
+
+extern TwoWire Wire;
+
+#endif
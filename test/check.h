@@ -0,0 +1,29 @@
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdio.h>
+
+// 主机测试的断言：失败时打印位置并计数，main 返回失败个数
+static int checkFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        checkFailures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+    double _a = (a), _b = (b); \
+    if (!(fabs(_a - _b) <= (tol))) { \
+        printf("%s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        checkFailures++; \
+    } \
+} while (0)
+
+#define CHECK_DONE() do { \
+    printf("%s: %s\n", __FILE__, checkFailures ? "FAILED" : "ok"); \
+    return checkFailures ? 1 : 0; \
+} while (0)
+
+#endif
@@ -0,0 +1,340 @@
+// 外部ADC（extadc.h）：用模拟的 ADS1115（I2C）和 ADS1256（SPI）检查多路开关的轮换顺序——
+// 每次转换完成后先切到下一个输入、再读出刚完成的结果，读到的码值属于正确的输入——
+// 以及超时、总线错误、芯片探测和按通道配置计算的扫描位图
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <vector>
+#include "check.h"
+
+// extadc.h 的日志和性能统计在主机上用空实现
+#define LOG_H
+#define LOGI(module, fmt, ...) ((void)0)
+#define METRICS_H
+#define METRICS_ENABLED 0
+#define METRICS_SCOPE(stage) ((void)0)
+
+#include "types.h"
+
+AnalogChannel analogChannels[Board::ANALOG_CHANNELS];
+
+#include "extadc.h"
+
+// ---- 模拟时间：采集任务等待通知时，正在转换的设备完成一次转换并触发中断 ----
+
+TickType_t now = 0;
+
+uint32_t millis() { return now; }
+uint32_t micros() { return now * 1000; }
+void delay(uint32_t ms) { now += ms; }
+void delayMicroseconds(uint32_t us) {}
+void pinMode(uint8_t pin, uint8_t mode) {}
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {}
+TickType_t xTaskGetTickCount() { return now; }
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {}
+void vTaskDelayUntil(TickType_t* previous, TickType_t ticks) { *previous += ticks; }
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* param,
+                                   int priority, TaskHandle_t* handle, int core) { return pdTRUE; }
+
+// 总线上的操作记录：切换输入、读出结果
+struct BusOp {
+    int device;
+    bool select;      // true 为切换输入，false 为读出
+    int value;        // 切换到的输入，或读出的码值
+};
+std::vector<BusOp> ops;
+
+// ---- ADS1115：连续转换，写配置寄存器以新的输入重新开始，转换寄存器保持上一次结果 ----
+
+struct FakeAds1115 {
+    bool present = true;
+    bool stalled = false;        // 不再完成转换
+    int failWrites = -1;         // 第几次写寄存器时无应答，-1 为不出错
+    int16_t input[ADS1115_INPUTS];
+    uint16_t config = 0;
+    uint16_t lo = 0, hi = 0;
+    int16_t conversion = 0;
+    bool converting = false;
+    uint8_t pointer = 0;
+    int writes = 0;
+
+    void complete() {
+        if (!converting || stalled) return;
+        int mux = ((config >> 12) & 0x7) - 4;
+        conversion = mux >= 0 ? input[mux] : 0;
+        ads1115ReadyIsr();
+    }
+} ads1115;
+
+uint8_t wireAddress;
+std::vector<uint8_t> wireTx;
+std::vector<uint8_t> wireRx;
+
+TwoWire Wire;
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) { return true; }
+void TwoWire::beginTransmission(uint8_t address) { wireAddress = address; wireTx.clear(); }
+size_t TwoWire::write(uint8_t value) { wireTx.push_back(value); return 1; }
+
+uint8_t TwoWire::endTransmission(bool stop) {
+    if (!ads1115.present || wireAddress != ADS1115_ADDRESS) return 2;   // 地址无应答
+    if (wireTx.empty()) return 0;
+    ads1115.pointer = wireTx[0];
+    if (wireTx.size() == 3) {
+        if (ads1115.writes++ == ads1115.failWrites) return 3;             // 数据无应答
+        uint16_t value = (wireTx[1] << 8) | wireTx[2];
+        if (ads1115.pointer == ADS1115_REG_CONFIG) {
+            ads1115.config = value;
+            ads1115.converting = true;
+            ops.push_back({0, true, ((value >> 12) & 0x7) - 4});
+        } else if (ads1115.pointer == ADS1115_REG_LO_THRESH) {
+            ads1115.lo = value;
+        } else if (ads1115.pointer == ADS1115_REG_HI_THRESH) {
+            ads1115.hi = value;
+        }
+    }
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t count) {
+    if (!ads1115.present || address != ADS1115_ADDRESS) return 0;
+    uint16_t value = ads1115.pointer == ADS1115_REG_CONVERSION ? (uint16_t)ads1115.conversion : ads1115.config;
+    if (ads1115.pointer == ADS1115_REG_CONVERSION) ops.push_back({0, false, ads1115.conversion});
+    wireRx = {(uint8_t)(value >> 8), (uint8_t)(value & 0xFF)};
+    return count;
+}
+
+int TwoWire::read() {
+    int value = wireRx.front();
+    wireRx.erase(wireRx.begin());
+    return value;
+}
+
+// ---- ADS1256：SYNC/WAKEUP 以 MUX 中的输入重新开始转换，RDATA 读出最近完成的24位结果 ----
+
+struct FakeAds1256 {
+    bool present = true;
+    bool stalled = false;
+    int32_t input[ADS1256_INPUTS];   // 24位码值
+    uint8_t reg[16];
+    int32_t output = 0;
+    bool converting = false;
+    bool busy = false;               // 复位、校准期间 DRDY 为高
+    bool selected = false;           // CS 为低
+    bool inTransaction = false;
+    int violations = 0;              // CS 为高或不在事务内时的传输
+
+    // 命令解析
+    std::vector<uint8_t> command;
+    std::vector<uint8_t> reply;
+
+    void complete() {
+        if (!converting || stalled) return;
+        int mux = reg[ADS1256_REG_MUX] >> 4;
+        output = input[mux];
+        ads1256ReadyIsr();
+    }
+
+    uint8_t transfer(uint8_t value) {
+        if (!selected || !inTransaction) violations++;
+        if (!present) return 0xFF;
+        if (!reply.empty()) {
+            uint8_t out = reply.front();
+            reply.erase(reply.begin());
+            return out;
+        }
+        command.push_back(value);
+        uint8_t op = command[0];
+        if ((op & 0xF0) == ADS1256_CMD_WREG) {
+            if (command.size() < 3 || command.size() < 3u + command[1]) return 0;
+            for (int i = 0; i <= command[1]; i++) {
+                int r = (op & 0x0F) + i;
+                reg[r] = r == ADS1256_REG_STATUS ? (ADS1256_ID << 4) | (command[2 + i] & 0x0F) : command[2 + i];
+            }
+        } else if ((op & 0xF0) == ADS1256_CMD_RREG) {
+            if (command.size() < 2) return 0;
+            for (int i = 0; i <= command[1]; i++) reply.push_back(reg[(op & 0x0F) + i]);
+        } else if (op == ADS1256_CMD_RDATA) {
+            reply = {(uint8_t)(output >> 16), (uint8_t)(output >> 8), (uint8_t)output};
+            ops.push_back({1, false, (int16_t)(output >> 8)});
+        } else if (op == ADS1256_CMD_WAKEUP) {
+            converting = true;
+            ops.push_back({1, true, reg[ADS1256_REG_MUX] >> 4});
+        } else if (op == ADS1256_CMD_RESET) {
+            memset(reg, 0, sizeof(reg));
+            reg[ADS1256_REG_STATUS] = ADS1256_ID << 4;
+            converting = false;
+        }
+        command.clear();
+        return 0;
+    }
+} ads1256;
+
+SPIClass SPI;
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi) {}
+void SPIClass::beginTransaction(SPISettings settings) { ads1256.inTransaction = true; }
+void SPIClass::endTransaction() { ads1256.inTransaction = false; }
+uint8_t SPIClass::transfer(uint8_t value) { return ads1256.transfer(value); }
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin == Board::ADS1256_CS_GPIO) ads1256.selected = value == LOW;
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin == Board::ADS1256_DRDY_GPIO) return ads1256.present && !ads1256.busy ? LOW : HIGH;
+    return HIGH;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    bool ready0 = extAdcReady[0], ready1 = extAdcReady[1];
+    ads1115.complete();
+    ads1256.complete();
+    if (extAdcReady[0] == ready0 && extAdcReady[1] == ready1) {
+        now += ticks;    // 没有中断，等到超时
+        return 0;
+    }
+    now += 1;
+    return 1;
+}
+
+void reset() {
+    ads1115 = FakeAds1115();
+    ads1256 = FakeAds1256();
+    for (int i = 0; i < ADS1115_INPUTS; i++) ads1115.input[i] = 1000 * (i + 1) - 7;
+    for (int i = 0; i < ADS1256_INPUTS; i++) ads1256.input[i] = (i + 1) * 0x10000 + 0x1234 - (i & 1) * 0x800000;
+    memset((void*)extAdcReady, 0, sizeof(extAdcReady));
+    memset(&extAdcStats, 0, sizeof(extAdcStats));
+    ops.clear();
+}
+
+// 每次读出之前都已切到下一个输入（最后一个除外），读出的是上一次选择的输入
+void checkPipelined(int device, const std::vector<int>& inputs) {
+    std::vector<BusOp> seq;
+    for (const BusOp& op : ops) {
+        if (op.device == device) seq.push_back(op);
+    }
+    size_t expected = inputs.size() * 2;
+    CHECK(seq.size() == expected);
+    if (seq.size() != expected) return;
+    CHECK(seq[0].select && seq[0].value == inputs[0]);
+    for (size_t k = 0; k < inputs.size(); k++) {
+        if (k + 1 < inputs.size()) {
+            CHECK(seq[2 * k + 1].select && seq[2 * k + 1].value == inputs[k + 1]);
+            CHECK(!seq[2 * k + 2].select);
+        } else {
+            CHECK(!seq[2 * k + 1].select);
+        }
+    }
+}
+
+void testAds1115Scan() {
+    reset();
+    int16_t code[EXT_ADC_MAX_INPUTS] = {0};
+    uint8_t valid = ads1115Scan(0b1011, code);
+    CHECK(valid == 0b1011);
+    CHECK(code[0] == ads1115.input[0]);
+    CHECK(code[1] == ads1115.input[1]);
+    CHECK(code[2] == 0);
+    CHECK(code[3] == ads1115.input[3]);
+    CHECK(extAdcStats.conversions[0] == 3);
+    CHECK(extAdcStats.timeouts[0] == 0);
+    checkPipelined(0, {0, 1, 3});
+
+    // 单个输入：不切换，直接读出
+    reset();
+    memset(code, 0, sizeof(code));
+    CHECK(ads1115Scan(0b0100, code) == 0b0100);
+    CHECK(code[2] == ads1115.input[2]);
+    checkPipelined(0, {2});
+
+    reset();
+    CHECK(ads1115Scan(0, code) == 0);
+    CHECK(ops.empty());
+}
+
+void testAds1115Errors() {
+    // 转换不再完成：等待超时后放弃本轮，已读到的保留
+    reset();
+    int16_t code[EXT_ADC_MAX_INPUTS] = {0};
+    ads1115.stalled = true;
+    TickType_t start = now;
+    CHECK(ads1115Scan(0b0011, code) == 0);
+    CHECK(extAdcStats.timeouts[0] == 1);
+    CHECK(now - start >= EXT_ADC_READY_TIMEOUT_MS && now - start <= 2 * EXT_ADC_READY_TIMEOUT_MS);
+
+    // 读出第二个输入之前切换第三个输入时无应答：本轮到此为止，只有第一个有效
+    reset();
+    ads1115.failWrites = 2;
+    CHECK(ads1115Scan(0b0111, code) == 0b0001);
+    CHECK(extAdcStats.busErrors[0] == 1);
+
+    reset();
+    ads1115.present = false;
+    CHECK(ads1115Scan(0b0001, code) == 0);
+    CHECK(extAdcStats.busErrors[0] == 1);
+}
+
+void testAds1256Scan() {
+    reset();
+    int16_t code[EXT_ADC_MAX_INPUTS] = {0};
+    uint8_t valid = ads1256Scan(0b10100101, code);
+    CHECK(valid == 0b10100101);
+    for (int i = 0; i < ADS1256_INPUTS; i++) {
+        int16_t expected = valid & (1u << i) ? (int16_t)(ads1256.input[i] >> 8) : 0;
+        CHECK(code[i] == expected);
+    }
+    CHECK(extAdcStats.conversions[1] == 4);
+    checkPipelined(1, {0, 2, 5, 7});
+    CHECK(ads1256.violations == 0);
+    CHECK(!ads1256.selected && !ads1256.inTransaction);
+
+    // 另一个设备的中断不能当作本设备转换完成
+    reset();
+    ads1256.stalled = true;
+    ads1115Select(0);
+    CHECK(ads1256Scan(0b11, code) == 0);
+    CHECK(extAdcStats.timeouts[1] == 1);
+}
+
+void testInit() {
+    reset();
+    CHECK(initAds1115());
+    CHECK(ads1115.lo == 0x0000 && ads1115.hi == 0x8000);
+    CHECK(initAds1256());
+    CHECK(ads1256.reg[ADS1256_REG_DRATE] == ADS1256_DRATE_1000SPS);
+    CHECK(ads1256.violations == 0);
+
+    reset();
+    ads1115.present = false;
+    ads1256.present = false;
+    CHECK(!initAds1115());
+    CHECK(!initAds1256());
+}
+
+void testScanMask() {
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        analogChannels[i].enabled = true;
+        analogChannels[i].backend = ADC_BACKEND_INTERNAL;
+        analogChannels[i].extInput = 0;
+    }
+    analogChannels[0].backend = ADC_BACKEND_ADS1115;
+    analogChannels[0].extInput = 2;
+    analogChannels[1].backend = ADC_BACKEND_ADS1115;
+    analogChannels[1].extInput = 3;
+    analogChannels[1].enabled = false;
+    analogChannels[2].backend = ADC_BACKEND_ADS1256;
+    analogChannels[2].extInput = 7;
+    analogChannels[3].backend = ADC_BACKEND_ADS1256;
+    analogChannels[3].extInput = 7;   // 两个通道共用一个输入只扫描一次
+    extAdcUpdateScanMask();
+    CHECK(extAdcScanMask[0].load() == 0b100);
+    CHECK(extAdcScanMask[1].load() == 0x80);
+}
+
+int main() {
+    testAds1115Scan();
+    testAds1115Errors();
+    testAds1256Scan();
+    testInit();
+    testScanMask();
+    CHECK_DONE();
+}
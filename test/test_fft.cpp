@@ -0,0 +1,103 @@
+// 实数FFT和 Goertzel（fft.h）：与直接按定义计算的 DFT 比较
+#include <math.h>
+#include <stdlib.h>
+#include "check.h"
+#include "fft.h"
+
+// 确定的伪随机输入，范围与12位ADC码值相当
+void fillRandom(float* x, int n, unsigned seed) {
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (float)((seed >> 16) & 0xFFF) - 2048.0f;
+    }
+}
+
+// 第 k 个频点的 DFT，双精度
+void directDft(const float* x, int n, int k, double& re, double& im) {
+    re = im = 0;
+    for (int i = 0; i < n; i++) {
+        double a = 2 * M_PI * (double)k * i / n;
+        re += x[i] * cos(a);
+        im -= x[i] * sin(a);
+    }
+}
+
+template <int N>
+void testMatchesDirectDft(unsigned seed) {
+    static RealFft<N> fft;
+    float x[N], data[N];
+    fillRandom(x, N, seed);
+    for (int i = 0; i < N; i++) data[i] = x[i];
+    fft.forward(data);
+
+    // 单精度的舍入误差随 log2(N) 增长，按输入的总幅度取容差
+    double scale = 0;
+    for (int i = 0; i < N; i++) scale += fabs(x[i]);
+    double tol = scale * 1e-5;
+
+    for (int k = 0; k <= N / 2; k++) {
+        double re, im;
+        directDft(x, N, k, re, im);
+        if (k == 0) {
+            CHECK_NEAR(data[0], re, tol);
+        } else if (k == N / 2) {
+            CHECK_NEAR(data[1], re, tol);
+        } else {
+            CHECK_NEAR(data[2 * k], re, tol);
+            CHECK_NEAR(data[2 * k + 1], im, tol);
+        }
+        CHECK_NEAR(sqrt(RealFft<N>::power(data, k)), sqrt(re * re + im * im), tol);
+    }
+}
+
+template <int N>
+void testWindow() {
+    static RealFft<N> fft;
+    // 周期 Hann 窗：Σw = N/2，Σw² = 3N/8
+    CHECK_NEAR(fft.windowSum(), N / 2.0, N * 1e-6);
+    CHECK_NEAR(fft.windowPower(), 3.0 * N / 8, N * 1e-6);
+
+    // 频点上的正弦加窗后，幅值按 2|X[k]| / windowSum 还原
+    const int bin = N / 8;
+    const float amplitude = 500;
+    float data[N];
+    for (int i = 0; i < N; i++) data[i] = amplitude * sinf(2 * (float)M_PI * bin * i / N + 0.7f);
+    fft.applyWindow(data);
+    fft.forward(data);
+    CHECK_NEAR(2 * sqrt(RealFft<N>::power(data, bin)) / fft.windowSum(), amplitude, amplitude * 1e-4);
+}
+
+void testGoertzel() {
+    const int N = 512;
+    float x[N];
+    fillRandom(x, N, 7);
+    // 频点上与 DFT 相同
+    for (int k = 1; k < N / 2; k += 37) {
+        double re, im;
+        directDft(x, N, k, re, im);
+        double expected = re * re + im * im;
+        CHECK_NEAR(goertzelPower(x, N, (float)k, (float)N), expected, expected * 1e-3 + 1);
+    }
+    // 不在频点上：与按定义在该频率的求和比较
+    const float rate = 1000, freq = 50;
+    double re = 0, im = 0;
+    for (int i = 0; i < N; i++) {
+        double a = 2 * M_PI * freq * i / rate;
+        re += x[i] * cos(a);
+        im -= x[i] * sin(a);
+    }
+    double expected = re * re + im * im;
+    CHECK_NEAR(goertzelPower(x, N, freq, rate), expected, expected * 1e-3 + 1);
+}
+
+int main() {
+    testMatchesDirectDft<8>(1);
+    testMatchesDirectDft<16>(2);
+    testMatchesDirectDft<64>(3);
+    testMatchesDirectDft<512>(4);
+    testMatchesDirectDft<1024>(5);
+    testWindow<64>();
+    testWindow<512>();
+    testGoertzel();
+    CHECK_DONE();
+}
@@ -0,0 +1,159 @@
+// 遥测 JSON（jsonwriter.h）：稳态下反复生成实时数据消息不申请堆内存，输出是合法的 JSON
+#include <Arduino.h>
+#include <new>
+#include "check.h"
+#include "types.h"
+#include "jsonwriter.h"
+
+// 统计窗口内的堆分配：替换 malloc 系列和 operator new
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static bool counting = false;
+static int allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+    if (counting) allocations++;
+    return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting) allocations++;
+    return __libc_calloc(count, size);
+}
+extern "C" void* realloc(void* ptr, size_t size) {
+    if (counting) allocations++;
+    return __libc_realloc(ptr, size);
+}
+extern "C" void free(void* ptr) { __libc_free(ptr); }
+
+void* operator new(size_t size) {
+    if (counting) allocations++;
+    void* p = __libc_malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { __libc_free(p); }
+void operator delete[](void* p) noexcept { __libc_free(p); }
+void operator delete(void* p, size_t) noexcept { __libc_free(p); }
+void operator delete[](void* p, size_t) noexcept { __libc_free(p); }
+
+const size_t SENSOR_JSON_SIZE = 8192;   // 与 webjk.ino 相同
+char sensorJson[SENSOR_JSON_SIZE];
+
+// 与 sendSensorData 相同的结构：每个通道的读数、三个统计窗口，温度和虚拟通道
+size_t renderTelemetry(const SensorSnapshot& snap, char* buf, size_t size) {
+    static const char* const windows[] = {"10s", "1m", "1h"};
+    BufferPrint out(buf, size);
+    JsonWriter json(out);
+    json.beginObject();
+    json.beginArray("values");
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if (!(snap.enabledMask & (1u << i))) continue;
+        json.beginObject();
+        json.field("channel", i);
+        json.field("name", "Tank \"A\" level\tch");
+        json.field("gpio", i + 1);
+        json.field("rawValue", (int)snap.currentValue[i]);
+        json.field("voltage", snap.currentValue[i] * 3.3 / 4095);
+        json.field("value", (double)snap.value[i]);
+        json.field("unit", "m³");
+        json.field("difference", (int)snap.difference[i]);
+        json.field("interval", (unsigned int)snap.sampleInterval[i]);
+        json.field("stale", (snap.staleMask & (1u << i)) != 0);
+        json.field("valid", (snap.invalidMask & (1u << i)) == 0);
+        json.beginObject("stats");
+        for (int w = 0; w < 3; w++) {
+            json.beginArray(windows[w]);
+            json.value((double)snap.value[i]).value(NAN).value(1e-9).value(-12345.678).value(0.0);
+            json.endArray();
+        }
+        json.endObject();
+        json.endObject();
+    }
+    json.endArray();
+    json.beginArray("temperatures");
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        json.beginObject();
+        json.field("value", (double)snap.tempValue[i]);
+        json.field("resistance", (double)snap.tempResistance[i]);
+        json.field("fault", (int)snap.tempFault[i]);
+        json.endObject();
+    }
+    json.endArray();
+    json.beginArray("virtual");
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) json.value((double)snap.virtualValue[k]);
+    json.endArray();
+    json.endObject();
+    return out.overflowed() ? 0 : out.length();
+}
+
+// 括号配对、字符串闭合（粗略检查输出没有被截断或写乱）
+bool balanced(const char* s) {
+    int depth = 0;
+    bool inString = false, escape = false;
+    for (; *s; s++) {
+        if (inString) {
+            if (escape) escape = false;
+            else if (*s == '\\') escape = true;
+            else if (*s == '"') inString = false;
+            else if ((uint8_t)*s < 0x20) return false;
+        } else if (*s == '"') {
+            inString = true;
+        } else if (*s == '{' || *s == '[') {
+            depth++;
+        } else if (*s == '}' || *s == ']') {
+            if (--depth < 0) return false;
+        }
+    }
+    return depth == 0 && !inString;
+}
+
+int main() {
+    static SensorSnapshot snap;
+    memset(&snap, 0, sizeof(snap));
+    snap.enabledMask = (1u << Board::ANALOG_CHANNELS) - 1;
+    snap.invalidMask = 0b10;
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        snap.value[i] = i == 1 ? NAN : i * 12.5f;
+        snap.currentValue[i] = 100 * i;
+        snap.sampleInterval[i] = 200;
+    }
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) snap.virtualValue[k] = k * 0.1f;
+
+    // 第一次生成时 C 库可能初始化区域设置等，不计入
+    size_t len = renderTelemetry(snap, sensorJson, SENSOR_JSON_SIZE);
+    CHECK(len > 0);
+    CHECK(balanced(sensorJson));
+    CHECK(strstr(sensorJson, "\"name\":\"Tank \\\"A\\\" level\\tch\"") != NULL);
+    CHECK(strstr(sensorJson, "\"value\":null") != NULL);
+
+    counting = true;
+    for (int tick = 0; tick < 1000; tick++) {
+        snap.value[0] = tick * 0.37f;
+        snap.currentValue[0] = tick;
+        len = renderTelemetry(snap, sensorJson, SENSOR_JSON_SIZE);
+    }
+    counting = false;
+    CHECK(allocations == 0);
+    CHECK(len > 0);
+
+    // 溢出时截断并报告，同样不申请内存
+    static char small[256];
+    counting = true;
+    CHECK(renderTelemetry(snap, small, sizeof(small)) == 0);
+    counting = false;
+    CHECK(allocations == 0);
+    CHECK(strlen(small) == sizeof(small) - 1);
+
+    // 统计本身有效：分配一次能被发现
+    static void* volatile sink;
+    counting = true;
+    sink = malloc(16);
+    counting = false;
+    free(sink);
+    CHECK(allocations == 1);
+    CHECK_DONE();
+}
@@ -0,0 +1,92 @@
+// 工频抑制滤波器（mainsfilter.h）：积分和陷波对工频干扰的残余、直流增益和阶跃响应
+#include <math.h>
+#include "check.h"
+#include "mainsfilter.h"
+
+const float DC = 2000;
+const float HUM = 300;           // 基波幅值（码值）
+const float HARMONIC = 100;      // 三次谐波幅值
+
+int16_t humSample(int n, float hz, float harmonic) {
+    float t = (float)n / MAINS_SAMPLE_RATE;
+    float x = DC + HUM * sinf(2 * (float)M_PI * hz * t + 0.3f) + harmonic * sinf(2 * (float)M_PI * 3 * hz * t + 1.1f);
+    return (int16_t)lroundf(x);
+}
+
+// 滤波器就绪、再过 settle 秒后的 seconds 秒内，输出偏离直流的最大值
+float maxResidue(MainsFilter& filter, float hz, float harmonic, float settle, float seconds) {
+    float residue = 0;
+    int n = 0;
+    while (!filter.ready()) filter.update(humSample(n++, hz, harmonic));
+    for (int end = n + (int)(settle * MAINS_SAMPLE_RATE); n < end; n++) filter.update(humSample(n, hz, harmonic));
+    int end = n + (int)(seconds * MAINS_SAMPLE_RATE);
+    for (; n < end; n++) {
+        float y = filter.update(humSample(n, hz, harmonic));
+        residue = fmaxf(residue, fabsf(y - DC));
+    }
+    return residue;
+}
+
+void testIntegrateRejectsHumAndHarmonics() {
+    for (int hz = 50; hz <= 60; hz += 10) {
+        for (int cycles = 1; cycles <= MAINS_MAX_CYCLES; cycles++) {
+            MainsFilter filter;
+            filter.configure(MAINS_INTEGRATE, hz, cycles, MAINS_SAMPLE_RATE);
+            // 只剩输入取整的误差
+            CHECK(maxResidue(filter, hz, HARMONIC, 0, 1.0f) < 0.5f);
+        }
+    }
+}
+
+void testIntegrateFrequencyDeviation() {
+    // 电网频率偏差0.4%时残余约为干扰幅度的0.4%
+    MainsFilter filter;
+    filter.configure(MAINS_INTEGRATE, 50, 1, MAINS_SAMPLE_RATE);
+    float residue = maxResidue(filter, 50.2f, 0, 0, 2.0f);
+    CHECK(residue < HUM * 0.005f + 0.5f);
+    CHECK(residue > HUM * 0.002f);
+}
+
+void testNotchRejectsFundamental() {
+    for (int hz = 50; hz <= 60; hz += 10) {
+        MainsFilter filter;
+        filter.configure(MAINS_NOTCH, hz, 1, MAINS_SAMPLE_RATE);
+        // 启动过渡衰减完以后
+        CHECK(maxResidue(filter, hz, 0, 1.0f, 1.0f) < HUM * 0.01f);
+    }
+}
+
+void testDcGainAndStep() {
+    MainsFilter integrate;
+    integrate.configure(MAINS_INTEGRATE, 50, 2, MAINS_SAMPLE_RATE);
+    int window = MAINS_SAMPLE_RATE / 50 * 2;
+    for (int i = 0; i < window; i++) integrate.update(1000);
+    CHECK(integrate.ready());
+    CHECK_NEAR(integrate.update(1000), 1000, 1e-3);
+    // 阶跃在一个积分窗口内完整反映
+    float y = 0;
+    for (int i = 0; i < window; i++) y = integrate.update(3000);
+    CHECK_NEAR(y, 3000, 1e-3);
+
+    MainsFilter notch;
+    notch.configure(MAINS_NOTCH, 50, 1, MAINS_SAMPLE_RATE);
+    for (int i = 0; i < MAINS_SAMPLE_RATE; i++) y = notch.update(1000);
+    CHECK(notch.ready());
+    CHECK_NEAR(y, 1000, 0.5);
+}
+
+void testOffPassesThrough() {
+    MainsFilter filter;
+    filter.configure(MAINS_OFF, 50, 1, MAINS_SAMPLE_RATE);
+    CHECK(filter.ready());
+    CHECK_NEAR(filter.update(1234), 1234, 0);
+}
+
+int main() {
+    testIntegrateRejectsHumAndHarmonics();
+    testIntegrateFrequencyDeviation();
+    testNotchRejectsFundamental();
+    testDcGainAndStep();
+    testOffPassesThrough();
+    CHECK_DONE();
+}
@@ -0,0 +1,190 @@
+// Modbus 报文处理（modbuspdu.h）：各功能码的应答格式、异常码，以及写命令全部有效才入队
+#include <Arduino.h>
+#include <vector>
+#include "check.h"
+#include "modbuspdu.h"
+
+// 设备访问的假实现：记录入队的命令
+SensorSnapshot fakeSensors;
+RelayConfigSet fakeRelays;
+size_t fakeSpace;
+
+struct FakeCommand {
+    int channel;
+    bool isMode;
+    int value;
+    unsigned long onTime;   // 修改模式时保留的定时参数
+};
+std::vector<FakeCommand> commands;
+
+void mbReadSensors(SensorSnapshot& snap) { snap = fakeSensors; }
+void mbReadRelays(RelayConfigSet& relays) { relays = fakeRelays; }
+size_t mbCommandSpace() { return fakeSpace; }
+
+bool mbRequestRelaySet(int channel, bool on) {
+    if (fakeSpace == 0) return false;
+    fakeSpace--;
+    commands.push_back({channel, false, on, 0});
+    return true;
+}
+
+bool mbRequestRelayMode(const RelayChannel& relay, int channel, uint16_t mode) {
+    if (fakeSpace == 0) return false;
+    fakeSpace--;
+    commands.push_back({channel, true, mode, relay.onTime});
+    return true;
+}
+
+void reset() {
+    memset(&fakeSensors, 0, sizeof(fakeSensors));
+    memset(&fakeRelays, 0, sizeof(fakeRelays));
+    fakeSpace = 32;
+    commands.clear();
+}
+
+uint8_t resp[MODBUS_MAX_ADU];
+
+size_t process(std::vector<uint8_t> pdu) {
+    memset(resp, 0xEE, sizeof(resp));
+    return modbusProcess(pdu.data(), pdu.size(), resp);
+}
+
+void checkException(size_t n, uint8_t fc, uint8_t code) {
+    CHECK(n == 2);
+    CHECK(resp[0] == (fc | 0x80));
+    CHECK(resp[1] == code);
+}
+
+void testReadCoils() {
+    reset();
+    fakeSensors.relayState = 0b1010;
+    fakeSensors.relayAutoRunning = 0b0001;
+    size_t n = process({MB_FC_READ_COILS, 0, 1, 0, 3});
+    CHECK(n == 3);
+    CHECK(resp[0] == MB_FC_READ_COILS);
+    CHECK(resp[1] == 1);
+    CHECK(resp[2] == 0b101);   // 线圈1-3，从请求的起始地址开始排列
+
+    n = process({MB_FC_READ_DISCRETE_INPUTS, 0, 0, 0, 4});
+    CHECK(n == 3);
+    CHECK(resp[2] == 0b0001);
+
+    checkException(process({MB_FC_READ_COILS, 0, 0, 0, 0}), MB_FC_READ_COILS, MB_EX_ILLEGAL_VALUE);
+    checkException(process({MB_FC_READ_COILS, 0, 1, 0, Board::RELAY_CHANNELS}), MB_FC_READ_COILS, MB_EX_ILLEGAL_ADDRESS);
+}
+
+void testReadRegisters() {
+    reset();
+    fakeRelays.channel[1].mode = AUTOMATIC;
+    size_t n = process({MB_FC_READ_HOLDING_REGISTERS, 0, 0, 0, 2});
+    CHECK(n == 6);
+    CHECK(resp[1] == 4);
+    CHECK(mbGet16(resp + 2) == MANUAL);
+    CHECK(mbGet16(resp + 4) == AUTOMATIC);
+
+    // float32 高字在前
+    fakeSensors.value[1] = 1.5f;     // 0x3FC00000
+    fakeSensors.currentValue[2] = 1234;
+    n = process({MB_FC_READ_INPUT_REGISTERS, 0, 2, 0, 2});
+    CHECK(n == 6);
+    CHECK(mbGet16(resp + 2) == 0x3FC0);
+    CHECK(mbGet16(resp + 4) == 0x0000);
+    n = process({MB_FC_READ_INPUT_REGISTERS, 0, MB_INPUT_ANALOG_RAW + 2, 0, 1});
+    CHECK(n == 4);
+    CHECK(mbGet16(resp + 2) == 1234);
+
+    fakeSensors.tempFault[1] = 0x40;
+    n = process({MB_FC_READ_INPUT_REGISTERS, 0, MB_INPUT_TEMP_FAULT + 1, 0, 1});
+    CHECK(n == 4);
+    CHECK(mbGet16(resp + 2) == 0x40);
+
+    // 地址空洞和越界
+    checkException(process({MB_FC_READ_INPUT_REGISTERS, 0, 2 * Board::ANALOG_CHANNELS, 0, 1}),
+                   MB_FC_READ_INPUT_REGISTERS, MB_EX_ILLEGAL_ADDRESS);
+    checkException(process({MB_FC_READ_INPUT_REGISTERS, 0, 0, 0, 126}),
+                   MB_FC_READ_INPUT_REGISTERS, MB_EX_ILLEGAL_VALUE);
+}
+
+void testFraming() {
+    reset();
+    // PDU 不足5字节
+    checkException(process({MB_FC_READ_COILS, 0, 0}), MB_FC_READ_COILS, MB_EX_ILLEGAL_VALUE);
+    // 不支持的功能码
+    checkException(process({0x2B, 0, 0, 0, 1}), 0x2B, MB_EX_ILLEGAL_FUNCTION);
+    // 写多个线圈：字节数与数量不符、数据不够
+    checkException(process({MB_FC_WRITE_MULTIPLE_COILS, 0, 0, 0, 2, 2, 0x03, 0}),
+                   MB_FC_WRITE_MULTIPLE_COILS, MB_EX_ILLEGAL_VALUE);
+    checkException(process({MB_FC_WRITE_MULTIPLE_REGISTERS, 0, 0, 0, 2, 4, 0, 1}),
+                   MB_FC_WRITE_MULTIPLE_REGISTERS, MB_EX_ILLEGAL_VALUE);
+    CHECK(commands.empty());
+    CHECK(modbusStats.exceptions > 0);
+}
+
+void testWriteCoils() {
+    reset();
+    size_t n = process({MB_FC_WRITE_SINGLE_COIL, 0, 2, 0xFF, 0x00});
+    CHECK(n == 5);
+    CHECK(resp[0] == MB_FC_WRITE_SINGLE_COIL && mbGet16(resp + 1) == 2 && mbGet16(resp + 3) == 0xFF00);
+    CHECK(commands.size() == 1 && commands[0].channel == 2 && !commands[0].isMode && commands[0].value == 1);
+
+    checkException(process({MB_FC_WRITE_SINGLE_COIL, 0, 2, 0x12, 0x34}), MB_FC_WRITE_SINGLE_COIL, MB_EX_ILLEGAL_VALUE);
+    checkException(process({MB_FC_WRITE_SINGLE_COIL, 0, Board::RELAY_CHANNELS, 0, 0}),
+                   MB_FC_WRITE_SINGLE_COIL, MB_EX_ILLEGAL_ADDRESS);
+
+    // 自动模式的继电器不能手动开关
+    reset();
+    fakeRelays.channel[1].mode = AUTOMATIC;
+    checkException(process({MB_FC_WRITE_SINGLE_COIL, 0, 1, 0xFF, 0x00}), MB_FC_WRITE_SINGLE_COIL, MB_EX_ILLEGAL_VALUE);
+    checkException(process({MB_FC_WRITE_MULTIPLE_COILS, 0, 0, 0, 3, 1, 0x07}),
+                   MB_FC_WRITE_MULTIPLE_COILS, MB_EX_ILLEGAL_VALUE);
+    CHECK(commands.empty());
+
+    // 队列放不下全部命令时一个也不入队
+    reset();
+    fakeSpace = 2;
+    checkException(process({MB_FC_WRITE_MULTIPLE_COILS, 0, 0, 0, 3, 1, 0x05}),
+                   MB_FC_WRITE_MULTIPLE_COILS, MB_EX_DEVICE_BUSY);
+    CHECK(commands.empty());
+
+    fakeSpace = 3;
+    n = process({MB_FC_WRITE_MULTIPLE_COILS, 0, 0, 0, 3, 1, 0x05});
+    CHECK(n == 5);
+    CHECK(mbGet16(resp + 1) == 0 && mbGet16(resp + 3) == 3);
+    CHECK(commands.size() == 3);
+    CHECK(commands[0].value == 1 && commands[1].value == 0 && commands[2].value == 1);
+}
+
+void testWriteRegisters() {
+    reset();
+    fakeRelays.channel[1].onTime = 2500;
+    size_t n = process({MB_FC_WRITE_SINGLE_REGISTER, 0, 1, 0, AUTOMATIC});
+    CHECK(n == 5);
+    CHECK(commands.size() == 1 && commands[0].isMode && commands[0].value == AUTOMATIC);
+    CHECK(commands[0].onTime == 2500);
+    checkException(process({MB_FC_WRITE_SINGLE_REGISTER, 0, 1, 0, 2}), MB_FC_WRITE_SINGLE_REGISTER, MB_EX_ILLEGAL_VALUE);
+
+    // 任何一个值无效或队列放不下都不入队
+    reset();
+    checkException(process({MB_FC_WRITE_MULTIPLE_REGISTERS, 0, 0, 0, 2, 4, 0, 1, 0, 7}),
+                   MB_FC_WRITE_MULTIPLE_REGISTERS, MB_EX_ILLEGAL_VALUE);
+    fakeSpace = 1;
+    checkException(process({MB_FC_WRITE_MULTIPLE_REGISTERS, 0, 0, 0, 2, 4, 0, 1, 0, 0}),
+                   MB_FC_WRITE_MULTIPLE_REGISTERS, MB_EX_DEVICE_BUSY);
+    CHECK(commands.empty());
+
+    fakeSpace = 2;
+    n = process({MB_FC_WRITE_MULTIPLE_REGISTERS, 0, 0, 0, 2, 4, 0, 1, 0, 0});
+    CHECK(n == 5);
+    CHECK(commands.size() == 2);
+    CHECK(commands[0].channel == 0 && commands[0].value == AUTOMATIC);
+    CHECK(commands[1].channel == 1 && commands[1].value == MANUAL);
+}
+
+int main() {
+    testReadCoils();
+    testReadRegisters();
+    testFraming();
+    testWriteCoils();
+    testWriteRegisters();
+    CHECK_DONE();
+}
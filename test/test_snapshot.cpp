@@ -0,0 +1,111 @@
+// Snapshot 的多线程压力测试，在 ThreadSanitizer 下运行（make tsan）
+//
+// 一个线程按网络回调的方式修改暂存区并发布，另一个线程按主循环的方式读取并应用，
+// 同时还有两个只读线程；每次发布的内容各字段都相同，读到不一致的内容说明复制被覆盖了。
+#include <Arduino.h>
+#include <thread>
+#include <atomic>
+#include "check.h"
+#include "snapshot.h"
+
+#define CHANNELS 12
+#define PUBLISHES 200000
+
+struct Channel {
+    uint32_t value;
+    char name[32];
+    float calib[8];
+};
+
+struct ConfigSet {
+    Channel channel[CHANNELS];
+    uint16_t revision[CHANNELS];
+};
+
+Snapshot<ConfigSet> configs;
+std::atomic<bool> done(false);
+
+void fillChannel(Channel& c, uint32_t value) {
+    c.value = value;
+    memset(c.name, (int)(value & 0x7F), sizeof(c.name));
+    for (int k = 0; k < 8; k++) c.calib[k] = (float)value;
+}
+
+bool channelConsistent(const Channel& c) {
+    for (size_t k = 0; k < sizeof(c.name); k++) {
+        if (c.name[k] != (char)(c.value & 0x7F)) return false;
+    }
+    for (int k = 0; k < 8; k++) {
+        if (c.calib[k] != (float)c.value) return false;
+    }
+    return true;
+}
+
+// 网络回调：每次修改一个通道，revision 加一后发布
+void writer() {
+    static ConfigSet staged;
+    memset(&staged, 0, sizeof(staged));
+    for (int i = 0; i < CHANNELS; i++) fillChannel(staged.channel[i], 0);
+    for (uint32_t n = 1; n <= PUBLISHES; n++) {
+        int i = n % CHANNELS;
+        fillChannel(staged.channel[i], n);
+        staged.revision[i]++;
+        configs.publish(staged);
+    }
+    done.store(true);
+}
+
+// 主循环：序号变化时读取，revision 变化的通道必须是完整的新值
+void applier(int* errors, uint32_t* applied) {
+    static ConfigSet active;
+    uint16_t revision[CHANNELS] = {0};
+    uint32_t seq = 0;
+    while (!done.load() || configs.sequence() != seq) {
+        if (configs.sequence() == seq) continue;
+        seq = configs.read(active);
+        for (int i = 0; i < CHANNELS; i++) {
+            if (!channelConsistent(active.channel[i])) (*errors)++;
+            if (active.revision[i] == revision[i]) continue;
+            revision[i] = active.revision[i];
+            (*applied)++;
+        }
+    }
+}
+
+void reader(int* errors) {
+    ConfigSet copy;
+    uint32_t last = 0;
+    while (!done.load()) {
+        uint32_t seq = configs.read(copy);
+        if (seq < last) (*errors)++;   // 序号不会倒退
+        last = seq;
+        for (int i = 0; i < CHANNELS; i++) {
+            if (!channelConsistent(copy.channel[i])) (*errors)++;
+        }
+    }
+}
+
+int main() {
+    int applyErrors = 0, readErrors[2] = {0, 0};
+    uint32_t applied = 0;
+    std::thread w(writer);
+    std::thread a(applier, &applyErrors, &applied);
+    std::thread r0(reader, &readErrors[0]);
+    std::thread r1(reader, &readErrors[1]);
+    w.join();
+    a.join();
+    r0.join();
+    r1.join();
+
+    CHECK(applyErrors == 0);
+    CHECK(readErrors[0] == 0);
+    CHECK(readErrors[1] == 0);
+    CHECK(applied > 0);
+    CHECK(configs.sequence() == PUBLISHES);
+
+    // 最后一次发布的内容
+    ConfigSet last;
+    configs.read(last);
+    CHECK(last.channel[PUBLISHES % CHANNELS].value == PUBLISHES);
+    CHECK_DONE();
+}
@@ -1,6 +1,8 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include "board.h"
+
 // 继电器模式枚举
 enum RelayMode {
     MANUAL = 0,
@@ -20,29 +22,102 @@ struct ADCCalibPoint {
     float tolerance;       // 容差范围
 };
 
-// 模拟量配置结构体
+// 定长内联字符串，替代 String 以避免堆分配
+template <size_t N>
+struct InlineString {
+    char buf[N];
+
+    void set(const char* s) {
+        if (!s) s = "";
+        size_t len = strlen(s);
+        if (len >= N) {
+            len = N - 1;
+            // 不截断半个UTF-8字符
+            while (len > 0 && ((uint8_t)s[len] & 0xC0) == 0x80) len--;
+        }
+        memcpy(buf, s, len);
+        buf[len] = '\0';
+    }
+    const char* c_str() const { return buf; }
+    bool isEmpty() const { return buf[0] == '\0'; }
+};
+
+// 模拟量通道的采样后端
+enum AnalogBackend {
+    ADC_BACKEND_INTERNAL = 0,   // 芯片内部ADC（通道对应的GPIO）
+    ADC_BACKEND_ADS1115 = 1,    // 外部 ADS1115，单端输入 AIN0-3
+    ADC_BACKEND_ADS1256 = 2,    // 外部 ADS1256，单端输入 AIN0-7（相对 AINCOM）
+    ADC_BACKEND_COUNT
+};
+
+#define ADS1115_INPUTS 4
+#define ADS1256_INPUTS 8
+
+// 后端的输入数量，内部ADC只有通道自己的引脚
+inline int analogBackendInputs(int backend) {
+    return backend == ADC_BACKEND_ADS1115 ? ADS1115_INPUTS :
+           backend == ADC_BACKEND_ADS1256 ? ADS1256_INPUTS : 1;
+}
+
+// 限幅值范围：采样状态中按 int16_t 保存，0 会使限幅滤波拒绝一切变化
+#define FILTER_LIMIT_MIN 1
+#define FILTER_LIMIT_MAX INT16_MAX
+
+// 模拟量配置结构体（冷数据：配置和元数据，只在配置读写和数据发送时访问）
 struct AnalogChannel {
     bool enabled;
-    String name;
-    String unit;
+    InlineString<32> name;
+    InlineString<16> unit;
     int gpio;
+    uint8_t backend;      // 采样后端 AnalogBackend
+    uint8_t extInput;     // 外部ADC的输入号
+    uint8_t mainsMode;    // 工频抑制 MainsMode（只用于内部 ADC1 通道）
+    uint8_t mainsHz;      // 工频频率 50/60
+    uint8_t mainsCycles;  // 积分的周期数
     int numPoints;
     CalibrationPoint calibPoints[8];
     int filterLimit;      // 限幅值
     float compensation;   // 补偿值
-    int lastRawValue;     // 上次的原始值
-    unsigned long lastSampleTime; // 上次采样时间
-    int sampleBuffer[5];  // 存储5个采样值的缓冲区
-    int sampleCount;      // 当前采样计数
-    int lastSecondValue;   // 上一秒的中值
-    int currentValue;      // 当前使用的值
-    int difference;    // 存储当前差值
-    static const ADCCalibPoint calibTable[31];  // 添加校准表
+    uint16_t sampleMin;   // 自适应采样的最短间隔(ms)，信号变化时使用
+    uint16_t sampleMax;   // 最长间隔(ms)，信号平稳时逐步放慢到这里；与 sampleMin 相同时固定间隔
 };
 
+// 网络回调暂存的模拟量配置，主循环按 revision 找出改动的通道后应用
+struct AnalogConfigSet {
+    AnalogChannel channel[Board::ANALOG_CHANNELS];
+    uint16_t revision[Board::ANALOG_CHANNELS];   // 每次修改加一
+};
+
+// 模拟量采样状态（热数据：按字段连续存放，采样循环只访问这里）
+struct AnalogSampleState {
+    uint16_t enabledMask;                            // 启用通道位图，第i位对应通道i
+    uint16_t externalMask;                           // 使用外部ADC的通道位图
+    uint8_t gpio[Board::ANALOG_CHANNELS];            // 采样引脚（从配置同步）
+    uint8_t backend[Board::ANALOG_CHANNELS];         // 采样后端（从配置同步）
+    uint8_t extInput[Board::ANALOG_CHANNELS];        // 外部ADC的输入号（从配置同步）
+    int16_t filterLimit[Board::ANALOG_CHANNELS];     // 限幅值（从配置同步）
+    uint8_t sampleCount[Board::ANALOG_CHANNELS];     // 当前采样计数
+    int16_t sampleBuffer[Board::ANALOG_CHANNELS][5]; // 每通道5个采样值的缓冲区
+    int16_t lastSecondValue[Board::ANALOG_CHANNELS]; // 上一秒的中值
+    int16_t currentValue[Board::ANALOG_CHANNELS];    // 当前使用的值
+    int16_t difference[Board::ANALOG_CHANNELS];      // 当前差值
+    int16_t lastSample[Board::ANALOG_CHANNELS];      // 最近一次原始采样值
+    uint32_t lastSampleTime[Board::ANALOG_CHANNELS]; // 最近一次成功采样的 millis()
+    uint16_t validMask;                              // 已取得过中值的通道
+    uint16_t staleMask;                              // 采样值过期的通道
+    uint16_t invalidMask;                            // 采样值无效的通道
+    uint16_t sampleMin[Board::ANALOG_CHANNELS];      // 采样间隔范围（从配置同步）
+    uint16_t sampleMax[Board::ANALOG_CHANNELS];
+    uint16_t sampleInterval[Board::ANALOG_CHANNELS]; // 当前采样间隔(ms)，见 adaptive.h
+    uint8_t quietCount[Board::ANALOG_CHANNELS];      // 连续平稳的中值个数
+};
+
+// ADC校准表（定义在 webjk.ino）
+extern const ADCCalibPoint adcCalibTable[31];
+
 // 继电器通道结构
 struct RelayChannel {
-    String name;
+    InlineString<32> name;
     int gpio;
     bool state;
     RelayMode mode;
@@ -54,4 +129,35 @@ struct RelayChannel {
     unsigned long lastToggleTime;
 };
 
+// 继电器配置和运行状态（控制任务发布，其他任务通过 Snapshot<RelayConfigSet> 读取，见 control.h）
+struct RelayConfigSet {
+    RelayChannel channel[Board::RELAY_CHANNELS];
+};
+
+// 虚拟通道数（由表达式计算，见 virtual.h）
+#define VIRTUAL_CHANNELS 4
+
+// 采集快照（主循环发布，其他任务通过 Snapshot<SensorSnapshot> 无锁复制）
+struct SensorSnapshot {
+    uint32_t timestamp;                           // 发布时的 millis()
+    uint16_t enabledMask;                         // 启用的模拟量通道位图
+    uint16_t staleMask;                           // 采样值过期（读取失败）的通道
+    uint16_t invalidMask;                         // 采样值无效的通道，value 为 NAN
+    float value[Board::ANALOG_CHANNELS];          // 校准并补偿后的物理值
+    int16_t currentValue[Board::ANALOG_CHANNELS]; // 滤波后的值
+    int16_t difference[Board::ANALOG_CHANNELS];   // 当前差值
+    int16_t lastSample[Board::ANALOG_CHANNELS];   // 最近一次原始采样值
+    uint16_t sampleInterval[Board::ANALOG_CHANNELS]; // 当前采样间隔(ms)
+    uint8_t rateScale[Board::ANALOG_CHANNELS];    // 当前间隔是最短间隔的倍数，发布间隔按此放慢
+    float tempValue[Board::TEMP_SENSORS];         // 温度(°C)
+    float tempResistance[Board::TEMP_SENSORS];    // RTD电阻(Ω)
+    uint8_t tempFault[Board::TEMP_SENSORS];       // MAX31865 故障码
+    uint8_t tempEnabledMask;                      // 启用的温度传感器
+    uint8_t virtualMask;                          // 启用的虚拟通道
+    float virtualValue[VIRTUAL_CHANNELS];         // 虚拟通道的值，无效时为 NAN
+    uint32_t relayState;                          // 第i位为继电器i的输出状态
+    uint32_t relayAutoRunning;                    // 第i位为继电器i是否在自动运行
+    uint16_t relayCycles[Board::RELAY_CHANNELS];  // 自动运行已完成的循环次数
+};
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,243 @@
+#ifndef VIRTUAL_H
+#define VIRTUAL_H
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include "types.h"
+#include "log.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "jsonwriter.h"
+#include "configcache.h"
+#include "expr.h"
+
+// 虚拟通道：由实际通道计算出的值，如压差 a0-a1、按平方根规律的流量 k*sqrt(a2)、两个RTD的平均 avg(t0,t1)。
+// 表达式保存配置时编译为字节码（expr.h），主循环发布采集快照时只在用到的输入变化后重新计算，
+// 结果写入快照，与实际通道一样进入实时数据、历史记录、滑动统计和报警。
+//
+// 变量：a0..a11 为模拟量通道的物理值，t0、t1 为温度，v0..v3 为编号更小的虚拟通道。
+// 未启用、无效或故障的输入为 NAN，结果也为 NAN。
+//
+// 输入按统一编号：模拟量 0..ANALOG_CHANNELS-1，之后为温度传感器，再之后为虚拟通道。
+
+#define VIRTUAL_BASE (Board::ANALOG_CHANNELS + Board::TEMP_SENSORS)
+#define VIRTUAL_INPUTS (VIRTUAL_BASE + VIRTUAL_CHANNELS)
+#define VIRTUAL_EXPR_SIZE 96
+#define VIRTUAL_CONFIG_PATH "/virtual_config.json"
+
+static_assert(VIRTUAL_INPUTS <= 32, "expression inputs are a 32-bit mask");
+
+// 虚拟通道配置（冷数据，网络回调写入）
+struct VirtualChannel {
+    bool enabled;
+    InlineString<32> name;
+    InlineString<16> unit;
+    InlineString<VIRTUAL_EXPR_SIZE> expr;
+};
+
+// 主循环执行的程序
+struct VirtualProgramSet {
+    uint8_t enabledMask;
+    ExprProgram program[VIRTUAL_CHANNELS];
+};
+
+struct VirtualStats {
+    uint32_t updates;        // 发布快照的次数
+    uint32_t evaluations;    // 实际计算的次数
+};
+
+VirtualChannel virtualChannels[VIRTUAL_CHANNELS];
+Snapshot<VirtualProgramSet> virtualPrograms;
+VirtualStats virtualStats;
+
+// 只在主循环中访问
+VirtualProgramSet virtualActive;
+uint32_t virtualSeq = 0;
+float virtualInputs[VIRTUAL_INPUTS];   // 上次计算时的输入和各虚拟通道的值
+
+// 变量名解析，context 为正在编译的虚拟通道号（只能引用编号更小的虚拟通道）
+int virtualResolve(const char* name, size_t len, void* context) {
+    if (len < 2) return -1;
+    char* end;
+    long n = strtol(name + 1, &end, 10);
+    if (end != name + len || n < 0) return -1;
+    switch (name[0]) {
+    case 'a': return n < Board::ANALOG_CHANNELS ? n : -1;
+    case 't': return n < Board::TEMP_SENSORS ? Board::ANALOG_CHANNELS + n : -1;
+    case 'v': return n < *(int*)context ? VIRTUAL_BASE + n : -1;
+    default: return -1;
+    }
+}
+
+// 编译一个通道的表达式，失败时把错误信息写入 error
+bool virtualCompile(int index, const char* expr, ExprProgram& program, char* error, size_t size) {
+    ExprCompiler compiler(virtualResolve, &index);
+    const char* message = compiler.compile(expr, program);
+    if (!message) return true;
+    snprintf(error, size, "v%d: %s at %d", index, message, compiler.errorPos());
+    return false;
+}
+
+// 由输入中有模拟量通道的虚拟通道随模拟量采样更新，其余随测温更新（主循环中调用）
+uint8_t virtualAnalogMask() {
+    uint8_t mask = 0;
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        if (virtualActive.program[k].inputs & ((1u << Board::ANALOG_CHANNELS) - 1)) mask |= 1u << k;
+    }
+    return mask & virtualActive.enabledMask;
+}
+
+static bool virtualSameBits(float a, float b) {
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// 计算虚拟通道并写入快照（publishSensorSnapshot 中调用）；只计算输入有变化的通道
+void virtualUpdate(SensorSnapshot& snap) {
+    virtualStats.updates++;
+    uint32_t changed = 0;
+    if (virtualPrograms.sequence() != virtualSeq) {
+        virtualSeq = virtualPrograms.read(virtualActive);
+        changed = ~0u;
+    }
+
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        bool valid = (snap.enabledMask & (1u << i)) && !(snap.invalidMask & (1u << i));
+        float v = valid ? snap.value[i] : NAN;
+        if (!virtualSameBits(v, virtualInputs[i])) {
+            virtualInputs[i] = v;
+            changed |= 1u << i;
+        }
+    }
+    for (int i = 0; i < Board::TEMP_SENSORS; i++) {
+        float v = (snap.tempEnabledMask & (1u << i)) && !snap.tempFault[i] ? snap.tempValue[i] : NAN;
+        int index = Board::ANALOG_CHANNELS + i;
+        if (!virtualSameBits(v, virtualInputs[index])) {
+            virtualInputs[index] = v;
+            changed |= 1u << index;
+        }
+    }
+
+    // 按编号顺序计算，结果变化后引用它的虚拟通道随之重算
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        int index = VIRTUAL_BASE + k;
+        float v = NAN;
+        if (virtualActive.enabledMask & (1u << k)) {
+            const ExprProgram& program = virtualActive.program[k];
+            if (!(program.inputs & changed) && !(changed & (1u << index))) continue;
+            v = program.eval(virtualInputs);
+            virtualStats.evaluations++;
+        }
+        if (!virtualSameBits(v, virtualInputs[index])) {
+            virtualInputs[index] = v;
+            changed |= 1u << index;
+        }
+    }
+
+    snap.virtualMask = virtualActive.enabledMask;
+    memcpy(snap.virtualValue, virtualInputs + VIRTUAL_BASE, sizeof(snap.virtualValue));
+}
+
+// 虚拟通道配置（/get_virtual_config，也是配置文件的格式）
+void writeVirtualConfigJson(JsonWriter& json) {
+    json.beginArray("channels");
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        const VirtualChannel& c = virtualChannels[k];
+        json.beginObject();
+        json.field("index", k);
+        json.field("enabled", c.enabled);
+        json.field("name", c.name.c_str());
+        json.field("unit", c.unit.c_str());
+        json.field("expr", c.expr.c_str());
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// 应用配置：[{index,enabled,name,unit,expr},...]，只修改列出的通道；
+// 所有启用的表达式都编译通过才应用，否则返回错误信息（只在 AsyncTCP 任务和启动时调用）
+const char* applyVirtualConfig(JsonArray config) {
+    static char error[64];
+    static VirtualChannel staged[VIRTUAL_CHANNELS];
+    static VirtualProgramSet programs;
+    memcpy(staged, virtualChannels, sizeof(staged));
+    for (JsonObject c : config) {
+        int k = c["index"] | -1;
+        if (k < 0 || k >= VIRTUAL_CHANNELS) return "invalid index";
+        const char* expr = c["expr"] | "";
+        if (strlen(expr) >= VIRTUAL_EXPR_SIZE) return "expression too long";
+        staged[k].enabled = c["enabled"] | false;
+        staged[k].name.set(c["name"] | "");
+        staged[k].unit.set(c["unit"] | "");
+        staged[k].expr.set(expr);
+    }
+
+    // 引用关系可能随编号更小的通道一起变化，全部重新编译
+    memset(&programs, 0, sizeof(programs));
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        if (!staged[k].enabled) continue;
+        if (!virtualCompile(k, staged[k].expr.c_str(), programs.program[k], error, sizeof(error))) return error;
+        programs.enabledMask |= 1u << k;
+    }
+
+    memcpy(virtualChannels, staged, sizeof(staged));
+    virtualPrograms.publish(programs);
+    configChanged(CONFIG_VIRTUAL);
+    return NULL;
+}
+
+void saveVirtualConfig() {
+    METRICS_SCOPE(METRIC_SAVE_VIRTUAL);
+    File file = SPIFFS.open(VIRTUAL_CONFIG_PATH, "w");
+    if (!file) {
+        LOGE(LOG_MOD_CFG, "Failed to open virtual channel config file for writing");
+        return;
+    }
+    JsonWriter json(file);
+    json.beginObject();
+    writeVirtualConfigJson(json);
+    json.endObject();
+    file.close();
+    LOGI(LOG_MOD_CFG, "Virtual channel config saved");
+}
+
+// 加载配置（在发布初始快照之前调用）
+void loadVirtualConfig() {
+    for (int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        virtualChannels[k].enabled = false;
+        virtualChannels[k].name.set(("虚拟" + String(k)).c_str());
+        virtualChannels[k].unit.set("");
+        virtualChannels[k].expr.set("");
+    }
+    for (int i = 0; i < VIRTUAL_INPUTS; i++) virtualInputs[i] = NAN;
+    VirtualProgramSet empty;
+    memset(&empty, 0, sizeof(empty));
+    virtualPrograms.publish(empty);
+
+    if (!SPIFFS.exists(VIRTUAL_CONFIG_PATH)) return;
+    File file = SPIFFS.open(VIRTUAL_CONFIG_PATH, "r");
+    if (!file) {
+        LOGE(LOG_MOD_CFG, "Failed to open virtual channel config file");
+        return;
+    }
+    DynamicJsonDocument doc(2048);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    const char* invalid = error ? "parse error" : applyVirtualConfig(doc["channels"].as<JsonArray>());
+    if (invalid) {
+        LOGE(LOG_MOD_CFG, "Failed to load virtual channel config: %s", invalid);
+        return;
+    }
+    LOGI(LOG_MOD_CFG, "Virtual channel config loaded");
+}
+
+#if METRICS_ENABLED
+void writeVirtualMetrics(Print& out) {
+    out.print("# TYPE esp_virtual_updates_total counter\n");
+    out.printf("esp_virtual_updates_total %u\n", virtualStats.updates);
+    out.print("# TYPE esp_virtual_evaluations_total counter\n");
+    out.printf("esp_virtual_evaluations_total %u\n", virtualStats.evaluations);
+}
+#endif
+
+#endif
@@ -4,9 +4,29 @@
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
 #include "types.h"
+#include "snapshot.h"
+#include "log.h"
+#include "broadcast.h"
+#include "jsonwriter.h"
+#include "jsonstream.h"
+#include "metrics.h"
+#include "configcache.h"
 #include "html.h"
 #include "ws.h"
 #include "temp.h"
+#include "control.h"
+#include "modbus.h"
+#include "mqtt.h"
+#include "history.h"
+#include "extadc.h"
+#include "adcsched.h"
+#include "adaptive.h"
+#include "mains.h"
+#include "capture.h"
+#include "spectrum.h"
+#include "virtual.h"
+#include "stats.h"
+#include "alarm.h"
 
 // Constants for WiFi connection
 const char* AP_SSID = "YourAPSSID";  // Set your AP's SSID
@@ -23,38 +43,115 @@ String systemTitle = "ESP32 控制系统";  // 默认标题
 
 // 定义 WebSocket 对象
 AsyncWebSocket ws("/ws");
+AsyncWebSocket logWs("/ws_log");  // 日志流
+
+// 定义模拟量通道数组（启动后只由主循环修改）
+AnalogChannel analogChannels[Board::ANALOG_CHANNELS];
+
+// 网络回调修改的配置只写入暂存区（只在 AsyncTCP 任务中访问），再发布给主循环应用，
+// 配置页面和统计等网络侧的读取也使用暂存区
+AnalogConfigSet analogStaged;
+Snapshot<AnalogConfigSet> analogConfigs;
+uint32_t analogConfigSeq = 0;                         // 主循环已应用的序号
+uint16_t analogAppliedRevision[Board::ANALOG_CHANNELS];
+
+// /save_analog_config 请求体的解析状态：逐个元素解析到暂存区，请求体收完后一次应用
+struct AnalogConfigUpload {
+    JsonArrayStream stream;
+    AnalogChannel staged[Board::ANALOG_CHANNELS];
+    uint16_t mask;
+};
+
+// /save_relay_config 请求体的解析状态：逐个元素解析，请求体收完后一次提交给控制任务
+struct RelayConfigUpload {
+    JsonArrayStream stream;
+    RelayChannel staged[Board::RELAY_CHANNELS];
+    uint32_t mask;
+    const char* error;        // 元素无效的原因
+};
 
-// 定义模拟量通道数组
-AnalogChannel analogChannels[12];
+// 请求体是一个对象的配置接口：分段到达时先拼接，收完后整体解析
+typedef JsonBodyBuffer<512> TempConfigUpload;     // /save_temp_config，一个传感器的配置
+typedef JsonBodyBuffer<1024> MqttConfigUpload;    // /save_mqtt_config
+typedef JsonBodyBuffer<256 * ALARM_CHANNELS + 64> AlarmConfigUpload;   // /save_alarm_config，每个通道约200字节
+typedef JsonBodyBuffer<256 * VIRTUAL_CHANNELS + 64> VirtualConfigUpload;   // /save_virtual_config，表达式最长96字节
+
+// 定义模拟量采样状态（热数据）
+AnalogSampleState analogState;
 
 // 定义继电器通道数组
-RelayChannel relayChannels[4];
+RelayChannel relayChannels[Board::RELAY_CHANNELS];
+
+// 采集快照：只由主循环发布，网络回调和数据发送从这里读取
+Snapshot<SensorSnapshot> sensorSnapshot;
 
 unsigned long lastSensorUpdate = 0;
 unsigned long lastTempUpdate = 0;  // 添加温度更新时间戳
 const unsigned long SENSOR_UPDATE_INTERVAL = 200;  // ADC采样间隔200ms (1秒5次)
 const unsigned long TEMP_UPDATE_INTERVAL = 1000;   // 温度采样间隔1000ms (1秒1次)
-const unsigned long DATA_SEND_INTERVAL = 1000;     // 数据发送间隔1秒
-unsigned long lastDataSendTime = 0;                // 上次发送数据的时间
+const unsigned long DATA_SEND_INTERVAL = 1000;     // 客户端默认的数据发送间隔1秒，可通过 set_rate 命令调整
+unsigned long lastDataSendTime = 0;                // 上次检查数据发送的时间
+unsigned long lastWsCleanupTime = 0;               // 上次清理WebSocket客户端的时间
 
-// 定义温度传感器对象
-Adafruit_MAX31865 thermo1(10);   // CS pin: GPIO10
-Adafruit_MAX31865 thermo2(39);   // CS pin: GPIO39
+// 实时数据JSON的预分配缓冲区
+const size_t SENSOR_JSON_SIZE = 8192;   // 含各通道的滑动窗口统计
+char sensorJson[SENSOR_JSON_SIZE];
 
-// 定义温度传感器配置数组
-TempSensorConfig tempSensors[2] = {
-    {false, "温度传感器 1", PT100, 0.0, 10},  // 默认关闭，CS: GPIO10
-    {false, "温度传感器 2", PT100, 0.0, 39}   // 默认关闭，CS: GPIO39
-};
+// 继电器状态推送（主循环中使用）
+const size_t RELAY_JSON_SIZE = 256 * Board::RELAY_CHANNELS + 128;   // 每路约200字节
+char relayJson[RELAY_JSON_SIZE];
+volatile bool relayStatusDirty = true;   // 继电器状态有变化，需要推送
+
+// WebSocket 命令应答缓冲区（只在 AsyncTCP 任务中使用）
+const size_t WS_REPLY_SIZE = RELAY_JSON_SIZE > 7936 ? RELAY_JSON_SIZE + 256 : 8192;   // 也用于应答继电器状态和统计
+char wsReplyJson[WS_REPLY_SIZE];
+uint32_t wsRateReply;   // set_rate 实际生效的间隔
+const size_t WS_COMMAND_JSON_SIZE = 8192;   // 解析一条命令，要能容纳完整的 save_alarm_config（同 alarm.h 读配置文件）
+
+// 定义温度传感器对象（在 initTempSensors 中按板级配置的片选引脚创建）
+Adafruit_MAX31865* thermoSensors[Board::TEMP_SENSORS];
+
+// 定义温度传感器配置数组（默认值在 loadTempConfig 中设置，启动后只由主循环修改）
+TempSensorConfig tempSensors[Board::TEMP_SENSORS];
+
+// 温度传感器配置的暂存区，与模拟量相同
+TempConfigSet tempStaged;
+Snapshot<TempConfigSet> tempConfigs;
+uint32_t tempConfigSeq = 0;
+uint16_t tempAppliedRevision[Board::TEMP_SENSORS];
 
 bool connectWiFi(const char* ssid, const char* password);
 void loadConfig();
 void saveConfig();
 void initAnalogChannels();
 void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
-void sendSensorData();
+void sendSensorData(unsigned long now);
+void writeAnalogConfigJson(JsonWriter& json);
+void writeRelayStatusJson(JsonWriter& json);
+void writeRelayConfigJson(JsonWriter& json);
+void writeTempConfigJson(JsonWriter& json);
+int parseAnalogChannelConfig(JsonObject channelConfig, AnalogChannel& channel);
+void commitAnalogChannels(const AnalogChannel* staged, uint16_t mask);
+int applyAnalogChannelConfig(JsonObject channelConfig);
+bool applyAnalogConfigArray(JsonArray config);
+bool onAnalogConfigElement(char* json, size_t len, void* context);
+bool applyFilterLimit(int channel, int limit);
+bool applyRelaySet(int channel, bool state, uint32_t clientId, int32_t requestId);
+bool applyRelayAutoControl(int channel, bool running, uint32_t clientId, int32_t requestId);
+const char* applyRelayConfig(JsonArray config);
+const char* commitRelayConfig(const RelayChannel* staged, uint32_t mask);
+bool onRelayConfigElement(char* json, size_t len, void* context);
+bool applyTempConfig(int sensorIndex, JsonObject config);
+void handleWsCommand(AsyncWebSocketClient *client, const char *data, size_t len);
+void pushRelayStatus();
+void sendRelayAcks();
+void publishSensorSnapshot();
+void writeRateJson(JsonWriter& json);
 void saveAnalogConfig(int channelIndex);
 void loadAnalogConfig();
+void syncAnalogSampleState(int channel);
+void initStagedConfig();
+void applyStagedConfig();
 void initRelayChannels();
 void saveRelayConfig();
 void loadRelayConfig();
@@ -70,19 +167,22 @@ void setupWiFiAndServer() {
     WiFi.softAPConfig(local_IP, gateway, subnet);
 
     WiFi.softAP(AP_SSID, AP_PASS);
-    Serial.printf("AP started successfully: %s\n", WiFi.softAPIP().toString().c_str());
+    LOGI(LOG_MOD_WIFI, "AP started successfully: %s", WiFi.softAPIP().toString().c_str());
 
     // Setup server routes
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_HOME);
         request->send(200, "text/html", generateHomePage());
     });
 
     server.on("/wifi", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_WIFI_PAGE);
         String ip = wifi_connected ? WiFi.localIP().toString() : "";
         request->send(200, "text/html", generateWiFiPage(wifi_connected, sta_ssid, ip));
     });
 
     server.on("/connect", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_CONNECT);
         if (request->hasParam("ssid") && request->hasParam("pass")) {
             sta_ssid = request->getParam("ssid")->value();
             sta_pass = request->getParam("pass")->value();
@@ -97,154 +197,57 @@ void setupWiFiAndServer() {
     });
 
     server.on("/analog", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_ANALOG_PAGE);
         request->send(200, "text/html", generateAnalogConfigPage());
     });
 
     server.on("/relay", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_RELAY_PAGE);
         request->send(200, "text/html", generateRelayConfigPage());
     });
 
+    // 请求体可以分多段到达，{"config":[...]} 中可以有任意个通道，全部有效时一次应用并保存
     server.on("/save_analog_config", HTTP_POST, [](AsyncWebServerRequest *request) {
-        request->send(400, "text/plain", "Invalid Request");
-    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-        DynamicJsonDocument doc(8192);
-        DeserializationError error = deserializeJson(doc, (char*)data);
-        
-        if (error) {
-            Serial.println("Failed to parse JSON");
-            request->send(400, "text/plain", "Invalid JSON");
+        METRICS_SCOPE(METRIC_HTTP_SAVE_ANALOG_CONFIG);
+        AnalogConfigUpload* upload = (AnalogConfigUpload*)request->_tempObject;
+        if(!upload || !upload->stream.finished() || upload->mask == 0) {
+            LOGW(LOG_MOD_WEB, "Invalid analog config request");
+            request->send(400, "text/plain", "Invalid channel or config");
             return;
         }
-
-        JsonArray config = doc["config"].as<JsonArray>();
-        if(config.size() == 1) {
-            // 单通道配置
-            JsonObject channelConfig = config[0];
-            int channelIndex = channelConfig["channel"].as<int>();
-            
-            if(channelIndex >= 0 && channelIndex < 12) {
-                analogChannels[channelIndex].enabled = channelConfig["enabled"].as<bool>();
-                analogChannels[channelIndex].name = channelConfig["name"].as<String>();
-                analogChannels[channelIndex].unit = channelConfig["unit"].as<String>();
-                
-                // 根据通道号计算正确的 GPIO
-                if(channelIndex < 8) {
-                    analogChannels[channelIndex].gpio = channelIndex + 1;  // GPIO1-8
-                } else {
-                    analogChannels[channelIndex].gpio = channelIndex + 7;  // GPIO15-18
-                }
-                
-                // 处理其他配置项
-                analogChannels[channelIndex].filterLimit = channelConfig["filterLimit"].as<int>();
-                analogChannels[channelIndex].compensation = channelConfig["compensation"].as<float>();
-                
-                // 处理校准点
-                JsonArray points = channelConfig["calibPoints"].as<JsonArray>();
-                analogChannels[channelIndex].numPoints = 0;
-                for(JsonVariant p : points) {
-                    if(analogChannels[channelIndex].numPoints < 8) {
-                        float voltage = p["voltage"].as<float>();
-                        float physical = p["physical"].as<float>();
-                        if (!isnan(voltage) && !isnan(physical)) {
-                            analogChannels[channelIndex].calibPoints[analogChannels[channelIndex].numPoints].voltage = voltage;
-                            analogChannels[channelIndex].calibPoints[analogChannels[channelIndex].numPoints].physical = physical;
-                            analogChannels[channelIndex].numPoints++;
-                        }
-                    }
-                }
-                
-                // 如果没���有效的校准点，设置默认值
-                if(analogChannels[channelIndex].numPoints == 0) {
-                    analogChannels[channelIndex].calibPoints[0] = {0.0, 0.0};
-                    analogChannels[channelIndex].calibPoints[1] = {3.3, 100.0};
-                    analogChannels[channelIndex].numPoints = 2;
-                }
-                
-                // 保存配置到文件
-                saveAnalogConfig(channelIndex);
-                
-                Serial.printf("Channel %d config saved successfully\n", channelIndex);
-                request->send(200, "text/plain", "OK");  // 确保返回 200 状态码和 "OK" 响应
-                return;
-            }
+        commitAnalogChannels(upload->staged, upload->mask);
+        request->send(200, "text/plain", "OK");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if(index == 0 && !request->_tempObject) {
+            request->_tempObject = calloc(1, sizeof(AnalogConfigUpload));
         }
-        
-        Serial.println("Invalid channel or config");
-        request->send(200, "text/plain", "OK");  // 即使出错也返回 200
+        AnalogConfigUpload* upload = (AnalogConfigUpload*)request->_tempObject;
+        if(upload) upload->stream.feed(data, len, onAnalogConfigElement, upload);
     });
 
     server.on("/get_analog_config", HTTP_GET, [](AsyncWebServerRequest *request) {
-        DynamicJsonDocument doc(8192);
-        JsonArray channels = doc.createNestedArray("channels");
-        
-        for(int i = 0; i < 12; i++) {  // 从8改为12
-            JsonObject channel = channels.createNestedObject();
-            channel["enabled"] = analogChannels[i].enabled;
-            channel["name"] = analogChannels[i].name;
-            channel["unit"] = analogChannels[i].unit;
-            channel["gpio"] = analogChannels[i].gpio;
-            channel["filterLimit"] = analogChannels[i].filterLimit;
-            channel["compensation"] = analogChannels[i].compensation;
-            
-            JsonArray points = channel.createNestedArray("calibPoints");
-            for(int j = 0; j < analogChannels[i].numPoints; j++) {
-                JsonObject point = points.createNestedObject();
-                point["voltage"] = analogChannels[i].calibPoints[j].voltage;
-                point["physical"] = analogChannels[i].calibPoints[j].physical;
-            }
-        }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        METRICS_SCOPE(METRIC_HTTP_GET_ANALOG_CONFIG);
+        sendConfigJson(request, CONFIG_ANALOG, writeAnalogConfigJson);
     });
 
     server.on("/get_relay_status", HTTP_GET, [](AsyncWebServerRequest *request) {
-        DynamicJsonDocument doc(1024);
-        JsonArray array = doc.createNestedArray("relays");
-        
-        for(int i = 0; i < 4; i++) {
-            JsonObject relay = array.createNestedObject();
-            relay["name"] = relayChannels[i].name;
-            relay["gpio"] = relayChannels[i].gpio;
-            relay["state"] = relayChannels[i].state;
-            relay["mode"] = relayChannels[i].mode;
-            relay["autoRunning"] = relayChannels[i].autoRunning;
-            relay["currentCycles"] = relayChannels[i].currentCycles;
-            relay["maxCycles"] = relayChannels[i].maxCycles;
-            relay["onTime"] = relayChannels[i].onTime;
-            relay["offTime"] = relayChannels[i].offTime;
-        }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        METRICS_SCOPE(METRIC_HTTP_GET_RELAY_STATUS);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonWriter json(*response);
+        json.beginObject();
+        writeRelayStatusJson(json);
+        json.endObject();
+        request->send(response);
     });
 
     server.on("/relay/set", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_RELAY_SET);
         if (request->hasParam("channel", true) && request->hasParam("state", true)) {
             int channel = request->getParam("channel", true)->value().toInt();
             bool state = request->getParam("state", true)->value() == "1";
             
-            if (channel >= 0 && channel < 4 && relayChannels[channel].mode == MANUAL) {
-                // 添加调试输出
-                Serial.printf("Setting relay %d to %s (GPIO%d)\n", 
-                    channel, 
-                    state ? "ON" : "OFF",
-                    relayChannels[channel].gpio);
-                
-                // 设置继电器状态
-                relayChannels[channel].state = state;
-                // 继电器高电平触发
-                digitalWrite(relayChannels[channel].gpio, state ? HIGH : LOW);
-                
-                // 再证GPIO状态
-                int pinState = digitalRead(relayChannels[channel].gpio);
-                Serial.printf("GPIO%d state after setting: %d (expected: %d)\n", 
-                    relayChannels[channel].gpio, 
-                    pinState,
-                    state ? HIGH : LOW);
-                
+            // 命令入队即返回，由继电器控制任务执行
+            if (applyRelaySet(channel, state, 0, 0)) {
                 request->send(200, "text/plain", "OK");
             } else {
                 request->send(400, "text/plain", "Invalid Request");
@@ -255,72 +258,43 @@ void setupWiFiAndServer() {
     });
 
     server.on("/get_relay_config", HTTP_GET, [](AsyncWebServerRequest *request) {
-        DynamicJsonDocument doc(1024);
-        JsonArray array = doc.createNestedArray("relays");
-        
-        for(int i = 0; i < 4; i++) {
-            JsonObject relay = array.createNestedObject();
-            relay["name"] = relayChannels[i].name;
-            relay["gpio"] = relayChannels[i].gpio;
-            relay["state"] = relayChannels[i].state;
-            relay["mode"] = relayChannels[i].mode;
-            relay["autoRunning"] = relayChannels[i].autoRunning;
-            relay["currentCycles"] = relayChannels[i].currentCycles;
-            relay["maxCycles"] = relayChannels[i].maxCycles;
-        }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        METRICS_SCOPE(METRIC_HTTP_GET_RELAY_CONFIG);
+        sendConfigJson(request, CONFIG_RELAY, writeRelayConfigJson);
     });
 
+    // 请求体可以分多段到达，有无效元素时不做任何修改
     server.on("/save_relay_config", HTTP_POST, [](AsyncWebServerRequest *request) {
-        request->send(400, "text/plain", "Invalid Request");
+        METRICS_SCOPE(METRIC_HTTP_SAVE_RELAY_CONFIG);
+        RelayConfigUpload* upload = (RelayConfigUpload*)request->_tempObject;
+        if (!upload || !upload->stream.finished()) {
+            LOGW(LOG_MOD_WEB, "Invalid relay config request");
+            request->send(400, "text/plain", upload && upload->error ? upload->error : "Invalid Request");
+            return;
+        }
+        const char* error = commitRelayConfig(upload->staged, upload->mask);
+        if (!error) {
+            request->send(200, "text/plain", "Configuration saved");
+        } else if (strcmp(error, "busy") == 0) {
+            request->send(503, "text/plain", "Busy");
+        } else {
+            request->send(400, "text/plain", error);
+        }
     }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-        DynamicJsonDocument doc(1024);
-        deserializeJson(doc, (char*)data);
-        
-        JsonArray config = doc["config"].as<JsonArray>();
-        for(JsonVariant v : config) {
-            int channel = v["channel"].as<int>();
-            if(channel >= 0 && channel < 4) {
-                relayChannels[channel].name = v["name"].as<String>();
-                relayChannels[channel].mode = (RelayMode)v["mode"].as<int>();
-                if(relayChannels[channel].mode == AUTOMATIC) {
-                    relayChannels[channel].onTime = v["onTime"].as<unsigned long>();
-                    relayChannels[channel].offTime = v["offTime"].as<unsigned long>();
-                    relayChannels[channel].maxCycles = v["maxCycles"].as<unsigned int>();
-                    relayChannels[channel].currentCycles = 0;
-                    relayChannels[channel].autoRunning = false;
-                }
-            }
+        if (index == 0 && !request->_tempObject) {
+            request->_tempObject = calloc(1, sizeof(RelayConfigUpload));
         }
-        
-        saveRelayConfig();
-        request->send(200, "text/plain", "Configuration saved");
+        RelayConfigUpload* upload = (RelayConfigUpload*)request->_tempObject;
+        if (upload) upload->stream.feed(data, len, onRelayConfigElement, upload);
     });
 
     // 添加自动运行控制路由
     server.on("/relay/auto_control", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_RELAY_AUTO_CONTROL);
         if (request->hasParam("channel", true) && request->hasParam("running", true)) {
             int channel = request->getParam("channel", true)->value().toInt();
             bool running = request->getParam("running", true)->value() == "1";
             
-            if (channel >= 0 && channel < 4 && relayChannels[channel].mode == AUTOMATIC) {
-                relayChannels[channel].autoRunning = running;
-                if(running) {
-                    // 只在开始新的自动运行时才重置循环次数
-                    if(relayChannels[channel].currentCycles >= relayChannels[channel].maxCycles) {
-                        relayChannels[channel].currentCycles = 0;
-                    }
-                    relayChannels[channel].lastToggleTime = millis();
-                    // 从关闭状态开始
-                    setRelayState(channel, false);
-                } else {
-                    // 停止动运行时，保持当前状态
-                    relayChannels[channel].autoRunning = false;
-                }
-                saveRelayConfig();  // 保存状态
+            if (applyRelayAutoControl(channel, running, 0, 0)) {
                 request->send(200, "text/plain", "OK");
             } else {
                 request->send(400, "text/plain", "Invalid Request");
@@ -331,6 +305,7 @@ void setupWiFiAndServer() {
     });
 
     server.on("/save_title", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_SAVE_TITLE);
         if (request->hasParam("title", true)) {
             String newTitle = request->getParam("title", true)->value();
             newTitle.trim();
@@ -339,14 +314,15 @@ void setupWiFiAndServer() {
                 systemTitle = newTitle;
                 
                 // 保存标题到SPIFFS
+                METRICS_SCOPE(METRIC_SAVE_TITLE);
                 File file = SPIFFS.open("/title.txt", "w");
                 if(file) {
                     file.print(systemTitle);
                     file.close();
-                    Serial.println("System title saved: " + systemTitle);
+                    LOGI(LOG_MOD_CFG, "System title saved: %s", systemTitle.c_str());
                     request->send(200, "text/plain", "OK");
                 } else {
-                    Serial.println("Failed to open title file for writing");
+                    LOGE(LOG_MOD_CFG, "Failed to open title file for writing");
                     request->send(500, "text/plain", "Failed to save");
                 }
             } else {
@@ -359,17 +335,16 @@ void setupWiFiAndServer() {
 
     ws.onEvent(onWsEvent);
     server.addHandler(&ws);
+    server.addHandler(&logWs);
 
     // 添加限幅值更路由（放在 server.begin() 之前）
     server.on("/save_filter_limit", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_SAVE_FILTER_LIMIT);
         if (request->hasParam("channel", true) && request->hasParam("limit", true)) {
             int channel = request->getParam("channel", true)->value().toInt();
             int limit = request->getParam("limit", true)->value().toInt();
             
-            if (channel >= 0 && channel < 8 && limit >= 0) {
-                analogChannels[channel].filterLimit = limit;
-                saveAnalogConfig(channel);  // 保存到配置文件
-                Serial.printf("Updated channel %d filter limit to %d\n", channel, limit);
+            if (applyFilterLimit(channel, limit)) {
                 request->send(200, "text/plain", "OK");
             } else {
                 request->send(400, "text/plain", "Invalid parameters");
@@ -381,112 +356,327 @@ void setupWiFiAndServer() {
 
     // 添加温度配置页面路由
     server.on("/temp", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_TEMP_PAGE);
         request->send(200, "text/html", generateTempConfigPage());
     });
 
     // 添加获取温度配置路由
     server.on("/get_temp_config", HTTP_GET, [](AsyncWebServerRequest *request) {
-        DynamicJsonDocument doc(1024);
-        JsonArray array = doc.createNestedArray("sensors");
-        
-        for(int i = 0; i < 2; i++) {
-            JsonObject sensor = array.createNestedObject();
-            sensor["enabled"] = tempSensors[i].enabled;
-            sensor["name"] = tempSensors[i].name;
-            sensor["type"] = (int)tempSensors[i].type;
-        }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        METRICS_SCOPE(METRIC_HTTP_GET_TEMP_CONFIG);
+        sendConfigJson(request, CONFIG_TEMP, writeTempConfigJson);
     });
 
     // 添加保存温度配置路由
     server.on("/save_temp_config", HTTP_POST, [](AsyncWebServerRequest *request) {
-        // 空处理函数，用于处理不带数据的POST请求
-    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-        // 这里是处理带数据的POST请求的函数
-        Serial.println("Received temp config save request");
-        
-        if(len == 0) {
-            Serial.println("Empty request body");
+        METRICS_SCOPE(METRIC_HTTP_SAVE_TEMP_CONFIG);
+        TempConfigUpload* upload = (TempConfigUpload*)request->_tempObject;
+        if(!upload || upload->length == 0) {
+            LOGW(LOG_MOD_WEB, "Empty temp config request body");
             request->send(400, "text/plain", "Empty request");
             return;
         }
-        
-        // 创建一个临时缓冲区来存储请求数据
-        char* json = new char[len + 1];
-        memcpy(json, data, len);
-        json[len] = '\0';
-        
-        Serial.printf("Received JSON: %s\n", json);
+        if(upload->overflow) {
+            LOGW(LOG_MOD_WEB, "Temp config request body too large");
+            request->send(413, "text/plain", "Request too large");
+            return;
+        }
         
         DynamicJsonDocument doc(1024);
-        DeserializationError error = deserializeJson(doc, json);
-        
-        delete[] json;
+        DeserializationError error = deserializeJson(doc, upload->body, upload->length);
         
         if(error) {
-            Serial.printf("Failed to parse JSON: %s\n", error.c_str());
+            LOGW(LOG_MOD_WEB, "Failed to parse temp config JSON: %s", error.c_str());
             request->send(400, "text/plain", "Invalid JSON");
             return;
         }
         
-        int sensorIndex = doc["index"].as<int>();
-        if(sensorIndex >= 0 && sensorIndex < 2) {
-            JsonObject config = doc["config"];
-            
-            Serial.printf("Saving config for sensor %d\n", sensorIndex);
-            Serial.printf("Enabled: %d\n", config["enabled"].as<bool>());
-            Serial.printf("Name: %s\n", config["name"].as<const char*>());
-            Serial.printf("Type: %d\n", config["type"].as<int>());
-            
-            // 更新配置
-            tempSensors[sensorIndex].enabled = config["enabled"].as<bool>();
-            tempSensors[sensorIndex].name = config["name"].as<String>();
-            tempSensors[sensorIndex].type = (TempSensorType)config["type"].as<int>();
-            
-            // 重新初始化传感器
-            switch(sensorIndex) {
-                case 0:
-                    thermo1.begin(MAX31865_2WIRE);
-                    break;
-                case 1:
-                    thermo2.begin(MAX31865_2WIRE);
-                    break;
-            }
-            
-            // 保存配置到文件
-            saveTempConfig();
-            
-            Serial.println("Temperature config saved successfully");
+        if(applyTempConfig(doc["index"] | -1, doc["config"])) {
             request->send(200, "text/plain", "OK");
         } else {
-            Serial.println("Invalid sensor index");
+            LOGW(LOG_MOD_WEB, "Invalid sensor index");
             request->send(400, "text/plain", "Invalid sensor index");
         }
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if(index == 0 && !request->_tempObject) {
+            request->_tempObject = calloc(1, sizeof(TempConfigUpload));
+        }
+        TempConfigUpload* upload = (TempConfigUpload*)request->_tempObject;
+        if(upload) upload->append(data, len);
+    });
+
+#if METRICS_ENABLED
+    // 性能统计（Prometheus 文本格式）
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_METRICS);
+        AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+        writeMetrics(*response);
+        request->send(response);
+    });
+#endif
+
+    server.on("/get_mqtt_config", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_GET_MQTT_CONFIG);
+        sendConfigJson(request, CONFIG_MQTT, writeMqttConfigJson);
+    });
+
+    server.on("/save_mqtt_config", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_SAVE_MQTT_CONFIG);
+        MqttConfigUpload* upload = (MqttConfigUpload*)request->_tempObject;
+        if (!upload || upload->length == 0) {
+            request->send(400, "text/plain", "Invalid Request");
+            return;
+        }
+        if (upload->overflow) {
+            request->send(413, "text/plain", "Request too large");
+            return;
+        }
+        DynamicJsonDocument doc(1024);
+        if (deserializeJson(doc, upload->body, upload->length)) {
+            request->send(400, "text/plain", "Invalid JSON");
+            return;
+        }
+        applyMqttConfig(doc.as<JsonObject>());
+        saveMqttConfig();
+        request->send(200, "text/plain", "OK");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (index == 0 && !request->_tempObject) {
+            request->_tempObject = calloc(1, sizeof(MqttConfigUpload));
+        }
+        MqttConfigUpload* upload = (MqttConfigUpload*)request->_tempObject;
+        if (upload) upload->append(data, len);
+    });
+
+    server.on("/get_alarm_config", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_GET_ALARM_CONFIG);
+        sendConfigJson(request, CONFIG_ALARM, writeAlarmConfigJson);
+    });
+
+    // 报警配置：{"mqtt":bool,"alarms":[...]}，只修改列出的通道
+    server.on("/save_alarm_config", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_SAVE_ALARM_CONFIG);
+        AlarmConfigUpload* upload = (AlarmConfigUpload*)request->_tempObject;
+        if (!upload || upload->length == 0) {
+            request->send(400, "text/plain", "Invalid Request");
+            return;
+        }
+        if (upload->overflow) {
+            request->send(413, "text/plain", "Request too large");
+            return;
+        }
+        DynamicJsonDocument doc(8192);
+        if (deserializeJson(doc, upload->body, upload->length)) {
+            request->send(400, "text/plain", "Invalid JSON");
+            return;
+        }
+        const char* error = applyAlarmConfig(doc.as<JsonObject>());
+        if (error) {
+            request->send(400, "text/plain", error);
+            return;
+        }
+        saveAlarmConfig();
+        request->send(200, "text/plain", "OK");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (index == 0 && !request->_tempObject) {
+            request->_tempObject = calloc(1, sizeof(AlarmConfigUpload));
+        }
+        AlarmConfigUpload* upload = (AlarmConfigUpload*)request->_tempObject;
+        if (upload) upload->append(data, len);
+    });
+
+    server.on("/get_virtual_config", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_GET_VIRTUAL_CONFIG);
+        sendConfigJson(request, CONFIG_VIRTUAL, writeVirtualConfigJson);
+    });
+
+    // 虚拟通道配置：{"channels":[{index,enabled,name,unit,expr},...]}，只修改列出的通道
+    server.on("/save_virtual_config", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_SAVE_VIRTUAL_CONFIG);
+        VirtualConfigUpload* upload = (VirtualConfigUpload*)request->_tempObject;
+        if (!upload || upload->length == 0) {
+            request->send(400, "text/plain", "Invalid Request");
+            return;
+        }
+        if (upload->overflow) {
+            request->send(413, "text/plain", "Request too large");
+            return;
+        }
+        DynamicJsonDocument doc(2048);
+        if (deserializeJson(doc, upload->body, upload->length)) {
+            request->send(400, "text/plain", "Invalid JSON");
+            return;
+        }
+        const char* error = applyVirtualConfig(doc["channels"].as<JsonArray>());
+        if (error) {
+            request->send(400, "text/plain", error);
+            return;
+        }
+        saveVirtualConfig();
+        request->send(200, "text/plain", "OK");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (index == 0 && !request->_tempObject) {
+            request->_tempObject = calloc(1, sizeof(VirtualConfigUpload));
+        }
+        VirtualConfigUpload* upload = (VirtualConfigUpload*)request->_tempObject;
+        if (upload) upload->append(data, len);
+    });
+
+    // 当前报警和通知延迟
+    server.on("/alarms", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_ALARMS);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonWriter json(*response);
+        json.beginObject();
+        writeAlarmStatusJson(json);
+        json.endObject();
+        request->send(response);
+    });
+
+    // 确认报警：channel=3 或 t0，不带参数时确认全部
+    server.on("/alarm/ack", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_ALARM_ACK);
+        int channel = -1;
+        if (request->hasParam("channel", true)) {
+            channel = alarmParseChannel(request->getParam("channel", true)->value().c_str());
+            if (channel < 0) {
+                request->send(400, "text/plain", "Invalid channel");
+                return;
+            }
+        }
+        if (requestAlarmAck(channel)) {
+            request->send(200, "text/plain", "OK");
+        } else {
+            request->send(503, "text/plain", "Busy");
+        }
+    });
+
+    // 历史数据导出：/export?format=csv|bin&channels=0,1,t0&from=&to=&offset=&limit=
+    // from/to 为 UTC 秒；offset 为起始序号，用于断点续传；limit 为最多导出的记录数
+    server.on("/export", HTTP_GET, [](AsyncWebServerRequest *request) {
+        bool binary = request->hasParam("format") && request->getParam("format")->value() == "bin";
+        uint32_t mask = request->hasParam("channels") ?
+            historyParseChannels(request->getParam("channels")->value().c_str()) : HISTORY_ALL_CHANNELS;
+        uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), NULL, 10) : 0;
+        uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), NULL, 10) : 0;
+        uint32_t offset = request->hasParam("offset") ? strtoul(request->getParam("offset")->value().c_str(), NULL, 10) : 0;
+        uint32_t limit = request->hasParam("limit") ? strtoul(request->getParam("limit")->value().c_str(), NULL, 10) : 0;
+
+        // 导出状态随响应对象释放（包括客户端中途断开）
+        std::shared_ptr<HistoryExport> exporter = std::make_shared<HistoryExport>(
+            binary ? HistoryExport::BINARY : HistoryExport::CSV, mask, from, to, offset, limit);
+        AsyncWebServerResponse *response = request->beginChunkedResponse(
+            binary ? "application/octet-stream" : "text/csv",
+            [exporter](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return exporter->fill(buffer, maxLen);
+            });
+        response->addHeader("Content-Disposition",
+            binary ? "attachment; filename=history.bin" : "attachment; filename=history.csv");
+        response->addHeader("X-History-Start", String(exporter->start()));
+        response->addHeader("X-History-End", String(exporter->end()));
+        request->send(response);
+    });
+
+    // 波形捕获：/capture/arm 参数 channels=0,1&rate=&pre=&post=&trigger=&channel=&level=&relay=
+    server.on("/capture/arm", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_CAPTURE_ARM);
+        if (!request->hasParam("channels", true)) {
+            request->send(400, "text/plain", "Missing Parameters");
+            return;
+        }
+        auto param = [request](const char* name, long def) -> long {
+            return request->hasParam(name, true) ? request->getParam(name, true)->value().toInt() : def;
+        };
+        String trigger = request->hasParam("trigger", true) ? request->getParam("trigger", true)->value() : "immediate";
+        CaptureConfig config;
+        const char* error = captureParseConfig(
+            captureParseChannels(request->getParam("channels", true)->value().c_str()), trigger.c_str(),
+            param("rate", CAPTURE_DEFAULT_RATE), param("pre", CAPTURE_DEFAULT_PRE), param("post", CAPTURE_DEFAULT_POST),
+            param("channel", -1), param("level", 2048), param("relay", -1), config);
+        if (!error) error = captureArm(config);
+        if (error) {
+            request->send(400, "text/plain", error);
+        } else {
+            request->send(200, "text/plain", "OK");
+        }
+    });
+
+    server.on("/capture/cancel", HTTP_POST, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_CAPTURE_CANCEL);
+        captureCancel();
+        request->send(200, "text/plain", "OK");
+    });
+
+    server.on("/capture/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_CAPTURE_STATUS);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonWriter json(*response);
+        json.beginObject();
+        writeCaptureStatusJson(json);
+        json.endObject();
+        request->send(response);
+    });
+
+    // 频谱分析结果（每通道主频、频带有效值、信噪比、工频幅值）
+    server.on("/spectrum", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_SPECTRUM);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonWriter json(*response);
+        json.beginObject();
+        writeSpectrumJson(json);
+        json.endObject();
+        request->send(response);
+    });
+
+    // 各通道的滑动窗口统计（10秒、1分钟、1小时）
+    server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_STATS);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonWriter json(*response);
+        json.beginObject();
+        writeStatsJson(json);
+        json.endObject();
+        request->send(response);
+    });
+
+    // 二进制波形（格式见 capture.h），只有完成的捕获可以下载
+    server.on("/capture/data", HTTP_GET, [](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_HTTP_CAPTURE_DATA);
+        std::shared_ptr<CaptureReader> reader = captureOpenReader();
+        if (!reader) {
+            request->send(409, "text/plain", "No completed capture");
+            return;
+        }
+        AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", captureDataSize(),
+            [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return captureRender(buffer, index, maxLen);
+            });
+        response->addHeader("Content-Disposition", "attachment; filename=capture.bin");
+        request->send(response);
     });
 
     // 保持在后
     server.begin();
-    Serial.println("Web server started successfully");
+    initModbus();
+    LOGI(LOG_MOD_WEB, "Web server started successfully");
 }
 
 void setup() {
     Serial.begin(115200);
     delay(1000);
 
+    // 启动异步日志，之后的输出都经过日志任务
+    initLog();
+
     // 始化 SPIFFS
     if (!SPIFFS.begin(true)) {
-        Serial.println("Failed to initialize SPIFFS!");
+        LOGE(LOG_MOD_SYS, "Failed to initialize SPIFFS!");
         return;
     }
-    Serial.println("SPIFFS initialized successfully");
+    LOGI(LOG_MOD_SYS, "SPIFFS initialized successfully");
 
     // 删除旧的继电器配置文件
     if(SPIFFS.exists("/relay_config.json")) {
         SPIFFS.remove("/relay_config.json");
-        Serial.println("Removed old relay config file");
+        LOGI(LOG_MOD_CFG, "Removed old relay config file");
     }
 
     // 加载系统标题
@@ -514,11 +704,11 @@ void setup() {
     
     // 如果有保存的 WiFi 配置，尝试连接
     if (!sta_ssid.isEmpty() && !sta_pass.isEmpty()) {
-        Serial.printf("Attempting to connect to saved WiFi: %s\n", sta_ssid.c_str());
+        LOGI(LOG_MOD_WIFI, "Attempting to connect to saved WiFi: %s", sta_ssid.c_str());
         if(connectWiFi(sta_ssid.c_str(), sta_pass.c_str())) {
-            Serial.println("Connected to saved WiFi successfully");
+            LOGI(LOG_MOD_WIFI, "Connected to saved WiFi successfully");
         } else {
-            Serial.println("Failed to connect to saved WiFi");
+            LOGW(LOG_MOD_WIFI, "Failed to connect to saved WiFi");
         }
     }
 
@@ -526,113 +716,137 @@ void setup() {
     loadAnalogConfig();
     loadRelayConfig();
     loadTempConfig();
+    loadMqttConfig();
+    loadVirtualConfig();
+    initAlarms();
     
     // 初始化设备
+    initAdcScheduler();
+    initMains();
+    initCapture();
+    initSpectrum();
     initAnalogChannels();
     initRelayChannels();
     initTempSensors();
+    initExtAdc();
+
+    // 继电器配置加载完成后再启动控制任务
+    initRelayControl();
+
+    // 服务器启动前发布初始快照
+    initStagedConfig();
+    publishSensorSnapshot();
+    publishStats(millis());
     
     setupWiFiAndServer();
+
+    // MQTT 任务在网络就绪后自行连接
+    initMqtt();
+
+    // 历史记录使用 UTC 时间，连上 WiFi 后由 SNTP 自动校时
+    configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+    initHistory();
 }
 
 void loop() {
     if (wifi_connected && WiFi.status() != WL_CONNECTED) {
         wifi_connected = false;
-        Serial.println("WiFi connection lost, trying to reconnect...");
+        LOGW(LOG_MOD_WIFI, "WiFi connection lost, trying to reconnect...");
         connectWiFi(sta_ssid.c_str(), sta_pass.c_str());
     }
 
     unsigned long currentMillis = millis();
 
+    // 网络回调修改的配置在采样之间应用
+    applyStagedConfig();
+
+    // 波形捕获的 DMA 启停（与 sampleADC 在同一任务中，不会同时访问 ADC1）
+    captureService();
+
     // 处理ADC采样
     if (currentMillis - lastSensorUpdate >= SENSOR_UPDATE_INTERVAL) {
         lastSensorUpdate = currentMillis;
+        METRICS_SCOPE(METRIC_SAMPLE_ADC);
+        uint32_t sampleMicros = micros();
         sampleADC();
+        publishSensorSnapshot();
+        SensorSnapshot snap;
+        sensorSnapshot.read(snap);
+        statsSampleAnalog(currentMillis, snap);
+        alarmSampleAnalog(snap, currentMillis, sampleMicros);
     }
 
     // 处理温度采样（每秒一次）
     if (currentMillis - lastTempUpdate >= TEMP_UPDATE_INTERVAL) {
         lastTempUpdate = currentMillis;
+        METRICS_SCOPE(METRIC_READ_TEMPS);
+        uint32_t sampleMicros = micros();
         readTemperatures();
+        publishSensorSnapshot();
+        SensorSnapshot snap;
+        sensorSnapshot.read(snap);
+        statsSampleTemps(currentMillis, snap);
+        alarmSampleTemps(snap, currentMillis, sampleMicros);
     }
 
-    // 处理数据发送
-    if (currentMillis - lastDataSendTime >= DATA_SEND_INTERVAL) {
+    // 处理数据发送：每个采样周期检查一次，各客户端按自己的间隔接收
+    if (currentMillis - lastDataSendTime >= SENSOR_UPDATE_INTERVAL) {
         lastDataSendTime = currentMillis;
-        sendSensorData();
+        METRICS_SCOPE(METRIC_SEND_SENSOR_DATA);
+        sendSensorData(currentMillis);
     }
 
-    // 处理继电器自动控制
-    for(int i = 0; i < 4; i++) {
-        if(relayChannels[i].mode == AUTOMATIC && relayChannels[i].autoRunning) {
-            unsigned long currentTime = millis();
-            unsigned long timeInState = currentTime - relayChannels[i].lastToggleTime;
-            
-            // 根据当前状态决定使用哪个时间间
-            unsigned long waitTime = relayChannels[i].state ? 
-                                   relayChannels[i].onTime : 
-                                   relayChannels[i].offTime;
-            
-            if(timeInState >= waitTime) {
-                // 检查是否达到最大循环次数
-                if(relayChannels[i].currentCycles >= relayChannels[i].maxCycles) {
-                    relayChannels[i].autoRunning = false;
-                    saveRelayConfig();  // 保存当前状态
-                    continue;
-                }
-                
-                // 切换状态
-                bool newState = !relayChannels[i].state;
-                setRelayState(i, newState);
-                relayChannels[i].lastToggleTime = currentTime;
-                
-                // 如果从开到关，增加循环计数
-                if(!newState) {  // 当切换到关闭状态时
-                    relayChannels[i].currentCycles++;
-                    saveRelayConfig();  // 保存循环次数
-                }
-            }
-        }
+    // 继电器状态变化后立即推送给所有客户端
+    if (relayStatusDirty) {
+        relayStatusDirty = false;
+        publishSensorSnapshot();
+        pushRelayStatus();
+    }
+
+    // 定期清理已断开的WebSocket客户端
+    if (currentMillis - lastWsCleanupTime >= WS_CLEANUP_INTERVAL) {
+        lastWsCleanupTime = currentMillis;
+        ws.cleanupClients();
+        logWs.cleanupClients();
     }
+
+    // 回复已执行的继电器命令
+    sendRelayAcks();
 }
 
 bool connectWiFi(const char* ssid, const char* password) {
-    Serial.printf("Connecting to WiFi: %s\n", ssid);
+    LOGI(LOG_MOD_WIFI, "Connecting to WiFi: %s", ssid);
     
     WiFi.begin(ssid, password);
     
     unsigned long startTime = millis();
     while (WiFi.status() != WL_CONNECTED && millis() - startTime < WIFI_CONNECT_TIMEOUT) {
         delay(WIFI_RETRY_DELAY);
-        Serial.print(".");
     }
-    Serial.println();
     
     if (WiFi.status() == WL_CONNECTED) {
         wifi_connected = true;
         sta_ssid = ssid;      // 保存SSID
         sta_pass = password;   // 保存密码
         saveConfig();         // 保存到文件
-        Serial.printf("Connected successfully. IP: %s\n", WiFi.localIP().toString().c_str());
+        LOGI(LOG_MOD_WIFI, "Connected successfully. IP: %s", WiFi.localIP().toString().c_str());
         return true;
     } else {
         wifi_connected = false;
-        Serial.println("Failed to connect");
+        LOGW(LOG_MOD_WIFI, "Failed to connect");
         return false;
     }
 }
 
 void loadConfig() {
-    Serial.println("Loading WiFi config...");
-    
     if(!SPIFFS.exists("/wifi_config.json")) {
-        Serial.println("No WiFi config file found");
+        LOGI(LOG_MOD_CFG, "No WiFi config file found");
         return;
     }
     
     File file = SPIFFS.open("/wifi_config.json", "r");
     if(!file) {
-        Serial.println("Failed to open WiFi config file");
+        LOGE(LOG_MOD_CFG, "Failed to open WiFi config file");
         return;
     }
     
@@ -641,53 +855,51 @@ void loadConfig() {
     file.close();
     
     if(error) {
-        Serial.println("Failed to parse WiFi config file");
+        LOGE(LOG_MOD_CFG, "Failed to parse WiFi config file");
         return;
     }
     
     sta_ssid = doc["ssid"].as<String>();
     sta_pass = doc["password"].as<String>();
     
-    Serial.println("WiFi config loaded successfully");
-    Serial.printf("Loaded SSID: %s\n", sta_ssid.c_str());
+    LOGI(LOG_MOD_CFG, "WiFi config loaded, SSID: %s", sta_ssid.c_str());
 }
 
 void saveConfig() {
-    Serial.println("Saving WiFi config...");
-    
+    METRICS_SCOPE(METRIC_SAVE_WIFI);
     DynamicJsonDocument doc(256);
     doc["ssid"] = sta_ssid;
     doc["password"] = sta_pass;
     
     File file = SPIFFS.open("/wifi_config.json", "w");
     if(!file) {
-        Serial.println("Failed to open config file for writing");
+        LOGE(LOG_MOD_CFG, "Failed to open WiFi config file for writing");
         return;
     }
     
     if(serializeJson(doc, file)) {
-        Serial.println("WiFi config saved successfully");
-        Serial.printf("Saved SSID: %s\n", sta_ssid.c_str());
+        LOGI(LOG_MOD_CFG, "WiFi config saved, SSID: %s", sta_ssid.c_str());
     } else {
-        Serial.println("Failed to write config file");
+        LOGE(LOG_MOD_CFG, "Failed to write WiFi config file");
     }
     file.close();
 }
 
 // 修改 initAnalogChannels 函数中的GPIO映射
 void initAnalogChannels() {
-    for (int i = 0; i < 12; i++) {  // 从8改为12
+    for (int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        // 引脚只由板级配置决定
+        analogChannels[i].gpio = Board::analogGpio(i);
+
         if (analogChannels[i].name.isEmpty()) {
             analogChannels[i].enabled = false;
-            analogChannels[i].name = "传感器 " + String(i + 1);
-            analogChannels[i].unit = "单位";
-            
-            // 修改GPIO映射
-            if (i < 8) {
-                analogChannels[i].gpio = i + 1;  // GPIO1-8
-            } else {
-                analogChannels[i].gpio = i + 7;  // GPIO15-18
-            }
+            analogChannels[i].name.set(("传感器 " + String(i + 1)).c_str());
+            analogChannels[i].unit.set("单位");
+            analogChannels[i].backend = ADC_BACKEND_INTERNAL;
+            analogChannels[i].extInput = 0;
+            analogChannels[i].mainsMode = MAINS_OFF;
+            analogChannels[i].mainsHz = 50;
+            analogChannels[i].mainsCycles = 1;
             
             // 其他初始化代码保持不变
             analogChannels[i].numPoints = 2;
@@ -695,28 +907,52 @@ void initAnalogChannels() {
             analogChannels[i].calibPoints[1] = {3.3, 100.0};
             analogChannels[i].filterLimit = 20;  // 设置默认限幅值
             analogChannels[i].compensation = 0;  // 设置默认补偿值
-            analogChannels[i].sampleCount = 0;
-            analogChannels[i].lastSecondValue = 0;
-            analogChannels[i].currentValue = 0;
-            analogChannels[i].difference = 0;
+            analogChannels[i].sampleMin = ADAPTIVE_TICK_MS;
+            analogChannels[i].sampleMax = ADAPTIVE_TICK_MS;
         }
+
+        // 清空采样状态并同步采样用的配置字段
+        analogState.sampleCount[i] = 0;
+        analogState.lastSecondValue[i] = 0;
+        analogState.currentValue[i] = 0;
+        analogState.difference[i] = 0;
+        analogState.validMask &= ~(1u << i);   // 第一次取得中值前无效
+        syncAnalogSampleState(i);
     }
 }
 
+// 将采样循环需要的配置字段同步到热数据区
+void syncAnalogSampleState(int channel) {
+    if (channel < 0 || channel >= Board::ANALOG_CHANNELS) return;
+
+    if (analogChannels[channel].enabled) {
+        analogState.enabledMask |= (1u << channel);
+    } else {
+        analogState.enabledMask &= ~(1u << channel);
+    }
+    if (analogChannels[channel].backend != ADC_BACKEND_INTERNAL) {
+        analogState.externalMask |= (1u << channel);
+    } else {
+        analogState.externalMask &= ~(1u << channel);
+    }
+    analogState.gpio[channel] = analogChannels[channel].gpio;
+    analogState.backend[channel] = analogChannels[channel].backend;
+    analogState.extInput[channel] = analogChannels[channel].extInput;
+    analogState.filterLimit[channel] = analogChannels[channel].filterLimit;
+    extAdcUpdateScanMask();
+    const AnalogChannel& ch = analogChannels[channel];
+    adaptiveSync(channel, ch.sampleMin, ch.sampleMax);
+    mainsUpdateConfig(channel, ch.enabled, ch.backend, ch.mainsMode, ch.mainsHz, ch.mainsCycles);
+}
+
 // 修改 initRelayChannels 函数中的GPIO映射
 void initRelayChannels() {
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        relayChannels[i].gpio = Board::relayGpio(i);
+
         // 如果继电器没有配置，才设置默认值
         if (relayChannels[i].name.isEmpty()) {
-            relayChannels[i].name = "电器 " + String(i + 1);
-            
-            // 修改GPIO映射
-            switch(i) {
-                case 0: relayChannels[i].gpio = 21; break;  // 继电器1 - GPIO21
-                case 1: relayChannels[i].gpio = 45; break;  // 继电器2 - GPIO45
-                case 2: relayChannels[i].gpio = 47; break;  // 继电器3 - GPIO47
-                case 3: relayChannels[i].gpio = 48; break;  // 继电器4 - GPIO48
-            }
+            relayChannels[i].name.set(("电器 " + String(i + 1)).c_str());
             
             relayChannels[i].state = false;
             relayChannels[i].mode = MANUAL;
@@ -726,112 +962,774 @@ void initRelayChannels() {
             relayChannels[i].offTime = 1000; // 默认1秒
             relayChannels[i].maxCycles = 1;  // 默认1次
         }
-        
-        // 确保GPIO设置正确
-        pinMode(relayChannels[i].gpio, OUTPUT);
-        digitalWrite(relayChannels[i].gpio, LOW);  // 初始状态为低电平（关闭）
-        
-        // 添加调试输出
-        Serial.printf("Initialized relay %d: GPIO%d, initial state: LOW (OFF)\n", 
-            i, relayChannels[i].gpio);
     }
+
+    // 所有输出一次初始化为断开
+    initRelayOutputs();
 }
 
 void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
     if (type == WS_EVT_CONNECT) {
-        Serial.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
-        // Optionally send initial data or a welcome message to the client
+        LOGI(LOG_MOD_WEB, "WebSocket client #%u connected from %s", client->id(), client->remoteIP().toString().c_str());
+        wsStreamAdd(client->id(), DATA_SEND_INTERVAL);
+        // 新客户端需要当前继电器状态
+        relayStatusDirty = true;
     } else if (type == WS_EVT_DISCONNECT) {
-        Serial.printf("WebSocket client #%u disconnected\n", client->id());
+        LOGI(LOG_MOD_WEB, "WebSocket client #%u disconnected", client->id());
+        wsStreamRemove(client->id());
     } else if (type == WS_EVT_DATA) {
         // Handle incoming data
         AwsFrameInfo *info = (AwsFrameInfo*)arg;
         if (info->final && info->index == 0 && info->len == len) {
             // The whole message is in a single frame and we got all of it's data
-            Serial.printf("WebSocket message: %s\n", data);
+            LOGD(LOG_MOD_WEB, "WebSocket message from #%u, %u bytes", client->id(), (unsigned)len);
+            if (info->opcode == WS_TEXT) {
+                handleWsCommand(client, (const char*)data, len);
+            }
         }
     }
 }
 
-void sendSensorData() {
-    DynamicJsonDocument doc(2048);
-    JsonArray values = doc.createNestedArray("values");
+void sendSensorData(unsigned long now) {
+    // 本周期没有到期的客户端时不序列化
+    if (!wsStreamAnyDue(now)) return;
+
+    SensorSnapshot snap;
+    sensorSnapshot.read(snap);
+    static StatsSet stats;
+    statsSet.read(stats);
+
+    // 直接生成到预分配缓冲区，不建立JSON文档
+    BufferPrint out(sensorJson, SENSOR_JSON_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.beginArray("values");
     
-    for(int i = 0; i < 12; i++) {
-        if(analogChannels[i].enabled) {
-            int rawValue = analogChannels[i].currentValue;
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if(snap.enabledMask & (1u << i)) {
+            int rawValue = snap.currentValue[i];
             // 计算未校准的电压
-            float uncalibrated_voltage = (rawValue * 3.3f) / 4095.0f;
+            float uncalibrated_voltage = adcRawVoltage(analogChannels[i].backend, rawValue);
             // 应用校准
-            float calibrated_voltage = calibrateVoltage(uncalibrated_voltage);
-            // 使用校准后的电压计算物理值
-            float physicalValue = mapVoltageToPhysical(calibrated_voltage, analogChannels[i]);
-            physicalValue += analogChannels[i].compensation;
-
-            JsonObject channel = values.createNestedObject();
-            channel["channel"] = i;
-            channel["name"] = analogChannels[i].name;
-            channel["gpio"] = analogChannels[i].gpio;
-            channel["rawValue"] = rawValue;
-            channel["rawVoltage"] = uncalibrated_voltage;  // 添加未校准电压
-            channel["voltage"] = calibrated_voltage;  // 校准后的电压
-            channel["value"] = physicalValue;
-            channel["unit"] = analogChannels[i].unit;
-            channel["filterLimit"] = analogChannels[i].filterLimit;
-            channel["compensation"] = analogChannels[i].compensation;
-            channel["difference"] = analogChannels[i].difference;
+            float calibrated_voltage = adcVoltage(analogChannels[i].backend, rawValue);
+            // 物理值在发布快照时已经计算
+            float physicalValue = snap.value[i];
+
+            json.beginObject();
+            json.field("channel", i);
+            json.field("name", analogChannels[i].name.c_str());
+            json.field("gpio", analogChannels[i].gpio);
+            json.field("backend", (int)analogChannels[i].backend);
+            json.field("rawValue", rawValue);
+            json.field("rawVoltage", uncalibrated_voltage);  // 添加未校准电压
+            json.field("voltage", calibrated_voltage);  // 校准后的电压
+            json.field("value", physicalValue);
+            json.field("unit", analogChannels[i].unit.c_str());
+            json.field("filterLimit", analogChannels[i].filterLimit);
+            json.field("compensation", analogChannels[i].compensation);
+            json.field("difference", snap.difference[i]);
+            json.field("sample", snap.lastSample[i]);
+            json.field("interval", snap.sampleInterval[i]);
+            json.field("stale", (snap.staleMask & (1u << i)) != 0);
+            json.field("valid", (snap.invalidMask & (1u << i)) == 0);
+            writeStatsCompact(json, stats.result[i]);
+            json.endObject();
         }
     }
+    json.endArray();
     
     // 添加温度数据
-    JsonArray temps = doc.createNestedArray("temperatures");
-    for(int i = 0; i < 2; i++) {
+    json.beginArray("temperatures");
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
         if(tempSensors[i].enabled) {
-            JsonObject temp = temps.createNestedObject();
-            temp["name"] = tempSensors[i].name;
-            temp["value"] = tempSensors[i].lastTemp;
-            temp["type"] = (int)tempSensors[i].type;
-            temp["enabled"] = tempSensors[i].enabled;
-            
-            // 计算电阻值
-            Adafruit_MAX31865* sensor;
-            switch(i) {
-                case 0: sensor = &thermo1; break;
-                case 1: sensor = &thermo2; break;
+            // 温度、电阻和故障码都来自最近一次测温，这里不再访问SPI
+            json.beginObject();
+            json.field("name", tempSensors[i].name.c_str());
+            json.field("value", snap.tempValue[i]);
+            json.field("type", (int)tempSensors[i].type);
+            json.field("enabled", tempSensors[i].enabled);
+            json.field("resistance", snap.tempResistance[i]);
+            json.field("fault", (int)snap.tempFault[i]);
+            writeStatsCompact(json, stats.result[Board::ANALOG_CHANNELS + i]);
+            json.endObject();
+        }
+    }
+    json.endArray();
+
+    // 虚拟通道的值在发布快照时已经计算
+    json.beginArray("virtual");
+    for(int k = 0; k < VIRTUAL_CHANNELS; k++) {
+        if(snap.virtualMask & (1u << k)) {
+            json.beginObject();
+            json.field("index", k);
+            json.field("name", virtualChannels[k].name.c_str());
+            json.field("unit", virtualChannels[k].unit.c_str());
+            json.field("value", snap.virtualValue[k]);
+            json.field("valid", !isnan(snap.virtualValue[k]));
+            writeStatsCompact(json, stats.result[VIRTUAL_BASE + k]);
+            json.endObject();
+        }
+    }
+    json.endArray();
+    json.endObject();
+
+    if (out.overflowed()) {
+        LOGW(LOG_MOD_WEB, "Sensor JSON exceeds %u bytes, frame dropped", (unsigned)SENSOR_JSON_SIZE);
+        return;
+    }
+    
+    // 复制到共享缓冲区，本周期到期的客户端共用
+    broadcastStream(ws, sensorJson, out.length(), now);
+}
+
+// 以下函数把配置写入调用方已打开的JSON对象中
+
+// 模拟量配置（/get_analog_config）
+void writeAnalogConfigJson(JsonWriter& json) {
+    json.beginArray("channels");
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        json.beginObject();
+        json.field("enabled", analogStaged.channel[i].enabled);
+        json.field("name", analogStaged.channel[i].name.c_str());
+        json.field("unit", analogStaged.channel[i].unit.c_str());
+        json.field("gpio", analogStaged.channel[i].gpio);
+        json.field("backend", (int)analogStaged.channel[i].backend);
+        json.field("input", (int)analogStaged.channel[i].extInput);
+        json.field("mains", (int)analogStaged.channel[i].mainsMode);
+        json.field("mainsHz", (int)analogStaged.channel[i].mainsHz);
+        json.field("mainsCycles", (int)analogStaged.channel[i].mainsCycles);
+        json.field("filterLimit", analogStaged.channel[i].filterLimit);
+        json.field("compensation", analogStaged.channel[i].compensation);
+        json.field("sampleMin", (int)analogStaged.channel[i].sampleMin);
+        json.field("sampleMax", (int)analogStaged.channel[i].sampleMax);
+        
+        json.beginArray("calibPoints");
+        for(int j = 0; j < analogStaged.channel[i].numPoints; j++) {
+            json.beginObject();
+            json.field("voltage", analogStaged.channel[i].calibPoints[j].voltage);
+            json.field("physical", analogStaged.channel[i].calibPoints[j].physical);
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// 继电器状态（/get_relay_status）
+void writeRelayStatusJson(JsonWriter& json) {
+    // 运行状态和配置取自快照，可在任意任务中调用
+    SensorSnapshot snap;
+    sensorSnapshot.read(snap);
+    RelayConfigSet relays;
+    relayConfigs.read(relays);
+
+    json.beginArray("relays");
+    for(int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        json.beginObject();
+        json.field("name", relays.channel[i].name.c_str());
+        char pin[32];
+        relayOutputLabel(i, pin, sizeof(pin));
+        json.field("gpio", relays.channel[i].gpio);
+        json.field("pin", pin);
+        json.field("state", (snap.relayState & (1u << i)) != 0);
+        json.field("mode", (int)relays.channel[i].mode);
+        json.field("autoRunning", (snap.relayAutoRunning & (1u << i)) != 0);
+        json.field("currentCycles", (unsigned int)snap.relayCycles[i]);
+        json.field("maxCycles", relays.channel[i].maxCycles);
+        json.field("onTime", relays.channel[i].onTime);
+        json.field("offTime", relays.channel[i].offTime);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// 继电器配置（/get_relay_config）
+void writeRelayConfigJson(JsonWriter& json) {
+    RelayConfigSet relays;
+    relayConfigs.read(relays);
+    json.beginArray("relays");
+    for(int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        json.beginObject();
+        json.field("name", relays.channel[i].name.c_str());
+        json.field("gpio", relays.channel[i].gpio);
+        json.field("state", relays.channel[i].state);
+        json.field("mode", (int)relays.channel[i].mode);
+        json.field("autoRunning", relays.channel[i].autoRunning);
+        json.field("currentCycles", relays.channel[i].currentCycles);
+        json.field("maxCycles", relays.channel[i].maxCycles);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// 温度传感器配置（/get_temp_config）
+void writeTempConfigJson(JsonWriter& json) {
+    json.beginArray("sensors");
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
+        json.beginObject();
+        json.field("enabled", tempStaged.sensor[i].enabled);
+        json.field("name", tempStaged.sensor[i].name.c_str());
+        json.field("type", (int)tempStaged.sensor[i].type);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// 从 JSON 解析单个模拟量通道配置到 channel，返回通道号，无效时返回 -1。
+// 没有给出的字段保持当前值
+int parseAnalogChannelConfig(JsonObject channelConfig, AnalogChannel& channel) {
+    int channelIndex = channelConfig["channel"] | -1;
+    if(channelIndex < 0 || channelIndex >= Board::ANALOG_CHANNELS) return -1;
+
+    channel = analogStaged.channel[channelIndex];
+    channel.enabled = channelConfig["enabled"] | channel.enabled;
+    if(channelConfig.containsKey("name")) channel.name.set(channelConfig["name"] | "");
+    if(channelConfig.containsKey("unit")) channel.unit.set(channelConfig["unit"] | "");
+    
+    channel.gpio = Board::analogGpio(channelIndex);
+
+    // 采样后端和外部ADC输入号，超出范围时整个配置无效
+    int backend = channelConfig["backend"] | (int)channel.backend;
+    int input = channelConfig["input"] | (int)channel.extInput;
+    if(backend < 0 || backend >= ADC_BACKEND_COUNT) return -1;
+    if(backend == ADC_BACKEND_INTERNAL) input = 0;
+    if(input < 0 || input >= analogBackendInputs(backend)) return -1;
+    channel.backend = backend;
+    channel.extInput = input;
+
+    // 工频抑制：模式、频率和积分周期数，超出范围时整个配置无效
+    int mains = channelConfig["mains"] | (int)channel.mainsMode;
+    int mainsHz = channelConfig["mainsHz"] | (int)channel.mainsHz;
+    int mainsCycles = channelConfig["mainsCycles"] | (int)channel.mainsCycles;
+    if(mains < 0 || mains >= MAINS_MODE_COUNT) return -1;
+    if(mainsHz != 50 && mainsHz != 60) return -1;
+    if(mainsCycles < 1 || mainsCycles > MAINS_MAX_CYCLES) return -1;
+    channel.mainsMode = mains;
+    channel.mainsHz = mainsHz;
+    channel.mainsCycles = mainsCycles;
+
+    // 自适应采样间隔范围，超出范围时整个配置无效
+    int sampleMin = channelConfig["sampleMin"] | (int)channel.sampleMin;
+    int sampleMax = channelConfig["sampleMax"] | (int)channel.sampleMax;
+    if(!adaptiveValidRange(sampleMin, sampleMax)) return -1;
+    channel.sampleMin = sampleMin;
+    channel.sampleMax = sampleMax;
+    
+    // 限幅值超出范围时整个配置无效
+    int filterLimit = channelConfig["filterLimit"] | channel.filterLimit;
+    if(filterLimit < FILTER_LIMIT_MIN || filterLimit > FILTER_LIMIT_MAX) return -1;
+    channel.filterLimit = filterLimit;
+    channel.compensation = channelConfig["compensation"] | channel.compensation;
+    
+    // 处理校准点（给出 calibPoints 时整体替换）
+    if(!channelConfig.containsKey("calibPoints")) return channelIndex;
+    JsonArray points = channelConfig["calibPoints"].as<JsonArray>();
+    channel.numPoints = 0;
+    for(JsonVariant p : points) {
+        if(channel.numPoints < 8) {
+            float voltage = p["voltage"].as<float>();
+            float physical = p["physical"].as<float>();
+            if (!isnan(voltage) && !isnan(physical)) {
+                channel.calibPoints[channel.numPoints].voltage = voltage;
+                channel.calibPoints[channel.numPoints].physical = physical;
+                channel.numPoints++;
             }
-            float rtd = sensor->readRTD();
-            float ratio = rtd / 32768.0;
-            float resistance = ratio * 439.78;  // 使用新的参考电阻值
-            temp["resistance"] = resistance;
-            temp["fault"] = sensor->readFault();
         }
     }
     
-    String output;
-    serializeJson(doc, output);
-    ws.textAll(output);
+    // 如果没有有效的校准点，设置默认值
+    if(channel.numPoints == 0) {
+        channel.calibPoints[0] = {0.0, 0.0};
+        channel.calibPoints[1] = {3.3, 100.0};
+        channel.numPoints = 2;
+    }
+    return channelIndex;
+}
+
+// 发布暂存区中 mask 对应通道的修改，由主循环应用并保存（只在 AsyncTCP 任务中调用）
+void publishAnalogStaged(uint16_t mask) {
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if(mask & (1u << i)) analogStaged.revision[i]++;
+    }
+    analogConfigs.publish(analogStaged);
+    configChanged(CONFIG_ANALOG);
+    LOGI(LOG_MOD_CFG, "Analog config staged, channel mask 0x%03x", mask);
+}
+
+// 一次提交多个通道的配置（mask 中的位对应 staged 中的通道）
+void commitAnalogChannels(const AnalogChannel* staged, uint16_t mask) {
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if(mask & (1u << i)) analogStaged.channel[i] = staged[i];
+    }
+    publishAnalogStaged(mask);
+}
+
+// 提交单个模拟量通道配置，返回通道号，无效时返回 -1
+int applyAnalogChannelConfig(JsonObject channelConfig) {
+    AnalogChannel channel;
+    int channelIndex = parseAnalogChannelConfig(channelConfig, channel);
+    if(channelIndex < 0) return -1;
+    analogStaged.channel[channelIndex] = channel;
+    publishAnalogStaged(1u << channelIndex);
+    return channelIndex;
+}
+
+// 批量应用通道配置：全部有效才应用，否则不做任何修改
+bool applyAnalogConfigArray(JsonArray config) {
+    AnalogChannel staged[Board::ANALOG_CHANNELS];
+    uint16_t mask = 0;
+    for(JsonVariant v : config) {
+        AnalogChannel channel;
+        int channelIndex = parseAnalogChannelConfig(v.as<JsonObject>(), channel);
+        if(channelIndex < 0) return false;
+        staged[channelIndex] = channel;
+        mask |= 1u << channelIndex;
+    }
+    if(mask == 0) return false;
+    commitAnalogChannels(staged, mask);
+    return true;
+}
+
+bool onAnalogConfigElement(char* json, size_t len, void* context) {
+    AnalogConfigUpload* upload = (AnalogConfigUpload*)context;
+    DynamicJsonDocument doc(1024);
+    if(deserializeJson(doc, json, len)) return false;
+    AnalogChannel channel;
+    int channelIndex = parseAnalogChannelConfig(doc.as<JsonObject>(), channel);
+    if(channelIndex < 0) return false;
+    upload->staged[channelIndex] = channel;
+    upload->mask |= 1u << channelIndex;
+    return true;
+}
+
+// 修改限幅值（主循环应用后保存）
+bool applyFilterLimit(int channel, int limit) {
+    if (channel < 0 || channel >= Board::ANALOG_CHANNELS) return false;
+    if (limit < FILTER_LIMIT_MIN || limit > FILTER_LIMIT_MAX) return false;
+
+    analogStaged.channel[channel].filterLimit = limit;
+    publishAnalogStaged(1u << channel);
+    LOGI(LOG_MOD_CFG, "Updated channel %d filter limit to %d", channel, limit);
+    return true;
+}
+
+// 以下继电器操作只把命令放入控制任务的队列，通道号无效或队列满时返回 false。
+// 模式检查在控制任务中进行，带 clientId 的命令执行后通过 WebSocket 回复结果。
+
+// 手动模式下设置继电器
+bool applyRelaySet(int channel, bool state, uint32_t clientId, int32_t requestId) {
+    if (channel < 0 || channel >= Board::RELAY_CHANNELS) return false;
+    return requestRelaySet(channel, state, clientId, requestId) != 0;
+}
+
+// 启动/停止自动运行
+bool applyRelayAutoControl(int channel, bool running, uint32_t clientId, int32_t requestId) {
+    if (channel < 0 || channel >= Board::RELAY_CHANNELS) return false;
+    return requestRelayAuto(channel, running, clientId, requestId) != 0;
+}
+
+// 解析一个继电器配置元素，返回通道号；通道号超出范围时返回 -1（忽略该元素），模式无效时返回 -2
+int parseRelayConfig(JsonObject v, RelayChannel& channel) {
+    int mode = v["mode"] | (int)MANUAL;
+    if(mode != MANUAL && mode != AUTOMATIC) return -2;
+    int channelIndex = v["channel"] | -1;
+    if(channelIndex < 0 || channelIndex >= Board::RELAY_CHANNELS) return -1;
+    channel.name.set(v["name"] | "");
+    channel.mode = (RelayMode)mode;
+    channel.onTime = v["onTime"].as<unsigned long>();
+    channel.offTime = v["offTime"].as<unsigned long>();
+    channel.maxCycles = v["maxCycles"].as<unsigned int>();
+    return channelIndex;
+}
+
+// 把解析好的继电器配置整批放入控制任务的队列（控制任务在同一轮中执行并保存一次），返回错误信息；
+// 队列放不下整批时不修改任何通道
+const char* commitRelayConfig(const RelayChannel* staged, uint32_t mask) {
+    return requestRelayConfigBatch(staged, mask) ? NULL : "busy";
+}
+
+// 应用继电器配置数组，返回错误信息；有无效的模式时不做任何修改
+const char* applyRelayConfig(JsonArray config) {
+    static RelayChannel staged[Board::RELAY_CHANNELS];   // 只在 AsyncTCP 任务中使用
+    uint32_t mask = 0;
+    for(JsonVariant v : config) {
+        RelayChannel channel;
+        int channelIndex = parseRelayConfig(v.as<JsonObject>(), channel);
+        if(channelIndex == -2) return "invalid mode";
+        if(channelIndex < 0) continue;
+        staged[channelIndex] = channel;
+        mask |= 1u << channelIndex;
+    }
+    return commitRelayConfig(staged, mask);
+}
+
+bool onRelayConfigElement(char* json, size_t len, void* context) {
+    RelayConfigUpload* upload = (RelayConfigUpload*)context;
+    DynamicJsonDocument doc(512);
+    if(deserializeJson(doc, json, len)) return false;
+    RelayChannel channel;
+    int channelIndex = parseRelayConfig(doc.as<JsonObject>(), channel);
+    if(channelIndex == -2) {
+        upload->error = "invalid mode";
+        return false;
+    }
+    if(channelIndex < 0) return true;
+    upload->staged[channelIndex] = channel;
+    upload->mask |= 1u << channelIndex;
+    return true;
+}
+
+// 提交温度传感器配置，主循环在两次测温之间重新初始化传感器并保存
+bool applyTempConfig(int sensorIndex, JsonObject config) {
+    if(sensorIndex < 0 || sensorIndex >= Board::TEMP_SENSORS) return false;
+    int type = config["type"] | (int)tempStaged.sensor[sensorIndex].type;
+    if(type != PT100 && type != PT1000) return false;
+
+    TempSensorSettings& sensor = tempStaged.sensor[sensorIndex];
+    sensor.enabled = config["enabled"].as<bool>();
+    if(config.containsKey("name")) sensor.name.set(config["name"] | "");
+    sensor.type = (TempSensorType)type;
+    tempStaged.revision[sensorIndex]++;
+    tempConfigs.publish(tempStaged);
+    configChanged(CONFIG_TEMP);
+
+    LOGI(LOG_MOD_CFG, "Temperature sensor %d config staged", sensorIndex);
+    return true;
+}
+
+// 用启动时加载的配置初始化暂存区（在网络服务启动前调用）
+void initStagedConfig() {
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        analogStaged.channel[i] = analogChannels[i];
+        analogStaged.revision[i] = 0;
+        analogAppliedRevision[i] = 0;
+    }
+    analogConfigs.publish(analogStaged);
+    analogConfigSeq = analogConfigs.sequence();
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
+        tempStaged.sensor[i].enabled = tempSensors[i].enabled;
+        tempStaged.sensor[i].name = tempSensors[i].name;
+        tempStaged.sensor[i].type = tempSensors[i].type;
+        tempStaged.revision[i] = 0;
+        tempAppliedRevision[i] = 0;
+    }
+    tempConfigs.publish(tempStaged);
+    tempConfigSeq = tempConfigs.sequence();
+}
+
+// 应用网络回调提交的配置（只在主循环中调用，不会与采样、测温同时访问通道配置和SPI）
+void applyStagedConfig() {
+    static AnalogConfigSet analog;
+    static TempConfigSet temp;
+
+    if(analogConfigs.sequence() != analogConfigSeq) {
+        analogConfigSeq = analogConfigs.read(analog);
+        uint16_t mask = 0;
+        for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+            if(analog.revision[i] == analogAppliedRevision[i]) continue;
+            analogAppliedRevision[i] = analog.revision[i];
+            analogChannels[i] = analog.channel[i];
+            syncAnalogSampleState(i);
+            mask |= 1u << i;
+        }
+        if(mask) {
+            saveAnalogConfig(-1);
+            LOGI(LOG_MOD_CFG, "Analog config saved, channel mask 0x%03x", mask);
+        }
+    }
+
+    if(tempConfigs.sequence() != tempConfigSeq) {
+        tempConfigSeq = tempConfigs.read(temp);
+        bool changed = false;
+        for(int i = 0; i < Board::TEMP_SENSORS; i++) {
+            if(temp.revision[i] == tempAppliedRevision[i]) continue;
+            tempAppliedRevision[i] = temp.revision[i];
+            tempSensors[i].enabled = temp.sensor[i].enabled;
+            tempSensors[i].name = temp.sensor[i].name;
+            tempSensors[i].type = temp.sensor[i].type;
+            thermoSensors[i]->begin(MAX31865_2WIRE);
+            changed = true;
+        }
+        if(changed) saveTempConfig();
+    }
+}
+
+// 发布采集快照（只在主循环中调用）
+void publishSensorSnapshot() {
+    SensorSnapshot snap;
+    snap.timestamp = millis();
+    snap.enabledMask = analogState.enabledMask;
+    snap.staleMask = analogState.staleMask;
+    snap.invalidMask = analogState.invalidMask;
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        snap.value[i] = 0;
+        if(analogState.invalidMask & (1u << i)) {
+            snap.value[i] = NAN;   // MQTT、历史记录和 Modbus 都看到无效值
+        } else if(analogState.enabledMask & (1u << i)) {
+            float voltage = adcVoltage(analogState.backend[i], analogState.currentValue[i]);
+            snap.value[i] = mapVoltageToPhysical(voltage, analogChannels[i]) + analogChannels[i].compensation;
+        }
+    }
+    memcpy(snap.currentValue, analogState.currentValue, sizeof(snap.currentValue));
+    memcpy(snap.difference, analogState.difference, sizeof(snap.difference));
+    memcpy(snap.lastSample, analogState.lastSample, sizeof(snap.lastSample));
+    memcpy(snap.sampleInterval, analogState.sampleInterval, sizeof(snap.sampleInterval));
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) snap.rateScale[i] = adaptiveRateScale(i);
+    snap.tempEnabledMask = 0;
+    for(int i = 0; i < Board::TEMP_SENSORS; i++) {
+        if(tempSensors[i].enabled) snap.tempEnabledMask |= 1u << i;
+        snap.tempValue[i] = tempSensors[i].lastTemp;
+        snap.tempResistance[i] = tempSensors[i].lastResistance;
+        snap.tempFault[i] = tempSensors[i].lastFault;
+    }
+    // 继电器状态由控制任务修改，从它发布的快照读取
+    static RelayConfigSet relays;
+    relayConfigs.read(relays);
+    snap.relayState = 0;
+    snap.relayAutoRunning = 0;
+    for(int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        const RelayChannel& relay = relays.channel[i];
+        if(relay.state) snap.relayState |= 1u << i;
+        if(relay.autoRunning) snap.relayAutoRunning |= 1u << i;
+        snap.relayCycles[i] = relay.currentCycles;
+    }
+    virtualUpdate(snap);
+    sensorSnapshot.publish(snap);
+}
+
+// 回复继电器控制任务执行完的 WebSocket 命令（只在主循环中调用）
+void sendRelayAcks() {
+    RelayAck ack;
+    while (relayAckQueue.pop(ack)) {
+        AsyncWebSocketClient *client = ws.client(ack.clientId);
+        if (!client || client->status() != WS_CONNECTED) continue;
+
+        char reply[96];
+        int n = ack.ok
+            ? snprintf(reply, sizeof(reply), "{\"type\":\"resp\",\"id\":%ld,\"ok\":true,\"seq\":%u}",
+                (long)ack.requestId, ack.seq)
+            : snprintf(reply, sizeof(reply), "{\"type\":\"resp\",\"id\":%ld,\"ok\":false,\"seq\":%u,\"error\":\"wrong mode\"}",
+                (long)ack.requestId, ack.seq);
+        client->text(reply, n);
+    }
+}
+
+// 推送继电器状态：{"type":"relays","relays":[...]}
+void pushRelayStatus() {
+    if (ws.count() == 0) return;
+
+    BufferPrint out(relayJson, RELAY_JSON_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("type", "relays");
+    writeRelayStatusJson(json);
+    json.endObject();
+
+    if (out.overflowed()) {
+        LOGW(LOG_MOD_WEB, "Relay JSON exceeds %u bytes", (unsigned)RELAY_JSON_SIZE);
+        return;
+    }
+    // 状态变化不能被积压策略丢掉
+    broadcastText(ws, relayJson, out.length(), false);
+}
+
+// set_rate 的应答数据
+void writeRateJson(JsonWriter& json) {
+    json.field("interval", (unsigned long)wsRateReply);
+}
+
+// 回复一条命令：{"type":"resp","id":N,"ok":true,"data":{...}} 或 {"type":"resp","id":N,"ok":false,"error":"..."}
+void sendWsReply(AsyncWebSocketClient *client, long id, const char *error, void (*writeData)(JsonWriter&)) {
+    BufferPrint out(wsReplyJson, WS_REPLY_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("type", "resp");
+    json.field("id", id);
+    json.field("ok", error == NULL);
+    if (error) {
+        json.field("error", error);
+    } else if (writeData) {
+        json.beginObject("data");
+        writeData(json);
+        json.endObject();
+    }
+    json.endObject();
+
+    if (out.overflowed()) {
+        LOGW(LOG_MOD_WEB, "WebSocket reply exceeds %u bytes", (unsigned)WS_REPLY_SIZE);
+        return;
+    }
+    client->text(wsReplyJson, out.length());
+}
+
+// capture_data 的发送缓冲区：由这里持有（不经 ws.makeBuffer，那样只有 textAll/binaryAll 才会释放），
+// 客户端发送完释放引用后，下次下载时同尺寸直接复用，否则换一块。只在 AsyncTCP 任务中使用
+AsyncWebSocketMessageBuffer* captureWsBuffer = NULL;
+
+// 取一个长度为 size 的捕获发送缓冲区，返回错误信息
+const char* acquireCaptureWsBuffer(size_t size) {
+    if (captureWsBuffer && !captureWsBuffer->canDelete()) return "busy";   // 上一次下载仍在发送
+    if (captureWsBuffer && captureWsBuffer->length() == size && captureWsBuffer->get()) return NULL;
+    delete captureWsBuffer;
+    captureWsBuffer = new AsyncWebSocketMessageBuffer(size);
+    if (!captureWsBuffer->get()) {
+        delete captureWsBuffer;
+        captureWsBuffer = NULL;
+        return "out of memory";
+    }
+    return NULL;
+}
+
+// WebSocket 命令：{"id":N,"cmd":"...", ...参数}
+//   relay_set          {channel, state}        手动模式开关继电器
+//   relay_auto         {channel, running}      启动/停止自动运行
+//   get_relay_status / get_relay_config / get_analog_config / get_temp_config
+//   save_relay_config  {config:[...]}          同 /save_relay_config
+//   save_analog_config {config:{...}|[...]}    单通道或多通道，同 /save_analog_config
+//   save_temp_config   {index, config:{...}}   同 /save_temp_config
+//   save_filter_limit  {channel, limit}        同 /save_filter_limit
+//   set_rate           {interval} 或 {hz}      本连接的实时数据更新间隔，最快与采样同步
+//   capture_arm        {channels:[..], rate, pre, post, trigger, channel, level, relay}  同 /capture/arm
+//   capture_cancel / capture_status
+//   get_spectrum                               同 /spectrum
+//   get_stats                                  同 /stats
+//   get_alarms / get_alarm_config              同 /alarms、/get_alarm_config
+//   save_alarm_config  {config:{...}}          同 /save_alarm_config
+//   alarm_ack          {channel}               确认报警，不带 channel 时确认全部
+//   get_virtual_config                         同 /get_virtual_config
+//   save_virtual_config {channels:[...]}       同 /save_virtual_config
+//   capture_data       应答状态后把波形作为一条二进制消息发给本连接，格式同 /capture/data
+void handleWsCommand(AsyncWebSocketClient *client, const char *data, size_t len) {
+    METRICS_SCOPE(METRIC_WS_COMMAND);
+
+    DynamicJsonDocument doc(WS_COMMAND_JSON_SIZE);
+    if (deserializeJson(doc, data, len)) {
+        sendWsReply(client, 0, "invalid json", NULL);
+        return;
+    }
+
+    long id = doc["id"] | 0L;
+    const char *cmd = doc["cmd"] | "";
+
+    // 继电器命令执行完后由主循环回复（sendRelayAcks），这里只回复入队失败
+    if (strcmp(cmd, "relay_set") == 0) {
+        if (!applyRelaySet(doc["channel"] | -1, doc["state"].as<int>() != 0, client->id(), id)) {
+            sendWsReply(client, id, "invalid request", NULL);
+        }
+    } else if (strcmp(cmd, "relay_auto") == 0) {
+        if (!applyRelayAutoControl(doc["channel"] | -1, doc["running"].as<int>() != 0, client->id(), id)) {
+            sendWsReply(client, id, "invalid request", NULL);
+        }
+    } else if (strcmp(cmd, "get_relay_status") == 0) {
+        sendWsReply(client, id, NULL, writeRelayStatusJson);
+    } else if (strcmp(cmd, "get_relay_config") == 0) {
+        sendWsReply(client, id, NULL, writeRelayConfigJson);
+    } else if (strcmp(cmd, "get_analog_config") == 0) {
+        sendWsReply(client, id, NULL, writeAnalogConfigJson);
+    } else if (strcmp(cmd, "get_temp_config") == 0) {
+        sendWsReply(client, id, NULL, writeTempConfigJson);
+    } else if (strcmp(cmd, "save_relay_config") == 0) {
+        sendWsReply(client, id, applyRelayConfig(doc["config"].as<JsonArray>()), NULL);
+    } else if (strcmp(cmd, "save_analog_config") == 0) {
+        bool ok = doc["config"].is<JsonArray>() ?
+            applyAnalogConfigArray(doc["config"].as<JsonArray>()) :
+            applyAnalogChannelConfig(doc["config"]) >= 0;
+        sendWsReply(client, id, ok ? NULL : "invalid channel", NULL);
+    } else if (strcmp(cmd, "save_temp_config") == 0) {
+        bool ok = applyTempConfig(doc["index"] | -1, doc["config"]);
+        sendWsReply(client, id, ok ? NULL : "invalid sensor index", NULL);
+    } else if (strcmp(cmd, "save_filter_limit") == 0) {
+        bool ok = applyFilterLimit(doc["channel"] | -1, doc["limit"] | -1);
+        sendWsReply(client, id, ok ? NULL : "invalid parameters", NULL);
+    } else if (strcmp(cmd, "set_rate") == 0) {
+        uint32_t interval = doc["interval"] | 0u;
+        float hz = doc["hz"] | 0.0f;
+        if (hz > 0) interval = (uint32_t)(1000.0f / hz);
+        wsRateReply = wsStreamSetInterval(client->id(), interval, SENSOR_UPDATE_INTERVAL);
+        sendWsReply(client, id, wsRateReply ? NULL : "client not registered", writeRateJson);
+    } else if (strcmp(cmd, "capture_arm") == 0) {
+        uint16_t mask = 0;
+        for (JsonVariant v : doc["channels"].as<JsonArray>()) {
+            int ch = v | -1;
+            if (ch >= 0 && ch < Board::ANALOG_CHANNELS) mask |= 1u << ch;
+        }
+        CaptureConfig config;
+        const char* error = captureParseConfig(mask, doc["trigger"] | "immediate",
+            doc["rate"] | (long)CAPTURE_DEFAULT_RATE, doc["pre"] | (long)CAPTURE_DEFAULT_PRE,
+            doc["post"] | (long)CAPTURE_DEFAULT_POST, doc["channel"] | -1L, doc["level"] | 2048L,
+            doc["relay"] | -1L, config);
+        if (!error) error = captureArm(config);
+        sendWsReply(client, id, error, writeCaptureStatusJson);
+    } else if (strcmp(cmd, "capture_cancel") == 0) {
+        captureCancel();
+        sendWsReply(client, id, NULL, writeCaptureStatusJson);
+    } else if (strcmp(cmd, "get_spectrum") == 0) {
+        sendWsReply(client, id, NULL, writeSpectrumJson);
+    } else if (strcmp(cmd, "get_stats") == 0) {
+        sendWsReply(client, id, NULL, writeStatsJson);
+    } else if (strcmp(cmd, "get_alarms") == 0) {
+        sendWsReply(client, id, NULL, writeAlarmStatusJson);
+    } else if (strcmp(cmd, "get_alarm_config") == 0) {
+        sendWsReply(client, id, NULL, writeAlarmConfigJson);
+    } else if (strcmp(cmd, "save_alarm_config") == 0) {
+        const char* error = applyAlarmConfig(doc["config"]);
+        if (!error) saveAlarmConfig();
+        sendWsReply(client, id, error, NULL);
+    } else if (strcmp(cmd, "alarm_ack") == 0) {
+        int channel = doc.containsKey("channel") ? alarmParseChannel(doc["channel"]) : -1;
+        if (doc.containsKey("channel") && channel < 0) {
+            sendWsReply(client, id, "invalid channel", NULL);
+        } else {
+            sendWsReply(client, id, requestAlarmAck(channel) ? NULL : "busy", NULL);
+        }
+    } else if (strcmp(cmd, "get_virtual_config") == 0) {
+        sendWsReply(client, id, NULL, writeVirtualConfigJson);
+    } else if (strcmp(cmd, "save_virtual_config") == 0) {
+        const char* error = applyVirtualConfig(doc["channels"].as<JsonArray>());
+        if (!error) saveVirtualConfig();
+        sendWsReply(client, id, error, NULL);
+    } else if (strcmp(cmd, "capture_status") == 0) {
+        sendWsReply(client, id, NULL, writeCaptureStatusJson);
+    } else if (strcmp(cmd, "capture_data") == 0) {
+        std::shared_ptr<CaptureReader> reader = captureOpenReader();
+        const char* error = reader ? acquireCaptureWsBuffer(captureDataSize()) : "no completed capture";
+        if (error) {
+            sendWsReply(client, id, error, NULL);
+        } else {
+            captureRender(captureWsBuffer->get(), 0, captureDataSize());
+            sendWsReply(client, id, NULL, writeCaptureStatusJson);
+            client->binary(captureWsBuffer);
+        }
+    } else {
+        sendWsReply(client, id, "unknown command", NULL);
+    }
 }
 
 // 修改 saveAnalogConfig 数，添补偿值的保存
 void saveAnalogConfig(int channelIndex) {
-    Serial.println("Saving analog config...");
-    
+    METRICS_SCOPE(METRIC_SAVE_ANALOG);
     File file = SPIFFS.open("/analog_config.json", "w");
     if(!file) {
-        Serial.println("Failed to open analog config file for writing");
+        LOGE(LOG_MOD_CFG, "Failed to open analog config file for writing");
         return;
     }
 
-    DynamicJsonDocument doc(8192);
+    DynamicJsonDocument doc(704 * Board::ANALOG_CHANNELS + 512);
     JsonArray channels = doc.createNestedArray("channels");
 
     // 保存所有通道的配置
-    for(int i = 0; i < 12; i++) {  // 从8改为12
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
         JsonObject channel = channels.createNestedObject();
         channel["enabled"] = analogChannels[i].enabled;
-        channel["name"] = analogChannels[i].name;
-        channel["unit"] = analogChannels[i].unit;
+        channel["name"] = analogChannels[i].name.c_str();
+        channel["unit"] = analogChannels[i].unit.c_str();
         channel["gpio"] = analogChannels[i].gpio;
+        channel["backend"] = analogChannels[i].backend;
+        channel["input"] = analogChannels[i].extInput;
+        channel["mains"] = analogChannels[i].mainsMode;
+        channel["mainsHz"] = analogChannels[i].mainsHz;
+        channel["mainsCycles"] = analogChannels[i].mainsCycles;
         channel["numPoints"] = analogChannels[i].numPoints;
         
         JsonArray points = channel.createNestedArray("calibPoints");
@@ -843,12 +1741,14 @@ void saveAnalogConfig(int channelIndex) {
         
         channel["filterLimit"] = analogChannels[i].filterLimit;
         channel["compensation"] = analogChannels[i].compensation;
+        channel["sampleMin"] = analogChannels[i].sampleMin;
+        channel["sampleMax"] = analogChannels[i].sampleMax;
     }
 
     if(serializeJson(doc, file)) {
-        Serial.println("Analog config saved successfully");
+        LOGI(LOG_MOD_CFG, "Analog config saved");
     } else {
-        Serial.println("Failed to write analog config");
+        LOGE(LOG_MOD_CFG, "Failed to write analog config");
     }
     file.close();
 }
@@ -858,12 +1758,11 @@ void loadAnalogConfig() {
     if(SPIFFS.exists("/analog_config.json")) {
         File file = SPIFFS.open("/analog_config.json", "r");
         if(file) {
-            Serial.println("Loading analog config...");
-            DynamicJsonDocument doc(8192);
+            DynamicJsonDocument doc(704 * Board::ANALOG_CHANNELS + 512);
             DeserializationError error = deserializeJson(doc, file);
             
             if (error) {
-                Serial.println("Failed to parse analog config file");
+                LOGE(LOG_MOD_CFG, "Failed to parse analog config file");
                 file.close();
                 return;
             }
@@ -871,15 +1770,47 @@ void loadAnalogConfig() {
             JsonArray channels = doc["channels"].as<JsonArray>();
             int i = 0;
             for(JsonVariant v : channels) {
-                if(i < 12) {  // 从8改为12
+                if(i < Board::ANALOG_CHANNELS) {
                     analogChannels[i].enabled = v["enabled"].as<bool>();
-                    analogChannels[i].name = v["name"].as<String>();
-                    analogChannels[i].unit = v["unit"].as<String>();
-                    analogChannels[i].gpio = v["gpio"].as<int>();
+                    analogChannels[i].name.set(v["name"].as<const char*>());
+                    analogChannels[i].unit.set(v["unit"].as<const char*>());
+                    analogChannels[i].gpio = Board::analogGpio(i);  // 引脚以板级配置为准
+                    // 旧配置文件没有后端字段，默认内部ADC；无效值也退回内部ADC
+                    int backend = v["backend"] | (int)ADC_BACKEND_INTERNAL;
+                    int input = v["input"] | 0;
+                    if(backend < 0 || backend >= ADC_BACKEND_COUNT ||
+                       input < 0 || input >= analogBackendInputs(backend)) {
+                        backend = ADC_BACKEND_INTERNAL;
+                        input = 0;
+                    }
+                    analogChannels[i].backend = backend;
+                    analogChannels[i].extInput = input;
+                    // 工频抑制默认关闭，无效值也关闭
+                    int mains = v["mains"] | (int)MAINS_OFF;
+                    int mainsHz = v["mainsHz"] | 50;
+                    int mainsCycles = v["mainsCycles"] | 1;
+                    if(mains < 0 || mains >= MAINS_MODE_COUNT || (mainsHz != 50 && mainsHz != 60) ||
+                       mainsCycles < 1 || mainsCycles > MAINS_MAX_CYCLES) {
+                        mains = MAINS_OFF;
+                        mainsHz = 50;
+                        mainsCycles = 1;
+                    }
+                    analogChannels[i].mainsMode = mains;
+                    analogChannels[i].mainsHz = mainsHz;
+                    analogChannels[i].mainsCycles = mainsCycles;
+                    // 旧配置文件没有采样间隔，默认固定间隔；无效值也退回固定间隔
+                    int sampleMin = v["sampleMin"] | ADAPTIVE_TICK_MS;
+                    int sampleMax = v["sampleMax"] | ADAPTIVE_TICK_MS;
+                    if(!adaptiveValidRange(sampleMin, sampleMax)) {
+                        sampleMin = ADAPTIVE_TICK_MS;
+                        sampleMax = ADAPTIVE_TICK_MS;
+                    }
+                    analogChannels[i].sampleMin = sampleMin;
+                    analogChannels[i].sampleMax = sampleMax;
                     analogChannels[i].numPoints = v["numPoints"].as<int>();
                     // 用 as<int>() 并置默认值
                     analogChannels[i].filterLimit = v["filterLimit"].as<int>();
-                    if(analogChannels[i].filterLimit <= 0) {
+                    if(analogChannels[i].filterLimit < FILTER_LIMIT_MIN || analogChannels[i].filterLimit > FILTER_LIMIT_MAX) {
                         analogChannels[i].filterLimit = 20;  // 设置认值
                     }
                     analogChannels[i].compensation = v["compensation"].as<float>();
@@ -902,7 +1833,7 @@ void loadAnalogConfig() {
                         analogChannels[i].numPoints = 2;
                     }
                     
-                    Serial.printf("Loaded channel %d: %s (filterLimit: %d)\n", 
+                    LOGD(LOG_MOD_CFG, "Loaded channel %d: %s (filterLimit: %d)", 
                         i, 
                         analogChannels[i].name.c_str(),
                         analogChannels[i].filterLimit);
@@ -910,34 +1841,35 @@ void loadAnalogConfig() {
                 }
             }
             file.close();
-            Serial.println("Analog config loaded successfully");
+            LOGI(LOG_MOD_CFG, "Analog config loaded");
         } else {
-            Serial.println("Failed to open analog config file");
+            LOGE(LOG_MOD_CFG, "Failed to open analog config file");
         }
     } else {
-        Serial.println("No analog config file found, using defaults");
-        for(int i = 0; i < 8; i++) {
+        LOGI(LOG_MOD_CFG, "No analog config file found, using defaults");
+        for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
             analogChannels[i].filterLimit = 20;  // 认值为20
+            analogChannels[i].sampleMin = ADAPTIVE_TICK_MS;
+            analogChannels[i].sampleMax = ADAPTIVE_TICK_MS;
         }
     }
 }
 
 // 修改 saveRelayConfig 函数添加错误处理和日志
 void saveRelayConfig() {
-    Serial.println("Saving relay config...");
-    
+    METRICS_SCOPE(METRIC_SAVE_RELAY);
     File file = SPIFFS.open("/relay_config.json", "w");
     if(!file) {
-        Serial.println("Failed to open relay config file for writing");
+        LOGE(LOG_MOD_CFG, "Failed to open relay config file for writing");
         return;
     }
 
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(256 * Board::RELAY_CHANNELS);
     JsonArray array = doc.createNestedArray("relays");
 
-    for(int i = 0; i < 4; i++) {
+    for(int i = 0; i < Board::RELAY_CHANNELS; i++) {
         JsonObject relay = array.createNestedObject();
-        relay["name"] = relayChannels[i].name;
+        relay["name"] = relayChannels[i].name.c_str();
         relay["gpio"] = relayChannels[i].gpio;
         relay["mode"] = relayChannels[i].mode;
         relay["onTime"] = relayChannels[i].onTime;
@@ -949,9 +1881,9 @@ void saveRelayConfig() {
     }
 
     if(serializeJson(doc, file)) {
-        Serial.println("Relay config saved successfully");
+        LOGD(LOG_MOD_CFG, "Relay config saved");
     } else {
-        Serial.println("Failed to write relay config");
+        LOGE(LOG_MOD_CFG, "Failed to write relay config");
     }
     file.close();
 }
@@ -961,13 +1893,12 @@ void loadRelayConfig() {
     if(SPIFFS.exists("/relay_config.json")) {
         File file = SPIFFS.open("/relay_config.json", "r");
         if(file) {
-            Serial.println("Loading relay config...");
-            DynamicJsonDocument doc(1024);
+            DynamicJsonDocument doc(256 * Board::RELAY_CHANNELS);
             DeserializationError error = deserializeJson(doc, file);
             file.close();
             
             if (error) {
-                Serial.println("Failed to parse relay config file");
+                LOGE(LOG_MOD_CFG, "Failed to parse relay config file");
                 initDefaultRelayConfig();  // 使用默认配置
                 return;
             }
@@ -975,15 +1906,10 @@ void loadRelayConfig() {
             JsonArray array = doc["relays"].as<JsonArray>();
             int i = 0;
             for(JsonVariant v : array) {
-                if(i < 4) {
-                    relayChannels[i].name = v["name"].as<String>();
-                    // 强制使用正确的 GPIO 映射
-                    switch(i) {
-                        case 0: relayChannels[i].gpio = 21; break;  // 继电器1 - GPIO21
-                        case 1: relayChannels[i].gpio = 45; break;  // 继电器2 - GPIO45
-                        case 2: relayChannels[i].gpio = 47; break;  // 继电器3 - GPIO47
-                        case 3: relayChannels[i].gpio = 48; break;  // 继电器4 - GPIO48
-                    }
+                if(i < Board::RELAY_CHANNELS) {
+                    relayChannels[i].name.set(v["name"].as<const char*>());
+                    // 强制使用板级配置的 GPIO 映射
+                    relayChannels[i].gpio = Board::relayGpio(i);
                     relayChannels[i].mode = (RelayMode)v["mode"].as<int>();
                     relayChannels[i].onTime = v["onTime"].as<unsigned long>();
                     relayChannels[i].offTime = v["offTime"].as<unsigned long>();
@@ -992,34 +1918,25 @@ void loadRelayConfig() {
                     relayChannels[i].state = false;  // 制初始状态为关闭
                     relayChannels[i].autoRunning = false;  // 强制自动运行为关闭
                     
-                    // 初始化 GPIO
-                    pinMode(relayChannels[i].gpio, OUTPUT);
-                    digitalWrite(relayChannels[i].gpio, LOW);
-                    
-                    Serial.printf("Loaded relay %d: GPIO%d\n", i, relayChannels[i].gpio);
+                    LOGD(LOG_MOD_CFG, "Loaded relay %d", i);
                     i++;
                 }
             }
         } else {
-            Serial.println("Failed to open relay config file");
+            LOGE(LOG_MOD_CFG, "Failed to open relay config file");
             initDefaultRelayConfig();  // 使用默认配置
         }
     } else {
-        Serial.println("No relay config file found, using defaults");
+        LOGI(LOG_MOD_CFG, "No relay config file found, using defaults");
         initDefaultRelayConfig();  // 使用默认配置
     }
 }
 
 // 添加默认配置初始化函数
 void initDefaultRelayConfig() {
-    for(int i = 0; i < 4; i++) {
-        relayChannels[i].name = "电器 " + String(i + 1);
-        switch(i) {
-            case 0: relayChannels[i].gpio = 21; break;  // 继电器1 - GPIO21
-            case 1: relayChannels[i].gpio = 45; break;  // 继电器2 - GPIO45
-            case 2: relayChannels[i].gpio = 47; break;  // 继电器3 - GPIO47
-            case 3: relayChannels[i].gpio = 48; break;  // 继电器4 - GPIO48
-        }
+    for(int i = 0; i < Board::RELAY_CHANNELS; i++) {
+        relayChannels[i].name.set(("电器 " + String(i + 1)).c_str());
+        relayChannels[i].gpio = Board::relayGpio(i);
         relayChannels[i].state = false;
         relayChannels[i].mode = MANUAL;
         relayChannels[i].autoRunning = false;
@@ -1027,37 +1944,82 @@ void initDefaultRelayConfig() {
         relayChannels[i].onTime = 1000;
         relayChannels[i].offTime = 1000;
         relayChannels[i].maxCycles = 1;
-        
-        pinMode(relayChannels[i].gpio, OUTPUT);
-        digitalWrite(relayChannels[i].gpio, LOW);
-        
-        Serial.printf("Initialized relay %d: GPIO%d, initial state: LOW (OFF)\n", 
-            i, relayChannels[i].gpio);
     }
     
     // 保存默认配置
     saveRelayConfig();
 }
 
-// 修改 sampleADC 函数添差值储
+// 修改 sampleADC 函数添差值储（只访问热数据区 analogState）
 void sampleADC() {
-    for(int i = 0; i < 12; i++) {  // 从8改为12
-        if(analogChannels[i].enabled) {
-            int rawValue = analogRead(analogChannels[i].gpio);
+    // 外部ADC由采集任务扫描，这里只取最近一批结果
+    ExtAdcBatch extBatch;
+    if(analogState.enabledMask & analogState.externalMask) extAdcBatch.read(extBatch);
+
+    // 先读 ADC1 和外部ADC，ADC2 通道最后集中读取（与 WiFi 争用时重试）；
+    // 信号平稳、采样间隔已经放慢的通道本节拍不到期时跳过（adaptive.h）
+    int raw[Board::ANALOG_CHANNELS];
+    uint16_t sampled = 0;
+    uint16_t adc2Pending = 0;
+    uint32_t tick = millis();
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if(!(analogState.enabledMask & (1u << i))) continue;
+        if(!adaptiveDue(i, tick)) continue;
+        if(analogState.backend[i] == ADC_BACKEND_INTERNAL) {
+            if(Board::analogAdcUnit(i) == 2) {
+                adc2Pending |= 1u << i;
+                continue;
+            }
+            if(mainsFilteredValue(i, raw[i])) {
+                // 工频抑制的通道由采样任务连续采样，取滤波器的最新输出（捕获期间为保持的输出）
+                adcChannelStats[i].reads++;
+            } else if(captureAdc1Busy()) {
+                // 波形捕获期间 ADC1 由 DMA 连续转换，取最近一次的转换结果
+                if(!captureLatestValue(i, raw[i])) {
+                    adcChannelStats[i].failures++;
+                    continue;
+                }
+                adcChannelStats[i].reads++;
+            } else {
+                raw[i] = adc1Read(i, analogState.gpio[i]);
+            }
+            sampled |= 1u << i;
+        } else {
+            int device = analogState.backend[i] - 1;
+            int input = analogState.extInput[i];
+            // 设备不在或本轮没读到该输入时不计入本次采样
+            if(!(extBatch.validMask[device] & (1u << input))) {
+                adcChannelStats[i].failures++;
+                continue;
+            }
+            raw[i] = extBatch.code[device][input];
+            adcChannelStats[i].reads++;
+            sampled |= 1u << i;
+        }
+    }
+    if(adc2Pending) sampled |= adc2ReadChannels(adc2Pending, raw);
+
+    uint32_t now = millis();
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if(sampled & (1u << i)) {
+            int rawValue = raw[i];
+            analogState.lastSample[i] = rawValue;
+            analogState.lastSampleTime[i] = now;
+            adaptiveOnSample(i, rawValue);
             
             // 存入采缓冲
-            analogChannels[i].sampleBuffer[analogChannels[i].sampleCount] = rawValue;
-            analogChannels[i].sampleCount++;
+            analogState.sampleBuffer[i][analogState.sampleCount[i]] = rawValue;
+            analogState.sampleCount[i]++;
             
-            // 当收集到5个样本时，取��间值
-            if(analogChannels[i].sampleCount >= 5) {
+            // 当收集到5个样本时，取中间值
+            if(analogState.sampleCount[i] >= 5) {
                 // 对本进行排序
-                int tempBuffer[5];
-                memcpy(tempBuffer, analogChannels[i].sampleBuffer, sizeof(tempBuffer));
+                int16_t tempBuffer[5];
+                memcpy(tempBuffer, analogState.sampleBuffer[i], sizeof(tempBuffer));
                 for(int j = 0; j < 4; j++) {
                     for(int k = 0; k < 4-j; k++) {
                         if(tempBuffer[k] > tempBuffer[k+1]) {
-                            int temp = tempBuffer[k];
+                            int16_t temp = tempBuffer[k];
                             tempBuffer[k] = tempBuffer[k+1];
                             tempBuffer[k+1] = temp;
                         }
@@ -1068,43 +2030,58 @@ void sampleADC() {
                 int newMedian = tempBuffer[2];
                 
                 // 计算与上一秒值差值
-                int diff = abs(newMedian - analogChannels[i].lastSecondValue);
+                int diff = abs(newMedian - analogState.lastSecondValue[i]);
                 
                 // 应用限幅滤波（与上一秒的比较）
-                if (diff <= analogChannels[i].filterLimit) {
+                if (diff <= analogState.filterLimit[i]) {
                     // 差值在限幅范围，继续使用上一秒值
-                    analogChannels[i].currentValue = analogChannels[i].lastSecondValue;
+                    analogState.currentValue[i] = analogState.lastSecondValue[i];
                 } else {
                     // 值超出限幅范围，使用新值
-                    analogChannels[i].currentValue = newMedian;
+                    analogState.currentValue[i] = newMedian;
                 }
 
-                // 存储实际差值用于示
-                analogChannels[i].difference = diff;
+                // 存储实际差值用于示，并按差值调整采样间隔
+                analogState.difference[i] = diff;
+                adaptiveOnMedian(i, diff);
                 
-                // 对于 GPIO1 打印详细信息
+                // 对于 GPIO1 打印详细信息（默认编译期关闭）
                 if(i == 0) {
-                    Serial.println("\nGPIO1 5个采样值:");
-                    for(int j = 0; j < 5; j++) {
-                        Serial.printf("%d ", analogChannels[i].sampleBuffer[j]);
-                    }
-                    Serial.printf("\n中值: %d", newMedian);
-                    Serial.printf("\n上一秒值: %d", analogChannels[i].lastSecondValue);
-                    Serial.printf("\n差值: %d", diff);
-                    Serial.printf("\n限值: %d", analogChannels[i].filterLimit);
-                    Serial.printf("\n最终使用值: %d\n", analogChannels[i].currentValue);
+                    LOGD(LOG_MOD_ADC, "GPIO1 samples %d %d %d %d %d, median %d, last %d",
+                        analogState.sampleBuffer[i][0], analogState.sampleBuffer[i][1],
+                        analogState.sampleBuffer[i][2], analogState.sampleBuffer[i][3],
+                        analogState.sampleBuffer[i][4], newMedian, analogState.lastSecondValue[i]);
+                    LOGD(LOG_MOD_ADC, "GPIO1 diff %d, limit %d, value %d",
+                        diff, analogState.filterLimit[i], analogState.currentValue[i]);
                 }
                 
                 // 更上一秒的值（移到这里）
-                analogChannels[i].lastSecondValue = analogChannels[i].currentValue;
-                analogChannels[i].sampleCount = 0;
+                analogState.lastSecondValue[i] = analogState.currentValue[i];
+                analogState.sampleCount[i] = 0;
+                analogState.validMask |= 1u << i;
             }
         }
     }
+
+    // 读取失败时不写入假值，而是按最后一次成功采样的时间标记过期/无效
+    uint16_t stale = 0;
+    uint16_t invalid = 0;
+    for(int i = 0; i < Board::ANALOG_CHANNELS; i++) {
+        if(!(analogState.enabledMask & (1u << i))) continue;
+        uint32_t age = now - analogState.lastSampleTime[i];
+        uint32_t allowance = adaptiveAgeAllowance(i);
+        if(!(analogState.validMask & (1u << i)) || age > ANALOG_INVALID_MS + allowance) {
+            invalid |= 1u << i;
+        } else if(age > ANALOG_STALE_MS + allowance) {
+            stale |= 1u << i;
+        }
+    }
+    analogState.staleMask = stale;
+    analogState.invalidMask = invalid;
 }
 
 // 修改校准表定义
-const ADCCalibPoint AnalogChannel::calibTable[31] = {
+const ADCCalibPoint adcCalibTable[31] = {
     {0.0f, 0.0f, 0.02f},
     {0.1f, 0.065f, 0.02f},
     {0.2f, 0.165f, 0.02f},
@@ -1141,32 +2118,32 @@ const ADCCalibPoint AnalogChannel::calibTable[31] = {
 // 修改校准函数
 float calibrateVoltage(float measured_voltage) {
     // 如果测量值超出范围，进行限制
-    if (measured_voltage <= AnalogChannel::calibTable[0].measured_voltage) {
-        return AnalogChannel::calibTable[0].input_voltage;
+    if (measured_voltage <= adcCalibTable[0].measured_voltage) {
+        return adcCalibTable[0].input_voltage;
     }
-    if (measured_voltage >= AnalogChannel::calibTable[30].measured_voltage) {
-        return AnalogChannel::calibTable[30].input_voltage;
+    if (measured_voltage >= adcCalibTable[30].measured_voltage) {
+        return adcCalibTable[30].input_voltage;
     }
 
     // 遍历所有校准点，查找匹配的范围
     for (int i = 0; i < 31; i++) {
-        float target = AnalogChannel::calibTable[i].measured_voltage;
-        float tolerance = AnalogChannel::calibTable[i].tolerance;
+        float target = adcCalibTable[i].measured_voltage;
+        float tolerance = adcCalibTable[i].tolerance;
         
         // 如果测量值在当前校准点的容差范围内
         if (measured_voltage >= (target - tolerance) && 
             measured_voltage <= (target + tolerance)) {
             // 直接返回对应的校准值
-            return AnalogChannel::calibTable[i].input_voltage;
+            return adcCalibTable[i].input_voltage;
         }
         
         // 如果测量值在两个校准点之间
         if (i < 30 && measured_voltage > target && 
-            measured_voltage < AnalogChannel::calibTable[i + 1].measured_voltage) {
+            measured_voltage < adcCalibTable[i + 1].measured_voltage) {
             
-            float next_target = AnalogChannel::calibTable[i + 1].measured_voltage;
-            float current_input = AnalogChannel::calibTable[i].input_voltage;
-            float next_input = AnalogChannel::calibTable[i + 1].input_voltage;
+            float next_target = adcCalibTable[i + 1].measured_voltage;
+            float current_input = adcCalibTable[i].input_voltage;
+            float next_input = adcCalibTable[i + 1].input_voltage;
             
             // 计算测量值在两个校准点之间的相对位置（0-1）
             float position = (measured_voltage - target) / (next_target - target);
@@ -1184,3 +2161,18 @@ float calibrateVoltage(float measured_voltage) {
     return measured_voltage; // 如果出现意外情况
 }
 
+// 码值对应的电压（内部ADC未经校准表）
+float adcRawVoltage(uint8_t backend, int code) {
+    switch(backend) {
+        case ADC_BACKEND_ADS1115: return code * ADS1115_VOLTS_PER_CODE;
+        case ADC_BACKEND_ADS1256: return code * ADS1256_VOLTS_PER_CODE;
+        default: return (code * 3.3f) / 4095.0f;
+    }
+}
+
+// 码值对应的输入电压：外部ADC本身是线性的，只有内部ADC需要查校准表
+float adcVoltage(uint8_t backend, int code) {
+    float voltage = adcRawVoltage(backend, code);
+    return backend == ADC_BACKEND_INTERNAL ? calibrateVoltage(voltage) : voltage;
+}
+
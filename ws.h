@@ -3,11 +3,15 @@
 
 #include <Arduino.h>
 #include "types.h"  // 包含共享类型定义
+#include "log.h"
+#include "configcache.h"
+#include "relayio.h"
 
 // 声明外部变量
 extern AsyncWebSocket ws;
-extern AnalogChannel analogChannels[12];
-extern RelayChannel relayChannels[4];
+extern AnalogChannel analogChannels[Board::ANALOG_CHANNELS];
+extern RelayChannel relayChannels[Board::RELAY_CHANNELS];
+extern volatile bool relayStatusDirty;
 
 // 将电压值映射到物理量（使用多点校准）
 float mapVoltageToPhysical(float voltage, const AnalogChannel& channel);
@@ -15,7 +19,7 @@ float mapVoltageToPhysical(float voltage, const AnalogChannel& channel);
 // 读取指定通道的模拟量值
 float readAnalogValue(int channel);
 
-// 修改继电器控制函数
+// 修改继电器控制函数（只在继电器控制任务中调用）
 void setRelayState(int channel, bool state);
 
 // 函数实现...
@@ -43,7 +47,7 @@ float mapVoltageToPhysical(float voltage, const AnalogChannel& channel) {
 }
 
 float readAnalogValue(int channel) {
-    if (channel < 0 || channel >= 12) return 0.0;
+    if (channel < 0 || channel >= Board::ANALOG_CHANNELS) return 0.0;
     
     int rawValue = analogRead(analogChannels[channel].gpio);
     // 限制最大电压为3.0V
@@ -52,21 +56,13 @@ float readAnalogValue(int channel) {
 }
 
 void setRelayState(int channel, bool state) {
-    if (channel >= 0 && channel < 4) {
-        // 添加调试输出
-        Serial.printf("setRelayState: channel=%d, state=%d, gpio=%d\n", 
-            channel, state, relayChannels[channel].gpio);
-        
+    if (channel >= 0 && channel < Board::RELAY_CHANNELS) {
         relayChannels[channel].state = state;
-        // 继电器高电平触发
-        digitalWrite(relayChannels[channel].gpio, state ? HIGH : LOW);
-        
-        // 验证GPIO状态
-        int pinState = digitalRead(relayChannels[channel].gpio);
-        Serial.printf("GPIO%d state verification: %d (expected: %d)\n", 
-            relayChannels[channel].gpio, 
-            pinState,
-            state ? HIGH : LOW);
+        // 只修改目标状态，控制任务本轮结束时一起写出
+        relayOutputSet(channel, state);
+        relayStatusDirty = true;
+
+        LOGD(LOG_MOD_RELAY, "setRelayState: channel=%d, state=%d", channel, state);
     }
 }
 